@@ -0,0 +1 @@
+#define OO_CP_INTF_VER 32bae8fa42e1f6d1d089973555f72c05
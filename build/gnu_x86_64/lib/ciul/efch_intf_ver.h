@@ -0,0 +1 @@
+#define EFCH_INTF_VER  "b690058f286d49852974e981e3de2e1d"
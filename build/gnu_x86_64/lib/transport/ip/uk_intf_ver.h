@@ -0,0 +1 @@
+#define OO_UK_INTF_VER  "7e7915748126536ea202139cc16053fd"
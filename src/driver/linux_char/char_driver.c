@@ -35,6 +35,7 @@
 #include <ci/driver/chrdev.h>
 #include "char_internal.h"
 #include <linux/init.h>
+#include <linux/vmalloc.h>
 
 
 int phys_mode_gid = 0;
@@ -139,6 +140,46 @@ ioctl_filter_add (ci_private_char_t *priv, ulong arg)
 }
 
 
+ci_noinline int
+ioctl_filter_batch (ci_private_char_t *priv, ulong arg)
+{
+  ci_filter_batch_t local;
+  ci_filter_batch_entry_t* entries;
+  void __user* uentries;
+  size_t bytes;
+  int rc;
+
+  memset(&local, 0, sizeof(local));
+  copy_from_user_ret(&local, (caddr_t) arg, sizeof(local), -EFAULT);
+  if( local.in_len < sizeof(local) ||
+      (local.op != CI_FILTER_BATCH_ADD && local.op != CI_FILTER_BATCH_DEL) )
+    return -EINVAL;
+  if( local.n == 0 )
+    return 0;
+  if( local.n > CI_FILTER_BATCH_MAX )
+    return -E2BIG;
+
+  bytes = local.n * sizeof(*entries);
+  uentries = (void __user*) (uintptr_t) local.entries;
+  entries = vmalloc(bytes);
+  if( entries == NULL )
+    return -ENOMEM;
+  if( copy_from_user(entries, uentries, bytes) ) {
+    vfree(entries);
+    return -EFAULT;
+  }
+  rc = efch_filter_batch(&priv->rt, local.op, entries, local.n);
+  if( copy_to_user(uentries, entries, bytes) ) {
+    /* The caller won't know the ids of the filters it has added. */
+    if( local.op == CI_FILTER_BATCH_ADD && rc == 0 )
+      efch_filter_batch_undo(&priv->rt, entries, local.n);
+    rc = -EFAULT;
+  }
+  vfree(entries);
+  return rc;
+}
+
+
 ci_noinline int
 ioctl_capabilities_op (ci_private_char_t *priv, ulong arg)
 {
@@ -194,6 +235,9 @@ ci_char_fop_ioctl(struct file *filp, uint cmd, ulong arg)
   case CI_FILTER_ADD:
     return ioctl_filter_add (priv, arg);
 
+  case CI_FILTER_BATCH:
+    return ioctl_filter_batch (priv, arg);
+
   case CI_CAPABILITIES_OP:
     return ioctl_capabilities_op (priv, arg);
 
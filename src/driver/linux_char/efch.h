@@ -39,6 +39,7 @@ struct ci_resource_alloc_s;
 struct ci_resource_op_s;
 struct ci_resource_prime_qs_op_s;
 union ci_filter_add_u;
+struct ci_filter_batch_entry_s;
 struct ci_resource_table_s;
 struct efch_resource_s;
 typedef struct ci_resource_table_s ci_resource_table_t;
@@ -175,6 +176,13 @@ extern int efch_filter_add(ci_resource_table_t* rt,
                            union ci_filter_add_u* filter_add,
                            int* copy_out);
 
+extern int efch_filter_batch(ci_resource_table_t* rt, int op,
+                             struct ci_filter_batch_entry_s* entries,
+                             unsigned n);
+extern void efch_filter_batch_undo(ci_resource_table_t* rt,
+                                   struct ci_filter_batch_entry_s* entries,
+                                   unsigned n);
+
 extern int efch_vi_prime(struct ci_private_char_s* priv,
                          efch_resource_id_t, unsigned current_ptr);
 
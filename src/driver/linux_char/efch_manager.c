@@ -338,3 +338,75 @@ int efch_filter_add(ci_resource_table_t* rt, ci_filter_add_t* filter_add,
              EFCH_RESOURCE_ID_PRI_ARG(filter_add->in.res_id), rc);
   return rc;
 }
+
+
+static int efch_filter_batch_del_one(ci_resource_table_t* rt,
+                                     efch_resource_id_t res_id,
+                                     int64_t filter_id)
+{
+  ci_resource_op_t op;
+  int copy_out = 0;
+
+  memset(&op, 0, sizeof(op));
+  op.op = CI_RSOP_FILTER_DEL;
+  op.id = res_id;
+  op.u.filter_del.filter_id = filter_id;
+  return efch_resource_op(rt, &op, &copy_out);
+}
+
+
+/* Apply a batch of [n] filter operations, which have been copied in from
+ * user space.  This saves a system call and a copy per filter; the filters
+ * themselves are still inserted one at a time.
+ */
+int efch_filter_batch(ci_resource_table_t* rt, int op,
+                      ci_filter_batch_entry_t* entries, unsigned n)
+{
+  int rc = 0, rc1;
+  unsigned i, j;
+
+  for( i = 0; i < n; ++i ) {
+    ci_filter_batch_entry_t* e = &entries[i];
+    int copy_out = 0;
+
+    if( op == CI_FILTER_BATCH_ADD ) {
+      /* [add.out] overlays [add.in], so keep the id for any rollback. */
+      e->res_id = e->add.in.res_id;
+      rc1 = efch_filter_add(rt, &e->add, &copy_out);
+      if( rc1 == 0 )
+        e->filter_id = e->add.out.filter_id;
+    }
+    else {
+      rc1 = efch_filter_batch_del_one(rt, e->res_id, e->filter_id);
+    }
+    e->rc = rc1;
+    if( rc1 < 0 && rc == 0 )
+      rc = rc1;
+    if( rc1 < 0 && op == CI_FILTER_BATCH_ADD )
+      break;
+  }
+
+  if( rc < 0 && op == CI_FILTER_BATCH_ADD ) {
+    for( j = 0; j < n; ++j ) {
+      if( j < i )
+        efch_filter_batch_del_one(rt, entries[j].res_id,
+                                  entries[j].filter_id);
+      if( j != i )
+        entries[j].rc = -ECANCELED;
+    }
+  }
+  return rc;
+}
+
+
+/* Remove the filters inserted by an ADD batch that succeeded, when the
+ * caller can't be told their ids.
+ */
+void efch_filter_batch_undo(ci_resource_table_t* rt,
+                            ci_filter_batch_entry_t* entries, unsigned n)
+{
+  unsigned i;
+
+  for( i = 0; i < n; ++i )
+    efch_filter_batch_del_one(rt, entries[i].res_id, entries[i].filter_id);
+}
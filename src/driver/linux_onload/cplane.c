@@ -61,6 +61,16 @@ MODULE_PARM_DESC(cplane_spawn_server,
                  "in a network namespace in which there are no other stacks.");
 
 
+static bool cplane_server_multi_ns = 0;
+module_param(cplane_server_multi_ns, bool, S_IRUGO);
+MODULE_PARM_DESC(cplane_server_multi_ns,
+                 "If true, the control plane server for the main (default) "
+                 "network namespace also serves all other network "
+                 "namespaces, each from a thread of its own, rather than "
+                 "a separate server process being spawned for each "
+                 "namespace.");
+
+
 char* cplane_server_path = NULL;
 static int cplane_server_path_set(const char* val,
                                   const struct kernel_param*);
@@ -423,15 +433,31 @@ static void cp_table_purge(void)
 }
 
 
+static int cp_send_sig_info(int sig, struct siginfo* info, struct pid* pid);
+
+/* Send a signal to the server.  It is directed at the thread that mapped the
+ * MIBs rather than at its process, because a multi-namespace server serves
+ * each namespace from a different thread.  The caller must hold
+ * cp_handle_lock and have checked that there is a server. */
+static int cp_signal_server(struct oo_cplane_handle* cp, int sig)
+{
+  struct siginfo info = {};
+
+  info.si_signo = sig;
+  info.si_code = SI_KERNEL;
+  return cp_send_sig_info(sig, &info, cp->server_pid);
+}
+
+
 static void cp_kill(struct oo_cplane_handle* cp)
 {
 
   cp_table_remove(cp);
 
   /* Holding cp_handle_lock ensures that cp->server_pid is not going to be
-   * released under our feet.  Calling kill_pid() is safe in atomic context. */
+   * released under our feet.  Sending a signal is safe in atomic context. */
   if( cp->server_pid != NULL )
-    kill_pid(cp->server_pid, SIGQUIT, 1);
+    cp_signal_server(cp, SIGQUIT);
 
 }
 
@@ -1589,7 +1615,7 @@ int oo_cp_oof_sync(struct oo_cplane_handle* cp)
 
   spin_lock_bh(&cp->cp_handle_lock);
   if( cp->server_pid != NULL )
-    rc = kill_pid(cp->server_pid, mib->dim->oof_req_sig, 1);
+    rc = cp_signal_server(cp, mib->dim->oof_req_sig);
   else
     rc = -ESRCH;
   spin_unlock_bh(&cp->cp_handle_lock);
@@ -2020,6 +2046,42 @@ static char* cp_get_server_path(void)
 }
 
 
+/* Ask the multi-namespace server in init_net to serve the namespace of the
+ * process [pid], rather than spawning a new server process for it.  The
+ * server finds the namespace through [pid] and checks it against [ino]. */
+static int cp_request_ns_server(pid_t pid, unsigned ino)
+{
+  struct oo_cplane_handle* main_cp;
+  struct cp_message_buffer* msg;
+  int rc = 0;
+
+  main_cp = __cp_acquire_from_netns_if_exists(&init_net, CI_FALSE);
+  if( main_cp == NULL )
+    return -ENOENT;
+
+  spin_lock_bh(&main_cp->cp_handle_lock);
+  if( main_cp->server_pid == NULL || ! main_cp->server_initialized )
+    rc = -ESRCH;
+  spin_unlock_bh(&main_cp->cp_handle_lock);
+  if( rc < 0 )
+    goto out;
+
+  msg = kmalloc(sizeof(*msg), GFP_KERNEL);
+  if( msg == NULL ) {
+    rc = -ENOMEM;
+    goto out;
+  }
+  msg->data.hmsg_type = CP_HMSG_SERVE_NETNS;
+  msg->data.u.serve_netns.pid = pid;
+  msg->data.u.serve_netns.ino = ino;
+  cp_message_enqueue(main_cp, msg);
+
+ out:
+  cp_release(main_cp);
+  return rc;
+}
+
+
 /* Control whether to switch into namespace of current process. */
 #define CP_SPAWN_SERVER_SWITCH_NS 0x00000001u
 /* Used at start-of-day to spawn a server that will run without a client. */
@@ -2077,6 +2139,19 @@ static int cp_spawn_server(ci_uint32 flags)
     flags = CP_SPAWN_SERVER_BOOTSTRAP;
   }
 
+  if( cplane_server_multi_ns && flags & CP_SPAWN_SERVER_SWITCH_NS &&
+      current->nsproxy->net_ns != &init_net ) {
+    /* If there's no server in init_net to ask, fall back to spawning one for
+     * this namespace alone. */
+    rc = cp_request_ns_server(task_tgid_nr(current),
+                              get_netns_id(current->nsproxy->net_ns));
+    if( rc == 0 )
+      return 0;
+    OO_DEBUG_CPLANE(ci_log("%s: multi-namespace server unavailable: rc=%d",
+                           __FUNCTION__, rc));
+    rc = 0;
+  }
+
   if( flags & CP_SPAWN_SERVER_SWITCH_NS &&
       current->nsproxy->net_ns != &init_net ) {
     ns_file_path = kmalloc(PATH_MAX, GFP_KERNEL);
@@ -2134,6 +2209,9 @@ static int cp_spawn_server(ci_uint32 flags)
     argv[direct_param_base + direct_param++] = "--"CPLANE_SERVER_NS_CMDLINE_OPT;
     argv[direct_param_base + direct_param++] = ns_file_path;
   }
+  else if( cplane_server_multi_ns ) {
+    argv[direct_param_base + direct_param++] = "--"CPLANE_SERVER_MULTI_NS;
+  }
   if( flags & CP_SPAWN_SERVER_BOOTSTRAP )
     argv[direct_param_base + direct_param++] = "--"CPLANE_SERVER_BOOTSTRAP;
   if( cplane_server_uid ) {
@@ -2804,7 +2882,7 @@ int oo_cp_llap_change_notify_all(struct oo_cplane_handle* main_cp)
           continue;
       spin_lock_bh(&cp->cp_handle_lock);
       if( cp->server_pid != NULL ) {
-        int rc1 = kill_pid(cp->server_pid, cp->mib[0].dim->llap_update_sig, 1);
+        int rc1 = cp_signal_server(cp, cp->mib[0].dim->llap_update_sig);
         if( rc == 0 )
           rc = rc1;
       }
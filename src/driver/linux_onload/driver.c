@@ -468,6 +468,19 @@ int oo_fop_stack_flush_unlock(struct file *f, fl_owner_t id)
   return 0;
 }
 
+#if CI_CFG_UL_INTERRUPT_HELPER
+/* A stack fd polls readable when there is work for the user-level helper,
+ * which lets the shared helper wait for many stacks at once. */
+static unsigned oo_fop_poll(struct file* file, poll_table* wait)
+{
+  ci_private_t* priv = file->private_data;
+
+  if( priv->fd_flags == OO_FDFLAG_STACK )
+    return oo_ulh_fop_poll(efab_priv_to_thr(priv), file, wait);
+  return cp_fop_poll(file, wait);
+}
+#endif
+
 struct file_operations oo_fops = {
   .owner   = THIS_MODULE,
   .open    = oo_fop_open,
@@ -476,9 +489,14 @@ struct file_operations oo_fops = {
   .compat_ioctl = oo_fop_compat_ioctl,
   .mmap    = oo_fop_mmap,
 
-  /* read and poll are used by the cplane server only */
+  /* read is used by the cplane server only; poll by the cplane server and
+   * the user-level helper */
   .read = cp_fop_read,
+#if CI_CFG_UL_INTERRUPT_HELPER
+  .poll = oo_fop_poll,
+#else
   .poll = cp_fop_poll,
+#endif
 
   /* flush is really needed for a stack fd only */
   .flush = oo_fop_stack_flush_unlock,
@@ -77,6 +77,7 @@ struct proc_dir_entry *oo_proc_root = NULL;
  *--------------------------------------------------------------------*/
 
 static const struct proc_ops efab_version_fops;
+static const struct proc_ops efab_stack_destroy_fops;
 #if CI_CFG_HANDLE_ICMP
 static const struct proc_ops efab_dlfilters_fops;
 #endif
@@ -94,6 +95,7 @@ typedef struct ci_proc_efab_entry_s {
 } ci_proc_efab_entry_t;
 static ci_proc_efab_entry_t ci_proc_efab_table[] = {
     {"version",       &efab_version_fops},
+    {"stack_destroy", &efab_stack_destroy_fops},
 #if CI_CFG_HANDLE_ICMP
     {"dlfilters",     &efab_dlfilters_fops},
 #endif
@@ -335,6 +337,44 @@ static const struct proc_ops efab_version_fops = {
 };
 
 
+/****************************************************************************
+ *
+ * /proc/driver/onload/stack_destroy
+ *
+ ****************************************************************************/
+
+static int
+efab_stack_destroy_read_proc(struct seq_file *seq, void *s)
+{
+  struct oo_stack_destroy_stats st;
+  ci_irqlock_state_t lock_flags;
+
+  ci_irqlock_lock(&THR_TABLE.lock, &lock_flags);
+  st = efab_tcp_driver.stack_destroy;
+  ci_irqlock_unlock(&THR_TABLE.lock, &lock_flags);
+
+  seq_printf(seq, "stacks_destroyed: %u\n", st.n_destroyed);
+  seq_printf(seq, "ports_released_us: last=%u max=%u\n",
+             st.ports_us_last, st.ports_us_max);
+  seq_printf(seq, "hw_released_us: last=%u max=%u\n",
+             st.hw_us_last, st.hw_us_max);
+  seq_printf(seq, "total_us: last=%u max=%u\n",
+             st.total_us_last, st.total_us_max);
+  return 0;
+}
+static int efab_stack_destroy_open_proc(struct inode *inode, struct file *file)
+{
+    return single_open(file, efab_stack_destroy_read_proc, 0);
+}
+static const struct proc_ops efab_stack_destroy_fops = {
+     PROC_OPS_SET_OWNER
+    .proc_open    = efab_stack_destroy_open_proc,
+    .proc_read    = seq_read,
+    .proc_lseek   = seq_lseek,
+    .proc_release = single_release,
+};
+
+
 #if CI_CFG_HANDLE_ICMP
 /****************************************************************************
  *
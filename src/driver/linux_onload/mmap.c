@@ -158,10 +158,10 @@ tcp_helper_rm_nopage(tcp_helper_resource_t* trs, struct vm_area_struct *vma,
        * come down this path, but ptrace() can get us here. */
       return VM_FAULT_SIGBUS;
     default:
-      ci_assert_ge(map_id, CI_NETIF_MMAP_ID_PKTS);
+      ci_assert(CI_NETIF_MMAP_ID_IS_PKTSET(map_id));
       *page_out = tcp_helper_rm_nopage_pkts(trs, vma,
                                        offset +
-                                       (map_id - CI_NETIF_MMAP_ID_PKTS) *
+                                       CI_NETIF_MMAP_ID_TO_PKTSET(map_id) *
                                        CI_CFG_PKT_BUF_SIZE * PKTS_PER_SET);
       return *page_out == NULL ? VM_FAULT_SIGBUS : 0;
   }
@@ -449,9 +449,10 @@ static int tcp_helper_rm_mmap_pkts(tcp_helper_resource_t* trs,
 {
   ci_netif* ni;
   ci_netif_state* ns;
-  uint64_t bufid = map_id - CI_NETIF_MMAP_ID_PKTS;
+  uint64_t bufid = CI_NETIF_MMAP_ID_TO_PKTSET(map_id);
 
-  if( bytes != CI_CFG_PKT_BUF_SIZE * PKTS_PER_SET )
+  if( bytes != CI_CFG_PKT_BUF_SIZE * PKTS_PER_SET ||
+      ! CI_NETIF_MMAP_ID_IS_PKTSET(map_id) )
     return -EINVAL;
 
   ni = &trs->netif;
@@ -459,7 +460,7 @@ static int tcp_helper_rm_mmap_pkts(tcp_helper_resource_t* trs,
   ci_assert(ns);
 
   /* Reserve space for packet buffers */
-  if( bufid > ni->packets->sets_max || ni->pkt_bufs[bufid] == NULL ) {
+  if( bufid >= ni->packets->sets_max || ni->pkt_bufs[bufid] == NULL ) {
     OO_DEBUG_ERR(ci_log("%s: %u BAD bufset_id=0x%"PRIx64"", __FUNCTION__,
                         trs->id, bufid));
     return -EINVAL;
@@ -521,7 +522,7 @@ efab_tcp_helper_rm_mmap(tcp_helper_resource_t* trs, unsigned long bytes,
       rc = tcp_helper_rm_mmap_efct_shm(trs, bytes, vma);
       break;
     default:
-      /* CI_NETIF_MMAP_ID_PKTS + set_id */
+      /* CI_NETIF_MMAP_ID_PKTSET(set_id) */
       rc = tcp_helper_rm_mmap_pkts(trs, bytes, vma, map_id);
   }
 
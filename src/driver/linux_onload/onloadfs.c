@@ -317,12 +317,26 @@ onload_alloc_file(tcp_helper_resource_t *thr, oo_sp ep_id,
   priv->_filp = file;
   file->f_pos = 0;
   file->private_data = priv;
+  if( thr->mapping_inode != NULL )
+    file->f_mapping = thr->mapping_inode->i_mapping;
 
   try_module_get(THIS_MODULE);
   *priv_p = priv;
   return 0;
 }
 
+/* Allocate an inode to own the address space through which a stack is
+ * mapped; see tcp_helper_resource_t::mapping_inode.  Release with iput().
+ */
+struct inode* onload_alloc_mapping_inode(void)
+{
+  struct inode *inode = new_inode(onload_mnt->mnt_sb);
+
+  if( inode != NULL )
+    inode->i_ino = get_next_ino();
+  return inode;
+}
+
 void onload_priv_free(ci_private_t *priv)
 {
   if( priv->_filp->f_path.mnt != onload_mnt ) {
@@ -168,6 +168,8 @@ EFRM_CLASS_CREATE_NO_MODULE symtype class_create include/linux/device/class.h st
 
 EFRM_HAVE_ITER_IOV symbol iter_iov include/linux/uio.h
 
+EFRM_HAVE_MMU_INTERVAL_NOTIFIER symbol mmu_interval_notifier_insert include/linux/mmu_notifier.h
+
 # TODO move onload-related stuff from net kernel_compat
 " | grep -E -v -e '^#' -e '^$' | sed 's/[ \t][ \t]*/:/g'
 }
@@ -402,6 +402,31 @@ typedef union ci_filter_add_u {
 } ci_filter_add_t;
 
 
+/* Batched filter insertion and removal (CI_FILTER_BATCH).  [entries] points
+ * at [n] ci_filter_batch_entry_t, each of which gets its own [rc].  An ADD
+ * batch is all-or-nothing: if any entry fails, the ones before it are
+ * removed again and report -ECANCELED, as do the ones after it.  A DEL
+ * batch carries on past failures.
+ */
+#define CI_FILTER_BATCH_MAX  1024
+
+typedef struct ci_filter_batch_entry_s {
+  efch_resource_id_t  res_id;      /* in (DEL) */
+  int32_t             rc;          /* out */
+  int64_t             filter_id;   /* in (DEL), out (ADD) */
+  ci_filter_add_t     add;         /* in/out (ADD) */
+} ci_filter_batch_entry_t;
+
+typedef struct ci_filter_batch_s {
+  uint16_t            in_len;
+  uint16_t            op;
+#define CI_FILTER_BATCH_ADD  0
+#define CI_FILTER_BATCH_DEL  1
+  uint32_t            n;
+  uint64_t            entries CI_ALIGN(8);  /* user pointer */
+} ci_filter_batch_t;
+
+
 /**********************************************************************
  *
  * License challenge
@@ -528,6 +553,7 @@ typedef struct ci_capabilities_op_s {
 #define CI_V3_LICENSE_CHALLENGE (CI_IOC_CHAR_BASE+ 6) /* V3 license challenge */
 #define CI_IOC_CHAR_MAX     (CI_IOC_CHAR_BASE+ 7)
 #define CI_RESOURCE_PRIME_QS (CI_IOC_CHAR_BASE+ 8)  /* prime VI queues (efct) */
+#define CI_FILTER_BATCH     (CI_IOC_CHAR_BASE+ 9)  /* batched filter ops */
 
 
 /**********************************************************************
@@ -473,6 +473,8 @@ extern unsigned ci_netif_build_future_intf_mask(ci_netif* ni) CI_HF;
 
 extern void ci_netif_error_detected(ci_netif*, unsigned error_flag,
                                     const char* caller) CI_HF;
+extern ci_uint32 ci_netif_lock_watchdog(ci_netif*,
+                                        ci_uint64* reported_frc) CI_HF;
 
 #if OO_DO_STACK_POLL
 #ifndef __KERNEL__
@@ -507,6 +509,7 @@ cicp_pkt_complete_fake(ci_netif* ni, ci_ip_pkt_fmt* pkt)
 
 
 extern void __ci_netif_send(ci_netif*, ci_ip_pkt_fmt* pkt) CI_HF;
+extern void ci_netif_txshape_poll(ci_netif*) CI_HF;
 ci_inline void ci_netif_send(ci_netif* ni, ci_ip_pkt_fmt* pkt)
 {
   ci_assert_nflags(pkt->flags, CI_PKT_FLAG_TX_PENDING);
@@ -874,6 +877,14 @@ extern void ci_udp_ep_assert_valid(citp_socket* ep,
 extern void ci_udp_handle_rx(ci_netif*, ci_ip_pkt_fmt* pkt, ci_udp_hdr*,
                              int ip_paylen) CI_HF;
 
+/*** ip_reasm.c ***/
+extern void ci_ip_reasm_rx(ci_netif*, ci_ip_pkt_fmt* pkt,
+                           int ip_tot_len) CI_HF;
+#if CI_CFG_IPV6
+extern int ci_ip6_reasm_rx(ci_netif*, ci_ip_pkt_fmt* pkt) CI_HF;
+#endif
+extern void ci_ip_reasm_timeout(ci_netif*) CI_HF;
+
 
 ci_inline 
 void ci_pkt_init_from_ipcache_len(ci_ip_pkt_fmt *pkt,
@@ -957,6 +968,10 @@ extern int ci_udp_getsockopt(citp_socket* ep, ci_fd_t fd, int level,
 		     int optname, void *optval, socklen_t *optlen ) CI_HF;
 extern int ci_udp_setsockopt(citp_socket* ep, ci_fd_t fd, int level,
 		     int optname, const void*optval, socklen_t optlen) CI_HF;
+struct ip_mreqn;
+extern int ci_udp_mcast_join_bulk(citp_socket* ep, ci_fd_t fd,
+                                  const struct ip_mreqn* groups, int n_groups,
+                                  int* n_joined) CI_HF;
 extern int ci_udp_ioctl(citp_socket*, ci_fd_t, int request, void* arg) CI_HF;
 #endif
 
@@ -1474,6 +1489,11 @@ ci_tcp_rx_reap_rxq_bufs_socklocked(ci_netif* netif, ci_tcp_state* ts)
 
 extern void ci_tcp_state_dump(ci_netif*, ci_tcp_state*, const char *pf,
                               oo_dump_log_fn_t logger, void* log_arg) CI_HF;
+#ifndef __KERNEL__
+struct ci_tcp_info;
+extern void ci_tcp_info_fill(ci_netif*, ci_sock_cmn*,
+                             struct ci_tcp_info*) CI_HF;
+#endif
 extern void ci_tcp_state_dump_id(ci_netif* ni, int ep_id) CI_HF;
 extern void ci_tcp_state_dump_qs(ci_netif*, int ep_id, int hex_dump) CI_HF;
 extern void ci_tcp_state_dump_rob(ci_netif* ni, ci_tcp_state* ts) CI_HF;
@@ -2015,6 +2035,29 @@ extern int  ci_netif_lock_or_defer_work(ci_netif*, citp_waitable*) CI_HF;
 extern int ci_tcp_connect(citp_socket*, const struct sockaddr*, socklen_t,
                           ci_fd_t fd, int *p_moved) CI_HF;
 extern int ci_tcp_shutdown(citp_socket*, int how, ci_fd_t fd) CI_HF;
+
+/* tcp_checkpoint.c: support for onload_checkpoint() and onload_restore() */
+struct oo_checkpoint_sock;
+extern int ci_tcp_checkpoint(ci_netif*, ci_tcp_state*,
+                             struct oo_checkpoint_sock*) CI_HF;
+extern void ci_tcp_checkpoint_copy(ci_netif*, ci_tcp_state*,
+                                   const struct oo_checkpoint_sock*,
+                                   char* buf) CI_HF;
+extern void ci_tcp_checkpoint_thaw(ci_netif*, ci_tcp_state*) CI_HF;
+extern int ci_tcp_checkpoint_release(ci_netif*,
+                                     const struct oo_checkpoint_sock*) CI_HF;
+extern int ci_tcp_checkpoint_reclaim(ci_netif*,
+                                     const struct oo_checkpoint_sock*,
+                                     int released) CI_HF;
+extern int ci_tcp_restore_prepare(ci_netif*, ci_tcp_state*,
+                                  const struct oo_checkpoint_sock*,
+                                  const char* rcv_data,
+                                  ci_ip_pkt_queue* rxq) CI_HF;
+extern int ci_tcp_restore(ci_netif*, ci_tcp_state*,
+                          const struct oo_checkpoint_sock*,
+                          ci_ip_pkt_queue* rxq) CI_HF;
+extern void ci_tcp_rx_enqueue_restored(ci_netif*, ci_tcp_state*,
+                                       ci_ip_pkt_fmt*, int bytes) CI_HF;
 #endif
 
 extern oo_sp ci_tcp_connect_find_local_peer(ci_netif *ni, int locked,
@@ -2624,6 +2667,16 @@ ci_inline ci_uint32 ci_ip_time_ticks2ms(ci_netif* ni, ci_iptime_t t) {
 }
 
 
+/*! Convert a time measure in ticks to us.  Unlike ci_ip_time_ticks2ms()
+**  this copes with totals that are longer than a ci_iptime_t can hold.
+*/
+ci_inline ci_uint64 ci_ip_time_ticks2us(ci_netif* ni, ci_uint64 t)
+{
+  ci_ip_timer_state *its = IPTIMER_STATE(ni);
+  return (t * ((1000ull << 48) / its->ci_ip_time_ms2tick_fxp)) >> 16;
+}
+
+
 /* Convert Herz (per-second value) to per tick. */
 ci_inline ci_uint32 ci_ip_time_freq_hz2tick(ci_netif* ni, ci_uint32 hz)
 {
@@ -4432,12 +4485,23 @@ ci_inline int ci_tcp_sendq_n_pkts(ci_tcp_state* ts) {
   return n >= 0 ? n : 0;
 }
 
+/* Effective TCP_NOTSENT_LOWAT for this socket in bytes; 0 if unlimited. */
+ci_inline unsigned ci_tcp_notsent_lowat(ci_netif* ni, ci_tcp_state* ts)
+{
+  return ts->c.notsent_lowat ? ts->c.notsent_lowat :
+                               NI_OPTS(ni).tcp_notsent_lowat;
+}
+
 /* This test is used to decide whether we should indicate to the app that
 ** it can enqueue more data on a socket.  ie. It is used to decide when to
 ** wake a blocking thread, and to decide whether to indicate the socket is
 ** writable in select() and poll().
 */
 ci_inline int ci_tcp_tx_advertise_space(ci_netif* ni, ci_tcp_state* ts) {
+  unsigned lowat = ci_tcp_notsent_lowat(ni, ts);
+  if( lowat != 0 &&
+      (unsigned) SEQ_SUB(tcp_enq_nxt(ts), tcp_snd_nxt(ts)) >= lowat )
+    return 0;
   if( NI_OPTS(ni).tcp_sndbuf_mode ) {
     int pkts_queued = ci_tcp_sendq_n_pkts(ts)
 #if CI_CFG_TIMESTAMPING
@@ -5426,6 +5490,81 @@ ci_inline ci_uint64 __oo_usec_to_cycles64(ci_uint32 khz, unsigned usec)
     __oo_usec_to_cycles64(IPTIMER_STATE(ni)->khz, usec)
 
 
+/*********************************************************************
+*********************** Per-socket cycle accounting ******************
+*********************************************************************/
+
+/* A region of stack processing that is charged to a socket.  Regions nest
+ * (for example ci_tcp_tx_advance() is called while handling an ACK), and
+ * each is charged only for the cycles not charged to regions within it.
+ * Must be used with the stack lock held.
+ */
+struct oo_sock_cycles_region {
+  ci_uint64 start;
+  ci_uint64 charged;
+};
+
+#if CI_CFG_SOCK_CYCLES
+
+/* Returns the start time of a call to be charged to a socket with
+ * ci_sock_cycles_add(), or zero if EF_SOCK_CYCLES is not set.
+ */
+ci_inline ci_uint64 ci_sock_cycles_start(ci_netif* ni)
+{
+  ci_uint64 frc = 0;
+  if(CI_UNLIKELY( NI_OPTS(ni).sock_cycles ))
+    ci_frc64(&frc);
+  return frc;
+}
+
+ci_inline void ci_sock_cycles_add(ci_uint64 start, ci_uint64* counter)
+{
+  ci_uint64 frc;
+  if(CI_LIKELY( start == 0 ))
+    return;
+  ci_frc64(&frc);
+  *counter += frc - start;
+}
+
+ci_inline void ci_sock_cycles_enter(ci_netif* ni,
+                                    struct oo_sock_cycles_region* r)
+{
+  r->start = ci_sock_cycles_start(ni);
+  r->charged = ni->cycles_charged;
+}
+
+ci_inline void ci_sock_cycles_leave(ci_netif* ni,
+                                    struct oo_sock_cycles_region* r,
+                                    ci_uint64* counter)
+{
+  ci_uint64 frc, own;
+  if(CI_LIKELY( r->start == 0 ))
+    return;
+  ci_frc64(&frc);
+  own = frc - r->start - (ni->cycles_charged - r->charged);
+  *counter += own;
+  ni->cycles_charged += own;
+}
+
+/* Charge the packet being handled to [s]. */
+ci_inline void ci_sock_cycles_rx_mark(ci_netif* ni, ci_sock_cmn* s)
+{
+  if(CI_UNLIKELY( NI_OPTS(ni).sock_cycles ))
+    ni->cycles_sock = SC_SP(s);
+}
+
+#else
+
+/* The counters are not built, so nothing is charged. */
+#define ci_sock_cycles_start(ni)              ((ci_uint64) 0)
+#define ci_sock_cycles_add(start, counter)    ((void) (start))
+#define ci_sock_cycles_enter(ni, r)           ((void) (r))
+#define ci_sock_cycles_leave(ni, r, counter)  ((void) (r))
+#define ci_sock_cycles_rx_mark(ni, s)         ((void) 0)
+
+#endif
+
+
 /**********************************************************************
  * Zero-copy API helpers
  */
@@ -5457,6 +5596,11 @@ struct ci_zc_usermem {
   uint64_t base;
   uint64_t size;
   uint64_t kernel_id;
+  /* EF_ZC_REG_CACHE state, protected by the stack lock.  [cache_refs] is
+   * zero if the registration is not cached. */
+  struct ci_zc_usermem* cache_next;
+  ci_uint32 cache_refs;
+  ci_uint32 cache_inval_seq;  /* zc_reg_inval_seq before registering */
   /* HW addresses are structured as
    * hw_addr[page_n + intf_i * size << PAGE_SHIFT] */
   uint64_t hw_addrs[0];
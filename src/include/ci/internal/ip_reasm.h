@@ -0,0 +1,257 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+#ifndef __CI_INTERNAL_IP_REASM_H__
+#define __CI_INTERNAL_IP_REASM_H__
+
+#include <ci/internal/ip.h>
+
+/* IP fragment reassembly (EF_IP_REASM_MAX).
+ *
+ * Each datagram being reassembled has an entry in a small table in the
+ * stack, keyed by addresses, protocol and IP ID as RFC791 requires.  The
+ * table has EF_IP_REASM_MAX entries, and takes no space when that is 0.  An
+ * entry holds on to the packet buffers of the fragments received so far,
+ * in order of offset.  It is complete when the last fragment has been seen
+ * and the payload bytes held add up to its end, as fragments are not
+ * allowed to overlap.
+ *
+ * Defences, as in Linux:
+ * - an exact duplicate of a fragment is dropped on its own;
+ * - any other overlap discards the whole datagram (RFC5722);
+ * - the number of fragments per datagram is limited;
+ * - an incomplete datagram is discarded when it times out;
+ * - when the table is full the oldest datagram makes way for a new one.
+ *
+ * The table holds packet ids only, and does not touch the packets, so that
+ * the caller decides what to do with them.
+ */
+
+/* Results of ci_ip_reasm_add(). */
+#define CI_IP_REASM_QUEUED    0  /* held until the rest arrive */
+#define CI_IP_REASM_COMPLETE  1  /* the entry holds the whole datagram */
+#define CI_IP_REASM_DUP       2  /* duplicate: drop the new fragment */
+#define CI_IP_REASM_BAD       3  /* drop the new fragment and the datagram */
+
+/* Largest payload of a reassembled IPv4 datagram. */
+#define CI_IP4_REASM_MAX_LEN  (0xffff - sizeof(ci_ip4_hdr))
+
+
+ci_inline void ci_ip_reasm_key_ip4(ci_ip_reasm_key* key, const ci_ip4_hdr* ip)
+{
+  memset(key, 0, sizeof(*key));
+  key->saddr = CI_ADDR_SH_FROM_IP4(ip->ip_saddr_be32);
+  key->daddr = CI_ADDR_SH_FROM_IP4(ip->ip_daddr_be32);
+  key->id = ip->ip_id_be16;
+  key->protocol = ip->ip_protocol;
+}
+
+
+/* Offset in bytes of the payload of IPv4 fragment [ip]. */
+ci_inline unsigned ci_ip4_frag_offset(const ci_ip4_hdr* ip)
+{
+  return CI_BSWAP_BE16(ip->ip_frag_off_be16 & CI_IP4_OFFSET_MASK) << 3;
+}
+
+
+ci_inline int ci_ip4_frag_more(const ci_ip4_hdr* ip)
+{
+  return (ip->ip_frag_off_be16 & CI_IP4_FRAG_MORE) != 0;
+}
+
+
+/* Largest payload of a reassembled IPv6 datagram, less the fragment header
+ * that is removed. */
+#define CI_IP6_REASM_MAX_LEN  (0xffff - sizeof(ci_ip6_frag_hdr))
+
+
+/* [ip6] is followed directly by fragment header [fh]. */
+ci_inline void ci_ip_reasm_key_ip6(ci_ip_reasm_key* key, const ci_ip6_hdr* ip6,
+                                   const ci_ip6_frag_hdr* fh)
+{
+  memset(key, 0, sizeof(*key));
+  key->saddr = CI_ADDR_SH_FROM_IP6(ip6->saddr);
+  key->daddr = CI_ADDR_SH_FROM_IP6(ip6->daddr);
+  key->id = fh->frag_id;
+  key->protocol = fh->next_hdr;
+}
+
+
+ci_inline unsigned ci_ip6_frag_offset(const ci_ip6_frag_hdr* fh)
+{
+  return CI_BSWAP_BE16(fh->frag_off) & CI_IP6_OFFSET;
+}
+
+
+ci_inline int ci_ip6_frag_more(const ci_ip6_frag_hdr* fh)
+{
+  return (CI_BSWAP_BE16(fh->frag_off) & CI_IP6_MF) != 0;
+}
+
+
+/* Is [pkt] one that we may hold on to for reassembly? */
+ci_inline int ci_ip_reasm_pkt_ok(ci_netif* ni, const ci_ip_pkt_fmt* pkt)
+{
+  return OO_PP_IS_NULL(pkt->frag_next) &&
+         ! (pkt->rx_flags & CI_PKT_RX_FLAG_RX_SHARED) &&
+         ! (ni->state->mem_pressure & OO_MEM_PRESSURE_CRITICAL);
+}
+
+
+/* Is IPv4 fragment [ip] one that we reassemble? */
+ci_inline int ci_ip4_reasm_ok(const ci_ip4_hdr* ip, int ip_tot_len)
+{
+  return ip->ip_protocol == IPPROTO_UDP &&
+         CI_IP4_IHL(ip) == sizeof(ci_ip4_hdr) &&
+         ip_tot_len > sizeof(ci_ip4_hdr);
+}
+
+
+/* Is the IPv6 fragment with header [fh] and IPv6 payload length [paylen]
+ * one that we reassemble? */
+ci_inline int ci_ip6_reasm_ok(const ci_ip6_frag_hdr* fh, int paylen)
+{
+  return fh->next_hdr == IPPROTO_UDP && paylen > sizeof(*fh);
+}
+
+
+ci_inline int ci_ip_reasm_key_eq(const ci_ip_reasm_key* a,
+                                 const ci_ip_reasm_key* b)
+{
+  return a->id == b->id && a->protocol == b->protocol &&
+         a->saddr.u64[0] == b->saddr.u64[0] &&
+         a->saddr.u64[1] == b->saddr.u64[1] &&
+         a->daddr.u64[0] == b->daddr.u64[0] &&
+         a->daddr.u64[1] == b->daddr.u64[1];
+}
+
+
+/* Look up the entry for [key] in the table [tbl] of [max] entries. */
+ci_inline ci_ip_reasm_entry*
+ci_ip_reasm_find(const ci_ip_reasm_state* s, ci_ip_reasm_entry* tbl,
+                 unsigned max, const ci_ip_reasm_key* key)
+{
+  unsigned i;
+  if( s->n_pending == 0 )
+    return NULL;
+  for( i = 0; i < max; ++i )
+    if( tbl[i].in_use && ci_ip_reasm_key_eq(&tbl[i].key, key) )
+      return &tbl[i];
+  return NULL;
+}
+
+
+/* Choose the entry for a new datagram: a free one if there is one, or else
+ * the one that will expire soonest, which the caller must free first.
+ */
+ci_inline ci_ip_reasm_entry*
+ci_ip_reasm_victim(ci_ip_reasm_entry* tbl, unsigned max)
+{
+  ci_ip_reasm_entry* victim = NULL;
+  unsigned i;
+
+  ci_assert_gt(max, 0);
+  for( i = 0; i < max; ++i ) {
+    ci_ip_reasm_entry* e = &tbl[i];
+    if( ! e->in_use )
+      return e;
+    if( victim == NULL || ci_ip_time_before(e->expiry, victim->expiry) )
+      victim = e;
+  }
+  return victim;
+}
+
+
+ci_inline void ci_ip_reasm_start(ci_ip_reasm_state* s, ci_ip_reasm_entry* e,
+                                 const ci_ip_reasm_key* key,
+                                 ci_iptime_t expiry)
+{
+  ci_assert(! e->in_use);
+  e->key = *key;
+  e->expiry = expiry;
+  e->total = 0;
+  e->received = 0;
+  e->n_frags = 0;
+  e->in_use = 1;
+  ++s->n_pending;
+}
+
+
+ci_inline void ci_ip_reasm_free(ci_ip_reasm_state* s, ci_ip_reasm_entry* e)
+{
+  ci_assert(e->in_use);
+  ci_assert_gt(s->n_pending, 0);
+  e->in_use = 0;
+  e->n_frags = 0;
+  --s->n_pending;
+}
+
+
+/* Add a fragment with [len] bytes of payload at [off] to [e].  [more] is
+ * the more-fragments flag, and [max_len] is the largest payload the
+ * datagram may have.  [pkt] is recorded only if the result is
+ * CI_IP_REASM_QUEUED or CI_IP_REASM_COMPLETE.
+ */
+ci_inline int ci_ip_reasm_add(ci_ip_reasm_entry* e, unsigned off,
+                              unsigned len, int more, oo_pkt_p pkt,
+                              unsigned max_len)
+{
+  unsigned end = off + len;
+  int i, n = e->n_frags;
+
+  if( len == 0 || end > max_len || (more && (len & 7)) )
+    return CI_IP_REASM_BAD;
+  if( e->total != 0 && (end > e->total || (! more && end != e->total)) )
+    return CI_IP_REASM_BAD;
+  if( ! more && n != 0 &&
+      e->frags[n - 1].off + e->frags[n - 1].len > end )
+    return CI_IP_REASM_BAD;
+
+  for( i = n; i > 0 && e->frags[i - 1].off >= off; --i )
+    ;
+  if( i < n && e->frags[i].off == off && e->frags[i].len == len )
+    return CI_IP_REASM_DUP;
+  if( (i > 0 && e->frags[i - 1].off + e->frags[i - 1].len > off) ||
+      (i < n && end > e->frags[i].off) )
+    return CI_IP_REASM_BAD;
+  if( n == CI_IP_REASM_MAX_FRAGS )
+    return CI_IP_REASM_BAD;
+
+  memmove(&e->frags[i + 1], &e->frags[i], (n - i) * sizeof(e->frags[0]));
+  e->frags[i].off = off;
+  e->frags[i].len = len;
+  e->frags[i].pkt = pkt;
+  ++e->n_frags;
+  e->received += len;
+  if( ! more )
+    e->total = end;
+  return e->total != 0 && e->received == e->total ?
+         CI_IP_REASM_COMPLETE : CI_IP_REASM_QUEUED;
+}
+
+
+ci_inline int ci_ip_reasm_expired(const ci_ip_reasm_entry* e,
+                                  ci_iptime_t now)
+{
+  return ! ci_ip_time_before(now, e->expiry);
+}
+
+
+/* Find the earliest expiry time of the entries in use.  Returns false if
+ * there are none.
+ */
+ci_inline int ci_ip_reasm_next_expiry(const ci_ip_reasm_entry* tbl,
+                                      unsigned max, ci_iptime_t* expiry)
+{
+  int found = 0;
+  unsigned i;
+
+  for( i = 0; i < max; ++i )
+    if( tbl[i].in_use &&
+        (! found || ci_ip_time_before(tbl[i].expiry, *expiry)) ) {
+      *expiry = tbl[i].expiry;
+      found = 1;
+    }
+  return found;
+}
+
+#endif  /* __CI_INTERNAL_IP_REASM_H__ */
@@ -405,6 +405,12 @@ struct ci_ip_pkt_fmt_s {
                                    * processing (EF100 feature). The user_mark
                                    * is put in pf.tcp_rx.lo.rx_sock */
 #define CI_PKT_RX_FLAG_RX_SHARED       0x08 /* Packet comes from shared RXQ */
+#define CI_PKT_RX_FLAG_IP6_EXT_MOVED   0x20 /* IPv6 ext hdrs moved ahead of
+                                   * the Ethernet header, see [ip6_ext_len] */
+  /* TX packets never use the flags above, so we borrow a bit for the TX
+   * path.  It is set and cleared by the netif lock holder while the packet
+   * is TX_PENDING, i.e. before the packet could reach any recvq. */
+#define CI_PKT_TX_FLAG_TXQ_ACCOUNTED   0x10 /* counted in ts->txq_bytes */
   ci_uint8              rx_flags;
 
   /*! Number of these buffers that are chained together using
@@ -456,6 +462,15 @@ struct ci_ip_pkt_fmt_s {
    * different levels of the stack. */
   ci_uint8              q_id;
 
+  /*! With CI_PKT_RX_FLAG_IP6_EXT_MOVED, the type of the first IPv6
+   * extension header and the length of them all.  The extension headers have
+   * been moved from after the IPv6 header to just before [pkt_start_off], so
+   * that the upper-layer header follows the IPv6 header, and are put back
+   * if the packet is passed to the kernel.
+   */
+  ci_uint8              ip6_ext_next_hdr;
+  ci_uint16             ip6_ext_len;
+
   /*! Ensure we have space before [dma_start] so we can expand the Ethernet
    * header to add a VLAN tag.  This member should never be referenced
    * because it may not immediately preceed [dma_start].
@@ -844,6 +859,8 @@ typedef struct {
 # define CI_IP_TIMER_NETIF_STATS        0xa  /* netif statistics timer   */
 # define CI_IP_TIMER_TCP_CORK           0xb  /* TCP_CORK timer           */
 # define CI_IP_TIMER_NETIF_TCP_RECYCLE  0xc  /* EF100 plugin recycling   */
+# define CI_IP_TIMER_NETIF_TXSHAPE      0xd  /* egress shaper backlog    */
+# define CI_IP_TIMER_NETIF_IP_REASM     0xe  /* IP fragment reassembly   */
 } ci_ip_timer;
 
 
@@ -885,6 +902,9 @@ typedef struct {
   ci_int32 n_free;  /**< Total number of free packets */
   CI_ULCONST ci_uint32 sets_n;   /**< number of pkt sets allocated */
   CI_ULCONST ci_uint32 sets_max; /**< max number of packet sets */
+  /* Number of sets allocated at stack creation.  These are never returned
+   * to the system by the idle reclaimer (EF_PKT_SHRINK_IDLE). */
+  CI_ULCONST ci_uint32 sets_hot;
   /* Packet buffers allocated.  This is [sets_n * PKTS_PER_SET]. */
   CI_ULCONST ci_int32  n_pkts_allocated;
 
@@ -1013,6 +1033,16 @@ typedef struct {
    CI_EPLOCK_NETIF_NEED_SOCK_BUFS | \
    CI_EPLOCK_NETIF_CLOSE_ENDPOINT | \
    CI_EPLOCK_NETIF_NEED_POLL)
+
+  /* Who took the lock, for EF_LOCK_WATCHDOG_USEC.  Written by the thread
+   * that takes the lock when [holder_track] is set.  [holder_tid] is
+   * written after the others, and cleared again on unlock.  These share the
+   * lock's cache line, which the holder has just written anyway.
+   */
+  ci_uint32           holder_track;
+  ci_uint32           holder_tid;     /* 0 if not known */
+  ci_uint64           holder_frc;     /* when the lock was taken */
+  ci_uint64           holder_site;    /* code address that took it */
 } ci_eplock_t;
 
 
@@ -1037,6 +1067,101 @@ struct oo_ringbuffer_state {
 
 #include <ci/internal/oo_vi_flags.h>
 
+/* Adaptive interrupt moderation state for one interface
+ * (EF_INT_MODERATION_ADAPTIVE).  Updated by the kernel at each interrupt;
+ * see ci/internal/irq_moderation.h.
+ */
+#define CI_IRQMOD_LEVELS      6
+#define CI_IRQMOD_BATCH_HIST  8
+
+typedef struct {
+  ci_uint64 window_start CI_ALIGN(8); /* frc at start of sampling window */
+  ci_uint32 window_irqs;  /* interrupts in the current window */
+  ci_uint32 window_evs;   /* events handled in the current window */
+  ci_uint32 level;        /* index into the moderation profile */
+  ci_uint32 usec;         /* current moderation, or 0 for none */
+  ci_uint32 n_changes;    /* number of changes of level */
+  /* Interrupts by number of events handled: 0, 1, 2-3, ..., 32-63, 64+ */
+  ci_uint32 batch_hist[CI_IRQMOD_BATCH_HIST];
+  /* Interrupts taken at each moderation level */
+  ci_uint32 level_hist[CI_IRQMOD_LEVELS];
+} ci_irqmod_state;
+
+/* Egress shaping state for one class (EF_TX_SHAPE).  Token counts are in
+ * units of 1/khz bytes so that refills are exact; see
+ * ci/internal/tx_shaper.h.
+ */
+#define CI_TXSHAPE_CLASSES  8
+
+typedef struct {
+  ci_uint64 rate CI_ALIGN(8); /* guaranteed rate in bytes per msec */
+  ci_uint64 ceil;         /* rate including borrowing, bytes per msec */
+  ci_int64  tokens;       /* may send this much at [rate] */
+  ci_int64  ctokens;      /* may send this much at [ceil] */
+  ci_uint64 tx_bytes;     /* bytes released by the shaper */
+  ci_uint32 tx_pkts;      /* packets released by the shaper */
+  ci_uint32 n_borrowed;   /* packets sent with the root's tokens */
+  ci_uint32 n_delayed;    /* packets that had to wait in [backlog] */
+  ci_uint32 max_backlog;  /* longest [backlog] seen */
+  oo_pktq   backlog;      /* linked through netif.tx.dmaq_next */
+} ci_txshape_class;
+
+typedef struct {
+  ci_uint64 last_frc CI_ALIGN(8); /* time of last refill */
+  ci_uint64 root_rate;    /* bytes per msec, or 0 for no limit */
+  ci_int64  root_tokens;
+  ci_uint32 shaped;       /* bitmask of configured classes */
+  ci_uint32 backlog;      /* total packets waiting in the shaper */
+  ci_txshape_class cls[CI_TXSHAPE_CLASSES];
+} ci_txshape_state;
+
+/* IP fragment reassembly (EF_IP_REASM_MAX); see ci/internal/ip_reasm.h. */
+#define CI_IP_REASM_MAX        16   /* datagrams reassembled at once */
+#define CI_IP_REASM_MAX_FRAGS  64   /* fragments in one datagram */
+
+typedef struct {
+  ci_uint16 off;          /* offset of the payload in the datagram */
+  ci_uint16 len;          /* payload bytes */
+  oo_pkt_p  pkt;
+} ci_ip_reasm_frag;
+
+typedef struct {
+  ci_addr_sh_t saddr CI_ALIGN(8);
+  ci_addr_sh_t daddr;
+  ci_uint32    id;        /* IP ID or IPv6 fragment ID, as on the wire */
+  ci_uint8     protocol;
+  ci_uint8     reserved[3];
+} ci_ip_reasm_key;
+
+typedef struct {
+  ci_ip_reasm_key key CI_ALIGN(8);
+  ci_iptime_t expiry;     /* discard if not complete by this time */
+  ci_uint16   total;      /* payload length, or 0 until the last fragment */
+  ci_uint16   received;   /* payload bytes held */
+  ci_uint8    in_use;
+  ci_uint8    n_frags;
+  ci_ip_reasm_frag frags[CI_IP_REASM_MAX_FRAGS]; /* sorted by [off] */
+} ci_ip_reasm_entry;
+
+/* The EF_IP_REASM_MAX entries themselves are at
+ * [ci_netif_state::ip_reasm_ofs].
+ */
+typedef struct {
+  ci_uint32 n_pending;    /* entries in use */
+} ci_ip_reasm_state;
+
+#if CI_CFG_TIMESTAMPING
+/* Ring of TX timestamp records (EF_TX_TIMESTAMP_RING); see
+ * ci/internal/tx_ts_ring.h.  The records themselves are at
+ * [ci_netif_state::tx_ts_ring_ofs].
+ */
+typedef struct {
+  ci_uint32 write;        /* records written, under the stack lock */
+  ci_uint32 dropped;      /* records dropped because the ring was full */
+  ci_uint32 read CI_ALIGN(CI_CACHE_LINE_SIZE); /* records read, lockless */
+} oo_tx_ts_ring_state;
+#endif
+
 typedef struct {
   ci_uint32             timer_quantum_ns CI_ALIGN(8);
   ci_uint32             rx_prefix_len;
@@ -1094,6 +1219,7 @@ typedef struct {
 
 # define CI_NETIF_NIC_ERROR_REMAP               0x00000001u
   ci_uint32             nic_error_flags;
+  ci_irqmod_state       irqmod;
 #if CI_CFG_CTPIO
   ci_uint32             ctpio_ct_threshold;
   /* This enforces EF_CTPIO_MAX_FRAME_LEN, and also is set to zero disable
@@ -1282,6 +1408,10 @@ struct ci_netif_state_s {
 #endif
   CI_ULCONST ci_uint32  seq_table_ofs;   /**< offset of seq no table */
   CI_ULCONST ci_uint32  deferred_pkts_ofs; /**< offset of deferred pkts array */
+#if CI_CFG_TIMESTAMPING
+  CI_ULCONST ci_uint32  tx_ts_ring_ofs;  /**< offset of TX timestamp records */
+#endif
+  CI_ULCONST ci_uint32  ip_reasm_ofs;    /**< offset of reassembly entries */
   CI_ULCONST ci_uint32  buf_ofs;         /**< offset of packet metadata */
   CI_ULCONST ci_uint32  dma_ofs;         /**< offset of dma_addrs */
 
@@ -1293,6 +1423,16 @@ struct ci_netif_state_s {
 #define OO_TIMEOUT_Q_MAX      2
   struct oo_p_dllink    timeout_q[OO_TIMEOUT_Q_MAX]; /**< time-out queues */
 
+  ci_txshape_state      txshape CI_ALIGN(8); /**< egress shaping */
+  ci_ip_timer           txshape_tid CI_ALIGN(8); /**< releases backlog */
+
+  ci_ip_reasm_state     ip_reasm CI_ALIGN(8); /**< fragment reassembly */
+  ci_ip_timer           ip_reasm_tid CI_ALIGN(8); /**< expires [ip_reasm] */
+
+#if CI_CFG_TIMESTAMPING
+  oo_tx_ts_ring_state   tx_ts_ring CI_ALIGN(CI_CACHE_LINE_SIZE);
+#endif
+
 #if CI_CFG_TCP_OFFLOAD_RECYCLER
   ci_ip_timer           recycle_tid;
   struct oo_p_dllink    recycle_retry_q;  /**< linked
@@ -1376,6 +1516,7 @@ struct ci_netif_state_s {
   ci_uint64             sock_spin_cycles    CI_ALIGN(8);
   ci_uint64             buzz_cycles         CI_ALIGN(8);
   ci_uint64             timer_prime_cycles  CI_ALIGN(8);
+  ci_uint64             lock_watchdog_cycles CI_ALIGN(8);
 
   CI_ULCONST ci_uint32  timesync_bytes;
   CI_ULCONST ci_uint32  io_mmap_bytes;
@@ -1448,6 +1589,10 @@ struct ci_netif_state_s {
   CI_ULCONST ci_uint32  sock_alloc_numa_nodes;
   CI_ULCONST ci_uint32  interrupt_numa_nodes;
 
+  /* Incremented by the kernel when memory registered by
+   * onload_zc_register_buffers() is unmapped (see EF_ZC_REG_CACHE). */
+  CI_ULCONST ci_uint32  zc_reg_inval_seq;
+
 #if CI_CFG_FD_CACHING
   ci_socket_cache_t     active_cache;
   ci_uint32             active_cache_avail_stack;
@@ -1888,6 +2033,20 @@ struct oo_sock_cplane {
   ((cp_flags) & OO_SCP_TPROXY       ? "TPROXY ":"")
 
 
+/* CPU cycles spent on a socket, accumulated when EF_SOCK_CYCLES is set.
+ * The stack-side counters are updated with the stack lock held, and the
+ * recv/send counters by the calling thread without it, so the latter may
+ * lose the odd update when a socket is shared between threads.
+ */
+struct oo_sock_cycles {
+  ci_uint64             rx;     /* handling received packets */
+  ci_uint64             tx;     /* ci_tcp_tx_advance() */
+  ci_uint64             timer;  /* socket timers */
+  ci_uint64             recv;   /* recv() and friends */
+  ci_uint64             send;   /* send() and friends */
+};
+
+
 struct ci_sock_cmn_s {
   citp_waitable         b;
 
@@ -2097,7 +2256,6 @@ struct ci_sock_cmn_s {
   ci_uint32             uuid;              /**< who made this socket    */
   ci_int32		pid;
 
-
   struct oo_p_dllink    reap_link;
 
   /* Size of 'ci_sock_cmn_s' structure may be improved by making 'domain'
@@ -2105,6 +2263,11 @@ struct ci_sock_cmn_s {
    * of 4 bytes.
    */
   ci_uint8              domain;           /*!<  PF_INET or PF_INET6 */
+
+  /* Last, so that it doesn't leave a hole for its alignment. */
+#if CI_CFG_SOCK_CYCLES
+  struct oo_sock_cycles cycles;
+#endif
 };
 
 ci_inline bool is_sock_flag_pmtu_do_set(const ci_sock_cmn* s, int af)
@@ -2522,16 +2685,37 @@ typedef struct {
   ci_uint8             tcp_defer_accept;    /* TCP_DEFER_ACCEPT sockopt  */
 #define OO_TCP_DEFER_ACCEPT_OFF 0xff
 
+  /* TCP_NOTSENT_LOWAT sockopt; 0 means use EF_TCP_NOTSENT_LOWAT. */
+  ci_uint32            notsent_lowat;
+
 } ci_tcp_socket_cmn;
 
 
+/* Chronograph states for the TCP_INFO busy and limited times.  Higher
+ * values take precedence; see ci_tcp_chrono_start(). */
+#define CI_TCP_CHRONO_NONE            0
+#define CI_TCP_CHRONO_BUSY            1  /* data outstanding or queued */
+#define CI_TCP_CHRONO_RWND_LIMITED    2  /* stopped by peer's window   */
+#define CI_TCP_CHRONO_SNDBUF_LIMITED  3  /* app stopped by SO_SNDBUF   */
+#define CI_TCP_CHRONO_N               3
+
 struct oo_tcp_socket_stats {
   ci_uint64  rx_pkts CI_ALIGN(8); /* total number of pkts received */
+#if CI_CFG_TCP_INFO_METRICS
+  ci_uint64  rx_bytes;        /* in-order payload bytes received   */
+  ci_uint64  tx_bytes;        /* payload bytes sent, inc. retrans  */
+  ci_uint64  tx_bytes_retrans;/* payload bytes retransmitted       */
+  ci_uint64  chrono[CI_TCP_CHRONO_N]; /* ticks in each chrono state  */
+  ci_uint32  tx_pkts;         /* segments sent, inc. pure ACKs     */
+  ci_uint32  tx_data_pkts;    /* segments sent with payload        */
+  ci_uint32  rx_data_pkts;    /* segments received with payload    */
+#endif
   ci_uint32  tx_stop_rwnd;    /* TX stopped by receive window      */
   ci_uint32  tx_stop_cwnd;    /* TX stopped by congestion window   */
   ci_uint32  tx_stop_more;    /* TX stopped by CORK, MSG_MORE etc. */
   ci_uint32  tx_stop_nagle;   /* TX stopped by nagle's algorithm   */
   ci_uint32  tx_stop_app;     /* TX stopped because TXQ empty      */
+  ci_uint32  tx_stop_txq;     /* TX stopped by EF_TCP_TXQ_LIMIT    */
 #if CI_CFG_BURST_CONTROL
   ci_uint32  tx_stop_burst;   /* TX stopped by burst control       */
 #endif
@@ -2542,6 +2726,9 @@ struct oo_tcp_socket_stats {
   ci_uint32  tx_tmpl_send_fast;  /* Number of fast tmpl sends      */
   ci_uint32  tx_tmpl_send_slow;  /* Number of slow tmpl sends      */
   ci_uint32  rx_isn;          /* initial sequence num              */
+#if CI_CFG_TCP_INFO_METRICS
+  ci_uint32  rate_bpms;       /* TCP_INFO delivery rate, bytes/ms  */
+#endif
   ci_uint16  tx_tmpl_active;  /* Number of active tmpl sends       */
   ci_uint16  rtos;            /* RTO timeouts                      */
   ci_uint16  fast_recovers;   /* times entered fast-recovery       */
@@ -2615,6 +2802,15 @@ struct ci_tcp_state_s {
    * because packet allocation failed.  Must send FIN, really. */
 #define CI_TCPT_FLAG_FIN_PENDING        0x800000
 
+  /* ci_tcp_tx_advance() stopped because this socket already has
+   * EF_TCP_TXQ_LIMIT bytes in the NIC TXQ.  TX completions re-start it. */
+#define CI_TCPT_FLAG_TXQ_LIMITED        0x1000000
+
+  /* onload_checkpoint() has frozen this connection: it ignores incoming
+   * segments, runs no timers and is dropped without a RST when closed.
+   * Its filters stay in place until onload_restore() takes it over. */
+#define CI_TCPT_FLAG_CHECKPOINTED       0x2000000
+
   /* flags advertised on SYN */
 # define CI_TCPT_SYN_FLAGS \
         (CI_TCPT_FLAG_WSCL | CI_TCPT_FLAG_TSO | CI_TCPT_FLAG_SACK)
@@ -2634,6 +2830,10 @@ struct ci_tcp_state_s {
   ci_uint32           send_out;   /**< Packets removed from send queue */
   ci_ip_pkt_queue     send;       /**< Send queue. */
 
+  /* Bytes of new data posted to the NIC TXQ (including the overflow dmaq)
+   * and not yet completed.  Only maintained when EF_TCP_TXQ_LIMIT is set. */
+  ci_uint32           txq_bytes;
+
   ci_ip_pkt_queue     retrans;    /**< Retransmit queue. */
 
   ci_ip_pkt_queue     recv1;      /**< Receive queue. */
@@ -2749,6 +2949,11 @@ struct ci_tcp_state_s {
 
   ci_uint8             incoming_tcp_hdr_len; /* expected TCP header length */
 
+#if CI_CFG_TCP_INFO_METRICS
+  ci_uint8             chrono_type; /* TCP_INFO chronograph state     */
+  ci_uint16            min_rtt;     /* smallest RTT sample, 0 if none */
+#endif
+
 #if CI_CFG_TCP_OFFLOAD_RECYCLER
   ci_uint16            plugin_stream_id;
 #endif
@@ -2800,6 +3005,17 @@ struct ci_tcp_state_s {
   ci_iptime_t          t_last_invalid_ack; /* timestamp of last ACK for
                                               an invalid incoming packet */
 
+#if CI_CFG_TCP_INFO_METRICS
+  /* TCP_INFO metrics; see ci/internal/tcp_info.h.  The chronograph has
+   * been in [chrono_type] since [chrono_start], and the time spent in
+   * each state is accumulated in [stats.chrono].  The delivery rate
+   * sample in progress started at [rate_start] with [rate_una] acked;
+   * the last one is in [stats.rate_bpms]. */
+  ci_iptime_t          chrono_start;
+  ci_iptime_t          rate_start;
+  ci_uint32            rate_una;
+#endif
+
   /* sa and sv are scaled by 8 and 4 respectively to minimize roundoff
   ** error when time has a large granularity See the appendix of
   ** Jacobson's SIGCOMM 88  */
@@ -2818,10 +3034,6 @@ struct ci_tcp_state_s {
   /* timestamp option fields see RFC1323 */
   ci_uint32            tsrecent;    /* TS.Recent RFC1323                  */
   ci_uint32            tslastack;   /* Last.ACK.sent RFC1323              */ 
-#ifndef NDEBUG
-  ci_uint32            tslastseq;   /* Sequence no of packet that updated tsrecent
-                                       Just being used for debugging - purge at will */
-#endif
   ci_iptime_t          tspaws;      /* last active timestamp for tsrecent */
 #define CI_TCP_TSO_WORD (CI_BSWAPC_BE32((CI_TCP_OPT_NOP       << 24u)  | \
                                         (CI_TCP_OPT_NOP       << 16u)  | \
@@ -2908,17 +3120,17 @@ struct ci_tcp_state_s {
     ci_uint16          dport_be16;
   } pre_nat;
 
+  /* NVMe plugin id
+   * The special id is set when a new id should be generated */
+#define ZC_NVME_CRC_ID_INVALID (ci_uint32)(-1)
+  ci_uint32             current_crc_id;
+
   struct oo_tcp_socket_stats    stats;
 
 #if CI_CFG_TCP_OFFLOAD_RECYCLER
   ci_uint64             plugin_ddr_base;
   ci_uint64             plugin_ddr_size;
 #endif
-
-  /* NVMe plugin id
-   * The special id is set when a new id should be generated */
-#define ZC_NVME_CRC_ID_INVALID (ci_uint32)(-1)
-  ci_uint32             current_crc_id;
 };
 
 
@@ -124,6 +124,10 @@ struct ci_netif_s {
 
 #ifndef __KERNEL__
   unsigned             future_intf_mask;
+  /* EF_SPIN_LOW_POWER: CI_MONITOR_* mode, and the bound on each wait in
+   * frc ticks.  Zero ticks means spin without waiting. */
+  int                  spin_wait_mode;
+  ci_uint32            spin_wait_ticks;
   /* Use ci_netif_get_driver_handle() rather than this directly. */
   ef_driver_handle     driver_handle;
   unsigned             mmap_bytes;
@@ -189,6 +193,18 @@ struct ci_netif_s {
   ci_tcp_prev_seq_t*   seq_table;
 
   struct oo_deferred_pkt* deferred_pkts;
+#if CI_CFG_TIMESTAMPING
+  struct onload_tx_timestamp* tx_ts_ring; /**< EF_TX_TIMESTAMP_RING records */
+#endif
+  ci_ip_reasm_entry*   ip_reasm;  /**< EF_IP_REASM_MAX entries */
+
+  /* EF_SOCK_CYCLES: socket to which the packet being handled is charged,
+   * and the running total of cycles charged, to exclude nested regions.
+   * Both are protected by the stack lock. */
+#if CI_CFG_SOCK_CYCLES
+  oo_sp                cycles_sock;
+  ci_uint64            cycles_charged;
+#endif
 
 #ifdef __ci_driver__
   unsigned             pkt_sets_n;
@@ -245,6 +261,11 @@ struct ci_netif_s {
   */
   oo_atomic_t          ref_count;
   unsigned             cached_count;
+
+  /* Registrations made by onload_zc_register_buffers() when EF_ZC_REG_CACHE
+   * is enabled, most recently used first.  Protected by the stack lock. */
+  struct ci_zc_usermem* zc_reg_cache;
+  unsigned             zc_reg_cache_idle;
 #endif /* __ci_driver__ */
 
   /* General flags */  
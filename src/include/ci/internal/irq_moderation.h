@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+#ifndef __CI_INTERNAL_IRQ_MODERATION_H__
+#define __CI_INTERNAL_IRQ_MODERATION_H__
+
+#include <ci/internal/ip.h>
+
+/* Adaptive interrupt moderation for interrupt-driven stacks.
+ *
+ * An interrupt-driven stack normally requests a wakeup as soon as it has
+ * handled an interrupt, so the next event raises another interrupt.  At
+ * high event rates that means an interrupt for every few events.  When the
+ * interrupt rate is high and batches are small we instead prime the event
+ * queue timer: the next event starts it, and its expiry interrupts us a
+ * short time later, by which time more events have arrived.
+ *
+ * The delay is taken from a profile of CI_IRQMOD_LEVELS levels.  We step
+ * up a level per sampling window while busy, down a level when the rate
+ * falls well below the threshold, and straight back to no moderation after
+ * a long idle period, so that sparse traffic sees the lowest latency.
+ */
+
+#define CI_IRQMOD_WINDOW_US     1000  /* sampling window */
+#define CI_IRQMOD_IDLE_WINDOWS  8     /* reset after this many idle windows */
+#define CI_IRQMOD_BATCH_TARGET  16    /* don't moderate harder beyond this */
+
+
+/* Moderation in usec at [level], given the configured maximum. */
+ci_inline unsigned ci_irqmod_level_usec(unsigned level, unsigned max_usec)
+{
+  unsigned usec;
+  if( level == 0 )
+    return 0;
+  usec = max_usec >> (CI_IRQMOD_LEVELS - 1 - level);
+  return usec ? usec : 1;
+}
+
+
+/* Index into batch_hist[] for an interrupt that handled [n_evs] events. */
+ci_inline unsigned ci_irqmod_batch_bucket(unsigned n_evs)
+{
+  unsigned b = 0;
+  while( n_evs != 0 && b < CI_IRQMOD_BATCH_HIST - 1 ) {
+    n_evs >>= 1;
+    ++b;
+  }
+  return b;
+}
+
+
+/* Account for an interrupt that handled [n_evs] events at time [now], and
+ * return the moderation (in usec) to apply before the next one.  [khz] is
+ * the frc frequency and [rate] the interrupt rate (per second) above which
+ * moderation is increased.
+ */
+ci_inline unsigned
+ci_irqmod_update(ci_irqmod_state* s, unsigned n_evs, ci_uint64 now,
+                 unsigned khz, unsigned rate, unsigned max_usec)
+{
+  ci_uint64 window = (ci_uint64) khz * CI_IRQMOD_WINDOW_US / 1000;
+  ci_uint64 elapsed = now - s->window_start;
+  unsigned level = s->level;
+
+  /* The state is shared with user-level, so don't trust [level]. */
+  if( level >= CI_IRQMOD_LEVELS )
+    level = CI_IRQMOD_LEVELS - 1;
+
+  ++s->batch_hist[ci_irqmod_batch_bucket(n_evs)];
+  ++s->level_hist[level];
+  ++s->window_irqs;
+  s->window_evs += n_evs;
+
+  if( elapsed >= window ) {
+    if( elapsed >= window * CI_IRQMOD_IDLE_WINDOWS ) {
+      level = 0;
+    }
+    else {
+      /* Compare irqs / (elapsed / (khz * 1000)) against [rate]. */
+      ci_uint64 irqs = (ci_uint64) s->window_irqs * khz * 1000;
+      ci_uint64 thresh = (ci_uint64) rate * elapsed;
+      if( irqs > thresh && level < CI_IRQMOD_LEVELS - 1 &&
+          s->window_evs < s->window_irqs * CI_IRQMOD_BATCH_TARGET )
+        ++level;
+      else if( irqs * 4 < thresh && level > 0 )
+        --level;
+    }
+    s->window_start = now;
+    s->window_irqs = 0;
+    s->window_evs = 0;
+  }
+
+  if( level != s->level ) {
+    s->level = level;
+    ++s->n_changes;
+  }
+  s->usec = ci_irqmod_level_usec(level, max_usec);
+  return s->usec;
+}
+
+#endif  /* __CI_INTERNAL_IRQ_MODERATION_H__ */
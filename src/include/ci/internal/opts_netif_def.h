@@ -187,10 +187,43 @@ CI_CFG_OPT("EF_XDP_MODE", xdp_mode, ci_uint32,
            1, , EF_XDP_MODE_DISABLED, 0, EF_XDP_MODE_COMPATIBLE, oneof:disabled;compatible)
 #endif
 
+#if CI_CFG_UL_INTERRUPT_HELPER
+CI_CFG_OPT("EF_HELPER_SHARED", helper_shared, ci_uint32,
+"Service this stack from a shared onload_helper process, started on demand, "
+"which looks after many stacks with a small pool of threads.  When disabled, "
+"or if the stack cannot be handed to the shared helper (for example because "
+"it runs as a different user), a helper process is started for this stack "
+"alone.",
+           1, , 0, 0, 1, yesno)
+#endif
+
 CI_CFG_OPT("EF_INT_REPRIME", int_reprime, ci_uint32,
 "Enable interrupts more aggressively than the default.",
            1, , 0, 0, 1, yesno)
 
+CI_CFG_OPT("EF_INT_MODERATION_ADAPTIVE", int_moderation_adaptive, ci_uint32,
+"Adapt the interrupt moderation of interrupt-driven stacks (EF_INT_DRIVEN) "
+"to the load.  When interrupts arrive at more than EF_INT_MODERATION_RATE "
+"per second and each handles only a few events, the stack delays its next "
+"interrupt by up to EF_INT_MODERATION_MAX_USEC so that more events are "
+"handled per interrupt.  The delay is stepped back down when the rate falls, "
+"and removed entirely when the stack goes idle."
+"\n"
+"Currently only supported on EF10 adapters; on other adapters interrupts "
+"are not moderated.",
+           1, , 0, 0, 1, yesno)
+
+CI_CFG_OPT("EF_INT_MODERATION_MAX_USEC", int_moderation_max_usec, ci_uint32,
+"Upper bound in microseconds on the interrupt moderation applied when "
+"EF_INT_MODERATION_ADAPTIVE is enabled.",
+           , , 128, 1, 1000, count)
+
+CI_CFG_OPT("EF_INT_MODERATION_RATE", int_moderation_rate, ci_uint32,
+"Interrupt rate, per second, above which EF_INT_MODERATION_ADAPTIVE "
+"increases interrupt moderation.  Moderation is decreased again once the "
+"rate drops below a quarter of this value.",
+           , , 20000, 1, MAX, count)
+
 #define MULTICAST_LIMITATIONS_NOTE                                      \
     "\nSee the OpenOnload manual for further details on multicast operation."
 
@@ -364,6 +397,18 @@ CI_CFG_OPT("EF_TX_TIMESTAMPING", tx_timestamping, ci_uint32,
 " does not succeed;\n",
            2, , 0, 0, 3, count)
 
+CI_CFG_OPT("EF_TX_TIMESTAMP_RING", tx_timestamp_ring, ci_uint32,
+"The number of records in a ring in the stack's shared memory that receives "
+"hardware timestamps of transmitted packets, for use with "
+"onload_tx_timestamp_read().  When set, packets sent with "
+"SOF_TIMESTAMPING_TX_HARDWARE are released as soon as the transmit "
+"completes, a record of the socket, its SOF_TIMESTAMPING_OPT_ID key, the "
+"payload length and the time is written to the ring, and nothing is "
+"delivered to the socket's error queue.  If the ring is full the record "
+"is dropped and counted.  The value is rounded up to a power of 2.  0 "
+"(the default) disables the ring.",
+           , , 0, 0, 1 << 20, count)
+
 CI_CFG_OPT("EF_TCP_TSOPT_MODE", tcp_tsopt_mode, ci_uint32,
 "Enable or disable per-stack TCP header timestamps (as defined in RFC 1323).  "
 "Overrides system setting ipv4.tcp_timestamps and EF_TCP_SYN_OPTS.  "
@@ -384,6 +429,18 @@ CI_CFG_OPT("EF_VALIDATE_ENV", validate_env, ci_uint32,
 "variables (starting with EF_).",
            1, , 1, 0, 1, level)
 
+#if CI_CFG_SOCK_CYCLES
+CI_CFG_OPT("EF_SOCK_CYCLES", sock_cycles, ci_uint32,
+"Account the CPU cycles spent processing each socket: handling received "
+"packets, transmitting, timers, and the recv and send calls.  Stack "
+"processing is charged exclusively, so cycles spent transmitting while "
+"handling an ACK are counted once.  The recv and send calls are charged "
+"for their whole duration, including any time spent spinning or blocked.  "
+"The totals are shown by \"onload_stackdump top_sockets\".  This adds a "
+"few timestamp reads to the data path, so is disabled by default.",
+           1, , 0, 0, 1, yesno)
+#endif
+
 #if CI_CFG_TAIL_DROP_PROBE
 CI_CFG_OPT("EF_TAIL_DROP_PROBE", tail_drop_probe, ci_uint32,
 "Whether to probe if the tail of a TCP burst isn't ACKed quickly.\n"
@@ -418,6 +475,26 @@ CI_CFG_OPT("EF_TCP_SNDBUF_MODE", tcp_sndbuf_mode, ci_uint32,
            "EF_TCP_RCVBUF_MODE to give automatic adjustment of RCVBUF.",
            2, , 1, 0, 2, oneof:no;yes;auto)
 
+CI_CFG_OPT("EF_TCP_NOTSENT_LOWAT", tcp_notsent_lowat, ci_uint32,
+           "Default value of the TCP_NOTSENT_LOWAT socket option for TCP "
+           "sockets in this stack.  When non-zero a socket is reported as "
+           "writable only when the amount of data in its send queue that "
+           "has not yet been transmitted is below this number of bytes.  "
+           "This keeps unsent data out of the send buffer where it may "
+           "become stale.  A value of 0 disables the limit.  Sockets may "
+           "override this value with setsockopt(TCP_NOTSENT_LOWAT).",
+           ,  , 0, 0, SMAX, bincount)
+
+CI_CFG_OPT("EF_TCP_TXQ_LIMIT", tcp_txq_limit, ci_uint32,
+           "Limits the number of bytes of new data that a single TCP socket "
+           "may have outstanding in the NIC transmit queue.  Once the limit "
+           "is reached further data is held in the socket send queue until "
+           "earlier packets complete, so that one bulk sender cannot fill "
+           "the TXQ and add latency to other sockets in the same stack.  "
+           "A value of 0 (the default) disables the limit.  A socket may "
+           "always post at least one packet.",
+           ,  , 0, 0, SMAX, bincount)
+
 CI_CFG_OPT("EF_TCP_COMBINE_SENDS_MODE", tcp_combine_sends_mode, ci_uint32,
            "This option controls how Onload fills packets in the TCP send "
            "buffer. In the default mode (set to 0) Onload will prefer to use "
@@ -799,6 +876,33 @@ CI_CFG_OPT("EF_UDP_SEND_UNLOCK_THRESH", udp_send_unlock_thresh, ci_uint16,
 "increase lock contention in multi-threaded applications.",
            , , 1500, MIN, MAX, count)
 
+CI_CFG_OPT("EF_IP6_EXT_HDRS", ip6_ext_hdrs, ci_uint32,
+"Controls acceleration of received IPv6 packets with extension headers "
+"before the TCP or UDP header.  By default these are passed to the kernel.  "
+"When set to 1 or 2, hop-by-hop options, destination options and routing "
+"headers with no segments left are skipped, and the packet is handled by "
+"Onload.  Packets with other extension headers, with options that must "
+"not be skipped, or with malformed headers are passed to the kernel when "
+"set to 1 and dropped when set to 2.  A fragment header may also follow "
+"the skipped headers if EF_IP_REASM_MAX is set.",
+           , , 0, 0, 2, oneof:off;pass;drop)
+
+CI_CFG_OPT("EF_IP_REASM_MAX", ip_reasm_max, ci_uint32,
+"The number of fragmented UDP datagrams that the stack reassembles at "
+"once.  IP fragments are usually delivered to the kernel stack, but "
+"when this is set and the adapter delivers fragments to Onload (for "
+"example with scalable filters) they are reassembled in the stack and "
+"the datagram is delivered to the accelerated socket directly.  When all "
+"are in use, the oldest incomplete datagram is discarded to make room.  "
+"Overlapping fragments cause the datagram to be discarded.  0 (the "
+"default) disables reassembly.",
+           , , 0, 0, 16, count)
+
+CI_CFG_OPT("EF_IP_REASM_TIMEOUT", ip_reasm_timeout, ci_uint32,
+"Time in milliseconds for which the stack holds on to the fragments of an "
+"incomplete datagram (see EF_IP_REASM_MAX) before discarding them.",
+           , , 30000, 1, MAX, time:msec)
+
 CI_CFG_OPT("EF_UDP_PORT_HANDOVER_MIN", udp_port_handover_min, ci_uint16,
 "When set (together with EF_UDP_PORT_HANDOVER_MAX), this causes UDP sockets "
 "explicitly bound to a port in the given range to be handed over to the "
@@ -976,6 +1080,21 @@ CI_CFG_OPT("EF_BUZZ_USEC", buzz_usec, ci_uint32,
 "by the EF_POLL_USEC option.",
            ,  poll_cycles, 0, MIN, MAX, time:usec)
 
+CI_CFG_OPT("EF_SPIN_LOW_POWER", spin_low_power_usec, ci_uint32,
+"When set, threads spinning in receive calls (see EF_SPIN_USEC) wait for "
+"the adapter in a low-power state instead of polling continuously.  The "
+"thread arms a monitor on the memory that the adapter will write next (the "
+"next receive buffer, or the next event queue entry) and waits with UMWAIT "
+"(Intel), MWAITX (AMD) or WFE (Arm) until it is written.  The value bounds "
+"each wait in microseconds, so that work done by other threads is still "
+"noticed promptly.  On Arm the bound is set by the kernel's timer event "
+"stream instead.  This option has no effect on CPUs without these "
+"instructions, or on interfaces where the next write location is not known "
+"(AF_XDP)."
+"\n"
+"Set to 0 (the default) to poll continuously.",
+           , , 0, 0, 1000, time:usec)
+
 CI_CFG_OPT("EF_HELPER_USEC", timer_usec, ci_uint32,
 "Timeout in microseconds for the count-down interrupt timer.  This timer "
 "generates an interrupt if network events are not handled by the application "
@@ -993,6 +1112,20 @@ CI_CFG_OPT("EF_HELPER_PRIME_USEC", timer_prime_usec, ci_uint32,
 "(EF_HELPER_USEC / 2).",
            ,  helper_timer, 250, MIN, MAX, time:usec)
 
+CI_CFG_OPT("EF_LOCK_WATCHDOG_USEC", lock_watchdog_usec, ci_uint32,
+"When set, threads that take the stack lock record their thread id, the "
+"time and the code address in the stack, and the periodic timer (or "
+"onload_helper) reports to the kernel log any hold of the stack lock that "
+"is longer than this many microseconds.  The report includes the lock "
+"holder's kernel stack and the state of the lock, and is made once per "
+"hold.  Holds are only checked when the lock is contended, at the "
+"granularity of the periodic timer (a few milliseconds), so short values "
+"are rounded up.  Recording the holder adds a small cost to each lock."
+"\n"
+"The holder is also shown by onload_stackdump lots.  Set to 0 (the "
+"default) to disable.",
+           , , 0, MIN, MAX, time:usec)
+
 CI_CFG_OPT("EF_MAX_PACKETS", max_packets, ci_uint32,
 "Upper limit on number of packet buffers in each OpenOnload stack.  Packet "
 "buffers require hardware resources which may become a limiting factor if "
@@ -1057,6 +1190,44 @@ CI_CFG_OPT("EF_PREALLOC_PACKETS", prealloc_packets, ci_int32,
 "EF_MIN_FREE_PACKETS option is not taken into account.",
            , , 0, 0, 1, yesno)
 
+CI_CFG_OPT("EF_PKT_SHRINK_IDLE", pkt_shrink_idle, ci_uint32,
+"When non-zero, packet buffer sets that were allocated after the stack was "
+"created are returned to the system once fewer than "
+"EF_PKT_SHRINK_THRESHOLD percent of the stack's packet buffers have been in "
+"use for this many milliseconds.  Before sets are returned, buffers held in "
+"the non-blocking pool and any that can be reaped from socket receive queues "
+"are freed.  Only entirely free sets are returned, so a set can only be "
+"returned once the sockets using it have released its buffers."
+"\n"
+"Sets allocated at stack creation (see EF_MIN_FREE_PACKETS), sets backed by "
+"huge pages and the set currently used for allocation are never returned.  "
+"The check is made by the kernel's periodic timer, which only polls a stack "
+"that is otherwise idle."
+"\n"
+"The default of 0 disables this.",
+           , , 0, 0, MAX, count)
+
+CI_CFG_OPT("EF_PKT_SHRINK_THRESHOLD", pkt_shrink_threshold, ci_uint32,
+"Percentage of the allocated packet buffers that must be in use to prevent "
+"packet sets being returned to the system.  See EF_PKT_SHRINK_IDLE.",
+           , , 25, 1, 100, count)
+
+CI_CFG_OPT("EF_ZC_REG_CACHE", zc_reg_cache, ci_uint32,
+"When non-zero, memory registered with onload_zc_register_buffers() stays "
+"registered after onload_zc_unregister_buffers(), and up to this many such "
+"idle registrations are kept per stack.  A later registration of a range "
+"covered by an existing registration reuses it rather than pinning and "
+"mapping the memory again, and a registration that overlaps or adjoins "
+"idle registrations replaces them with a single registration of the "
+"combined range."
+"\n"
+"Cached registrations are dropped when any registered memory is unmapped "
+"or remapped.  Note that idle registrations continue to count against "
+"RLIMIT_MEMLOCK."
+"\n"
+"The default of 0 disables the cache.",
+           , , 0, 0, 65536, count)
+
 /* Max is currently 2^21 EPs.
  * We allocate ep in pages, EP_BUF_PER_PAGE=4 ep per page, so min is 4.
  * 7 synrecv states consume one endpoint, but we also use aux buffers for
@@ -1612,6 +1783,22 @@ CI_CFG_STR_OPT("EF_INTERFACE_BLACKLIST", iface_blacklist, ci_string256,
                "interface is present on both lists it will not be accelerated." ,
                ,  , "", none, none, )
 
+CI_CFG_STR_OPT("EF_TX_SHAPE", tx_shape, ci_string256,
+"Enables hierarchical token-bucket shaping of the traffic sent by the "
+"stack.  Packets are classified by IP precedence, the top three bits of "
+"the IP TOS or IPv6 traffic class, which sockets choose with IP_TOS or "
+"IPV6_TCLASS.  The value is a comma-separated list of:\n"
+" * <class>=<rate>[:<ceil>] - shape class 0-7 to <rate> Mbit/s, allowing "
+"it to borrow up to <ceil> Mbit/s when the root has bandwidth to spare;\n"
+" * root=<ceil> - the bandwidth in Mbit/s shared by all classes.\n"
+"For example \"root=10000,1=1000:9000\" limits bulk traffic sent with "
+"IP_TOS 0x20 to 1Gbit/s, or up to 9Gbit/s when the rest of the traffic "
+"leaves room.  Traffic in unconfigured classes is never delayed.  Delayed "
+"packets are released in strict priority order, highest class first.  "
+"Templated sends are not shaped.  Shaping state is shown by "
+"\"onload_stackdump lots\".",
+               ,  , "", none, none, )
+
 CI_CFG_OPT("EF_KERNEL_PACKETS_BATCH_SIZE", kernel_packets_batch_size, ci_uint32,
 "In some cases (for example, when using scalable filters), packets that "
 "should be delivered to the kernel stack are "
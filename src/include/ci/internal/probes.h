@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+#ifndef __CI_INTERNAL_PROBES_H__
+#define __CI_INTERNAL_PROBES_H__
+
+#include <ci/internal/transport_config_opt.h>
+
+/* USDT (user-level statically defined tracing) probes.
+ *
+ * With CI_CFG_USDT, and <sys/sdt.h> available at build time, the
+ * user-level library contains probes in provider "onload" that perf,
+ * bpftrace, systemtap etc. can attach to, e.g.
+ *
+ *   bpftrace -e 'usdt:/usr/lib64/libonload.so:onload:tcp_state
+ *                { printf("%d:%d %x -> %x\n", arg0, arg1, arg2, arg3); }'
+ *
+ * A probe that is not attached is a single nop.  Arguments are evaluated
+ * regardless, so keep them to values that are already to hand.  In the
+ * kernel and in builds without <sys/sdt.h> the probes compile to nothing.
+ *
+ * Probes and their arguments:
+ *
+ *   rx_pkt(stack_id, intf_i, pkt_id, frame_len)
+ *     A received packet is about to be demuxed (netif_event.c).
+ *   tcp_rx(stack_id, sock_id, seq, ack, payload_len)
+ *     A TCP segment is delivered to a connected socket.
+ *   tcp_state(stack_id, sock_id, old_state, new_state)
+ *     A TCP socket changes state (CI_TCP_* values).
+ *   send_entry(stack_id, sock_id, msghdr*, flags)
+ *   send_return(stack_id, sock_id, rc)
+ *   recv_entry(stack_id, sock_id, msghdr*, flags)
+ *   recv_return(stack_id, sock_id, rc)
+ *     TCP and UDP send and receive calls.  rc is the byte count or -1,
+ *     except that for recvmmsg() it is the count of messages received.
+ *     sendmmsg() fires send_entry and send_return for each message.
+ *   lock_wait(stack_id)
+ *   lock_acquired(stack_id, rc)
+ *     The stack lock is contended, and the slow path has finished
+ *     waiting for it.
+ *   timer(stack_id, timer_fn, sock_id)
+ *     A stack timer fires.  timer_fn is a CI_IP_TIMER_* value and sock_id
+ *     is -1 for timers that do not belong to a socket.
+ */
+
+#if CI_CFG_USDT && ! defined(__KERNEL__) && defined(__has_include)
+# if __has_include(<sys/sdt.h>)
+#  include <sys/sdt.h>
+#  define OO_HAVE_USDT 1
+# endif
+#endif
+
+#ifdef OO_HAVE_USDT
+# define OO_PROBE1(name, a)              DTRACE_PROBE1(onload, name, a)
+# define OO_PROBE2(name, a, b)           DTRACE_PROBE2(onload, name, a, b)
+# define OO_PROBE3(name, a, b, c)        DTRACE_PROBE3(onload, name, a, b, c)
+# define OO_PROBE4(name, a, b, c, d)     DTRACE_PROBE4(onload, name, a, b, c, d)
+# define OO_PROBE5(name, a, b, c, d, e)  \
+  DTRACE_PROBE5(onload, name, a, b, c, d, e)
+#else
+# define OO_PROBE1(name, a)              do{}while(0)
+# define OO_PROBE2(name, a, b)           do{}while(0)
+# define OO_PROBE3(name, a, b, c)        do{}while(0)
+# define OO_PROBE4(name, a, b, c, d)     do{}while(0)
+# define OO_PROBE5(name, a, b, c, d, e)  do{}while(0)
+#endif
+
+#endif  /* __CI_INTERNAL_PROBES_H__ */
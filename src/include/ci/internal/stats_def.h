@@ -68,6 +68,10 @@ OO_STAT("Number of network events handled by periodic timer.  Indicates your "
 OO_STAT("Number of times periodic timer could not get the stack lock.  "
         "Not severe.",
         ci_uint32, periodic_lock_contends, count)
+OO_STAT("Number of times a thread was found to have held the stack lock for "
+        "longer than EF_LOCK_WATCHDOG_USEC.  Each is logged with the "
+        "holder's details.",
+        ci_uint32, lock_watchdog_reports, count)
 OO_STAT("Number of interrupts.  Expected if interrupt driven; otherwise "
         "suggests timeout of one kind or another.",
         ci_uint32, interrupts, count)
@@ -94,6 +98,10 @@ OO_STAT("Number of times an interrupt could not lock the stack.  Usually "
 OO_STAT("Number of times an interrupt handler was limited by NAPI budget.  "
         "This potentially leads to drops if there's a microburst.",
         ci_uint32, interrupt_budget_limited, count)
+OO_STAT("Number of times an interrupt deferred the next interrupt using the "
+        "event queue timer rather than requesting an immediate wakeup.  See "
+        "EF_INT_MODERATION_ADAPTIVE.",
+        ci_uint32, interrupt_moderated, count)
 OO_STAT("Number of times poll has been deferred to lock holder.  i.e. There "
         "was contention, and this reader thread gave way.",
         ci_uint32, deferred_polls, count)
@@ -586,6 +594,29 @@ OO_STAT("Number of attempts to allocate packet buffer set which have failed "
         "unlikely for this to increment multiple times.  To resolve this, "
         "make huge pages available, or look into EF_PACKET_BUFFER_MODE.",
         ci_uint32, bufset_alloc_nospace, count)
+OO_STAT("Number of packet sets that have been returned to the system because "
+        "the stack was idle and few of its packet buffers were in use.  See "
+        "EF_PKT_SHRINK_IDLE.",
+        ci_uint32, pkt_sets_shrunk, count)
+OO_STAT("Number of packet buffers released from the non-blocking pool and "
+        "socket receive queues by the idle reclaimer before it returned "
+        "packet sets.  See EF_PKT_SHRINK_IDLE.",
+        ci_uint32, pkt_shrink_trimmed, count)
+OO_STAT("Number of zero-copy buffer registrations satisfied by an existing "
+        "registration.  See EF_ZC_REG_CACHE.",
+        ci_uint32, zc_reg_cache_hits, count)
+OO_STAT("Number of zero-copy buffer registrations that had to register "
+        "memory with the kernel.  See EF_ZC_REG_CACHE.",
+        ci_uint32, zc_reg_cache_misses, count)
+OO_STAT("Number of idle zero-copy registrations replaced by a registration "
+        "of a larger range that covered them.  See EF_ZC_REG_CACHE.",
+        ci_uint32, zc_reg_cache_merges, count)
+OO_STAT("Number of idle zero-copy registrations released because the cache "
+        "was full.  See EF_ZC_REG_CACHE.",
+        ci_uint32, zc_reg_cache_evictions, count)
+OO_STAT("Number of cached zero-copy registrations released because "
+        "registered memory was unmapped.  See EF_ZC_REG_CACHE.",
+        ci_uint32, zc_reg_cache_invalidated, count)
 OO_STAT("Something has requested a larger MSS than we can support in a "
         "single packet buffer; so we've reduced it.  The maximum mss has "
         "multiple possibilities depending on card version.  "
@@ -617,6 +648,27 @@ OO_STAT("A UDP packet has arrived into the Onload stack, but it doesn't "
         "or the socket just closed (and there were already matching packets"
         "in the RX ring).",
         ci_uint32, udp_rx_no_match_drops, count)
+OO_STAT("Number of IPv6 packets accelerated by skipping extension headers "
+        "(EF_IP6_EXT_HDRS).",
+        ci_uint32, rx_ip6_ext_hdrs, count)
+OO_STAT("Number of IPv6 packets with extension headers that could not be "
+        "skipped (EF_IP6_EXT_HDRS).",
+        ci_uint32, rx_ip6_ext_hdrs_unknown, count)
+OO_STAT("Number of IP fragments held for reassembly (EF_IP_REASM_MAX).",
+        ci_uint32, ip_reasm_frags, count)
+OO_STAT("Number of UDP datagrams reassembled from fragments.",
+        ci_uint32, ip_reasm_oks, count)
+OO_STAT("Number of duplicate IP fragments dropped.",
+        ci_uint32, ip_reasm_dups, count)
+OO_STAT("Number of fragmented datagrams discarded because fragments "
+        "overlapped or were malformed, or the checksum was bad.",
+        ci_uint32, ip_reasm_fails, count)
+OO_STAT("Number of fragmented datagrams discarded because they were not "
+        "complete within EF_IP_REASM_TIMEOUT.",
+        ci_uint32, ip_reasm_timeouts, count)
+OO_STAT("Number of fragmented datagrams discarded to make room for a new "
+        "one.  Consider increasing EF_IP_REASM_MAX.",
+        ci_uint32, ip_reasm_evictions, count)
 OO_STAT("We've been asked to free up a UDP socket (i.e. nothing references "
         "that fd any more) - but there are still some transmits waiting to "
         "complete.  The socket will be freed up once those transmits complete.",
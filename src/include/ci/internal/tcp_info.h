@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+#ifndef __CI_INTERNAL_TCP_INFO_H__
+#define __CI_INTERNAL_TCP_INFO_H__
+
+#include <ci/internal/ip.h>
+
+/* Per-connection metrics for the extended TCP_INFO fields.
+ *
+ * Byte and segment counts live in [ts->stats] and are bumped where the
+ * data path already touches the socket.  The chronograph follows Linux: a
+ * connection is busy while it has data queued or unacknowledged, and while
+ * busy it may be limited by the peer's receive window or by its own send
+ * buffer.  Only the highest state that applies is timed.  The delivery
+ * rate is sampled about once per smoothed RTT from the data acked in that
+ * time, starting afresh whenever the connection becomes busy so that idle
+ * periods don't dilute it.
+ *
+ * All of these must be called with the stack lock held.  Without
+ * CI_CFG_TCP_INFO_METRICS they do nothing, and the fields they maintain
+ * are reported as zero.
+ */
+
+
+/* Payload bytes in outgoing segment [pkt] with TCP header [tcp]. */
+ci_inline unsigned ci_tcp_tx_pkt_data_len(ci_ip_pkt_fmt* pkt,
+                                          const ci_tcp_hdr* tcp)
+{
+  return PKT_TCP_TX_SEQ_SPACE(pkt) -
+         ((tcp->tcp_flags & CI_TCP_FLAG_SYN) != 0) -
+         ((tcp->tcp_flags & CI_TCP_FLAG_FIN) != 0);
+}
+
+
+#if CI_CFG_TCP_INFO_METRICS
+
+/* Count segment [pkt] being sent on [ts].  Returns its payload length. */
+ci_inline unsigned ci_tcp_info_tx(ci_tcp_state* ts, ci_ip_pkt_fmt* pkt,
+                                  const ci_tcp_hdr* tcp)
+{
+  unsigned len = ci_tcp_tx_pkt_data_len(pkt, tcp);
+  ++ts->stats.tx_pkts;
+  ts->stats.tx_data_pkts += len != 0;
+  ts->stats.tx_bytes += len;
+  return len;
+}
+
+
+/* Count segment [pkt] being retransmitted on [ts]. */
+ci_inline void ci_tcp_info_retrans(ci_tcp_state* ts, ci_ip_pkt_fmt* pkt,
+                                   const ci_tcp_hdr* tcp)
+{
+  ts->stats.tx_bytes_retrans += ci_tcp_info_tx(ts, pkt, tcp);
+}
+
+
+/* Count a segment with no payload, such as an ACK, sent on [ts]. */
+ci_inline void ci_tcp_info_tx_ack(ci_tcp_state* ts)
+{
+  ++ts->stats.tx_pkts;
+}
+
+
+/* Take back a segment of [bytes] that was counted but not sent, as when
+ * MSG_WARM is unwound. */
+ci_inline void ci_tcp_info_tx_undo(ci_tcp_state* ts, unsigned bytes)
+{
+  --ts->stats.tx_pkts;
+  --ts->stats.tx_data_pkts;
+  ts->stats.tx_bytes -= bytes;
+}
+
+
+/* Count a segment received on [ts], with payload if [data]. */
+ci_inline void ci_tcp_info_rx(ci_tcp_state* ts, int data)
+{
+  ts->stats.rx_data_pkts += data;
+}
+
+
+/* Count [bytes] of in-order payload added to the receive queue. */
+ci_inline void ci_tcp_info_rx_bytes(ci_tcp_state* ts, int bytes)
+{
+  ts->stats.rx_bytes += bytes;
+}
+
+
+ci_inline void ci_tcp_rate_restart(ci_tcp_state* ts, ci_iptime_t now)
+{
+  ts->rate_start = now;
+  ts->rate_una = tcp_snd_una(ts);
+}
+
+
+/* Called when [ack] acknowledges new data. */
+ci_inline void ci_tcp_rate_sample(ci_netif* ni, ci_tcp_state* ts,
+                                  ci_uint32 ack, ci_iptime_t now)
+{
+  ci_iptime_t ticks = now - ts->rate_start;
+  if( ticks != 0 && ticks >= tcp_srtt(ts) ) {
+    ci_uint64 us = ci_ip_time_ticks2us(ni, ticks);
+    ci_uint64 bpms = (ci_uint64) SEQ_SUB(ack, ts->rate_una) * 1000 /
+                     CI_MAX(us, 1);
+    ts->stats.rate_bpms = CI_MIN(bpms, 0xffffffffu);
+    ts->rate_start = now;
+    ts->rate_una = ack;
+  }
+}
+
+
+ci_inline void ci_tcp_chrono_set(ci_tcp_state* ts, int type, ci_iptime_t now)
+{
+  if( ts->chrono_type != CI_TCP_CHRONO_NONE )
+    ts->stats.chrono[ts->chrono_type - 1] += now - ts->chrono_start;
+  ts->chrono_type = type;
+  ts->chrono_start = now;
+}
+
+
+/* [ts] has entered state [type]. */
+ci_inline void ci_tcp_chrono_start(ci_tcp_state* ts, int type,
+                                   ci_iptime_t now)
+{
+  if( type > ts->chrono_type ) {
+    if( ts->chrono_type == CI_TCP_CHRONO_NONE )
+      ci_tcp_rate_restart(ts, now);
+    ci_tcp_chrono_set(ts, type, now);
+  }
+}
+
+
+/* [ts] may have left state [type].  It stays busy until it has nothing
+ * left to send or to have acked.
+ */
+ci_inline void ci_tcp_chrono_stop(ci_tcp_state* ts, int type,
+                                  ci_iptime_t now)
+{
+  if( ts->chrono_type == CI_TCP_CHRONO_NONE )
+    return;
+  if( ci_ip_queue_is_empty(&ts->retrans) && ci_ip_queue_is_empty(&ts->send) )
+    ci_tcp_chrono_set(ts, CI_TCP_CHRONO_NONE, now);
+  else if( ts->chrono_type == type && type != CI_TCP_CHRONO_BUSY )
+    ci_tcp_chrono_set(ts, CI_TCP_CHRONO_BUSY, now);
+}
+
+
+/* Ticks that [ts] has spent in state [type], including the current spell
+ * if it is in that state now.
+ */
+ci_inline ci_uint64 ci_tcp_chrono_ticks(const ci_tcp_state* ts, int type,
+                                        ci_iptime_t now)
+{
+  ci_uint64 t = ts->stats.chrono[type - 1];
+  if( ts->chrono_type == type )
+    t += (ci_iptime_t) (now - ts->chrono_start);
+  return t;
+}
+
+
+/* Called once ci_tcp_tx_advance() has sent [sent] segments, stopping at the
+ * peer's receive window if [rwnd_limited]. */
+ci_inline void ci_tcp_chrono_tx(ci_netif* ni, ci_tcp_state* ts, int sent,
+                                int rwnd_limited)
+{
+  ci_iptime_t now;
+
+  /* Loopback connections have nothing to be acked, so are never busy. */
+  if( ts->s.pkt.flags & CI_IP_CACHE_IS_LOCALROUTE )
+    return;
+  if( rwnd_limited ) {
+    ci_tcp_chrono_start(ts, CI_TCP_CHRONO_RWND_LIMITED, ci_ip_time_now(ni));
+  }
+  else if( sent != 0 ) {
+    now = ci_ip_time_now(ni);
+    ci_tcp_chrono_start(ts, CI_TCP_CHRONO_BUSY, now);
+    ci_tcp_chrono_stop(ts, CI_TCP_CHRONO_RWND_LIMITED, now);
+  }
+}
+
+
+/* Called when [ack] acknowledges new data on [ts], once the buffers it
+ * acks have been freed. */
+ci_inline void ci_tcp_info_acked(ci_netif* ni, ci_tcp_state* ts,
+                                 ci_uint32 ack)
+{
+  ci_iptime_t now = ci_ip_time_now(ni);
+
+  ci_tcp_rate_sample(ni, ts, ack, now);
+  if( ts->chrono_type == CI_TCP_CHRONO_SNDBUF_LIMITED &&
+      ci_tcp_tx_send_space(ni, ts) > 0 )
+    ci_tcp_chrono_stop(ts, CI_TCP_CHRONO_SNDBUF_LIMITED, now);
+  else
+    ci_tcp_chrono_stop(ts, CI_TCP_CHRONO_BUSY, now);
+}
+
+#else
+
+#define ci_tcp_info_tx(ts, pkt, tcp)                ((void) 0)
+#define ci_tcp_info_retrans(ts, pkt, tcp)           ((void) 0)
+#define ci_tcp_info_tx_ack(ts)                      ((void) 0)
+#define ci_tcp_info_tx_undo(ts, bytes)              ((void) 0)
+#define ci_tcp_info_rx(ts, data)                    ((void) 0)
+#define ci_tcp_info_rx_bytes(ts, bytes)             ((void) 0)
+#define ci_tcp_chrono_start(ts, type, now)          ((void) 0)
+#define ci_tcp_chrono_tx(ni, ts, sent, rwnd_limited) ((void) (rwnd_limited))
+#define ci_tcp_info_acked(ni, ts, ack)              ((void) 0)
+
+#endif
+
+#endif  /* __CI_INTERNAL_TCP_INFO_H__ */
@@ -105,6 +105,15 @@
 #define CI_CFG_SUPPORT_STATS_COLLECTION	1
 #define CI_CFG_TCP_SOCK_STATS           0
 
+/* Per-socket CPU cycle counters for EF_SOCK_CYCLES.  These cost 40 bytes
+ * of every socket's shared state. */
+#define CI_CFG_SOCK_CYCLES              1
+
+/* Byte and segment counts, min_rtt, delivery rate and busy times for the
+ * extended TCP_INFO fields.  These cost 72 bytes of every TCP socket's
+ * shared state. */
+#define CI_CFG_TCP_INFO_METRICS         1
+
 /* Enable this to cause buffered stats (from sockopt) to be output
  * to the log rather than written to a buffer */
 #define CI_CFG_SEND_STATS_TO_LOG        1
@@ -584,6 +593,11 @@
  * PDU digests in Onload. Useful for testing of Onload CRC-offload logic. */
 #define CI_CFG_NVME_LOCAL_CRC_MODE 0
 
+/* Compile USDT probes into the user-level library for tracing with perf,
+ * bpftrace etc.  Needs <sys/sdt.h> (systemtap-sdt-devel) at build time,
+ * and otherwise compiles to nothing.  See ci/internal/probes.h. */
+#define CI_CFG_USDT 1
+
 #ifdef __KERNEL__
 #include <linux/version.h>
 /* Enable Berkeley Packet Filter program functionality
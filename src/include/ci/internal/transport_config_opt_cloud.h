@@ -25,4 +25,10 @@
 #undef CI_CFG_TX_CRC_OFFLOAD
 #define CI_CFG_TX_CRC_OFFLOAD 1
 
+/* Leave room in the socket buffer for IPv6 and the plugin state */
+#undef CI_CFG_SOCK_CYCLES
+#define CI_CFG_SOCK_CYCLES 0
+#undef CI_CFG_TCP_INFO_METRICS
+#define CI_CFG_TCP_INFO_METRICS 0
+
 #endif /* __CI_INTERNAL_TRANSPORT_CONFIG_OPT_CLOUD_H__ */
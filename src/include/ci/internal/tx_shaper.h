@@ -0,0 +1,238 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+#ifndef __CI_INTERNAL_TX_SHAPER_H__
+#define __CI_INTERNAL_TX_SHAPER_H__
+
+#include <ci/internal/ip.h>
+
+/* Hierarchical token-bucket egress shaping (EF_TX_SHAPE).
+ *
+ * Packets are classified by IP precedence: the top three bits of the TOS
+ * or traffic class, which sockets choose with IP_TOS or IPV6_TCLASS.  Each
+ * configured class has a guaranteed [rate] and a [ceil] up to which it may
+ * borrow bandwidth that the root (the stack's link rate) has to spare.
+ * Traffic in unconfigured classes is never delayed, but still uses up the
+ * root's tokens, so it reduces what shaped classes may borrow.
+ *
+ * Packets that may not be sent yet wait in a per-class backlog.  Backlogs
+ * are released in strict priority order, highest class first: first the
+ * classes that are within their rate, then those that may borrow.
+ *
+ * Token counts are kept in units of 1/khz bytes.  A bucket filling at R
+ * bytes per msec then gains exactly R tokens per cycle, so that refills
+ * do not lose remainders however often they happen.
+ */
+
+#define CI_TXSHAPE_BURST_USEC  1000   /* bucket depth, as time at its rate */
+#define CI_TXSHAPE_MIN_BURST   16384  /* min bucket depth in bytes */
+#define CI_TXSHAPE_MAX_MBPS    10000000
+
+/* Results of ci_txshape_check(). */
+#define CI_TXSHAPE_WAIT    0
+#define CI_TXSHAPE_SEND    1   /* within the class's rate */
+#define CI_TXSHAPE_BORROW  2   /* over rate, but within ceil and root */
+
+
+ci_inline unsigned ci_txshape_class_of_tos(unsigned tos)
+{
+  return (tos >> 5) & (CI_TXSHAPE_CLASSES - 1);
+}
+
+
+ci_inline int ci_txshape_is_shaped(const ci_txshape_state* s, unsigned c)
+{
+  return (s->shaped >> c) & 1;
+}
+
+
+/* Depth in tokens of a bucket that fills at [rate] bytes per msec. */
+ci_inline ci_int64 ci_txshape_depth(ci_uint64 rate, unsigned khz)
+{
+  ci_uint64 bytes = rate * CI_TXSHAPE_BURST_USEC / 1000;
+  if( bytes < CI_TXSHAPE_MIN_BURST )
+    bytes = CI_TXSHAPE_MIN_BURST;
+  return (ci_int64) (bytes * khz);
+}
+
+
+ci_inline void ci_txshape_fill(ci_int64* tokens, ci_uint64 rate,
+                               ci_uint64 elapsed, unsigned khz)
+{
+  ci_int64 depth = ci_txshape_depth(rate, khz);
+  if( rate == 0 )
+    return;
+  /* Compare before multiplying, as [elapsed] may be large. */
+  if( *tokens >= depth || elapsed > (ci_uint64) (depth - *tokens) / rate )
+    *tokens = depth;
+  else
+    *tokens += (ci_int64) (elapsed * rate);
+}
+
+
+ci_inline void ci_txshape_spend(ci_int64* tokens, ci_uint64 rate,
+                                ci_int64 n, unsigned khz)
+{
+  /* Limit the debt, so that a burst of traffic that we were not allowed to
+   * delay does not starve the bucket for ever after. */
+  ci_int64 depth = ci_txshape_depth(rate, khz);
+  *tokens -= n;
+  if( *tokens < -depth )
+    *tokens = -depth;
+}
+
+
+ci_inline int ci_txshape_parse_mbps(const char** p, ci_uint64* bpms)
+{
+  ci_uint64 v = 0;
+  if( **p < '0' || **p > '9' )
+    return -EINVAL;
+  while( **p >= '0' && **p <= '9' ) {
+    v = v * 10 + (*(*p)++ - '0');
+    if( v > CI_TXSHAPE_MAX_MBPS )
+      return -EINVAL;
+  }
+  *bpms = v * 125;  /* Mbit/s == 125 bytes per msec */
+  return 0;
+}
+
+/* Parse [spec] into [s], which must be zeroed.  [spec] is a comma-separated
+ * list of "root=<ceil>" and "<class>=<rate>[:<ceil>]", with rates in Mbit/s.
+ * [ceil] defaults to [rate], i.e. no borrowing.  Returns 0 on success or
+ * -EINVAL.
+ */
+ci_inline int ci_txshape_parse(ci_txshape_state* s, const char* spec)
+{
+  const char* p = spec;
+  ci_uint64 rate, ceil;
+  unsigned c;
+
+  while( *p != '\0' ) {
+    if( ! strncmp(p, "root=", 5) ) {
+      p += 5;
+      if( ci_txshape_parse_mbps(&p, &s->root_rate) < 0 )
+        return -EINVAL;
+    }
+    else {
+      if( *p < '0' || *p >= '0' + CI_TXSHAPE_CLASSES || p[1] != '=' )
+        return -EINVAL;
+      c = *p - '0';
+      p += 2;
+      if( ci_txshape_parse_mbps(&p, &rate) < 0 )
+        return -EINVAL;
+      ceil = rate;
+      if( *p == ':' ) {
+        ++p;
+        if( ci_txshape_parse_mbps(&p, &ceil) < 0 || ceil < rate )
+          return -EINVAL;
+      }
+      if( ceil == 0 )
+        return -EINVAL;
+      s->cls[c].rate = rate;
+      s->cls[c].ceil = ceil;
+      s->shaped |= 1u << c;
+    }
+    if( *p == ',' )
+      ++p;
+    else if( *p != '\0' )
+      return -EINVAL;
+  }
+  return 0;
+}
+
+
+/* Start with full buckets at time [now]. */
+ci_inline void ci_txshape_init(ci_txshape_state* s, ci_uint64 now,
+                               unsigned khz)
+{
+  unsigned c;
+  s->last_frc = now;
+  s->root_tokens = ci_txshape_depth(s->root_rate, khz);
+  s->backlog = 0;
+  for( c = 0; c < CI_TXSHAPE_CLASSES; ++c ) {
+    ci_txshape_class* cl = &s->cls[c];
+    cl->tokens = cl->rate ? ci_txshape_depth(cl->rate, khz) : 0;
+    cl->ctokens = ci_txshape_depth(cl->ceil, khz);
+    oo_pktq_init(&cl->backlog);
+  }
+}
+
+
+ci_inline void ci_txshape_refill(ci_txshape_state* s, ci_uint64 now,
+                                 unsigned khz)
+{
+  ci_uint64 elapsed = now - s->last_frc;
+  unsigned c;
+
+  /* The frc may be a little behind on another core. */
+  if( (ci_int64) elapsed <= 0 )
+    return;
+  s->last_frc = now;
+  ci_txshape_fill(&s->root_tokens, s->root_rate, elapsed, khz);
+  for( c = 0; c < CI_TXSHAPE_CLASSES; ++c )
+    if( ci_txshape_is_shaped(s, c) ) {
+      ci_txshape_fill(&s->cls[c].tokens, s->cls[c].rate, elapsed, khz);
+      ci_txshape_fill(&s->cls[c].ctokens, s->cls[c].ceil, elapsed, khz);
+    }
+}
+
+
+/* May a packet of [len] bytes in shaped class [c] be sent now? */
+ci_inline int ci_txshape_check(const ci_txshape_state* s, unsigned c,
+                               unsigned len, unsigned khz)
+{
+  const ci_txshape_class* cl = &s->cls[c];
+  ci_int64 need = (ci_int64) len * khz;
+
+  if( cl->tokens >= need )
+    return CI_TXSHAPE_SEND;
+  if( cl->ceil > cl->rate && cl->ctokens >= need &&
+      (s->root_rate == 0 || s->root_tokens >= need) )
+    return CI_TXSHAPE_BORROW;
+  return CI_TXSHAPE_WAIT;
+}
+
+
+/* Account for sending [len] bytes in class [c], as permitted by [how].
+ * For an unshaped class only the root is charged.
+ */
+ci_inline void ci_txshape_charge(ci_txshape_state* s, unsigned c,
+                                 unsigned len, unsigned khz, int how)
+{
+  ci_txshape_class* cl = &s->cls[c];
+  ci_int64 n = (ci_int64) len * khz;
+
+  if( s->root_rate )
+    ci_txshape_spend(&s->root_tokens, s->root_rate, n, khz);
+  if( ! ci_txshape_is_shaped(s, c) )
+    return;
+  if( how == CI_TXSHAPE_SEND )
+    ci_txshape_spend(&cl->tokens, cl->rate, n, khz);
+  else
+    ++cl->n_borrowed;
+  ci_txshape_spend(&cl->ctokens, cl->ceil, n, khz);
+  cl->tx_bytes += len;
+  ++cl->tx_pkts;
+}
+
+
+/* Choose the class to release a packet from.  [head_len][c] is the length
+ * of the packet at the head of class c's backlog, or 0 if it is empty.
+ * Returns the class and sets [*how], or returns -1 if nothing may be sent
+ * yet.
+ */
+ci_inline int ci_txshape_pick(const ci_txshape_state* s,
+                              const unsigned* head_len, unsigned khz,
+                              int* how)
+{
+  int c, pass;
+  for( pass = CI_TXSHAPE_SEND; pass <= CI_TXSHAPE_BORROW; ++pass )
+    for( c = CI_TXSHAPE_CLASSES - 1; c >= 0; --c )
+      if( head_len[c] != 0 &&
+          ci_txshape_check(s, c, head_len[c], khz) == pass ) {
+        *how = pass;
+        return c;
+      }
+  return -1;
+}
+
+#endif  /* __CI_INTERNAL_TX_SHAPER_H__ */
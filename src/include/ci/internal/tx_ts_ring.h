@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+#ifndef __CI_INTERNAL_TX_TS_RING_H__
+#define __CI_INTERNAL_TX_TS_RING_H__
+
+#include <ci/internal/ip.h>
+#include <onload/extensions_timestamping.h>
+
+#if CI_CFG_TIMESTAMPING
+
+/* Ring of TX timestamp records in shared memory (EF_TX_TIMESTAMP_RING).
+ *
+ * With the ring, packets sent with a TX timestamp are not queued to their
+ * socket's timestamp_q.  Instead a record is written here when the
+ * transmit completes and the packet is freed as usual, and applications
+ * pick the records up with onload_tx_timestamp_read() without a syscall.
+ *
+ * The stack is the only writer, under the stack lock, and advances [write]
+ * only once the record is in place.  Readers claim records by advancing
+ * [read] with compare-and-swap, so any number may read without the lock.
+ * The writer never overwrites a record that has not been read: when the
+ * ring is full new records are dropped and counted.
+ *
+ * [size] is a power of 2.  The writer must take it from the stack's own
+ * copy of the options rather than from shared state, so that a misbehaving
+ * application can't make it write outside the ring.
+ */
+
+
+ci_inline void oo_tx_ts_ring_put(oo_tx_ts_ring_state* st,
+                                 struct onload_tx_timestamp* recs,
+                                 unsigned size,
+                                 const struct onload_tx_timestamp* rec)
+{
+  ci_uint32 w = st->write;
+
+  if( w - OO_ACCESS_ONCE(st->read) >= size ) {
+    ++st->dropped;
+    return;
+  }
+  recs[w & (size - 1)] = *rec;
+  ci_wmb();
+  st->write = w + 1;
+}
+
+
+/* Take up to [max] records from the ring and copy them to [out].  Returns
+ * the number taken.
+ */
+ci_inline int oo_tx_ts_ring_get(oo_tx_ts_ring_state* st,
+                                const struct onload_tx_timestamp* recs,
+                                unsigned size,
+                                struct onload_tx_timestamp* out, int max)
+{
+  ci_uint32 r, n, i;
+
+  do {
+    r = OO_ACCESS_ONCE(st->read);
+    ci_rmb();
+    n = OO_ACCESS_ONCE(st->write) - r;
+    ci_rmb();
+    n = CI_MIN(n, size);
+    n = CI_MIN(n, (ci_uint32) max);
+    for( i = 0; i < n; ++i )
+      out[i] = recs[(r + i) & (size - 1)];
+  } while( n != 0 && ci_cas32u_fail(&st->read, r, r + n) );
+
+  return n;
+}
+
+#endif  /* CI_CFG_TIMESTAMPING */
+
+#endif  /* __CI_INTERNAL_TX_TS_RING_H__ */
@@ -156,4 +156,126 @@ ci_inline void ci_ip6_frag_hdr_init(ci_ip6_frag_hdr* fh, ci_uint8 next_hdr,
   fh->frag_id = frag_id_be32;
 }
 
+/**********************************************************************
+ ** Extension headers
+ */
+
+#define CI_NEXTHDR_HOP      0
+#define CI_NEXTHDR_ROUTING  43
+#define CI_NEXTHDR_ESP      50
+#define CI_NEXTHDR_AUTH     51
+#define CI_NEXTHDR_NONE     59
+#define CI_NEXTHDR_DEST     60
+#define CI_NEXTHDR_MOBILITY 135
+#define CI_NEXTHDR_HIP      139
+#define CI_NEXTHDR_SHIM6    140
+
+/* Hop-by-hop and destination options */
+#define CI_IP6_OPT_PAD1     0
+#define CI_IP6_OPT_PADN     1
+
+/* Most extension headers that ci_ip6_ext_walk() walks past */
+#define CI_IP6_EXT_MAX      8
+
+/* Results of ci_ip6_ext_walk() */
+#define CI_IP6_EXT_OK       0  /* found the header that follows */
+#define CI_IP6_EXT_UNKNOWN  1  /* needs processing that we don't do */
+#define CI_IP6_EXT_BAD      2  /* malformed or truncated */
+
+/* Is [next_hdr] an extension header rather than an upper-layer header?
+ * (RFC7045)
+ */
+ci_inline int ci_ip6_is_ext_hdr(ci_uint8 next_hdr)
+{
+  switch( next_hdr ) {
+  case CI_NEXTHDR_HOP:
+  case CI_NEXTHDR_ROUTING:
+  case CI_NEXTHDR_FRAGMENT:
+  case CI_NEXTHDR_ESP:
+  case CI_NEXTHDR_AUTH:
+  case CI_NEXTHDR_NONE:
+  case CI_NEXTHDR_DEST:
+  case CI_NEXTHDR_MOBILITY:
+  case CI_NEXTHDR_HIP:
+  case CI_NEXTHDR_SHIM6:
+  case 253:  /* experimental (RFC3692) */
+  case 254:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+
+/* Check the options of a hop-by-hop or destination options header [hdr] of
+ * [len] bytes.
+ */
+ci_inline int ci_ip6_ext_opts(const ci_uint8* hdr, int len)
+{
+  int i = 2;
+
+  while( i < len ) {
+    if( hdr[i] == CI_IP6_OPT_PAD1 ) {
+      ++i;
+      continue;
+    }
+    if( i + 2 > len || i + 2 + hdr[i + 1] > len )
+      return CI_IP6_EXT_BAD;
+    /* RFC8200 4.2: the top two bits of the type say what to do with an
+     * option that isn't recognised, and 00 is to skip it. */
+    if( hdr[i] != CI_IP6_OPT_PADN && (hdr[i] & 0xc0) )
+      return CI_IP6_EXT_UNKNOWN;
+    i += 2 + hdr[i + 1];
+  }
+  return CI_IP6_EXT_OK;
+}
+
+/* Walk past the hop-by-hop, destination options and routing headers that
+ * follow [ip6], within the [len] bytes after it.  On success, [*proto] is
+ * the upper-layer header or a fragment header, and [*off] is its offset
+ * from the end of [ip6].
+ *
+ * Any other extension header gives CI_IP6_EXT_UNKNOWN, as do an option
+ * that must not be skipped and a routing header with segments left, which
+ * means that we are not the final destination.
+ */
+ci_inline int ci_ip6_ext_walk(const ci_ip6_hdr* ip6, int len,
+                              ci_uint8* proto, int* off)
+{
+  const ci_uint8* hdr = (const ci_uint8*) (ip6 + 1);
+  ci_uint8 next_hdr = ip6->next_hdr;
+  int i, rc, hdr_len, o = 0;
+
+  for( i = 0; i <= CI_IP6_EXT_MAX; ++i ) {
+    if( next_hdr != CI_NEXTHDR_HOP && next_hdr != CI_NEXTHDR_DEST &&
+        next_hdr != CI_NEXTHDR_ROUTING ) {
+      if( next_hdr != CI_NEXTHDR_FRAGMENT && ci_ip6_is_ext_hdr(next_hdr) )
+        return CI_IP6_EXT_UNKNOWN;
+      *proto = next_hdr;
+      *off = o;
+      return CI_IP6_EXT_OK;
+    }
+    if( i == CI_IP6_EXT_MAX )
+      break;
+    /* RFC8200 4.3: hop-by-hop options come first if at all */
+    if( next_hdr == CI_NEXTHDR_HOP && i != 0 )
+      return CI_IP6_EXT_BAD;
+    if( o + 8 > len )
+      return CI_IP6_EXT_BAD;
+    hdr_len = (hdr[o + 1] + 1) << 3;
+    if( o + hdr_len > len )
+      return CI_IP6_EXT_BAD;
+    if( next_hdr == CI_NEXTHDR_ROUTING ) {
+      if( hdr[o + 3] != 0 )
+        return CI_IP6_EXT_UNKNOWN;
+    }
+    else if( (rc = ci_ip6_ext_opts(hdr + o, hdr_len)) != CI_IP6_EXT_OK ) {
+      return rc;
+    }
+    next_hdr = hdr[o];
+    o += hdr_len;
+  }
+  return CI_IP6_EXT_UNKNOWN;
+}
+
 #endif /* __CI_NET_IPV6_H__ */
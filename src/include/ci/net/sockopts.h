@@ -79,6 +79,37 @@ struct ci_tcp_info
   ci_uint32 tcpi_rcv_space;
 
   ci_uint32 tcpi_total_retrans;
+
+  /* Fields added in later versions of Linux, up to 5.4 */
+  ci_uint64 tcpi_pacing_rate;
+  ci_uint64 tcpi_max_pacing_rate;
+  ci_uint64 tcpi_bytes_acked;
+  ci_uint64 tcpi_bytes_received;
+  ci_uint32 tcpi_segs_out;
+  ci_uint32 tcpi_segs_in;
+
+  ci_uint32 tcpi_notsent_bytes;
+  ci_uint32 tcpi_min_rtt;
+  ci_uint32 tcpi_data_segs_in;
+  ci_uint32 tcpi_data_segs_out;
+
+  ci_uint64 tcpi_delivery_rate;
+
+  ci_uint64 tcpi_busy_time;
+  ci_uint64 tcpi_rwnd_limited;
+  ci_uint64 tcpi_sndbuf_limited;
+
+  ci_uint32 tcpi_delivered;
+  ci_uint32 tcpi_delivered_ce;
+
+  ci_uint64 tcpi_bytes_sent;
+  ci_uint64 tcpi_bytes_retrans;
+  ci_uint32 tcpi_dsack_dups;
+  ci_uint32 tcpi_reord_seen;
+
+  ci_uint32 tcpi_rcv_ooopack;
+
+  ci_uint32 tcpi_snd_wnd;
 };
 
 #endif /* __CI_NET_SOCKOPTS_H__ */
@@ -319,6 +319,29 @@ ci_inline void ci_atomic32_merge(volatile ci_uint32* p,
 
 # define ci_spinloop_pause()  do{}while(0)
 
+/* Low-power wait for a write to a cache line.  ci_monitor_arm() sets the
+ * exclusive monitor on [addr]; a write by another agent clears it, which
+ * generates the event that ends the WFE in ci_monitor_wait().  WFE has no
+ * timeout of its own, so [ticks] is ignored and the wait is bounded by the
+ * kernel's timer event stream instead.  The caller must re-check the
+ * condition it is waiting for between the two calls.
+ */
+#define CI_MONITOR_NONE  0
+#define CI_MONITOR_WFE   1
+
+ci_inline void ci_monitor_arm(int mode, const volatile void* addr)
+{
+  ci_uint32 v;
+  __asm__ __volatile__("ldaxr %w0, [%1]" : "=&r" (v) : "r" (addr)
+                       : "memory");
+  (void) v;
+}
+
+ci_inline void ci_monitor_wait(int mode, ci_uint64 now, ci_uint32 ticks)
+{
+  __asm__ __volatile__("wfe" : : : "memory");
+}
+
 #define CI_HAVE_ADDC32
 #define ci_add_carry32(sum, v)                          \
   do {                                                  \
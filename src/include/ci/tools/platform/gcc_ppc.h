@@ -1024,6 +1024,11 @@ static inline void ci_prefetch_ppc(const void *x)
 
 #define ci_spinloop_pause()      do{}while(0)
 
+/* No user-level monitored wait on this platform. */
+#define CI_MONITOR_NONE  0
+#define ci_monitor_arm(mode, addr)         do{}while(0)
+#define ci_monitor_wait(mode, now, ticks)  do{}while(0)
+
 
 static inline void ci_clflush(volatile void* addr)
 {
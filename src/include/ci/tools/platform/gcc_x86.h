@@ -504,6 +504,48 @@ ci_inline void ci_atomic32_merge(volatile ci_uint32* p,
 
 # define ci_spinloop_pause()  __asm__("pause") 
 
+/* Low-power wait for a write to a cache line.  ci_monitor_arm() arms a
+ * monitor on [addr]; ci_monitor_wait() then returns when the line is
+ * written, on an interrupt, or after [ticks] TSC cycles from [now].  The
+ * caller must re-check the condition it is waiting for between the two
+ * calls, and must have checked that the CPU supports [mode] (see
+ * ci_cpu_has_feature()).  The instructions are hand-encoded so that older
+ * assemblers can build them.
+ */
+#define CI_MONITOR_NONE    0
+#define CI_MONITOR_UMWAIT  1  /* Intel WAITPKG */
+#define CI_MONITOR_MWAITX  2  /* AMD MONITORX */
+
+ci_inline void ci_monitor_arm(int mode, const volatile void* addr)
+{
+  if( mode == CI_MONITOR_UMWAIT )
+    /* umonitor %rax */
+    __asm__ __volatile__(".byte 0xf3, 0x0f, 0xae, 0xf0" : : "a" (addr));
+  else
+    /* monitorx %rax, %ecx, %edx */
+    __asm__ __volatile__(".byte 0x0f, 0x01, 0xfa"
+                         : : "a" (addr), "c" (0), "d" (0));
+}
+
+ci_inline void ci_monitor_wait(int mode, ci_uint64 now, ci_uint32 ticks)
+{
+  if( mode == CI_MONITOR_UMWAIT ) {
+    /* umwait %ecx: ecx=1 selects C0.1, which wakes faster than C0.2 */
+    ci_uint64 deadline = now + ticks;
+    __asm__ __volatile__(".byte 0xf2, 0x0f, 0xae, 0xf1"
+                         : : "c" (1), "a" ((ci_uint32) deadline),
+                             "d" ((ci_uint32) (deadline >> 32))
+                         : "cc", "memory");
+  }
+  else {
+    /* mwaitx %eax, %ebx, %ecx: eax=0xf0 stays in C0, ecx=2 enables the
+     * timeout in ebx */
+    __asm__ __volatile__(".byte 0x0f, 0x01, 0xfb"
+                         : : "a" (0xf0), "b" (ticks), "c" (2)
+                         : "memory");
+  }
+}
+
 #define CI_HAVE_ADDC32
 #define ci_add_carry32(sum, v)  __asm__("addl %1, %0 ;"			  \
 					"adcl $0, %0 ;"			  \
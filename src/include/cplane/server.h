@@ -31,6 +31,7 @@
 #define CPLANE_SERVER_GID "gid"
 #define CPLANE_SERVER_PREFSRC_AS_LOCAL "preferred-source-as-local"
 #define CPLANE_SERVER_TRACK_XDP "track-xdp"
+#define CPLANE_SERVER_MULTI_NS "multi-ns"
 #ifndef NDEBUG
 #define CPLANE_SERVER_CORE_SIZE "core_size"
 #endif
@@ -46,6 +47,7 @@ enum cp_helper_msg_type {
   CP_HMSG_FWD_REQUEST,
   CP_HMSG_VETH_SET_FWD_TABLE_ID,
   CP_HMSG_SET_HWPORT,
+  CP_HMSG_SERVE_NETNS,
 };
 
 /* message from in-kernel cplane helper to the cplane server */
@@ -66,6 +68,13 @@ struct cp_helper_msg {
       ci_hwport_id_t hwport;
       cp_nic_flags_t nic_flags;
     } set_hwport;
+    struct {
+      /* A process in the namespace to serve */
+      ci_uint32 pid;
+      /* The nsfs inode of the namespace, in case [pid] is reused before the
+       * server looks it up; 0 if unknown */
+      ci_uint32 ino;
+    } serve_netns;
   } u;
 };
 
@@ -0,0 +1,276 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+
+/**************************************************************************\
+*//*! \file
+** \author    Advanced Micro Devices, Inc.
+** \brief     Packet buffer pools for EtherFabric Virtual Interface HAL.
+** \date      2024/06/03
+** \copyright Copyright &copy; 2024 Advanced Micro Devices, Inc.
+*//*
+\**************************************************************************/
+
+#ifndef __EFAB_PKTPOOL_H__
+#define __EFAB_PKTPOOL_H__
+
+#include <etherfabric/base.h>
+#include <etherfabric/memreg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief Maximum number of protection domains a pool can be registered
+** with */
+#define EF_PKTPOOL_MAX_REGS  4
+
+/*! \brief Flags for ef_pktpool_attr::flags */
+enum ef_pktpool_flags {
+  /** Fail rather than fall back to normal pages if huge pages are not
+  ** available */
+  EF_PKTPOOL_FLAG_HUGE_PAGES = 0x1,
+  /** Do not attempt to use huge pages */
+  EF_PKTPOOL_FLAG_NO_HUGE_PAGES = 0x2,
+};
+
+/*! \brief Attributes of a packet buffer pool */
+typedef struct ef_pktpool_attr {
+  /** Number of buffers in the pool */
+  unsigned n_bufs;
+  /** Size of each buffer: a power of two from 64 bytes up to
+  ** EF_VI_NIC_PAGE_SIZE */
+  unsigned buf_size;
+  /** NUMA node to allocate memory on, or -1 for no preference */
+  int numa_node;
+  /** Flags from enum ef_pktpool_flags */
+  unsigned flags;
+} ef_pktpool_attr;
+
+/*! \brief A pool of packet buffers
+**
+** Users should treat this structure as opaque, and use the functions below
+** to access it.
+*/
+typedef struct ef_pktpool {
+  /** Base of the buffer memory */
+  char* mem;
+  /** Bytes of buffer memory */
+  size_t mem_bytes;
+  /** log2 of the buffer size */
+  unsigned buf_shift;
+  /** Number of buffers */
+  unsigned n_bufs;
+  /** Reference count of each buffer */
+  uint32_t* refs;
+  /** Next buffer on the free list for each buffer */
+  int32_t* next;
+  /** Free list head: generation in the upper 32 bits and (id + 1) in the
+  ** lower 32 bits, or zero in the lower 32 bits if empty */
+  uint64_t free_head;
+  /** Registrations of the memory, one per protection domain */
+  ef_memreg regs[EF_PKTPOOL_MAX_REGS];
+  /** Driver handles of the registrations */
+  ef_driver_handle reg_dh[EF_PKTPOOL_MAX_REGS];
+  /** Number of valid entries in regs[] */
+  int n_regs;
+  /** Whether the memory is backed by huge pages */
+  int huge_pages;
+} ef_pktpool;
+
+/*! \brief A cache of free buffers from an ef_pktpool
+**
+** Each thread that allocates or frees buffers should use its own cache.
+** Allocating from and freeing to a cache does not touch shared state
+** unless the cache is empty or full, in which case buffers are moved in
+** batches to or from the pool's lock-free free list.
+**
+** Users should treat this structure as opaque.
+*/
+typedef struct ef_pktpool_cache {
+  /** The pool this cache belongs to */
+  ef_pktpool* pool;
+  /** Number of buffers in the cache */
+  unsigned n;
+  /** Capacity of the cache */
+  unsigned size;
+  /** Ids of the buffers in the cache */
+  int32_t ids[];
+} ef_pktpool_cache;
+
+
+/*! \brief Initialise packet buffer pool attributes to defaults
+**
+** \param attr   The attributes to initialise.
+** \param n_bufs Number of buffers in the pool.
+**
+** The defaults are 2048 byte buffers, no NUMA preference, and huge pages
+** if available.
+*/
+extern void ef_pktpool_attr_init(ef_pktpool_attr* attr, unsigned n_bufs);
+
+/*! \brief Allocate a packet buffer pool
+**
+** \param pool_out Updated to point to the new pool.
+** \param attr     Attributes of the pool.
+**
+** \return 0 on success, or a negative error code.
+**
+** Allocates memory for the buffers, preferring huge pages and the given
+** NUMA node, and puts all buffers on the pool's free list.  The memory must
+** be registered with ef_pktpool_register() before buffers are used for
+** DMA.
+*/
+extern int ef_pktpool_alloc(ef_pktpool** pool_out,
+                            const ef_pktpool_attr* attr);
+
+/*! \brief Register a packet buffer pool for DMA
+**
+** \param pool  The pool to register.
+** \param dh    Driver handle for the registration.
+** \param pd    Protection domain in which to register the memory.
+** \param pd_dh Driver handle for the protection domain.
+**
+** \return The index of the registration, for use with
+**         ef_pktpool_buf_dma_addr(), or a negative error code.
+**
+** A pool may be registered with up to EF_PKTPOOL_MAX_REGS protection
+** domains, for example to forward between interfaces.
+*/
+extern int ef_pktpool_register(ef_pktpool* pool, ef_driver_handle dh,
+                               struct ef_pd* pd, ef_driver_handle pd_dh);
+
+/*! \brief Free a packet buffer pool
+**
+** \param pool The pool to free.
+**
+** All caches of the pool must have been freed first.  The memory is
+** unregistered, but note that ef_vi only releases registered memory when
+** the driver handles used to register it are closed.
+*/
+extern void ef_pktpool_free(ef_pktpool* pool);
+
+/*! \brief Allocate a cache of free buffers for a pool
+**
+** \param cache_out Updated to point to the new cache.
+** \param pool      The pool.
+** \param size      Maximum number of buffers held by the cache.
+**
+** \return 0 on success, or a negative error code.
+*/
+extern int ef_pktpool_cache_alloc(ef_pktpool_cache** cache_out,
+                                  ef_pktpool* pool, unsigned size);
+
+/*! \brief Free a cache, returning its buffers to the pool
+**
+** \param cache The cache to free.
+*/
+extern void ef_pktpool_cache_free(ef_pktpool_cache* cache);
+
+/*! \brief Move buffers from the pool to a cache (internal)
+**
+** \return Number of buffers moved.
+*/
+extern int ef_pktpool_cache_fill(ef_pktpool_cache* cache);
+
+
+/*! \brief Return the address of a buffer
+**
+** \param pool The pool.
+** \param id   The buffer id.
+**
+** \return The address of the start of the buffer.
+*/
+ef_vi_inline void* ef_pktpool_buf_ptr(const ef_pktpool* pool, int id)
+{
+  return pool->mem + ((size_t) id << pool->buf_shift);
+}
+
+/*! \brief Return the id of the buffer containing an address
+**
+** \param pool The pool.
+** \param p    An address within a buffer.
+**
+** \return The buffer id.
+*/
+ef_vi_inline int ef_pktpool_buf_id(const ef_pktpool* pool, const void* p)
+{
+  return (int) (((const char*) p - pool->mem) >> pool->buf_shift);
+}
+
+/*! \brief Return the DMA address of a buffer
+**
+** \param pool  The pool.
+** \param reg_i Index of the registration from ef_pktpool_register().
+** \param id    The buffer id.
+**
+** \return The DMA address of the start of the buffer.  Buffers never
+**         straddle a 4K boundary, so the buffer is contiguous in DMA
+**         address space.
+*/
+ef_vi_inline ef_addr
+ef_pktpool_buf_dma_addr(ef_pktpool* pool, int reg_i, int id)
+{
+  return ef_memreg_dma_addr(&pool->regs[reg_i],
+                            (size_t) id << pool->buf_shift);
+}
+
+/*! \brief Allocate a buffer
+**
+** \param cache The calling thread's cache.
+**
+** \return The id of a buffer with a reference count of one, or -ENOBUFS if
+**         the pool is empty.
+*/
+ef_vi_inline int ef_pktpool_buf_alloc(ef_pktpool_cache* cache)
+{
+  int id;
+  if( cache->n == 0 && ef_pktpool_cache_fill(cache) == 0 )
+    return -ENOBUFS;
+  id = cache->ids[--cache->n];
+  cache->pool->refs[id] = 1;
+  return id;
+}
+
+/*! \brief Take an additional reference to a buffer
+**
+** \param pool The pool.
+** \param id   The buffer id.
+**
+** Use this when passing a buffer to more than one consumer, such as when
+** transmitting a received packet on several interfaces.  Each reference is
+** dropped with ef_pktpool_buf_release().
+*/
+ef_vi_inline void ef_pktpool_buf_ref(ef_pktpool* pool, int id)
+{
+  __atomic_add_fetch(&pool->refs[id], 1, __ATOMIC_RELAXED);
+}
+
+/*! \brief Drop a reference to a buffer, freeing it when none remain
+**
+** \param cache The calling thread's cache.
+** \param id    The buffer id.
+*/
+extern void ef_pktpool_buf_release(ef_pktpool_cache* cache, int id);
+
+/*! \brief Allocate buffers and post them to a VI's receive ring
+**
+** \param cache  The calling thread's cache.
+** \param vi     The virtual interface.
+** \param reg_i  Index of the registration for the VI's protection domain.
+** \param offset Offset within each buffer at which to receive.
+** \param max    Maximum number of buffers to post.
+**
+** \return The number of buffers posted.
+**
+** Posts as many buffers as fit in the receive ring (up to \p max) and then
+** pushes them to the NIC.  The buffer id is used as the dma_id, so the
+** buffer for a completed receive is ef_pktpool_buf_ptr(pool, rx_rq_id).
+*/
+extern int ef_pktpool_rx_refill(ef_pktpool_cache* cache, struct ef_vi* vi,
+                                int reg_i, unsigned offset, int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __EFAB_PKTPOOL_H__ */
@@ -1049,6 +1049,57 @@ extern int ef_vi_filter_del(ef_vi* vi, ef_driver_handle vi_dh,
                             ef_filter_cookie* filter_cookie);
 
 
+/*! \brief Add many filters to a virtual interface, all or none
+**
+** \param vi                The virtual interface on which to add the
+**                          filters.
+** \param vi_dh             The ef_driver_handle for the virtual interface.
+** \param filter_specs      Array of \p n filters to add.
+** \param n                 Number of filters.
+** \param filter_cookies_out Array of \p n cookies, set on return to identify
+**                          the filters added.
+** \param rcs_out           Array of \p n results, set on return to the
+**                          result for each filter.
+**
+** \return 0 on success, or the negative error code of the filter that
+**         failed.
+**
+** Add a batch of filters to a virtual interface.  This is equivalent to
+** calling ef_vi_filter_add() for each filter, but takes far fewer calls
+** into the driver when adding many filters.
+**
+** If any filter cannot be added then none are: the ones already added are
+** removed again.  The failing filter's entry in \p rcs_out is set to its
+** error, and the rest to -ECANCELED.
+*/
+extern int ef_vi_filter_add_batch(ef_vi* vi, ef_driver_handle vi_dh,
+                                  const ef_filter_spec* filter_specs, int n,
+                                  ef_filter_cookie* filter_cookies_out,
+                                  int* rcs_out);
+
+
+/*! \brief Delete many filters from a virtual interface
+**
+** \param vi             The virtual interface from which to delete the
+**                       filters.
+** \param vi_dh          The ef_driver_handle for the virtual interface.
+** \param filter_cookies Array of \p n cookies, as set on return from
+**                       ef_vi_filter_add() or ef_vi_filter_add_batch().
+** \param n              Number of filters.
+** \param rcs_out        Array of \p n results, set on return to the result
+**                       for each filter.
+**
+** \return 0 on success, or the first negative error code in \p rcs_out.
+**
+** Delete a batch of filters from a virtual interface.  Unlike
+** ef_vi_filter_add_batch(), a failure to delete one filter does not stop
+** the others from being deleted.
+*/
+extern int ef_vi_filter_del_batch(ef_vi* vi, ef_driver_handle vi_dh,
+                                  ef_filter_cookie* filter_cookies, int n,
+                                  int* rcs_out);
+
+
 /*! \brief Values for the ef_filter_info::valid_fields bitmask */
 enum ef_filter_info_fields {
   /*! The ef_filter_info::filter_id field has a valid value */
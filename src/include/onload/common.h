@@ -152,6 +152,17 @@ typedef struct {
   ci_ifid_t         ifindex;
 } oo_tcp_filter_mcast_t;
 
+/* Maximum number of groups in one OO_IOC_EP_FILTER_MCAST_ADD_BULK. */
+#define OO_MCAST_BULK_MAX  1024
+
+typedef struct {
+  ci_user_ptr_t     addrs;    /* ci_uint32[n_addrs], network order */
+  oo_sp             tcp_id;
+  ci_ifid_t         ifindex;
+  ci_int32          n_addrs;  /* in: entries in [addrs]; out: groups added */
+  ci_int32          rc;       /* out: result of the first failed add */
+} oo_tcp_filter_mcast_bulk_t;
+
 typedef struct {
   ci_user_ptr_t buf;
   ci_int32      buf_len;
@@ -433,6 +444,8 @@ struct oo_ulh_waiter {
   ci_uint32 flags CI_ALIGN(8);
   /* Stack is already locked, the helper should release the stack lock */
 #define OO_ULH_WAIT_FLAG_LOCKED 1
+  /* In: do not sleep, just report the pending work (shared helper) */
+#define OO_ULH_WAIT_FLAG_NONBLOCK 0x80000000
 
   ci_uint32 timeout_ms;     /* in */
   ci_uint32 rs_ref_count;   /* out */
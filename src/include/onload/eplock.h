@@ -41,13 +41,33 @@ __ef_eplock_lock_slow(ci_netif *, long tiemout, int maybe_wedged) CI_HF;
 #endif
 
 
+#ifndef __KERNEL__
+/* Internal!  Do not call. */
+extern void ef_eplock_holder_note(ci_eplock_t*) CI_HF;
+#endif
+
+
 #if defined(CI_HAVE_COMPARE_AND_SWAP)
 
+  /*! Record the caller as the holder of the lock it has just taken, if
+  ** EF_LOCK_WATCHDOG_USEC is in use.  Only user-level holders are
+  ** recorded.
+  */
+ci_inline void ef_eplock_holder_track(ci_eplock_t* l) {
+#ifndef __KERNEL__
+  if(CI_UNLIKELY( l->holder_track ))
+    ef_eplock_holder_note(l);
+#endif
+}
+
   /*! Attempt to lock an eplock.  Returns true on success. */
 ci_inline int ef_eplock_trylock(ci_eplock_t* l) {
   ci_uint64 v = l->lock;
-  return !(v & CI_EPLOCK_LOCKED) &&
-    ci_cas64u_succeed(&l->lock, v, v | CI_EPLOCK_LOCKED);
+  if( (v & CI_EPLOCK_LOCKED) ||
+      ! ci_cas64u_succeed(&l->lock, v, v | CI_EPLOCK_LOCKED) )
+    return 0;
+  ef_eplock_holder_track(l);
+  return 1;
 }
 
   /* Always returns 0 (success) at userland.  Returns -EINTR if interrupted
@@ -62,6 +82,7 @@ ci_inline int ef_eplock_lock(ci_netif *ni) {
 #ifdef __KERNEL__
   return rc;
 #else
+  ef_eplock_holder_track(&ni->state->lock);
   /* Ensure the compiler knows we're returning zero, so it can optimise out
    * any code conditional on the return value.
    */
@@ -709,6 +709,67 @@ onload_socket_nonaccel(int domain, int type, int protocol);
 extern int
 onload_socket_unicast_nonaccel(int domain, int type, int protocol);
 
+
+/**********************************************************************
+ * onload_mcast_join_bulk: join many multicast groups in one call
+ *
+ * Equivalent to calling setsockopt(IP_ADD_MEMBERSHIP) on [fd] for each
+ * entry in [groups] in turn, stopping at the first failure.  For
+ * accelerated sockets the filters for groups on the same interface are
+ * installed together, which is much cheaper than joining one at a time
+ * when a socket subscribes to thousands of groups.
+ *
+ * Returns the number of groups joined.  If this is less than [n_groups],
+ * errno gives the reason that the next group could not be joined.
+ * Returns -1 with errno set if the first group could not be joined.
+ * Falls back to setsockopt() if the onload extensions library is not in
+ * use.
+ */
+extern int
+onload_mcast_join_bulk(int fd, const struct ip_mreqn* groups, int n_groups);
+
+
+/**********************************************************************
+ * onload_checkpoint, onload_restore: move connections to a new process
+ *
+ * onload_checkpoint() freezes the sockets [fds] and writes their state to
+ * [out_fd]: addresses, the common socket options and, for TCP, sequence
+ * numbers, negotiated options, RTT estimates and all data that is either
+ * unacknowledged by the peer or not yet read by the application.  All of
+ * the sockets must be in the same stack.  TCP sockets must be established
+ * connections; UDP sockets are described by their addresses only.
+ *
+ * A frozen TCP connection neither sends nor receives, but its filters stay
+ * in place so that the peer's segments are dropped (and retransmitted)
+ * rather than reset by the kernel.  The caller must keep the frozen
+ * sockets open until onload_restore() has completed, and should then
+ * close them; closing a frozen socket does not notify the peer.
+ *
+ * onload_restore() reads a checkpoint from [in_fd] in another process on
+ * the same host, creates a socket for each entry and stores them in
+ * [fds], which has room for [max_fds].  Each TCP connection is taken over
+ * from the checkpointed stack and carries on from where it was frozen.
+ * UDP sockets are bound and connected again, so a UDP socket's original
+ * must already be closed unless it has SO_REUSEADDR set.  With
+ * ONLOAD_RESTORE_SAME_FD, each socket is given the fd number that it had
+ * in the checkpointing process, replacing whatever is there.
+ *
+ * onload_checkpoint() returns 0 on success, or -1 with errno set, in which
+ * case no socket is left frozen.  onload_restore() returns the number of
+ * sockets restored.  If this is less than the number in the checkpoint,
+ * errno gives the reason; -1 is returned if none could be restored.
+ * Restoring stops at the first socket that fails, and the TCP connections
+ * from there on are thawed, so that they carry on in the checkpointing
+ * process.
+ */
+#define ONLOAD_RESTORE_SAME_FD  0x1
+
+extern int
+onload_checkpoint(int out_fd, const int* fds, int n_fds);
+
+extern int
+onload_restore(int in_fd, int* fds, int max_fds, unsigned flags);
+
 #endif /* ONLOAD_INCLUDE_DS_DATA_ONLY */
 
 #ifdef __cplusplus
@@ -57,6 +57,54 @@ enum onload_timestamping_flags {
 
 extern int onload_timestamping_request(int fd, unsigned flags);
 
+
+/**********************************************************************
+ * onload_tx_timestamp_read: read transmit timestamps without the error queue
+ *
+ * When EF_TX_TIMESTAMP_RING is set, the hardware timestamps of packets sent
+ * with SOF_TIMESTAMPING_TX_HARDWARE on any socket in a stack are written to
+ * a ring in the stack's shared memory as the transmits complete, instead of
+ * being queued to each socket's error queue.  This reads up to [max] of them
+ * into [recs] without entering the kernel.  [fd] may be any accelerated
+ * socket in the stack.  Records from all sockets in the stack are returned
+ * in the order in which the transmits completed, and the [endpoint_id]
+ * field identifies the socket in the same way as onload_fd_stat().  If the
+ * ring was full when a transmit completed then its record is dropped, and
+ * the total number dropped by the stack is stored in [*dropped] if it is not
+ * NULL.  It is safe to call this from several threads at once.
+ *
+ * [key] is the value that SOF_TIMESTAMPING_OPT_ID reports for the packet
+ * if the socket has enabled it, and zero otherwise.  [len] is the length of
+ * the packet's TCP or UDP payload.  If the hardware did not provide a
+ * timestamp then [stamp.sec] is zero.
+ *
+ * Returns the number of records read, or a negative error code on failure.
+ *   -EINVAL     max is negative
+ *   -ENOTTY     fd does not refer to an onload-accelerated socket
+ *   -ENOENT     the stack has no timestamp ring (EF_TX_TIMESTAMP_RING is 0)
+ *   -EOPNOTSUPP this build of onload does not support timestamping
+ */
+
+struct onload_tx_timestamp {
+  struct onload_timestamp stamp;
+  uint32_t endpoint_id;
+  uint32_t key;
+  uint32_t len;
+  uint32_t flags;
+};
+
+/* Flags for onload_tx_timestamp */
+enum onload_tx_timestamp_flags {
+  /* The adapter clock was in sync with the system clock */
+  ONLOAD_TX_TIMESTAMP_IN_SYNC = 1 << 0,
+
+  /* The packet was a TCP retransmission */
+  ONLOAD_TX_TIMESTAMP_RETRANS = 1 << 1,
+};
+
+extern int onload_tx_timestamp_read(int fd, struct onload_tx_timestamp* recs,
+                                    int max, unsigned* dropped);
+
 #ifdef __cplusplus
 }
 #endif
@@ -112,6 +112,10 @@ extern int onload_zc_buffer_decref(int fd, onload_zc_handle buf);
  * The returned 'handle' value must be used in the onload_zc_iovec::buf field
  * when this registered region is to be used, and can be passed to
  * onload_zc_unregister_buffers() to unregister the buffers.
+ *
+ * If EF_ZC_REG_CACHE is set then a range covered by an earlier registration
+ * on the same stack may return that registration's handle rather than
+ * registering the memory again.
  */
 extern int onload_zc_register_buffers(int fd,
                                       ef_addrspace addr_space,
@@ -125,6 +129,11 @@ extern int onload_zc_register_buffers(int fd,
  * then this may cause an application crash or termination of the VI. The
  * onload_zc_await_stack_sync() function can help with this synchronisation.
  *
+ * If EF_ZC_REG_CACHE is set then the memory may remain registered (and
+ * locked) after this call, so that it can be reused by a later call to
+ * onload_zc_register_buffers().  Each successful registration must still be
+ * unregistered exactly once.
+ *
  * Returns zero on success, or <0 to indicate an error.
  */
 extern int onload_zc_unregister_buffers(int fd,
@@ -74,6 +74,9 @@ enum {
   OO_OP_EP_FILTER_MCAST_DEL,
 #define OO_IOC_EP_FILTER_MCAST_DEL  OO_IOC_W(EP_FILTER_MCAST_DEL, \
                                              oo_tcp_filter_mcast_t)
+  OO_OP_EP_FILTER_MCAST_ADD_BULK,
+#define OO_IOC_EP_FILTER_MCAST_ADD_BULK OO_IOC_RW(EP_FILTER_MCAST_ADD_BULK, \
+                                                  oo_tcp_filter_mcast_bulk_t)
   OO_OP_EP_FILTER_DUMP,
 #define OO_IOC_EP_FILTER_DUMP       OO_IOC_W(EP_FILTER_DUMP,            \
                                              oo_tcp_filter_dump_t)
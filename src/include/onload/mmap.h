@@ -22,7 +22,7 @@
  * - CI_NETIF_MMAP_ID_CTPIO     VI resource: CTPIO IO BAR
  * - CI_NETIF_MMAP_ID_PLUGIN    VI resource: EF100 plugin-specific BAR
  * - CI_NETIF_MMAP_ID_EFCT_SHM  VI resource: EFCT rxq shared state
- * - CI_NETIF_MMAP_ID_PKTS + packet set id
+ * - CI_NETIF_MMAP_ID_PKTSET(packet set id)
  *   packet sets
  */
 #define CI_NETIF_MMAP_ID_STATE    0
@@ -33,8 +33,25 @@
 #define CI_NETIF_MMAP_ID_CTPIO    5
 #define CI_NETIF_MMAP_ID_PLUGIN   6
 #define CI_NETIF_MMAP_ID_EFCT_SHM 7
-#define CI_NETIF_MMAP_ID_PKTS     8
-#define CI_NETIF_MMAP_ID_PKTSET(id) (CI_NETIF_MMAP_ID_PKTS+(id))
+
+/* Packet sets are mapped above everything else, one set per stride, so
+ * that their mappings overlap neither each other nor the shared state.
+ * This lets the kernel revoke the user mapping of a single set when it
+ * returns the set to the system.
+ */
+#define CI_NETIF_MMAP_ID_PKTS     (1ull << 32)
+#define CI_NETIF_MMAP_PKTSET_BYTES \
+  ((ci_uint64) CI_CFG_PKT_BUF_SIZE << CI_CFG_PKTS_PER_SET_S)
+#define CI_NETIF_MMAP_PKTSET_STRIDE \
+  ((CI_NETIF_MMAP_PKTSET_BYTES >> OO_MMAP_ID_SHIFT) ? \
+   (CI_NETIF_MMAP_PKTSET_BYTES >> OO_MMAP_ID_SHIFT) : 1)
+#define CI_NETIF_MMAP_ID_PKTSET(id) \
+  (CI_NETIF_MMAP_ID_PKTS + (ci_uint64) (id) * CI_NETIF_MMAP_PKTSET_STRIDE)
+#define CI_NETIF_MMAP_ID_IS_PKTSET(map_id) \
+  ((map_id) >= CI_NETIF_MMAP_ID_PKTS && \
+   ((map_id) - CI_NETIF_MMAP_ID_PKTS) % CI_NETIF_MMAP_PKTSET_STRIDE == 0)
+#define CI_NETIF_MMAP_ID_TO_PKTSET(map_id) \
+  (((map_id) - CI_NETIF_MMAP_ID_PKTS) / CI_NETIF_MMAP_PKTSET_STRIDE)
 
 
 /* OO_MMAP_TYPE_DSHM:
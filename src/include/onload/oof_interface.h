@@ -133,6 +133,15 @@ extern int
 oof_socket_mcast_add(struct oof_manager*, struct oof_socket*,
                      unsigned maddr, int ifindex);
 
+/* Join [n_maddrs] groups on [ifindex] under a single acquisition of the
+ * filter locks.  Stops at the first failure; [n_added_out] (if not NULL)
+ * returns the number of groups that were added.
+ */
+extern int
+oof_socket_mcast_add_bulk(struct oof_manager*, struct oof_socket*,
+                          const unsigned* maddrs, int n_maddrs, int ifindex,
+                          int* n_added_out);
+
 extern void
 oof_socket_mcast_del(struct oof_manager*, struct oof_socket*,
                      unsigned maddr, int ifindex);
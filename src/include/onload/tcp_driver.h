@@ -54,12 +54,31 @@ typedef struct {
  *---------------------------------------------------------------------------*/
 
 
+/* How long stack destruction takes, in microseconds from the start of
+ * tcp_helper_dtor().  [ports] is when the filters and OS sockets are gone,
+ * so that another stack can bind the same ports; [hw] is the time taken to
+ * flush and free the VIs and packet buffers.  Protected by THR_TABLE.lock.
+ */
+struct oo_stack_destroy_stats {
+  ci_uint32 n_destroyed;
+  ci_uint32 ports_us_last;
+  ci_uint32 ports_us_max;
+  ci_uint32 hw_us_last;
+  ci_uint32 hw_us_max;
+  ci_uint32 total_us_last;
+  ci_uint32 total_us_max;
+};
+
+
 struct oo_filter_ns_manager;
 typedef struct efab_tcp_driver_s {
 
   /*! TCP helpers table */
   tcp_helpers_table_t     thr_table;
 
+  /*! Stack destruction timings */
+  struct oo_stack_destroy_stats stack_destroy;
+
   /* ID field in the IP header handling */
   efab_ipid_cb_t          ipid;         /* see ipid.h in this dir. */
 
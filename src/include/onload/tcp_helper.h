@@ -21,6 +21,9 @@
 #include <onload/oof_hw_filter.h>
 #include <onload/oof_socket.h>
 #include <onload/tcp_helper_ref.h>
+#ifdef EFRM_HAVE_MMU_INTERVAL_NOTIFIER
+#include <linux/mmu_notifier.h>
+#endif
 
 
 /* Forwards. */
@@ -158,6 +161,13 @@ struct oo_iobufs_usermem_group {
 struct oo_iobufs_usermem {
   int n_groups;
   struct oo_iobufs_usermem_group* groups;
+#ifdef EFRM_HAVE_MMU_INTERVAL_NOTIFIER
+  /* Watches for the memory being unmapped, so that user-level can stop
+   * reusing the registration (EF_ZC_REG_CACHE). */
+  struct mmu_interval_notifier notifier;
+  struct tcp_helper_resource_s* trs;
+  bool notifier_active;
+#endif
 };
 
 
@@ -215,8 +225,23 @@ typedef struct tcp_helper_resource_s {
   /*! Link for global list of stacks. */
   ci_dllink              all_stacks_link;
 
-  /* VI descruction completion helper. */
+  /* VI descruction completion helper: completed when the last of
+   * [vi_flushes_pending] flushes finishes. */
   struct completion complete;
+  atomic_t          vi_flushes_pending;
+
+  /* Address space shared by all files that can map this stack, so that
+   * the user mappings of a packet set can be revoked when the set is
+   * returned to the system.  NULL when EF_PKT_SHRINK_IDLE is not in use. */
+  struct inode*          mapping_inode;
+  /* One more than the highest packet set id ever returned to the system.
+   * User-level may still have the old mappings of these ids, which can only
+   * be refaulted from small pages. */
+  unsigned               pkt_sets_retired_hwm;
+  /* Trusted copy of ni->packets->sets_hot. */
+  unsigned               pkt_sets_hot;
+  /* Trusted copy of ni->packets->set[].dma_addr_base. */
+  ci_uint32*             pkt_set_dma_base;
 
 #if ! CI_CFG_UL_INTERRUPT_HELPER
   /* For pinning periodic work */
@@ -265,6 +290,12 @@ typedef struct tcp_helper_resource_s {
   atomic_t                 timer_running;
   /*! timer - periodic poll */
   struct delayed_work      timer;
+  /*! idle packet-set reclaim: when packet usage was last seen above
+   * EF_PKT_SHRINK_THRESHOLD, and when the timer last looked at it */
+  unsigned long            pkt_shrink_since;
+  unsigned long            pkt_shrink_checked;
+  /*! start of the last lock hold reported by EF_LOCK_WATCHDOG_USEC */
+  ci_uint64                lock_watchdog_reported;
 #endif
 
   /*! tcp_helper endpoint(s) to be closed at next calling of
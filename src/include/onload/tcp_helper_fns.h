@@ -455,6 +455,7 @@ extern int onloadfs_get_dev_t(ci_private_t* priv, void* arg);
 extern int onload_alloc_file(tcp_helper_resource_t *thr, oo_sp ep_id,
                              int flags, oo_fd_flags fd_flags,
                              ci_private_t **priv_p);
+extern struct inode* onload_alloc_mapping_inode(void);
 
 extern int oo_clone_fd(struct file* filp, int do_cloexec);
 
@@ -623,6 +624,8 @@ tcp_helper_free_ephemeral_ports(struct efab_ephemeral_port_head* table,
 int oo_wait_for_interrupt(ci_private_t* priv, void* arg);
 int oo_get_closing_ep(ci_private_t* priv, void* arg);
 int oo_wakeup_waiters(ci_private_t* priv, void* arg);
+unsigned oo_ulh_fop_poll(tcp_helper_resource_t* trs, struct file* file,
+                         poll_table* wait);
 #endif
 
 static inline void
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_HEADER >
+**  \brief  File format for onload_checkpoint() and onload_restore()
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+#ifndef __ONLOAD_UL_CHECKPOINT_H__
+#define __ONLOAD_UL_CHECKPOINT_H__
+
+/* A checkpoint file is an oo_checkpoint_hdr followed by [n_socks]
+ * records.  Each record is an oo_checkpoint_sock followed by [n_opts]
+ * oo_checkpoint_opt, then [snd_len] bytes of send data (everything not
+ * yet acknowledged by the peer, starting at [snd_una]) and then [rcv_len]
+ * bytes of receive data (everything acknowledged but not yet read by the
+ * application, ending at [rcv_nxt]).
+ *
+ * The file is only meaningful on the host that wrote it: it refers to the
+ * checkpointed stack by id, and TCP timestamps and timer values are in
+ * units derived from the host's cycle counter.
+ */
+
+#define OO_CHECKPOINT_MAGIC    0x4f4f434bu   /* "OOCK" */
+#define OO_CHECKPOINT_VERSION  1
+
+struct oo_checkpoint_hdr {
+  ci_uint32 magic;
+  ci_uint32 version;
+  ci_uint32 stack_id;
+  ci_uint32 n_socks;
+};
+
+
+/* A socket option as seen by getsockopt(). */
+struct oo_checkpoint_opt {
+  ci_int32  level;
+  ci_int32  name;
+  ci_uint32 len;
+  ci_uint8  val[16];
+};
+
+
+struct oo_checkpoint_sock {
+  ci_int32  fd;             /* fd in the checkpointing process */
+  ci_uint32 sock_id;        /* endpoint in the checkpointed stack */
+  ci_int32  domain;
+  ci_int32  type;
+  ci_uint32 state;          /* CI_TCP_ESTABLISHED or CI_TCP_STATE_UDP */
+  ci_uint32 n_opts;
+  ci_addr_t laddr;
+  ci_addr_t raddr;
+  ci_uint16 lport_be16;
+  ci_uint16 rport_be16;
+  ci_uint32 s_flags;        /* CI_SOCK_FLAG_* */
+
+  /* TCP only */
+  ci_uint32 tcpflags;       /* negotiated options, CI_TCPT_NEG_FLAGS */
+  ci_uint32 snd_una;
+  ci_uint32 snd_max;
+  ci_uint32 rcv_nxt;
+  ci_uint32 rcv_wnd_right_edge_sent;
+  ci_uint32 tsrecent;
+  ci_uint32 ssthresh;
+  ci_uint32 sa;
+  ci_uint32 sv;
+  ci_uint32 rto;
+  ci_uint16 smss;
+  ci_uint16 user_mss;
+  ci_uint8  snd_wscl;
+  ci_uint8  rcv_wscl;
+  ci_uint8  pad[2];
+
+  ci_uint32 snd_len;
+  ci_uint32 rcv_len;
+};
+
+#endif  /* __ONLOAD_UL_CHECKPOINT_H__ */
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_HEADER >
+**  \brief  Protocol between stacks and the shared onload_helper
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+#ifndef __ONLOAD_UL_HELPER_H__
+#define __ONLOAD_UL_HELPER_H__
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The shared helper ("onload_helper -m") listens on an abstract AF_UNIX
+ * SOCK_SEQPACKET socket, one name per user.  A process that creates a
+ * stack connects, sends the stack id as a ci_int32, and gets back a
+ * ci_int32: zero if the helper has taken the stack on, or a negative
+ * error code.
+ *
+ * Abstract names have no owner or permissions, so any local user can bind
+ * another user's name first.  Both ends therefore check with SO_PEERCRED
+ * that the other runs as the same effective uid, and refuse otherwise: the
+ * helper with -EPERM, and the stack by starting a dedicated helper.
+ */
+#define OO_ULH_SHARED_NAME  "onload_helper"
+
+static inline socklen_t
+oo_ulh_shared_addr(struct sockaddr_un* sun, unsigned uid)
+{
+  int len;
+
+  memset(sun, 0, sizeof(*sun));
+  sun->sun_family = AF_UNIX;
+  /* Leading NUL: abstract namespace. */
+  len = snprintf(sun->sun_path + 1, sizeof(sun->sun_path) - 1,
+                 OO_ULH_SHARED_NAME ":%u", uid);
+  return offsetof(struct sockaddr_un, sun_path) + 1 + len;
+}
+
+#endif  /* __ONLOAD_UL_HELPER_H__ */
@@ -48,6 +48,11 @@ struct oo_per_thread {
   unsigned                   spinstate; 
   int                        in_vfork_child;
   void*                      vfork_scratch[OO_VFORK_SCRATCH_SIZE];
+  /* fdtable entries this thread has marked busy, less those it has
+   * cleared, and its link in the list of such threads.  See
+   * citp_fdtable_busy_inc(). */
+  int                        fdt_n_busy;
+  ci_dllink                  fdt_busy_link;
 };
 
 
@@ -176,6 +176,28 @@ ci_tcp_helper_ep_mcast_add_del(ci_fd_t           fd,
                                ci_ifid_t         ifindex,
                                int               add);
 
+/*--------------------------------------------------------------------
+ *!
+ * Adds several multicast addresses on one interface to socket list.
+ *
+ * \param fd              File descriptor of tcp_helper
+ * \param ep              TCP control block id
+ * \param mcast_addrs     Multicast addresses to add to the socket list
+ * \param n_addrs         Number of entries in mcast_addrs
+ * \param ifindex         Interface to join on
+ * \param n_added_out     Number of addresses added
+ *
+ * \return                standard error codes
+ *
+ *--------------------------------------------------------------------*/
+extern int
+ci_tcp_helper_ep_mcast_add_bulk(ci_fd_t           fd,
+                                oo_sp             ep,
+                                const ci_uint32*  mcast_addrs,
+                                int               n_addrs,
+                                ci_ifid_t         ifindex,
+                                int*              n_added_out);
+
 /*--------------------------------------------------------------------
  *!
  * Setup event triggering mechanism
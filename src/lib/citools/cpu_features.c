@@ -48,7 +48,7 @@ get_cpuid(int op, int *eax, int *ebx, int *ecx, int *edx)
   /* NB. We have to save [ebx] when building position indepent code. */
   __asm__ __volatile__ ("pushl %%ebx; cpuid; mov %%ebx, %0; popl %%ebx"
 			: "=r" (*ebx), "=a" (*eax), "=c" (*ecx), "=d" (*edx)
-			: "a" (op));
+			: "a" (op), "2" (0));
 }
 #endif
 
@@ -149,7 +149,7 @@ get_cpuid(int op, int *eax, int *ebx, int *ecx, int *edx)
 {
   __asm__ __volatile__ ("cpuid\n\t"
                         : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
-                        : "a" (op));
+                        : "a" (op), "2" (0));
 }
 
 #else
@@ -177,6 +177,29 @@ int ci_cpu_has_feature(char* feature)
 
   if( ! strcmp(feature, "pclmul") )
     return ecx & 0x00000002;
+
+  /* Leaf 7 sub-leaf 0 = structured extended feature bits.  get_cpuid()
+   * passes sub-leaf 0. */
+  if( ! strcmp(feature, "waitpkg") ) {
+    get_cpuid(0, &eax, &ebx, &ecx, &edx);
+    if( eax < 7 )
+      return 0;
+    get_cpuid(7, &eax, &ebx, &ecx, &edx);
+    return ecx & 0x00000020;
+  }
+
+  /* Leaf 0x80000001 = AMD extended feature bits */
+  if( ! strcmp(feature, "mwaitx") ) {
+    get_cpuid((int) 0x80000000, &eax, &ebx, &ecx, &edx);
+    if( (unsigned) eax < 0x80000001 )
+      return 0;
+    get_cpuid((int) 0x80000001, &eax, &ebx, &ecx, &edx);
+    return ecx & 0x20000000;
+  }
+#elif defined(__aarch64__)
+  /* WFE is part of the base architecture. */
+  if( ! strcmp(feature, "wfe") )
+    return 1;
 #endif
 
   /* Not supported on platforms that don't implement the CPUID instruction */
@@ -70,6 +70,16 @@ ci_filter_add(int fp, ci_filter_add_t* filter_add)
 }
 
 
+/*! \i_efab_unix */
+ci_inline int
+ci_filter_batch(int fp, ci_filter_batch_t* batch)
+{
+  int r;
+  if( (r = ioctl(fp, CI_FILTER_BATCH, batch)) < 0 )  return -errno;
+  return r;
+}
+
+
 /*! \i_efab_unix */
 ci_inline int
 ci_resource_prime(int fp, struct ci_resource_prime_op_s* io)
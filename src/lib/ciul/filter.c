@@ -356,13 +356,14 @@ static int ef_filter_add_special(ef_driver_handle dh, int resource_id,
   return rc;
 }
 
-static int ef_filter_add_normal(ef_driver_handle dh, int resource_id,
-                                int rxq_no, const ef_filter_spec *fs,
-                                unsigned flags,
-                                ef_filter_cookie *filter_cookie_out, int *rxq_out)
+/* Fill in the driver's request to add the filter [fs].  Returns -EINVAL if
+ * [fs] is not a valid combination of match types.
+ */
+static int ef_filter_add_prepare(int resource_id, int rxq_no,
+                                 const ef_filter_spec *fs, unsigned flags,
+                                 ci_filter_add_t *filter_add_out)
 {
   ci_filter_add_t filter_add;
-  int rc;
 
   memset(&filter_add, 0, sizeof(filter_add));
   filter_add.in.in_len = sizeof(filter_add.in);
@@ -460,6 +461,22 @@ static int ef_filter_add_normal(ef_driver_handle dh, int resource_id,
     filter_add.in.rxq_no = rxq_no;
   }
 
+  *filter_add_out = filter_add;
+  return 0;
+}
+
+static int ef_filter_add_normal(ef_driver_handle dh, int resource_id,
+                                int rxq_no, const ef_filter_spec *fs,
+                                unsigned flags,
+                                ef_filter_cookie *filter_cookie_out, int *rxq_out)
+{
+  ci_filter_add_t filter_add;
+  int rc;
+
+  rc = ef_filter_add_prepare(resource_id, rxq_no, fs, flags, &filter_add);
+  if( rc < 0 )
+    return rc;
+
   rc = ci_filter_add(dh, &filter_add);
   *rxq_out = filter_add.out.rxq;
 
@@ -471,11 +488,10 @@ static int ef_filter_add_normal(ef_driver_handle dh, int resource_id,
 }
 
 
-static int ef_filter_add(ef_driver_handle dh, int resource_id, int rxq_no,
-                         const ef_filter_spec *fs, unsigned flags,
-                         ef_filter_cookie *filter_cookie_out, int *rxq_out)
+/* Special filters are added with resource ops of their own. */
+static bool ef_filter_is_special(unsigned type)
 {
-    switch( fs->type ) {
+    switch( type ) {
     case EF_FILTER_PORT_SNIFF:
     case EF_FILTER_TX_PORT_SNIFF:
     case EF_FILTER_BLOCK_KERNEL:
@@ -487,13 +503,23 @@ static int ef_filter_add(ef_driver_handle dh, int resource_id, int rxq_no,
     case EF_FILTER_MISMATCH_UNICAST:
     case EF_FILTER_MISMATCH_MULTICAST | EF_FILTER_VLAN:
     case EF_FILTER_MISMATCH_MULTICAST:
+      return true;
+    default:
+      return false;
+    }
+}
+
+static int ef_filter_add(ef_driver_handle dh, int resource_id, int rxq_no,
+                         const ef_filter_spec *fs, unsigned flags,
+                         ef_filter_cookie *filter_cookie_out, int *rxq_out)
+{
+    if( ef_filter_is_special(fs->type) )
       return ef_filter_add_special(dh, resource_id, rxq_no, flags, fs->type,
                                    get_proto(fs), fs->data[5],
                                    filter_cookie_out, rxq_out);
-    default:
+    else
       return ef_filter_add_normal(dh, resource_id, rxq_no, fs, flags,
                                   filter_cookie_out, rxq_out);
-    }
 }
 
 
@@ -520,17 +546,12 @@ static int ef_filter_del(ef_driver_handle dh, int resource_id,
   return ci_resource_op(dh, &op);
 }
 
-int ef_vi_filter_add(ef_vi *vi, ef_driver_handle dh, const ef_filter_spec *fs,
-		     ef_filter_cookie *filter_cookie_out)
+static unsigned ef_vi_filter_flags(ef_vi *vi, const ef_filter_spec *fs,
+                                   int *rxq_no_out)
 {
-  if( ! vi->vi_clustered ) {
-    int rc;
-    int rxq;
-    ef_filter_cookie cookie;
     unsigned flags = 0;
-    int rxq_no = 0;
-
 
+    *rxq_no_out = 0;
     if( vi->efct_shm ) {
 
       /* The main intention for this is to reuse an rxq already given to the application if already given.
@@ -540,7 +561,7 @@ int ef_vi_filter_add(ef_vi *vi, ef_driver_handle dh, const ef_filter_spec *fs,
        */
       if( vi->efct_shm->q[0].superbuf_pkts ) {
         flags |= CI_FILTER_FLAG_PREF_RXQ;
-        rxq_no = vi->efct_shm->q[0].qid;
+        *rxq_no_out = vi->efct_shm->q[0].qid;
       }
       
       /* If there is no preferred queue strategy, any should be fine so best hence let the driver choose. */
@@ -550,6 +571,18 @@ int ef_vi_filter_add(ef_vi *vi, ef_driver_handle dh, const ef_filter_spec *fs,
 
     if ( fs->flags & EF_FILTER_FLAG_EXCLUSIVE_RXQ )
       flags |= CI_FILTER_FLAG_EXCLUSIVE_RXQ;
+    return flags;
+}
+
+int ef_vi_filter_add(ef_vi *vi, ef_driver_handle dh, const ef_filter_spec *fs,
+		     ef_filter_cookie *filter_cookie_out)
+{
+  if( ! vi->vi_clustered ) {
+    int rc;
+    int rxq;
+    ef_filter_cookie cookie;
+    int rxq_no;
+    unsigned flags = ef_vi_filter_flags(vi, fs, &rxq_no);
 
     rc = ef_filter_add(dh, vi->vi_resource_id, rxq_no, fs, flags, &cookie, &rxq);
     if( rc < 0 )
@@ -579,6 +612,210 @@ int ef_vi_filter_del(ef_vi *vi, ef_driver_handle dh,
 }
 
 
+/**********************************************************************
+ * Add and remove filters in bulk.
+ */
+
+/* Fallback for drivers without CI_FILTER_BATCH, and for filters that need
+ * more than the driver's filter_add: add them one at a time.
+ */
+static int ef_vi_filter_add_each(ef_vi *vi, ef_driver_handle dh,
+                                 const ef_filter_spec *fs, int n,
+                                 ef_filter_cookie *cookies, int *rcs)
+{
+  int i, j, rc = 0;
+
+  for( i = 0; i < n; ++i ) {
+    rcs[i] = rc = ef_vi_filter_add(vi, dh, &fs[i], &cookies[i]);
+    if( rc < 0 )
+      break;
+  }
+  if( rc < 0 )
+    for( j = 0; j < n; ++j ) {
+      if( j < i )
+        ef_vi_filter_del(vi, dh, &cookies[j]);
+      if( j != i )
+        rcs[j] = -ECANCELED;
+    }
+  return rc;
+}
+
+
+static int ef_filter_batch_op(ef_driver_handle dh, int op,
+                              ci_filter_batch_entry_t *e, int n)
+{
+  ci_filter_batch_t batch;
+  int i, rc;
+
+  memset(&batch, 0, sizeof(batch));
+  batch.in_len = sizeof(batch);
+  batch.op = op;
+  batch.n = n;
+  batch.entries = (uintptr_t) e;
+  rc = ci_filter_batch(dh, &batch);
+  if( rc < 0 ) {
+    /* The driver sets every entry's rc if it gets as far as trying them,
+     * so failures before that show up as entries that all succeeded.  So
+     * does a failure to copy back the results, after which the driver
+     * removes any filters that it added. */
+    for( i = 0; i < n; ++i )
+      if( e[i].rc != 0 )
+        return rc;
+    for( i = 0; i < n; ++i )
+      e[i].rc = rc;
+  }
+  return rc;
+}
+
+
+/* Returns -ENOTTY, having done nothing, if the driver can't do batches. */
+static int ef_vi_filter_add_batched(ef_vi *vi, ef_driver_handle dh,
+                                    const ef_filter_spec *fs, int n,
+                                    ef_filter_cookie *cookies, int *rcs)
+{
+  ci_filter_batch_entry_t *e;
+  int i, rc = 0, done, chunk, rxq_no;
+  unsigned flags;
+
+  e = calloc(CI_MIN(n, CI_FILTER_BATCH_MAX), sizeof(*e));
+  if( e == NULL )
+    return -ENOMEM;
+
+  for( done = 0; done < n; done += chunk ) {
+    chunk = CI_MIN(n - done, CI_FILTER_BATCH_MAX);
+    memset(e, 0, chunk * sizeof(*e));
+    for( i = 0; i < chunk; ++i ) {
+      flags = ef_vi_filter_flags(vi, &fs[done + i], &rxq_no);
+      ef_filter_add_prepare(vi->vi_resource_id, rxq_no, &fs[done + i], flags,
+                            &e[i].add);
+    }
+    rc = ef_filter_batch_op(dh, CI_FILTER_BATCH_ADD, e, chunk);
+    if( rc == -ENOTTY && done == 0 && e[0].rc == -ENOTTY )
+      break;
+    for( i = 0; i < chunk; ++i ) {
+      rcs[done + i] = e[i].rc;
+      if( e[i].rc == 0 ) {
+        cookies[done + i].filter_id = e[i].filter_id;
+        cookies[done + i].filter_type = fs[done + i].type;
+      }
+    }
+    if( rc < 0 ) {
+      /* The driver has undone this chunk; undo the ones before it. */
+      if( done > 0 ) {
+        ef_vi_filter_del_batch(vi, dh, cookies, done, rcs);
+        for( i = 0; i < done; ++i )
+          rcs[i] = -ECANCELED;
+      }
+      for( i = done + chunk; i < n; ++i )
+        rcs[i] = -ECANCELED;
+      break;
+    }
+  }
+  free(e);
+  return rc;
+}
+
+
+int ef_vi_filter_add_batch(ef_vi *vi, ef_driver_handle dh,
+                           const ef_filter_spec *fs, int n,
+                           ef_filter_cookie *cookies_out, int *rcs_out)
+{
+  ci_filter_add_t filter_add;
+  int i, j, rc, rxq_no, batched = 1;
+
+  if( n < 0 )
+    return -EINVAL;
+  if( vi->vi_clustered ) {
+    ef_log("%s: WARNING: Ignored attempt to set filters on a cluster",
+           __FUNCTION__);
+    for( i = 0; i < n; ++i )
+      rcs_out[i] = 0;
+    return 0;
+  }
+
+  /* Reject bad specs before touching the hardware. */
+  for( i = 0; i < n; ++i ) {
+    if( ef_filter_is_special(fs[i].type) ) {
+      batched = 0;
+      continue;
+    }
+    rc = ef_filter_add_prepare(vi->vi_resource_id, 0, &fs[i],
+                               ef_vi_filter_flags(vi, &fs[i], &rxq_no),
+                               &filter_add);
+    if( rc < 0 ) {
+      for( j = 0; j < n; ++j )
+        rcs_out[j] = j == i ? rc : -ECANCELED;
+      return rc;
+    }
+  }
+
+  if( batched && ! vi->internal_ops.post_filter_add ) {
+    rc = ef_vi_filter_add_batched(vi, dh, fs, n, cookies_out, rcs_out);
+    if( rc != -ENOTTY )
+      return rc;
+  }
+  return ef_vi_filter_add_each(vi, dh, fs, n, cookies_out, rcs_out);
+}
+
+
+int ef_vi_filter_del_batch(ef_vi *vi, ef_driver_handle dh,
+                           ef_filter_cookie *cookies, int n, int *rcs_out)
+{
+  ci_filter_batch_entry_t *e;
+  int *idx;
+  int i, k, rc = 0, rc1, done, chunk;
+
+  if( n < 0 )
+    return -EINVAL;
+  if( vi->vi_clustered ) {
+    for( i = 0; i < n; ++i )
+      rcs_out[i] = 0;
+    return 0;
+  }
+
+  chunk = CI_MIN(n, CI_FILTER_BATCH_MAX);
+  e = calloc(chunk, sizeof(*e));
+  idx = calloc(chunk, sizeof(*idx));
+  if( e == NULL || idx == NULL ) {
+    free(e);
+    free(idx);
+    return -ENOMEM;
+  }
+
+  for( done = 0; done < n; done += chunk ) {
+    chunk = CI_MIN(n - done, CI_FILTER_BATCH_MAX);
+    for( i = k = 0; i < chunk; ++i ) {
+      ef_filter_cookie *c = &cookies[done + i];
+      /* Sniff filters have no ids, so they go one at a time. */
+      if( c->filter_type == EF_FILTER_PORT_SNIFF ||
+          c->filter_type == EF_FILTER_TX_PORT_SNIFF ) {
+        rcs_out[done + i] = ef_filter_del(dh, vi->vi_resource_id, c);
+        continue;
+      }
+      memset(&e[k], 0, sizeof(e[k]));
+      e[k].res_id = efch_make_resource_id(vi->vi_resource_id);
+      e[k].filter_id = c->filter_id;
+      idx[k++] = done + i;
+    }
+    if( k == 0 )
+      continue;
+    rc1 = ef_filter_batch_op(dh, CI_FILTER_BATCH_DEL, e, k);
+    for( i = 0; i < k; ++i ) {
+      if( rc1 == -ENOTTY && e[i].rc == -ENOTTY )
+        e[i].rc = ef_filter_del(dh, vi->vi_resource_id, &cookies[idx[i]]);
+      rcs_out[idx[i]] = e[i].rc;
+    }
+  }
+  free(e);
+  free(idx);
+
+  for( i = 0; i < n; ++i )
+    if( rcs_out[i] < 0 && rc == 0 )
+      rc = rcs_out[i];
+  return rc;
+}
+
+
 int ef_vi_filter_query(ef_vi* vi, ef_driver_handle vi_dh,
                        const ef_filter_cookie* filter_cookie,
                        ef_filter_info* filter_info, size_t filter_info_size)
@@ -45,6 +45,7 @@ LIB_SRCS	+=		\
 		vi_prime.c	\
 		capabilities.c	\
 		smartnic_exts.c	\
+		pktpool.c	\
 		ctpio.c
 
 # librt is needed on old glibc, e.g. on RHEL 6
@@ -0,0 +1,299 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  Packet buffer pools.
+**   \date  2024/06/03
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+#include <etherfabric/base.h>
+#include <etherfabric/pktpool.h>
+#include <etherfabric/pd.h>
+#include "ef_vi_internal.h"
+#include "logging.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+#define PKTPOOL_HUGE_PAGE_SIZE  (2u << 20)
+#define PKTPOOL_MPOL_PREFERRED  1
+#define PKTPOOL_MAX_NUMA_NODES  1024
+
+
+/* Free list.  A Treiber stack of buffer ids linked through pool->next[],
+ * with a generation count in the head to defeat ABA.  A stale read of
+ * next[] by a pop that then loses the race is harmless, because next[] is
+ * never freed while the pool exists.
+ */
+
+static uint64_t free_head_make(uint64_t old, int32_t id)
+{
+  return ((old >> 32) + 1) << 32 | (uint32_t) (id + 1);
+}
+
+
+static void free_list_push_chain(ef_pktpool* pool, int32_t first,
+                                 int32_t last)
+{
+  uint64_t old = __atomic_load_n(&pool->free_head, __ATOMIC_RELAXED);
+  do
+    pool->next[last] = (int32_t) (uint32_t) old - 1;
+  while( ! __atomic_compare_exchange_n(&pool->free_head, &old,
+                                       free_head_make(old, first), 1,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED) );
+}
+
+
+static int32_t free_list_pop(ef_pktpool* pool)
+{
+  uint64_t old = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+  int32_t id;
+  do {
+    id = (int32_t) (uint32_t) old - 1;
+    if( id < 0 )
+      return -1;
+  } while( ! __atomic_compare_exchange_n(&pool->free_head, &old,
+                                         free_head_make(old,
+                                           __atomic_load_n(&pool->next[id],
+                                                           __ATOMIC_RELAXED)),
+                                         1, __ATOMIC_ACQUIRE,
+                                         __ATOMIC_ACQUIRE) );
+  return id;
+}
+
+
+void ef_pktpool_attr_init(ef_pktpool_attr* attr, unsigned n_bufs)
+{
+  attr->n_bufs = n_bufs;
+  attr->buf_size = 2048;
+  attr->numa_node = -1;
+  attr->flags = 0;
+}
+
+
+static void pktpool_mem_bind(void* mem, size_t bytes, int numa_node)
+{
+  unsigned long nodemask[PKTPOOL_MAX_NUMA_NODES / (8 * sizeof(long))] = {};
+  const int bits = 8 * sizeof(long);
+
+  if( numa_node < 0 || numa_node >= PKTPOOL_MAX_NUMA_NODES )
+    return;
+  nodemask[numa_node / bits] = 1ul << (numa_node % bits);
+  /* A preference rather than a binding, so an exhausted node doesn't make
+   * the registration fail.  Must happen before the memory is touched. */
+  if( syscall(SYS_mbind, mem, bytes, PKTPOOL_MPOL_PREFERRED, nodemask,
+              PKTPOOL_MAX_NUMA_NODES, 0) < 0 )
+    LOGVV(ef_log("%s: mbind(node=%d) failed errno=%d", __FUNCTION__,
+                 numa_node, errno));
+}
+
+
+static int pktpool_mem_alloc(ef_pktpool* pool, const ef_pktpool_attr* attr)
+{
+  size_t bytes = (size_t) attr->n_bufs << pool->buf_shift;
+  void* mem;
+
+  bytes = EF_VI_ALIGN_FWD(bytes, (size_t) PKTPOOL_HUGE_PAGE_SIZE);
+  pool->mem_bytes = bytes;
+
+  if( ! (attr->flags & EF_PKTPOOL_FLAG_NO_HUGE_PAGES) ) {
+    mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+               MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+    if( mem != MAP_FAILED ) {
+      pool->huge_pages = 1;
+      pool->mem = mem;
+      pktpool_mem_bind(mem, bytes, attr->numa_node);
+      return 0;
+    }
+    if( attr->flags & EF_PKTPOOL_FLAG_HUGE_PAGES )
+      return -ENOMEM;
+  }
+
+  /* Huge page alignment gives the best chance of transparent huge pages. */
+  mem = mmap(NULL, bytes + PKTPOOL_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+             MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if( mem == MAP_FAILED )
+    return -errno;
+  pool->mem = (char*) EF_VI_ALIGN_FWD((uintptr_t) mem,
+                                      (uintptr_t) PKTPOOL_HUGE_PAGE_SIZE);
+  if( pool->mem != (char*) mem )
+    munmap(mem, pool->mem - (char*) mem);
+  munmap(pool->mem + bytes, (char*) mem + PKTPOOL_HUGE_PAGE_SIZE - pool->mem);
+  if( ! (attr->flags & EF_PKTPOOL_FLAG_NO_HUGE_PAGES) )
+    madvise(pool->mem, bytes, MADV_HUGEPAGE);
+  pktpool_mem_bind(pool->mem, bytes, attr->numa_node);
+  return 0;
+}
+
+
+int ef_pktpool_alloc(ef_pktpool** pool_out, const ef_pktpool_attr* attr)
+{
+  ef_pktpool* pool;
+  unsigned i;
+  int rc;
+
+  if( attr->n_bufs == 0 || attr->n_bufs > INT32_MAX ||
+      attr->buf_size < 64 || attr->buf_size > EF_VI_NIC_PAGE_SIZE ||
+      (attr->buf_size & (attr->buf_size - 1)) != 0 )
+    return -EINVAL;
+
+  pool = calloc(1, sizeof(*pool));
+  if( pool == NULL )
+    return -ENOMEM;
+  pool->buf_shift = __builtin_ctz(attr->buf_size);
+  pool->n_bufs = attr->n_bufs;
+  pool->refs = calloc(attr->n_bufs, sizeof(pool->refs[0]));
+  pool->next = malloc(attr->n_bufs * sizeof(pool->next[0]));
+  if( pool->refs == NULL || pool->next == NULL ) {
+    rc = -ENOMEM;
+    goto fail;
+  }
+  if( (rc = pktpool_mem_alloc(pool, attr)) < 0 )
+    goto fail;
+
+  for( i = 0; i < attr->n_bufs; ++i )
+    pool->next[i] = (int32_t) i + 1;
+  pool->next[attr->n_bufs - 1] = -1;
+  pool->free_head = free_head_make(0, 0);
+
+  *pool_out = pool;
+  return 0;
+
+ fail:
+  free(pool->next);
+  free(pool->refs);
+  free(pool);
+  return rc;
+}
+
+
+int ef_pktpool_register(ef_pktpool* pool, ef_driver_handle dh,
+                        struct ef_pd* pd, ef_driver_handle pd_dh)
+{
+  int reg_i = pool->n_regs;
+  int rc;
+
+  if( reg_i >= EF_PKTPOOL_MAX_REGS )
+    return -ENOSPC;
+  rc = ef_memreg_alloc(&pool->regs[reg_i], dh, pd, pd_dh,
+                       pool->mem, pool->mem_bytes);
+  if( rc < 0 )
+    return rc;
+  pool->reg_dh[reg_i] = dh;
+  pool->n_regs = reg_i + 1;
+  return reg_i;
+}
+
+
+void ef_pktpool_free(ef_pktpool* pool)
+{
+  int i;
+  for( i = 0; i < pool->n_regs; ++i )
+    ef_memreg_free(&pool->regs[i], pool->reg_dh[i]);
+  munmap(pool->mem, pool->mem_bytes);
+  free(pool->next);
+  free(pool->refs);
+  free(pool);
+}
+
+
+int ef_pktpool_cache_alloc(ef_pktpool_cache** cache_out, ef_pktpool* pool,
+                           unsigned size)
+{
+  ef_pktpool_cache* cache;
+
+  if( size < 2 )
+    return -EINVAL;
+  cache = malloc(sizeof(*cache) + size * sizeof(cache->ids[0]));
+  if( cache == NULL )
+    return -ENOMEM;
+  cache->pool = pool;
+  cache->n = 0;
+  cache->size = size;
+  *cache_out = cache;
+  return 0;
+}
+
+
+static void cache_return(ef_pktpool_cache* cache, unsigned n)
+{
+  unsigned i;
+
+  EF_VI_BUG_ON(n > cache->n);
+  if( n == 0 )
+    return;
+  /* Link them up and push the lot with a single update of the head. */
+  for( i = cache->n - n; i < cache->n - 1; ++i )
+    cache->pool->next[cache->ids[i]] = cache->ids[i + 1];
+  free_list_push_chain(cache->pool, cache->ids[cache->n - n],
+                       cache->ids[cache->n - 1]);
+  cache->n -= n;
+}
+
+
+void ef_pktpool_cache_free(ef_pktpool_cache* cache)
+{
+  cache_return(cache, cache->n);
+  free(cache);
+}
+
+
+int ef_pktpool_cache_fill(ef_pktpool_cache* cache)
+{
+  unsigned want = cache->size / 2;
+  int32_t id;
+
+  while( cache->n < want && (id = free_list_pop(cache->pool)) >= 0 )
+    cache->ids[cache->n++] = id;
+  return cache->n;
+}
+
+
+/* Move buffers from the cache to the pool, leaving it half full. */
+static void cache_flush(ef_pktpool_cache* cache)
+{
+  if( cache->n > cache->size / 2 )
+    cache_return(cache, cache->n - cache->size / 2);
+}
+
+
+void ef_pktpool_buf_release(ef_pktpool_cache* cache, int id)
+{
+  ef_pktpool* pool = cache->pool;
+  /* The sole owner need not pay for an atomic operation. */
+  if( pool->refs[id] != 1 &&
+      __atomic_sub_fetch(&pool->refs[id], 1, __ATOMIC_ACQ_REL) != 0 )
+    return;
+  if( cache->n == cache->size )
+    cache_flush(cache);
+  cache->ids[cache->n++] = id;
+}
+
+
+int ef_pktpool_rx_refill(ef_pktpool_cache* cache, struct ef_vi* vi,
+                         int reg_i, unsigned offset, int max)
+{
+  ef_pktpool* pool = cache->pool;
+  int n = ef_vi_receive_space(vi);
+  int i, id;
+
+  if( n > max )
+    n = max;
+  for( i = 0; i < n; ++i ) {
+    if( (id = ef_pktpool_buf_alloc(cache)) < 0 )
+      break;
+    if( ef_vi_receive_init(vi, ef_pktpool_buf_dma_addr(pool, reg_i, id) +
+                           offset, id) < 0 ) {
+      ef_pktpool_buf_release(cache, id);
+      break;
+    }
+  }
+  if( i > 0 )
+    ef_vi_receive_push(vi);
+  return i;
+}
@@ -16,9 +16,13 @@
 #include <linux/if_xdp.h>
 #include <linux/file.h>
 #include <linux/bpf.h>
+#include <linux/filter.h>
 #include <linux/mman.h>
 #include <linux/fdtable.h>
 #include <linux/sched/signal.h>
+#include <linux/if_vlan.h>
+#include <linux/ip.h>
+#include <net/ip.h>
 #include <net/sock.h>
 
 #include <ci/efrm/syscall.h>
@@ -37,6 +41,14 @@ int enable_af_xdp_flow_filters = 1;
 module_param(enable_af_xdp_flow_filters, int, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(enable_af_xdp_flow_filters,
                  "Enables flow filter use for AF_XDP devices ");
+static unsigned af_xdp_flow_map_entries = 0;
+module_param(af_xdp_flow_map_entries, uint, S_IRUGO);
+MODULE_PARM_DESC(af_xdp_flow_map_entries,
+                 "Size of the BPF flow table used in place of ethtool ntuple "
+                 "filters on AF_XDP devices.  Traffic that matches no entry "
+                 "is passed to the kernel.  0 (the default) to use ethtool "
+                 "filters");
+
 /* filter id when no actual filter is installed */
 #define AF_XDP_NO_FILTER_MAGIC_ID 0x7FFFFF00
 
@@ -185,12 +197,37 @@ struct protection_domain
   long freed_buffer_table_count;
 };
 
+/* Key of the BPF flow table.  Fields are in network order, as in the
+ * packet.  Wild (3-tuple) entries have zero raddr and rport.  Must match
+ * struct flow_key in af_xdp_bpf.c. */
+struct af_xdp_flow_key
+{
+  uint32_t laddr;
+  uint32_t raddr;
+  uint16_t lport;
+  uint16_t rport;
+  uint8_t proto;
+  uint8_t pad[3];
+};
+
+/* Flow table value: the queue to deliver to, or any queue for RSS
+ * filters. */
+#define AF_XDP_FLOW_ANY_QUEUE 0x7fffffff
+
 /* Per-NIC AF_XDP resources */
 struct efhw_nic_af_xdp
 {
   struct file* map;
   struct efhw_af_xdp_vi* vi;
   struct protection_domain* pd;
+
+  /* BPF flow table, if af_xdp_flow_map_entries is set.  flow_keys holds
+   * the key of each installed filter, indexed by filter id; unused slots
+   * have zero proto. */
+  struct file* flow_map;
+  struct af_xdp_flow_key* flow_keys;
+  unsigned flow_next;
+  spinlock_t flow_lock;
 };
 
 
@@ -382,6 +419,134 @@ static int xdp_prog_load(struct sys_call_area* area, int map_fd)
   return xdp_sys_bpf(BPF_PROG_LOAD, sys_call_area_user_addr(area, attr));
 }
 
+/* Create the flow table to share with the BPF program */
+static int xdp_flow_map_create(struct sys_call_area* area, int max_entries)
+{
+  union bpf_attr* attr = sys_call_area_ptr(area);
+  memset(attr, 0, sizeof(*attr));
+
+  attr->map_type = BPF_MAP_TYPE_HASH;
+  attr->key_size = sizeof(struct af_xdp_flow_key);
+  attr->value_size = sizeof(uint32_t);
+  attr->max_entries = max_entries;
+  strncpy(attr->map_name, "onload_flows", sizeof(attr->map_name));
+  return xdp_sys_bpf(BPF_MAP_CREATE, sys_call_area_user_addr(area, attr));
+}
+
+/* Load the BPF program which redirects only the flows in the flow table
+ * to AF_XDP sockets, and passes everything else to the kernel.  See
+ * xdp_flow_prog in af_xdp_bpf.c for the equivalent C. */
+static int xdp_flow_prog_load(struct sys_call_area* area, int map_fd,
+                              int flow_map_fd)
+{
+/* Offsets from the start of the frame, past any VLAN tag */
+#define ETH_TYPE  12
+#define IP_VHL    ETH_HLEN
+#define IP_FRAG   (ETH_HLEN + offsetof(struct iphdr, frag_off))
+#define IP_PROTO  (ETH_HLEN + offsetof(struct iphdr, protocol))
+#define IP_SADDR  (ETH_HLEN + offsetof(struct iphdr, saddr))
+#define IP_DADDR  (ETH_HLEN + offsetof(struct iphdr, daddr))
+#define L4_SPORT  (ETH_HLEN + sizeof(struct iphdr))
+#define L4_DPORT  (L4_SPORT + 2)
+/* Flow key on the stack */
+#define KEY(f)    (-(int) sizeof(struct af_xdp_flow_key) + \
+                   (int) offsetof(struct af_xdp_flow_key, f))
+  const struct bpf_insn insns[] = {
+    BPF_MOV64_REG(BPF_REG_6, BPF_REG_1),
+    BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, data)),
+    BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_6,
+                offsetof(struct xdp_md, data_end)),
+    /* Ethernet + VLAN + IPv4 without options + ports */
+    BPF_MOV64_REG(BPF_REG_4, BPF_REG_2),
+    BPF_ALU64_IMM(BPF_ADD, BPF_REG_4, L4_DPORT + 2 + VLAN_HLEN),
+    BPF_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, 45),             /* pass */
+    BPF_LDX_MEM(BPF_H, BPF_REG_4, BPF_REG_2, ETH_TYPE),
+    BPF_JMP_IMM(BPF_JNE, BPF_REG_4, htons(ETH_P_8021Q), 2),
+    BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, VLAN_HLEN),
+    BPF_LDX_MEM(BPF_H, BPF_REG_4, BPF_REG_2, ETH_TYPE),
+    BPF_JMP_IMM(BPF_JNE, BPF_REG_4, htons(ETH_P_IP), 40),       /* pass */
+    /* Leave IP options and fragments to the kernel */
+    BPF_LDX_MEM(BPF_B, BPF_REG_4, BPF_REG_2, IP_VHL),
+    BPF_JMP_IMM(BPF_JNE, BPF_REG_4, 0x45, 38),                  /* pass */
+    BPF_LDX_MEM(BPF_H, BPF_REG_4, BPF_REG_2, IP_FRAG),
+    BPF_ALU64_IMM(BPF_AND, BPF_REG_4, htons(IP_MF | IP_OFFSET)),
+    BPF_JMP_IMM(BPF_JNE, BPF_REG_4, 0, 35),                     /* pass */
+    BPF_LDX_MEM(BPF_B, BPF_REG_4, BPF_REG_2, IP_PROTO),
+    BPF_JMP_IMM(BPF_JEQ, BPF_REG_4, IPPROTO_TCP, 1),
+    BPF_JMP_IMM(BPF_JNE, BPF_REG_4, IPPROTO_UDP, 32),           /* pass */
+    /* Build the 5-tuple key; proto and pad in one word */
+    BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_4, KEY(proto)),
+    BPF_LDX_MEM(BPF_W, BPF_REG_4, BPF_REG_2, IP_DADDR),
+    BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_4, KEY(laddr)),
+    BPF_LDX_MEM(BPF_W, BPF_REG_4, BPF_REG_2, IP_SADDR),
+    BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_4, KEY(raddr)),
+    BPF_LDX_MEM(BPF_H, BPF_REG_4, BPF_REG_2, L4_DPORT),
+    BPF_STX_MEM(BPF_H, BPF_REG_10, BPF_REG_4, KEY(lport)),
+    BPF_LDX_MEM(BPF_H, BPF_REG_4, BPF_REG_2, L4_SPORT),
+    BPF_STX_MEM(BPF_H, BPF_REG_10, BPF_REG_4, KEY(rport)),
+    BPF_LD_MAP_FD(BPF_REG_1, flow_map_fd),
+    BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+    BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, KEY(laddr)),
+    BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+    BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, 8),                      /* found */
+    /* No full match: try the 3-tuple */
+    BPF_ST_MEM(BPF_W, BPF_REG_10, KEY(raddr), 0),
+    BPF_ST_MEM(BPF_H, BPF_REG_10, KEY(rport), 0),
+    BPF_LD_MAP_FD(BPF_REG_1, flow_map_fd),
+    BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+    BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, KEY(laddr)),
+    BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+    BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 9),                      /* pass */
+    /* found: the packet must have arrived on the filter's queue */
+    BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_6,
+                offsetof(struct xdp_md, rx_queue_index)),
+    BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_0, 0),
+    BPF_JMP_IMM(BPF_JEQ, BPF_REG_1, AF_XDP_FLOW_ANY_QUEUE, 1),
+    BPF_JMP_REG(BPF_JNE, BPF_REG_1, BPF_REG_2, 5),              /* pass */
+    BPF_LD_MAP_FD(BPF_REG_1, map_fd),
+    BPF_MOV64_IMM(BPF_REG_3, XDP_PASS),
+    BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+    BPF_EXIT_INSN(),
+    /* pass: */
+    BPF_MOV64_IMM(BPF_REG_0, XDP_PASS),
+    BPF_EXIT_INSN(),
+  };
+#undef ETH_TYPE
+#undef IP_VHL
+#undef IP_FRAG
+#undef IP_PROTO
+#undef IP_SADDR
+#undef IP_DADDR
+#undef L4_SPORT
+#undef L4_DPORT
+#undef KEY
+
+  struct bpf_insn* prog;
+  char* license;
+  union bpf_attr* attr;
+
+  attr = sys_call_area_ptr(area);
+  memset(attr, 0, sizeof(*attr));
+
+  license = (void*)(attr + 1);
+#define LICENSE "GPL"
+  strncpy(license, LICENSE, strlen(LICENSE) + 1);
+
+  prog = (void*)(license + strlen(LICENSE) + 1);
+#undef LICENSE
+  EFHW_ASSERT((char*)(prog + ARRAY_SIZE(insns)) <=
+              (char*)attr + PAGE_SIZE);
+  memcpy(prog, insns, sizeof(insns));
+
+  attr->prog_type = BPF_PROG_TYPE_XDP;
+  attr->insn_cnt = ARRAY_SIZE(insns);
+  attr->insns = sys_call_area_user_addr(area, prog);
+  attr->license = sys_call_area_user_addr(area, license);
+  strncpy(attr->prog_name, XDP_PROG_NAME, strlen(XDP_PROG_NAME));
+
+  return xdp_sys_bpf(BPF_PROG_LOAD, sys_call_area_user_addr(area, attr));
+}
+
 /* Update an element in the XDP socket map (using fds) */
 static int xdp_map_update_fd(int map_fd, int key, int sock_fd)
 {
@@ -1016,6 +1181,9 @@ af_xdp_nic_tweak_hardware(struct efhw_nic *nic)
 		   | NIC_FLAG_RX_FILTER_TYPE_IP_LOCAL /* only wild filters */
 	     | NIC_FLAG_USERSPACE_PRIME  /* no explicit priming needed */
 		   ;
+	/* The flow table matches full 5-tuples too. */
+	if( af_xdp_flow_map_entries )
+		nic->flags |= NIC_FLAG_RX_FILTER_TYPE_IP_FULL;
 }
 
 
@@ -1026,7 +1194,7 @@ __af_xdp_nic_init_hardware(struct efhw_nic *nic,
 			   const uint8_t *mac_addr,
 			   struct sys_call_area* sys_call_area)
 {
-	int map_fd, rc;
+	int map_fd, flow_map_fd = -1, rc;
 	struct efhw_nic_af_xdp* xdp;
 
 	xdp = kzalloc(sizeof(*xdp) +
@@ -1044,16 +1212,36 @@ __af_xdp_nic_init_hardware(struct efhw_nic *nic,
 	if( rc < 0 )
 		goto fail_map;
 
-	rc = xdp_prog_load(sys_call_area, map_fd);
+	if( af_xdp_flow_map_entries ) {
+		rc = flow_map_fd = xdp_flow_map_create(sys_call_area,
+		                                       af_xdp_flow_map_entries);
+		if( rc < 0 )
+			goto fail;
+		xdp->flow_keys = vzalloc(af_xdp_flow_map_entries *
+		                         sizeof(xdp->flow_keys[0]));
+		if( xdp->flow_keys == NULL ) {
+			rc = -ENOMEM;
+			goto fail_flow;
+		}
+		spin_lock_init(&xdp->flow_lock);
+		rc = xdp_flow_prog_load(sys_call_area, map_fd, flow_map_fd);
+	}
+	else {
+		rc = xdp_prog_load(sys_call_area, map_fd);
+	}
 	if( rc < 0 )
-		goto fail;
+		goto fail_flow;
 
 	rc = xdp_set_link(nic->net_dev, rc);
 	if( rc < 0 )
-		goto fail;
+		goto fail_flow;
 
 	xdp->map = fget(map_fd);
 	ci_close_fd(map_fd);
+	if( flow_map_fd >= 0 ) {
+		xdp->flow_map = fget(flow_map_fd);
+		ci_close_fd(flow_map_fd);
+	}
 
 	nic->arch_extra = xdp;
 	memcpy(nic->mac_addr, mac_addr, ETH_ALEN);
@@ -1063,6 +1251,10 @@ __af_xdp_nic_init_hardware(struct efhw_nic *nic,
 	rc = af_xdp_rss_get_support(nic);
 	return rc;
 
+fail_flow:
+	if( flow_map_fd >= 0 )
+		ci_close_fd(flow_map_fd);
+	vfree(xdp->flow_keys);
 fail:
 	ci_close_fd(map_fd);
 fail_map:
@@ -1095,6 +1287,9 @@ af_xdp_nic_release_hardware(struct efhw_nic* nic)
   xdp_set_link(nic->net_dev, -1);
   if( xdp ) {
     fput(xdp->map);
+    if( xdp->flow_map )
+      fput(xdp->flow_map);
+    vfree(xdp->flow_keys);
     kfree(xdp);
   }
 }
@@ -1627,6 +1822,119 @@ static int af_xdp_efx_spec_to_ethtool_flow(struct efx_filter_spec* efx_spec,
 	return 0;
 }
 
+/* The flow table stands in for a hardware filter table: the oof layer
+ * inserts and removes filters as for any NIC, and they land here. */
+
+static int af_xdp_spec_to_flow_key(const struct efx_filter_spec* spec,
+				   struct af_xdp_flow_key* key)
+{
+	const unsigned wild = EFX_FILTER_MATCH_ETHER_TYPE |
+			      EFX_FILTER_MATCH_IP_PROTO |
+			      EFX_FILTER_MATCH_LOC_HOST |
+			      EFX_FILTER_MATCH_LOC_PORT;
+	const unsigned full = wild | EFX_FILTER_MATCH_REM_HOST |
+			      EFX_FILTER_MATCH_REM_PORT;
+	/* The BPF program does not look at the VLAN id or MAC address, so
+	 * such filters match a little more than was asked for, as with the
+	 * 3-tuple ethtool filters. */
+	unsigned match = spec->match_flags & ~(EFX_FILTER_MATCH_OUTER_VID |
+					       EFX_FILTER_MATCH_LOC_MAC);
+
+	if( spec->flags & ~(EFX_FILTER_FLAG_RX | EFX_FILTER_FLAG_STACK_ID |
+			    EFX_FILTER_FLAG_VPORT_ID |
+			    EFX_FILTER_FLAG_RX_SCATTER |
+			    EFX_FILTER_FLAG_RX_RSS) )
+		return -EPROTONOSUPPORT;
+	if( match != wild && match != full )
+		return -EPROTONOSUPPORT;
+	/* IPv4 only, as the BPF program. */
+	if( spec->ether_type != htons(ETH_P_IP) )
+		return -EOPNOTSUPP;
+	if( spec->ip_proto != IPPROTO_TCP && spec->ip_proto != IPPROTO_UDP )
+		return -EPROTONOSUPPORT;
+
+	memset(key, 0, sizeof(*key));
+	key->proto = spec->ip_proto;
+	key->laddr = spec->loc_host[0];
+	key->lport = spec->loc_port;
+	if( match == full ) {
+		key->raddr = spec->rem_host[0];
+		key->rport = spec->rem_port;
+	}
+	return 0;
+}
+
+/* The map is updated directly rather than with bpf(2), so that filters
+ * can be changed from any context.  The caller holds flow_lock. */
+static struct bpf_map* af_xdp_flow_map(struct efhw_nic_af_xdp* xdp)
+{
+	/* As __bpf_map_get() */
+	return xdp->flow_map->private_data;
+}
+
+static int af_xdp_flow_insert(struct efhw_nic* nic,
+			      const struct efx_filter_spec* spec)
+{
+	struct efhw_nic_af_xdp* xdp = nic->arch_extra;
+	struct af_xdp_flow_key key;
+	struct bpf_map* map;
+	uint32_t queue;
+	unsigned i, id;
+	int rc;
+
+	rc = af_xdp_spec_to_flow_key(spec, &key);
+	if( rc < 0 )
+		return rc;
+	queue = spec->flags & EFX_FILTER_FLAG_RX_RSS ?
+		AF_XDP_FLOW_ANY_QUEUE : spec->dmaq_id;
+
+	spin_lock_bh(&xdp->flow_lock);
+	for( i = 0; i < af_xdp_flow_map_entries; ++i ) {
+		id = (xdp->flow_next + i) % af_xdp_flow_map_entries;
+		if( xdp->flow_keys[id].proto == 0 )
+			break;
+	}
+	if( i == af_xdp_flow_map_entries ) {
+		rc = -ENOSPC;
+		goto out;
+	}
+
+	map = af_xdp_flow_map(xdp);
+	rcu_read_lock();
+	/* Like a hardware filter table, refuse duplicates. */
+	rc = map->ops->map_update_elem(map, &key, &queue, BPF_NOEXIST);
+	rcu_read_unlock();
+	if( rc < 0 )
+		goto out;
+
+	xdp->flow_keys[id] = key;
+	xdp->flow_next = id + 1;
+	rc = id;
+out:
+	spin_unlock_bh(&xdp->flow_lock);
+	return rc;
+}
+
+static void af_xdp_flow_remove(struct efhw_nic* nic, int filter_id)
+{
+	struct efhw_nic_af_xdp* xdp = nic->arch_extra;
+	struct bpf_map* map;
+
+	if( filter_id < 0 || filter_id >= af_xdp_flow_map_entries )
+		return;
+
+	spin_lock_bh(&xdp->flow_lock);
+	if( xdp->flow_keys[filter_id].proto != 0 ) {
+		map = af_xdp_flow_map(xdp);
+		rcu_read_lock();
+		map->ops->map_delete_elem(map, &xdp->flow_keys[filter_id]);
+		rcu_read_unlock();
+		memset(&xdp->flow_keys[filter_id], 0,
+		       sizeof(xdp->flow_keys[filter_id]));
+	}
+	spin_unlock_bh(&xdp->flow_lock);
+}
+
 static int
 af_xdp_filter_insert(struct efhw_nic *nic, struct efx_filter_spec *spec,
                      int *rxq, unsigned pd_excl_token, const struct cpumask *mask,
@@ -1638,6 +1946,8 @@ af_xdp_filter_insert(struct efhw_nic *nic, struct efx_filter_spec *spec,
 	const struct ethtool_ops *ops;
 	struct cmd_context ctx;
 
+	if (af_xdp_flow_map_entries)
+		return af_xdp_flow_insert(nic, spec);
 	if (!enable_af_xdp_flow_filters)
 		return AF_XDP_NO_FILTER_MAGIC_ID; /* pretend a filter is installed */
 	memset(&info, 0, sizeof(info));
@@ -1680,6 +1990,10 @@ af_xdp_filter_remove(struct efhw_nic *nic, int filter_id)
 
 	if (filter_id == AF_XDP_NO_FILTER_MAGIC_ID)
 		return;
+	if (af_xdp_flow_map_entries) {
+		af_xdp_flow_remove(nic, filter_id);
+		return;
+	}
 
 	memset(&info, 0, sizeof(info));
 	info.cmd = ETHTOOL_SRXCLSRLDEL;
@@ -1,7 +1,18 @@
 /* SPDX-License-Identifier: GPL-2.0 */
 /* X-SPDX-Copyright-Text: (c) Copyright 2019-2020 Xilinx, Inc. */
 
-/* BPF program to redirect inbound packets to AF_XDP sockets.
+/* BPF programs to redirect inbound packets to AF_XDP sockets.
+ *
+ * xdp_sock_prog redirects every TCP and UDP packet by queue, and relies on
+ * ethtool ntuple filters to steer Onload's flows to Onload's queues.
+ *
+ * xdp_flow_prog is used instead when the af_xdp_flow_map_entries module
+ * parameter is set.  It looks packets up in a hash table of 5-tuple and
+ * 3-tuple filters which the driver maintains as its filter table, and
+ * passes everything else to the kernel, so it needs no ntuple support from
+ * the NIC.  It works on veth, for example.  af_xdp.c builds it with the
+ * kernel's instruction macros (see xdp_flow_prog_load), so the steps below
+ * are not needed for it; this version is for reference.
  *
  * Currently, this is not built automatically and requires manual translation
  * to the binary data loaded by xdp_prog_load (see af_xdp.c). One approach is:
@@ -52,9 +63,23 @@
 #define PROTO_UDP 17
 
 extern struct bpf_map_def xsks_map;
+extern struct bpf_map_def flows_map;
 
 static int (*bpf_redirect_map)(void *map, int key, int flags) =
         (void *) BPF_FUNC_redirect_map;
+static void* (*bpf_map_lookup_elem)(void *map, const void *key) =
+        (void *) BPF_FUNC_map_lookup_elem;
+
+/* Must match struct af_xdp_flow_key in af_xdp.c */
+struct flow_key {
+  unsigned laddr;
+  unsigned raddr;
+  unsigned short lport;
+  unsigned short rport;
+  unsigned proto;
+};
+
+#define FLOW_ANY_QUEUE 0x7fffffff
 
 int xdp_sock_prog(struct xdp_md *ctx)
 {
@@ -92,3 +117,51 @@ int xdp_sock_prog(struct xdp_md *ctx)
   return bpf_redirect_map(&xsks_map, index, XDP_PASS);
 }
 
+
+int xdp_flow_prog(struct xdp_md *ctx)
+{
+  char* data = (char*)(long)ctx->data;
+  char* end = (char*)(long)ctx->data_end;
+  struct flow_key key;
+  unsigned* queue;
+
+  /* Ethernet header + vlan header + IP header + ports */
+  if( data + 14 + 4 + 20 + 4 > end )
+    return XDP_PASS;
+
+  unsigned short ethertype = *(unsigned short*)(data+12);
+  if( ethertype == ETHERTYPE_VLAN ) {
+    data += 4;
+    ethertype = *(unsigned short*)(data+12);
+  }
+  if( ethertype != ETHERTYPE_IPv4 )
+    return XDP_PASS;
+
+  /* IP options and fragments are left to the kernel */
+  if( *(unsigned char*)(data+14) != 0x45 ||
+      (*(unsigned short*)(data+20) & 0xff3f) != 0 )
+    return XDP_PASS;
+
+  key.proto = *(unsigned char*)(data+23);
+  if( key.proto != PROTO_TCP && key.proto != PROTO_UDP )
+    return XDP_PASS;
+  key.laddr = *(unsigned*)(data+30);
+  key.raddr = *(unsigned*)(data+26);
+  key.lport = *(unsigned short*)(data+36);
+  key.rport = *(unsigned short*)(data+34);
+
+  queue = bpf_map_lookup_elem(&flows_map, &key);
+  if( queue == 0 ) {
+    key.raddr = 0;
+    key.rport = 0;
+    queue = bpf_map_lookup_elem(&flows_map, &key);
+    if( queue == 0 )
+      return XDP_PASS;
+  }
+
+  /* The socket can only take packets from the queue it is bound to. */
+  int index = ctx->rx_queue_index;
+  if( *queue != FLOW_ANY_QUEUE && *queue != index )
+    return XDP_PASS;
+  return bpf_redirect_map(&xsks_map, index, XDP_PASS);
+}
@@ -97,6 +97,7 @@ efab_eplock_unlock_and_wake(ci_netif *ni, int in_dl_context)
    */
   ci_assert_nflags(ni->flags, CI_NETIF_FLAG_IN_DL_CONTEXT);
   CITP_STATS_NETIF_INC(ni, unlock_slow);
+  ni->state->lock.holder_tid = 0;
 
  again:
 
@@ -148,6 +148,10 @@ static void
 oof_socket_mcast_del_connected(struct oof_manager* fm,
                                struct oof_socket* skf, int stack_locked);
 
+static ci_dllist*
+oof_mcast_member_bucket(struct oof_manager* fm, struct oof_socket* skf,
+                        unsigned maddr);
+
 static unsigned
 oof_mcast_filter_duplicate_hwports(struct oof_manager* fm,
                                    struct oof_mcast_filter* mf,
@@ -1064,6 +1068,21 @@ oof_manager_alloc(unsigned local_addr_max, void* owner_private)
     ci_free(fm);
     return NULL;
   }
+  fm->fm_mcast_filter_hash = CI_ALLOC_ARRAY(ci_dllist, OOF_MCAST_HASH_SIZE);
+  fm->fm_mcast_member_hash = CI_ALLOC_ARRAY(ci_dllist, OOF_MCAST_HASH_SIZE);
+  if( fm->fm_mcast_filter_hash == NULL || fm->fm_mcast_member_hash == NULL ) {
+    if( fm->fm_mcast_filter_hash != NULL )
+      ci_free(fm->fm_mcast_filter_hash);
+    if( fm->fm_mcast_member_hash != NULL )
+      ci_free(fm->fm_mcast_member_hash);
+    ci_free(fm->fm_local_addrs);
+    ci_free(fm);
+    return NULL;
+  }
+  for( hash = 0; hash < OOF_MCAST_HASH_SIZE; ++hash ) {
+    ci_dllist_init(&fm->fm_mcast_filter_hash[hash]);
+    ci_dllist_init(&fm->fm_mcast_member_hash[hash]);
+  }
 
   fm->fm_owner_private = owner_private;
   spin_lock_init(&fm->fm_inner_lock);
@@ -1123,6 +1142,8 @@ oof_manager_free(struct oof_manager* fm)
   ci_assert(ci_dllist_is_empty(&fm->fm_mcast_laddr_socks));
   for( hash = 0; hash < OOF_LOCAL_PORT_TBL_SIZE; ++hash )
     ci_assert(ci_dllist_is_empty(&fm->fm_local_ports[hash]));
+  for( hash = 0; hash < OOF_MCAST_HASH_SIZE; ++hash )
+    ci_assert(ci_dllist_is_empty(&fm->fm_mcast_filter_hash[hash]));
 
   for( la_i = 0; la_i < fm->fm_local_addr_n; ++la_i ) {
     la = &fm->fm_local_addrs[la_i];
@@ -1138,6 +1159,8 @@ oof_manager_free(struct oof_manager* fm)
     oof_local_interface_details_free(fm, lid);
 
   mutex_destroy(&fm->fm_outer_lock);
+  ci_free(fm->fm_mcast_filter_hash);
+  ci_free(fm->fm_mcast_member_hash);
   ci_free(fm->fm_local_addrs);
   ci_free(fm);
 }
@@ -3496,9 +3519,9 @@ oof_udp_connect_mcast_laddr(struct oof_manager* fm, struct oof_socket* skf,
   /* See if we've joined any groups on this laddr, and if so which hwports
    * they're using.
    */
-  CI_DLLIST_FOR_EACH2(struct oof_mcast_member, mm, mm_socket_link,
-                      &skf->sf_mcast_memberships)
-    if( mm->mm_maddr == laddr )
+  CI_DLLIST_FOR_EACH2(struct oof_mcast_member, mm, mm_hash_link,
+                      oof_mcast_member_bucket(fm, skf, laddr))
+    if( mm->mm_socket == skf && mm->mm_maddr == laddr )
       hwports |= mm->mm_hwport_mask;
 
 
@@ -3766,6 +3789,85 @@ oof_udp_connect(struct oof_manager* fm, struct oof_socket* skf, int af_space,
      ((mm)->mm_hwport_mask & (fm)->fm_hwports_mcast_replicate_capable) )
 
 
+/* [owner] is the oof_local_port for filters and the oof_socket for
+ * memberships.  Groups used together usually differ only in their
+ * low-order bytes, so fold those down into the bucket index.
+ */
+static unsigned
+oof_mcast_hash(const void* owner, unsigned maddr)
+{
+  unsigned h = CI_BSWAP_BE32(maddr) ^ (unsigned) ((ci_uintptr_t) owner >> 6);
+  return (h ^ (h >> 10) ^ (h >> 20)) & OOF_MCAST_HASH_MASK;
+}
+
+
+static ci_dllist*
+oof_mcast_filter_bucket(struct oof_manager* fm, struct oof_local_port* lp,
+                        unsigned maddr)
+{
+  return &fm->fm_mcast_filter_hash[oof_mcast_hash(lp, maddr)];
+}
+
+
+static ci_dllist*
+oof_mcast_member_bucket(struct oof_manager* fm, struct oof_socket* skf,
+                        unsigned maddr)
+{
+  return &fm->fm_mcast_member_hash[oof_mcast_hash(skf, maddr)];
+}
+
+
+static void
+oof_mcast_filter_link(struct oof_manager* fm, struct oof_local_port* lp,
+                      struct oof_mcast_filter* mf)
+{
+  mf->mf_lp = lp;
+  ci_dllist_push(&lp->lp_mcast_filters, &mf->mf_lp_link);
+  ci_dllist_push(oof_mcast_filter_bucket(fm, lp, mf->mf_maddr),
+                 &mf->mf_hash_link);
+}
+
+
+static void
+oof_mcast_filter_unlink(struct oof_mcast_filter* mf)
+{
+  ci_dllist_remove(&mf->mf_lp_link);
+  ci_dllist_remove(&mf->mf_hash_link);
+}
+
+
+static void
+oof_mcast_member_link(struct oof_manager* fm, struct oof_mcast_member* mm)
+{
+  struct oof_socket* skf = mm->mm_socket;
+  ci_dllist_push(&skf->sf_mcast_memberships, &mm->mm_socket_link);
+  ci_dllist_push(oof_mcast_member_bucket(fm, skf, mm->mm_maddr),
+                 &mm->mm_hash_link);
+}
+
+
+static void
+oof_mcast_member_unlink(struct oof_mcast_member* mm)
+{
+  ci_dllist_remove(&mm->mm_socket_link);
+  ci_dllist_remove(&mm->mm_hash_link);
+}
+
+
+static struct oof_mcast_member*
+oof_socket_find_mcast_member(struct oof_manager* fm, struct oof_socket* skf,
+                             unsigned maddr, int ifindex)
+{
+  struct oof_mcast_member* mm;
+  CI_DLLIST_FOR_EACH2(struct oof_mcast_member, mm, mm_hash_link,
+                      oof_mcast_member_bucket(fm, skf, maddr))
+    if( mm->mm_socket == skf && mm->mm_maddr == maddr &&
+        mm->mm_ifindex == ifindex )
+      break;
+  return mm;
+}
+
+
 static struct oof_mcast_member*
 oof_mcast_member_list_get(ci_dllist* mm_list)
 {
@@ -3801,12 +3903,14 @@ oof_mcast_filter_list_free(ci_dllist* mcast_filters)
 
 
 static int
-oof_socket_has_maddr_filter(struct oof_socket* skf, unsigned maddr)
+oof_socket_has_maddr_filter(struct oof_manager* fm, struct oof_socket* skf,
+                            unsigned maddr)
 {
   struct oof_mcast_member* mm;
-  CI_DLLIST_FOR_EACH2(struct oof_mcast_member, mm, mm_socket_link,
-                      &skf->sf_mcast_memberships)
-    if( mm->mm_maddr == maddr && mm->mm_filter != NULL )
+  CI_DLLIST_FOR_EACH2(struct oof_mcast_member, mm, mm_hash_link,
+                      oof_mcast_member_bucket(fm, skf, maddr))
+    if( mm->mm_socket == skf && mm->mm_maddr == maddr &&
+        mm->mm_filter != NULL )
       return 1;
   return 0;
 }
@@ -3841,9 +3945,12 @@ oof_mcast_member_state(struct oof_manager* fm, struct oof_mcast_member* mm)
    * via another oof_mcast_filter, which can happen on ports that don't
    * support vlans.
    */
-  CI_DLLIST_FOR_EACH2(struct oof_mcast_filter, mf2, mf_lp_link,
-                        &mm->mm_socket->sf_local_port->lp_mcast_filters)
-    hwports_got |= oof_mcast_filter_duplicate_hwports(fm, mm->mm_filter, mf2);
+  CI_DLLIST_FOR_EACH2(struct oof_mcast_filter, mf2, mf_hash_link,
+                      oof_mcast_filter_bucket(fm, mm->mm_filter->mf_lp,
+                                              mm->mm_maddr))
+    if( mf2->mf_lp == mm->mm_filter->mf_lp )
+      hwports_got |= oof_mcast_filter_duplicate_hwports(fm, mm->mm_filter,
+                                                        mf2);
 
   if( hwports_want ) {
     if( (hwports_got & hwports_want) == hwports_want )
@@ -3885,15 +3992,16 @@ oof_mcast_filter_hwport_mask(struct oof_manager* fm,
 
 
 static struct oof_mcast_filter*
-oof_local_port_find_mcast_filter(struct oof_local_port* lp,
+oof_local_port_find_mcast_filter(struct oof_manager* fm,
+                                 struct oof_local_port* lp,
                                  struct tcp_helper_resource_s* stack,
                                  unsigned maddr, ci_uint16 vlan_id)
 {
   struct oof_mcast_filter* mf;
-  CI_DLLIST_FOR_EACH2(struct oof_mcast_filter, mf, mf_lp_link,
-                      &lp->lp_mcast_filters)
-    if( mf->mf_filter.trs == stack && mf->mf_maddr == maddr
-        && mf->mf_vlan_id == vlan_id )
+  CI_DLLIST_FOR_EACH2(struct oof_mcast_filter, mf, mf_hash_link,
+                      oof_mcast_filter_bucket(fm, lp, maddr))
+    if( mf->mf_lp == lp && mf->mf_filter.trs == stack &&
+        mf->mf_maddr == maddr && mf->mf_vlan_id == vlan_id )
       break;
   return mf;
 }
@@ -3971,9 +4079,10 @@ oof_mcast_filter_installable_hwports(struct oof_manager* fm,
   unsigned hwport_mask = mf->mf_hwport_mask;
   struct oof_mcast_filter* mf2;
 
-  CI_DLLIST_FOR_EACH2(struct oof_mcast_filter, mf2, mf_lp_link,
-                      &lp->lp_mcast_filters)
-    if( mf2 != mf ) {
+  /* Only filters for the same group can conflict or duplicate. */
+  CI_DLLIST_FOR_EACH2(struct oof_mcast_filter, mf2, mf_hash_link,
+                      oof_mcast_filter_bucket(fm, lp, mf->mf_maddr))
+    if( mf2 != mf && mf2->mf_lp == lp ) {
       hwport_mask &= ~oof_mcast_conflicted_hwports(fm, mf->mf_filter.trs,
                                                    mf->mf_maddr,
                                                    mf->mf_hwport_mask,
@@ -4011,7 +4120,7 @@ oof_mcast_install(struct oof_manager* fm, struct oof_mcast_member* mm,
    * In the case of connected sockets the connect path is responsible for
    * managing the sw filter.
    */
-  if( (! oof_socket_has_maddr_filter(skf, mm->mm_maddr)) &&
+  if( (! oof_socket_has_maddr_filter(fm, skf, mm->mm_maddr)) &&
       (! OOF_CONNECTED_MCAST(skf, mm->mm_maddr)) ) {
     ci_addr_t laddr_val;
 
@@ -4035,8 +4144,10 @@ oof_mcast_install(struct oof_manager* fm, struct oof_mcast_member* mm,
    */
   if( (mm->mm_hwport_mask & fm->fm_hwports_mcast_replicate_capable)
       != mm->mm_hwport_mask )  {
-    CI_DLLIST_FOR_EACH2(struct oof_mcast_filter, mf, mf_lp_link,
-                        &lp->lp_mcast_filters) {
+    CI_DLLIST_FOR_EACH2(struct oof_mcast_filter, mf, mf_hash_link,
+                        oof_mcast_filter_bucket(fm, lp, mm->mm_maddr)) {
+     if( mf->mf_lp != lp )
+       continue;
      conflicted_port_mask =
        oof_mcast_conflicted_hwports(fm, skf_stack, mm->mm_maddr,
                                     mm->mm_hwport_mask, mm->mm_vlan_id, mf);
@@ -4055,13 +4166,13 @@ oof_mcast_install(struct oof_manager* fm, struct oof_mcast_member* mm,
     }
   }
 
-  mf = oof_local_port_find_mcast_filter(lp, skf_stack, mm->mm_maddr,
+  mf = oof_local_port_find_mcast_filter(fm, lp, skf_stack, mm->mm_maddr,
                                         mm->mm_vlan_id);
   if( mf == NULL ) {
     mf = oof_mcast_filter_list_get(mcast_filters);
     oof_mcast_filter_init(mf, mm->mm_maddr, mm->mm_vlan_id);
     mf->mf_filter.trs = skf_stack;
-    ci_dllist_push(&lp->lp_mcast_filters, &mf->mf_lp_link);
+    oof_mcast_filter_link(fm, lp, mf);
     mf_pushed = 1;
   }
 
@@ -4089,7 +4200,7 @@ oof_mcast_install(struct oof_manager* fm, struct oof_mcast_member* mm,
     mm->mm_filter = old_mm_filter;
     ci_dllist_pop(&mf->mf_memberships);
     if( mf_pushed ) {
-      ci_dllist_pop(&lp->lp_mcast_filters);
+      oof_mcast_filter_unlink(mf);
       ci_dllist_push(mcast_filters, &mf->mf_lp_link);
     }
     laddr = CI_ADDR_FROM_IP4(mm->mm_maddr);
@@ -4126,9 +4237,9 @@ oof_mcast_remove(struct oof_manager* fm, struct oof_mcast_member* mm,
    * removing it to avoid a gap where there is no filter installed.
    */
   if( mm->mm_hwport_mask & ~fm->fm_hwports_vlan_filters ) {
-    CI_DLLIST_FOR_EACH2(struct oof_mcast_filter, mf2, mf_lp_link,
-                        &lp->lp_mcast_filters)
-      if( (mf2 != mf) &&
+    CI_DLLIST_FOR_EACH2(struct oof_mcast_filter, mf2, mf_hash_link,
+                        oof_mcast_filter_bucket(fm, lp, mm->mm_maddr))
+      if( (mf2 != mf) && (mf2->mf_lp == lp) &&
           (hwport_mask = oof_mcast_filter_duplicate_hwports(fm, mf2, mf)) ) {
         /* mf2 is relying on filtering via mf for hwport_mask.  Pass those
          * filters over to mf2.
@@ -4143,7 +4254,7 @@ oof_mcast_remove(struct oof_manager* fm, struct oof_mcast_member* mm,
     oof_hw_filter_clear(fm, &mf->mf_filter);
     IPF_LOG(FSK_FMT "CLEAR "IPPORT_FMT, FSK_PRI_ARGS(skf),
             IPPORT_ARG(mm->mm_maddr, lp->lp_lport));
-    ci_dllist_remove(&mf->mf_lp_link);
+    oof_mcast_filter_unlink(mf);
     ci_dllist_push(mcast_filters, &mf->mf_lp_link);
     filter_removed = 1;
   }
@@ -4160,9 +4271,9 @@ oof_mcast_remove(struct oof_manager* fm, struct oof_mcast_member* mm,
   /* Is it now possible to insert filters to accelerate this group for
    * another stack?
    */
-  CI_DLLIST_FOR_EACH2(struct oof_mcast_filter, mf, mf_lp_link,
-                      &lp->lp_mcast_filters)
-    if( mf->mf_maddr == mm->mm_maddr ) {
+  CI_DLLIST_FOR_EACH2(struct oof_mcast_filter, mf, mf_hash_link,
+                      oof_mcast_filter_bucket(fm, lp, mm->mm_maddr))
+    if( mf->mf_lp == lp && mf->mf_maddr == mm->mm_maddr ) {
       unsigned got_hwport_mask;
       got_hwport_mask = oo_hw_filter_hwports(&mf->mf_filter);
       if( mf->mf_hwport_mask != got_hwport_mask ) {
@@ -4190,7 +4301,7 @@ oof_mcast_remove(struct oof_manager* fm, struct oof_mcast_member* mm,
     }
 
   /* Remove software filter if no filters remain for maddr. */
-  if( ! oof_socket_has_maddr_filter(skf, mm->mm_maddr) &&
+  if( ! oof_socket_has_maddr_filter(fm, skf, mm->mm_maddr) &&
       ! OOF_CONNECTED_MCAST(skf, mm->mm_maddr) ) {
     ci_addr_t laddr = CI_ADDR_FROM_IP4(mm->mm_maddr);
 
@@ -4349,7 +4460,7 @@ __oof_mcast_update_filters(struct oof_manager* fm, int ifindex)
             if( remove ) {
               struct oof_socket* skf = mm->mm_socket;
               int maddr = mm->mm_maddr;
-              ci_dllist_remove(&mm->mm_socket_link);
+              oof_mcast_member_unlink(mm);
               rc = oof_mcast_remove(fm, mm, 0, &mcast_filters);
               ci_free(mm);
               if( OOF_CONNECTED_MCAST(skf, maddr) )
@@ -4409,32 +4520,98 @@ oof_mcast_update_filters(ci_ifid_t ifindex, void *arg)
 }
 
 
+/* Add a membership for one group.  Takes a preallocated member from
+ * [mm_list] and, if a new filter is needed, one from [mcast_filters].
+ * Unused objects are left on the lists for the caller to free.
+ */
+static int
+__oof_socket_mcast_add(struct oof_manager* fm, struct oof_socket* skf,
+                       struct oof_local_interface_details* lid,
+                       unsigned maddr, int ifindex,
+                       ci_dllist* mm_list, ci_dllist* mcast_filters)
+{
+  struct oof_mcast_member* mm;
+  int rc = 0;
+
+  ci_assert(spin_is_locked(&fm->fm_inner_lock));
+  ci_assert(mutex_is_locked(&fm->fm_outer_lock));
+
+  if( oof_socket_find_mcast_member(fm, skf, maddr, ifindex) != NULL )
+    return 0;  /* NB. Ignore duplicates. */
+
+  mm = oof_mcast_member_list_get(mm_list);
+  oof_mcast_member_init(mm, skf, maddr, ifindex,
+                        lid->lid_hwport_mask, lid->lid_vlan_id);
+  oof_mcast_member_link(fm, mm);
+  if( skf->sf_local_port != NULL ) {
+    /* For connected sockets we install any full match filters and the sw
+     * filter via the connect path first.  Then wild match filters are
+     * added for all sockets if needed.  If the connect path fails, we don't
+     * install hw filters so that traffic can go via the kernel.
+     */
+    if( OOF_CONNECTED_MCAST(skf, maddr) )
+      rc = oof_udp_connect_mcast_laddr(fm, skf, skf->sf_laddr.ip4,
+                                       skf->sf_raddr.ip4, skf->sf_rport);
+    if( rc == 0 && OOF_NEED_MCAST_FILTER(fm, skf, mm) ) {
+      rc = oof_mcast_install(fm, mm, mcast_filters);
+      if( rc != 0 ) {
+        oof_mcast_member_unlink(mm);
+        ci_dllist_push(mm_list, &mm->mm_socket_link);
+      }
+    }
+  }
+  return rc;
+}
+
+
 int
 oof_socket_mcast_add(struct oof_manager* fm, struct oof_socket* skf,
                      unsigned maddr, int ifindex)
 {
-  struct oof_mcast_member* new_mm;
-  struct oof_mcast_filter* mf;
+  IPF_LOG(FSK_FMT "maddr="IP_FMT" if=%d",
+          FSK_PRI_ARGS(skf), IP_ARG(maddr), ifindex);
+  return oof_socket_mcast_add_bulk(fm, skf, &maddr, 1, ifindex, NULL);
+}
+
+
+int
+oof_socket_mcast_add_bulk(struct oof_manager* fm, struct oof_socket* skf,
+                          const unsigned* maddrs, int n_maddrs, int ifindex,
+                          int* n_added_out)
+{
   struct oof_mcast_member* mm;
-  ci_dllist mcast_filters;
+  struct oof_mcast_filter* mf;
+  ci_dllist mm_list, mcast_filters;
   struct oof_local_interface_details* lid;
-  int rc;
+  int i, n_added = 0, rc = 0;
 
-  IPF_LOG(FSK_FMT "maddr="IP_FMT" if=%d",
-          FSK_PRI_ARGS(skf), IP_ARG(maddr), ifindex);
+  IPF_LOG(FSK_FMT "n_maddrs=%d if=%d", FSK_PRI_ARGS(skf), n_maddrs, ifindex);
 
+  ci_dllist_init(&mm_list);
   ci_dllist_init(&mcast_filters);
-  new_mm = NULL;
-  if( ! CI_IP_IS_MULTICAST(maddr) ) {
-    ERR_LOG(FSK_FMT "ERROR: maddr="IP_FMT, FSK_PRI_ARGS(skf), IP_ARG(maddr));
-    rc = -EINVAL;
+
+  for( i = 0; i < n_maddrs; ++i )
+    if( ! CI_IP_IS_MULTICAST(maddrs[i]) ) {
+      ERR_LOG(FSK_FMT "ERROR: maddr="IP_FMT,
+              FSK_PRI_ARGS(skf), IP_ARG(maddrs[i]));
+      n_maddrs = i;
+      rc = -EINVAL;
+      break;
+    }
+  if( n_maddrs == 0 )
     goto out;
-  }
 
-  if( (new_mm = CI_ALLOC_OBJ(struct oof_mcast_member)) == NULL )
-    goto out_of_memory;
-  if( (mf = CI_ALLOC_OBJ(struct oof_mcast_filter)) == NULL )
-    goto out_of_memory;
+  /* Allocate the worst case up front, so that the whole batch is added
+   * with a single pass under the locks.
+   */
+  for( i = 0; i < n_maddrs; ++i ) {
+    if( (mm = CI_ALLOC_OBJ(struct oof_mcast_member)) == NULL )
+      goto out_of_memory;
+    ci_dllist_push(&mm_list, &mm->mm_socket_link);
+    if( (mf = CI_ALLOC_OBJ(struct oof_mcast_filter)) == NULL )
+      goto out_of_memory;
+    ci_dllist_push(&mcast_filters, &mf->mf_lp_link);
+  }
 
   mutex_lock(&fm->fm_outer_lock);
   spin_lock_bh(&fm->fm_inner_lock);
@@ -4444,8 +4621,6 @@ oof_socket_mcast_add(struct oof_manager* fm, struct oof_socket* skf,
     IPF_LOG(FSK_FMT "ERROR: no records for if=%d",
             FSK_PRI_ARGS(skf), ifindex);
     rc = -ENODEV;
-    ci_free(mf);
-    mf = NULL;
     goto out_unlock;
   }
 
@@ -4455,35 +4630,12 @@ oof_socket_mcast_add(struct oof_manager* fm, struct oof_socket* skf,
     /* Carry on -- we may get hwports later due to cplane changes. */
   }
 
-  oof_mcast_member_init(new_mm, skf, maddr, ifindex,
-                        lid->lid_hwport_mask, lid->lid_vlan_id);
-  ci_dllist_push(&mcast_filters, &mf->mf_lp_link);
-
-  rc = 0;
-  CI_DLLIST_FOR_EACH2(struct oof_mcast_member, mm, mm_socket_link,
-                      &skf->sf_mcast_memberships)
-    if( mm->mm_maddr == maddr && mm->mm_ifindex == ifindex )
+  for( n_added = 0; n_added < n_maddrs; ++n_added ) {
+    int rc1 = __oof_socket_mcast_add(fm, skf, lid, maddrs[n_added], ifindex,
+                                     &mm_list, &mcast_filters);
+    if( rc1 != 0 ) {
+      rc = rc1;
       break;
-  if( mm == NULL ) {  /* NB. Ignore duplicates. */
-    mm = new_mm;
-    new_mm = NULL;
-    ci_dllist_push(&skf->sf_mcast_memberships, &mm->mm_socket_link);
-    if( skf->sf_local_port != NULL ) {
-      /* For connected sockets we install any full match filters and the sw
-       * filter via the connect path first.  Then wild match filters are
-       * added for all sockets if needed.  If the connect path fails, we don't
-       * install hw filters so that traffic can go via the kernel.
-       */
-      if( OOF_CONNECTED_MCAST(skf, maddr) )
-        rc = oof_udp_connect_mcast_laddr(fm, skf, skf->sf_laddr.ip4,
-                                         skf->sf_raddr.ip4, skf->sf_rport);
-      if( rc == 0 && OOF_NEED_MCAST_FILTER(fm, skf, mm) ) {
-        rc = oof_mcast_install(fm, mm, &mcast_filters);
-        if( rc != 0 ) {
-          ci_dllist_pop(&skf->sf_mcast_memberships);
-          new_mm = mm;
-        }
-      }
     }
   }
 
@@ -4492,9 +4644,10 @@ oof_socket_mcast_add(struct oof_manager* fm, struct oof_socket* skf,
   mutex_unlock(&fm->fm_outer_lock);
 
  out:
-  if( new_mm )
-    ci_free(new_mm);
+  oof_mcast_member_list_free(&mm_list);
   oof_mcast_filter_list_free(&mcast_filters);
+  if( n_added_out != NULL )
+    *n_added_out = n_added;
   return rc;
 
  out_of_memory:
@@ -4515,9 +4668,9 @@ oof_socket_mcast_del_connected(struct oof_manager* fm,
   ci_assert(spin_is_locked(&fm->fm_inner_lock));
   ci_assert(mutex_is_locked(&fm->fm_outer_lock));
 
-  CI_DLLIST_FOR_EACH2(struct oof_mcast_member, mm, mm_socket_link,
-                      &skf->sf_mcast_memberships)
-    if( mm->mm_maddr == skf->sf_laddr.ip4 )
+  CI_DLLIST_FOR_EACH2(struct oof_mcast_member, mm, mm_hash_link,
+                      oof_mcast_member_bucket(fm, skf, skf->sf_laddr.ip4))
+    if( mm->mm_socket == skf && mm->mm_maddr == skf->sf_laddr.ip4 )
       hwports |= mm->mm_hwport_mask;
 
   hwports_full = hwports & ~fm->fm_hwports_mcast_replicate_capable;
@@ -4556,12 +4709,9 @@ oof_socket_mcast_del(struct oof_manager* fm, struct oof_socket* skf,
   mutex_lock(&fm->fm_outer_lock);
   spin_lock_bh(&fm->fm_inner_lock);
 
-  CI_DLLIST_FOR_EACH2(struct oof_mcast_member, mm, mm_socket_link,
-                      &skf->sf_mcast_memberships)
-    if( mm->mm_maddr == maddr && mm->mm_ifindex == ifindex)
-      break;
+  mm = oof_socket_find_mcast_member(fm, skf, maddr, ifindex);
   if( mm != NULL ) {
-    ci_dllist_remove(&mm->mm_socket_link);
+    oof_mcast_member_unlink(mm);
     if( mm->mm_filter != NULL )
       oof_mcast_remove(fm, mm, 1, &mcast_filters);
 
@@ -4593,6 +4743,7 @@ oof_socket_mcast_del_all(struct oof_manager* fm, struct oof_socket* skf)
   while( ci_dllist_not_empty(&skf->sf_mcast_memberships) ) {
     mm = CI_CONTAINER(struct oof_mcast_member, mm_socket_link,
                       ci_dllist_pop(&skf->sf_mcast_memberships));
+    ci_dllist_remove(&mm->mm_hash_link);
     if( mm->mm_filter != NULL )
       oof_mcast_remove(fm, mm, 1, &mf_list);
     ci_dllist_push(&mm_list, &mm->mm_socket_link);
@@ -4637,7 +4788,7 @@ oof_socket_mcast_install(struct oof_manager* fm, struct oof_socket* skf)
                           &skf->sf_mcast_memberships) {
         if( mm->mm_filter == NULL &&
             OOF_NEED_MCAST_FILTER(fm, skf, mm) &&
-            oof_local_port_find_mcast_filter(lp, skf_stack, mm->mm_maddr,
+            oof_local_port_find_mcast_filter(fm, lp, skf_stack, mm->mm_maddr,
                                              mm->mm_vlan_id) == NULL )
           ++mf_needed;
       }
@@ -14,6 +14,13 @@
 #define OOF_LOCAL_PORT_TBL_SIZE      16
 #define OOF_LOCAL_PORT_TBL_MASK      (OOF_LOCAL_PORT_TBL_SIZE - 1)
 
+/* Multicast filters and memberships are additionally indexed by group so
+ * that stacks joining many thousands of groups don't pay for a list walk
+ * on every join.
+ */
+#define OOF_MCAST_HASH_SIZE          1024
+#define OOF_MCAST_HASH_MASK          (OOF_MCAST_HASH_SIZE - 1)
+
 struct tcp_helper_resource_s;
 struct oo_hw_filter;
 
@@ -173,6 +180,13 @@ struct oof_manager {
 
   ci_dllist    fm_mcast_laddr_socks;
 
+  /* [oof_mcast_filter]s hashed by {local_port, maddr} and
+   * [oof_mcast_member]s hashed by {socket, maddr}.  Each table has
+   * OOF_MCAST_HASH_SIZE buckets.
+   */
+  ci_dllist*   fm_mcast_filter_hash;
+  ci_dllist*   fm_mcast_member_hash;
+
   /* List of scalable-filter-manager structures, or "tproxies" for short. */
   ci_dllist    fm_tproxies;
 
@@ -253,6 +267,12 @@ struct oof_mcast_filter {
   /* Link for [oof_local_port::lp_mcast_filters]. */
   ci_dllink           mf_lp_link;
 
+  /* The local port this filter belongs to, and link for
+   * [oof_manager::fm_mcast_filter_hash].
+   */
+  struct oof_local_port* mf_lp;
+  ci_dllink           mf_hash_link;
+
   ci_dllist           mf_memberships;
 
   ci_uint16           mf_vlan_id;
@@ -288,6 +308,9 @@ struct oof_mcast_member {
   /* Link for [struct oof_mcast_filter::mf_memberships]. */
   ci_dllink                mm_filter_link;
 
+  /* Link for [struct oof_manager::fm_mcast_member_hash]. */
+  ci_dllink                mm_hash_link;
+
   /* The vlan id of [mm_ifindex]. */
   ci_uint16                mm_vlan_id;
 
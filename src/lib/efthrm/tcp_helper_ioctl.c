@@ -58,6 +58,8 @@ oo_priv_set_stack(ci_private_t* priv, tcp_helper_resource_t* trs)
     }
   } while( ci_cas_uintptr_fail(p, old, new) );
 
+  if( trs->mapping_inode != NULL )
+    priv->_filp->f_mapping = trs->mapping_inode->i_mapping;
   return 0;
 }
 
@@ -669,6 +671,41 @@ efab_ep_filter_mcast_del(ci_private_t *priv, void *arg)
   return rc;
 }
 static int
+efab_ep_filter_mcast_add_bulk(ci_private_t *priv, void *arg)
+{
+  oo_tcp_filter_mcast_bulk_t *op = arg;
+  tcp_helper_endpoint_t* ep;
+  unsigned* addrs;
+  int n_added = 0;
+  int rc;
+
+  if( op->n_addrs <= 0 || op->n_addrs > OO_MCAST_BULK_MAX )
+    return -EINVAL;
+  rc = efab_ioctl_get_ep(priv, op->tcp_id, &ep);
+  if( rc != 0 )
+    return rc;
+
+  addrs = kmalloc(op->n_addrs * sizeof(*addrs), GFP_KERNEL);
+  if( addrs == NULL )
+    return -ENOMEM;
+  if( copy_from_user(addrs, CI_USER_PTR_GET(op->addrs),
+                     op->n_addrs * sizeof(*addrs)) ) {
+    kfree(addrs);
+    return -EFAULT;
+  }
+
+  /* A partial failure is reported in [op->rc] so that [op->n_addrs] is
+   * copied back to the caller.
+   */
+  op->rc = oof_socket_mcast_add_bulk(
+                          oo_filter_ns_to_manager(ep->thr->filter_ns),
+                          &ep->oofilter, addrs, op->n_addrs,
+                          op->ifindex, &n_added);
+  op->n_addrs = n_added;
+  kfree(addrs);
+  return 0;
+}
+static int
 efab_ep_filter_dump(ci_private_t *priv, void *arg)
 {
   oo_tcp_filter_dump_t *op = arg;
@@ -1617,6 +1654,7 @@ oo_operations_table_t oo_operations[] = {
   op(OO_IOC_EP_FILTER_CLEAR,     efab_ep_filter_clear),
   op(OO_IOC_EP_FILTER_MCAST_ADD, efab_ep_filter_mcast_add),
   op(OO_IOC_EP_FILTER_MCAST_DEL, efab_ep_filter_mcast_del),
+  op(OO_IOC_EP_FILTER_MCAST_ADD_BULK, efab_ep_filter_mcast_add_bulk),
   op(OO_IOC_EP_FILTER_DUMP,      efab_ep_filter_dump),
 
   op(OO_IOC_TCP_SOCK_LOCK,      efab_tcp_helper_sock_lock_slow_rsop),
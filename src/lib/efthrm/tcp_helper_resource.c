@@ -12,6 +12,7 @@
 /*! \cidoxg_driver_efab */
 #include <ci/internal/transport_config_opt.h>
 #include <onload_kernel_compat.h>
+#include <linux/sched/debug.h>
 #include <onload/linux_onload_internal.h>
 #include <onload/linux_onload.h>
 #include <onload/linux_ip_protocols.h>
@@ -46,6 +47,8 @@
 #include <ci/net/ipv4.h>
 #include <ci/internal/more_stats.h>
 #include <ci/internal/crc_offload_prefix.h>
+#include <ci/internal/irq_moderation.h>
+#include <ci/internal/tx_ts_ring.h>
 #include "tcp_helper_resource.h"
 #include "tcp_helper_stats_dump.h"
 #include <onload/tcp-ceph.h>
@@ -2003,9 +2006,11 @@ static int deferred_vis(tcp_helper_resource_t* trs)
 }
 
 
-static void vi_complete(void *completion_void)
+static void vi_flush_complete(void *trs_void)
 {
-  complete((struct completion *)completion_void);
+  tcp_helper_resource_t* trs = trs_void;
+  if( atomic_dec_and_test(&trs->vi_flushes_pending) )
+    complete(&trs->complete);
 }
 
 #if CI_CFG_NIC_RESET_SUPPORT
@@ -2044,6 +2049,7 @@ static void release_pkts(tcp_helper_resource_t* trs)
   for (i = 0; i < ni->pkt_sets_n; i++)
     oo_iobufset_pages_release(ni->pkt_bufs[i]);
   vfree(ni->pkt_bufs);
+  vfree(trs->pkt_set_dma_base);
 }
 
 
@@ -2071,17 +2077,23 @@ static void release_vi(tcp_helper_resource_t* trs)
 {
   int intf_i;
 
-  /* Flush vis first to ensure our bufs won't be used any more */
+  /* Flush vis first to ensure our bufs won't be used any more.  All the
+   * flushes are issued before we wait, so that they proceed in parallel
+   * across VIs and interfaces.  The extra count held while issuing stops
+   * an early completion from waking us too soon. */
+  reinit_completion(&trs->complete);
+  atomic_set(&trs->vi_flushes_pending, 1);
   OO_STACK_FOR_EACH_INTF_I(&trs->netif, intf_i) {
     int vi_i;
     for( vi_i = ci_netif_num_vis(&trs->netif) - 1; vi_i >= 0; --vi_i ) {
       struct efrm_vi *vi_rs = trs->nic[intf_i].thn_vi_rs[vi_i];
-      reinit_completion(&trs->complete);
-      efrm_vi_register_flush_callback(vi_rs, &vi_complete, &trs->complete);
+      atomic_inc(&trs->vi_flushes_pending);
+      efrm_vi_register_flush_callback(vi_rs, &vi_flush_complete, trs);
       efrm_vi_resource_stop_callback(vi_rs);
-      wait_for_completion(&trs->complete);
     }
   }
+  vi_flush_complete(trs);
+  wait_for_completion(&trs->complete);
 
   /* Now do the rest of vi release */
   OO_STACK_FOR_EACH_INTF_I(&trs->netif, intf_i) {
@@ -2353,6 +2365,12 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   sz += sizeof(ci_tcp_prev_seq_t) * no_seq_table_entries;
   sz = CI_ROUND_UP(sz, __alignof__(struct oo_deferred_pkt));
   sz += sizeof(struct oo_deferred_pkt) * NI_OPTS(ni).defer_arp_pkts;
+#if CI_CFG_TIMESTAMPING
+  sz = CI_ROUND_UP(sz, __alignof__(struct onload_tx_timestamp));
+  sz += sizeof(struct onload_tx_timestamp) * NI_OPTS(ni).tx_timestamp_ring;
+#endif
+  sz = CI_ROUND_UP(sz, __alignof__(ci_ip_reasm_entry));
+  sz += sizeof(ci_ip_reasm_entry) * NI_OPTS(ni).ip_reasm_max;
   sz = CI_ROUND_UP(sz, __alignof__(ci_netif_filter_table));
   sz += filter_table_size;
   sz = CI_ROUND_UP(sz, __alignof__(ci_netif_filter_table_entry_ext));
@@ -2468,6 +2486,16 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   ns->deferred_pkts_ofs = ns_ofs;
   ns_ofs += sizeof(struct oo_deferred_pkt) * NI_OPTS(ni).defer_arp_pkts;
 
+#if CI_CFG_TIMESTAMPING
+  ns_ofs = CI_ROUND_UP(ns_ofs, __alignof__(struct onload_tx_timestamp));
+  ns->tx_ts_ring_ofs = ns_ofs;
+  ns_ofs += sizeof(struct onload_tx_timestamp) * NI_OPTS(ni).tx_timestamp_ring;
+#endif
+
+  ns_ofs = CI_ROUND_UP(ns_ofs, __alignof__(ci_ip_reasm_entry));
+  ns->ip_reasm_ofs = ns_ofs;
+  ns_ofs += sizeof(ci_ip_reasm_entry) * NI_OPTS(ni).ip_reasm_max;
+
   ns_ofs = CI_ROUND_UP(ns_ofs, __alignof__(ci_netif_filter_table));
   ns->table_ofs = ns_ofs;
   ns_ofs += filter_table_size;
@@ -2505,6 +2533,10 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
 #endif
   ni->seq_table = (void*) ((char*) ns + ns->seq_table_ofs);
   ni->deferred_pkts = (void*) ((char*) ns + ns->deferred_pkts_ofs);
+#if CI_CFG_TIMESTAMPING
+  ni->tx_ts_ring = (void*) ((char*) ns + ns->tx_ts_ring_ofs);
+#endif
+  ni->ip_reasm = (void*) ((char*) ns + ns->ip_reasm_ofs);
   ni->filter_table = (void*) ((char*) ns + ns->table_ofs);
   ni->filter_table_ext = (void*) ((char*) ns + ns->table_ext_ofs);
 
@@ -2887,6 +2919,14 @@ allocate_netif_hw_resources(ci_resource_onload_alloc_t* alloc,
   OO_STACK_FOR_EACH_INTF_I(ni, intf_i)
     ni->nic_hw[intf_i].pkt_rs = NULL;
 
+  trs->pkt_set_dma_base = vmalloc(sizeof(ci_uint32) * ni->pkt_sets_max);
+  if( trs->pkt_set_dma_base == NULL ) {
+    OO_DEBUG_ERR(ci_log("%s: failed to allocate DMA base table",
+                        __FUNCTION__));
+    rc = -ENOMEM;
+    goto fail5;
+  }
+
   OO_STACK_FOR_EACH_INTF_I(ni, intf_i) {
     if( (ni->nic_hw[intf_i].pkt_rs = ci_alloc(sz)) == NULL ) {
       OO_DEBUG_ERR(ci_log("%s: failed to allocate iobufset tables",
@@ -2940,6 +2980,7 @@ allocate_netif_hw_resources(ci_resource_onload_alloc_t* alloc,
   OO_STACK_FOR_EACH_INTF_I(ni, intf_i)
     if( ni->nic_hw[intf_i].pkt_rs )
       ci_free(ni->nic_hw[intf_i].pkt_rs);
+  vfree(trs->pkt_set_dma_base);
   vfree(ni->pkt_bufs);
  fail4:
   release_vi(trs);
@@ -4228,6 +4269,17 @@ int oo_wait_for_interrupt(ci_private_t* priv, void* argp)
   unsigned long timeout = msecs_to_jiffies(arg->timeout_ms);
   ci_uint32 intfs;
 
+  if( arg->flags & OO_ULH_WAIT_FLAG_NONBLOCK ) {
+    /* The shared helper polls the stack fd, and then collects the work
+     * here without blocking. */
+    request_pending_wakeups(trs);
+    stack_has_ul_job(trs, &intfs, &arg->flags);
+    if( NI_OPTS(&trs->netif).int_driven && intfs != 0 )
+      ci_atomic_or(&trs->wake_intfs, intfs);
+    arg->rs_ref_count = trs->ref[OO_THR_REF_APP];
+    return 0;
+  }
+
   if( timeout == 0 || timeout > periodic_poll )
     timeout = periodic_poll;
 
@@ -4269,6 +4321,16 @@ int oo_wait_for_interrupt(ci_private_t* priv, void* argp)
   return 0;
 }
 
+unsigned oo_ulh_fop_poll(tcp_helper_resource_t* trs, struct file* file,
+                         poll_table* wait)
+{
+  request_pending_wakeups(trs);
+  poll_wait(file, &trs->ulh_waitq, wait);
+  if( ci_atomic_read(&trs->intr_intfs) != 0 || trs->ulh_flags != 0 )
+    return POLLIN | POLLRDNORM;
+  return 0;
+}
+
 static int oo_handle_wakeup_in_ul(void* context, int is_timeout,
                                   struct efhw_nic* nic, int budget)
 {
@@ -4425,6 +4487,9 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
 #endif
 
   ni = &rs->netif;
+  rs->mapping_inode = NULL;
+  rs->pkt_sets_hot = 0;
+  rs->pkt_sets_retired_hwm = 0;
 
   ni->opts = *opts;
   ci_netif_config_opts_rangecheck(&ni->opts);
@@ -4673,6 +4738,7 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
 
   if( (rc = ci_netif_init_fill_rx_rings(ni)) != 0 )
     goto fail9;
+  rs->pkt_sets_hot = ni->packets->sets_hot = ni->pkt_sets_n;
 
   rs->tproxy_ifindex = NULL;
   /* When requested set up tproxy mode on selected interface(s) */
@@ -4809,6 +4875,11 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
 #endif
   }
 #if ! CI_CFG_UL_INTERRUPT_HELPER
+  if( NI_OPTS(ni).pkt_shrink_idle != 0 &&
+      (rs->mapping_inode = onload_alloc_mapping_inode()) == NULL )
+    NI_LOG(ni, RESOURCE_WARNINGS,
+           FN_FMT "Failed to allocate mapping inode; packet sets will not "
+           "be returned to the system", FN_PRI_ARGS(ni));
   tcp_helper_initialize_and_start_periodic_timer(rs);
   if( NI_OPTS(ni).int_driven )
     tcp_helper_request_wakeup(netif2tcp_helper_resource(ni));
@@ -5837,10 +5908,31 @@ tcp_helper_stop(tcp_helper_resource_t* trs)
  *
  *--------------------------------------------------------------------*/
 
+static void
+tcp_helper_destroy_stats_update(ci_uint32 ports_us, ci_uint32 hw_us,
+                                ci_uint32 total_us)
+{
+  struct oo_stack_destroy_stats* st = &efab_tcp_driver.stack_destroy;
+  ci_irqlock_state_t lock_flags;
+
+  ci_irqlock_lock(&THR_TABLE.lock, &lock_flags);
+  ++st->n_destroyed;
+  st->ports_us_last = ports_us;
+  st->ports_us_max = CI_MAX(st->ports_us_max, ports_us);
+  st->hw_us_last = hw_us;
+  st->hw_us_max = CI_MAX(st->hw_us_max, hw_us);
+  st->total_us_last = total_us;
+  st->total_us_max = CI_MAX(st->total_us_max, total_us);
+  ci_irqlock_unlock(&THR_TABLE.lock, &lock_flags);
+}
+
+
 void tcp_helper_dtor(tcp_helper_resource_t* trs)
 {
   int rc;
   ci_irqlock_state_t lock_flags;
+  ktime_t start = ktime_get(), t;
+  ci_uint32 ports_us, hw_us;
 
   ci_assert(NULL != trs);
 
@@ -5897,6 +5989,8 @@ void tcp_helper_dtor(tcp_helper_resource_t* trs)
   /* Remove all filters - and make sure we do not send anything, while
    * closing socket or as a reply to a network packet. */
   release_ep_tbl(trs);
+  t = ktime_get();
+  ports_us = ktime_us_delta(t, start);
 
 #if CI_CFG_HANDLE_ICMP
   /* dlfilters have been removed.  Let's process (and free) all icmp
@@ -5928,8 +6022,12 @@ void tcp_helper_dtor(tcp_helper_resource_t* trs)
 
   oo_filter_ns_put(&efab_tcp_driver, trs->filter_ns);
 
+  t = ktime_get();
   release_netif_hw_resources(trs);
+  hw_us = ktime_us_delta(ktime_get(), t);
   release_netif_resources(trs);
+  if( trs->mapping_inode != NULL )
+    iput(trs->mapping_inode);
   if( trs->thc_pktbuf_alloc )
     oo_hugetlb_allocator_put(trs->thc_pktbuf_alloc);
   if( trs->thc_efct_alloc )
@@ -5964,7 +6062,11 @@ void tcp_helper_dtor(tcp_helper_resource_t* trs)
   --THR_TABLE.stack_count;
   ci_irqlock_unlock(&THR_TABLE.lock, &lock_flags);
 
-  OO_DEBUG_TCPH(ci_log("%s [%u]: finished", __FUNCTION__, trs->id));  
+  tcp_helper_destroy_stats_update(ports_us, hw_us,
+                                  ktime_us_delta(ktime_get(), start));
+  OO_DEBUG_TCPH(ci_log("%s [%u]: finished: ports released after %uus, "
+                       "hw released in %uus", __FUNCTION__, trs->id,
+                       ports_us, hw_us));
   CI_FREE_OBJ(trs);
 }
 
@@ -6347,7 +6449,10 @@ efab_tcp_helper_iobufset_alloc(tcp_helper_resource_t* trs,
    * Otherwise, we'll avoid them. */
   if( ni->flags & CI_NETIF_FLAG_HUGE_PAGES_FAILED )
     flags |= OO_IOBUFSET_FLAG_HUGE_PAGE_FAILED;
-  if( !in_atomic() && current->mm != NULL ) {
+  /* Ids that were returned by the idle reclaimer may still be mapped by
+   * user-level, which will fault the new set in via small pages. */
+  if( !in_atomic() && current->mm != NULL &&
+      ni->pkt_sets_n >= trs->pkt_sets_retired_hwm ) {
 #ifdef EFRM_DO_NAMESPACES
     struct nsproxy *ns;
     ns = task_nsproxy_start(current);
@@ -6507,6 +6612,75 @@ static long efab_get_unstraddled_user_pages(unsigned long base, long max_pages,
 }
 
 
+#if PAGE_SIZE == EFHW_NIC_PAGE_SIZE
+#ifdef EFRM_HAVE_MMU_INTERVAL_NOTIFIER
+static bool usermem_invalidate(struct mmu_interval_notifier* mni,
+                               const struct mmu_notifier_range* range,
+                               unsigned long cur_seq)
+{
+  struct oo_iobufs_usermem* ioum;
+  ioum = container_of(mni, struct oo_iobufs_usermem, notifier);
+
+  /* The pages are pinned, so changes of protection or migration don't
+   * change what the registration maps; anything else might. */
+  switch( range->event ) {
+  case MMU_NOTIFY_PROTECTION_VMA:
+  case MMU_NOTIFY_PROTECTION_PAGE:
+  case MMU_NOTIFY_SOFT_DIRTY:
+    break;
+  default:
+    ci_atomic32_inc(&ioum->trs->netif.state->zc_reg_inval_seq);
+    break;
+  }
+  mmu_interval_set_seq(mni, cur_seq);
+  return true;
+}
+
+static const struct mmu_interval_notifier_ops usermem_notifier_ops = {
+  .invalidate = usermem_invalidate,
+};
+#endif
+
+
+static int usermem_watch(tcp_helper_resource_t* trs,
+                         struct oo_iobufs_usermem* ioum,
+                         unsigned long user_base, int n_pages)
+{
+#ifdef EFRM_HAVE_MMU_INTERVAL_NOTIFIER
+  int rc;
+
+  ioum->trs = trs;
+  ioum->notifier_active = false;
+  if( NI_OPTS(&trs->netif).zc_reg_cache == 0 )
+    return 0;
+  rc = mmu_interval_notifier_insert(&ioum->notifier, current->mm, user_base,
+                                    (unsigned long) n_pages << PAGE_SHIFT,
+                                    &usermem_notifier_ops);
+  if( rc == 0 )
+    ioum->notifier_active = true;
+  return rc;
+#else
+  /* Without a notifier we can't tell user-level when the memory goes away,
+   * so make every cached registration stale as soon as it's made. */
+  if( NI_OPTS(&trs->netif).zc_reg_cache != 0 )
+    ci_atomic32_inc(&trs->netif.state->zc_reg_inval_seq);
+  return 0;
+#endif
+}
+#endif
+
+
+static void usermem_unwatch(struct oo_iobufs_usermem* ioum)
+{
+#ifdef EFRM_HAVE_MMU_INTERVAL_NOTIFIER
+  if( ioum->notifier_active ) {
+    mmu_interval_notifier_remove(&ioum->notifier);
+    ioum->notifier_active = false;
+  }
+#endif
+}
+
+
 int efab_tcp_helper_map_usermem(tcp_helper_resource_t* trs,
                                 struct oo_iobufs_usermem* ioum,
                                 unsigned long user_base, int n_pages,
@@ -6529,9 +6703,16 @@ int efab_tcp_helper_map_usermem(tcp_helper_resource_t* trs,
   if( user_base & (PAGE_SIZE - 1) || n_pages == 0 )
     return -EINVAL;
 
+  /* Start watching before pinning so that an unmap can't slip between. */
+  rc = usermem_watch(trs, ioum, user_base, n_pages);
+  if( rc < 0 )
+    return rc;
+
   pages = kmalloc_array(n_pages, sizeof(*pages), GFP_KERNEL);
-  if( ! pages )
+  if( ! pages ) {
+    usermem_unwatch(ioum);
     return -ENOMEM;
+  }
 
   mmap_read_lock(current->mm);
   rc = efab_get_unstraddled_user_pages(user_base, n_pages, pages);
@@ -6676,6 +6857,7 @@ int efab_tcp_helper_map_usermem(tcp_helper_resource_t* trs,
   efab_put_pages(pages, n_pages);
  fail1:
   kfree(pages);
+  usermem_unwatch(ioum);
   return rc;
 #endif
 }
@@ -6688,6 +6870,7 @@ void efab_tcp_helper_unmap_usermem(tcp_helper_resource_t* trs,
   int group_i;
   int intf_i;
 
+  usermem_unwatch(ioum);
   for( group_i = 0; group_i < ioum->n_groups; ++group_i ) {
     struct oo_iobufs_usermem_group* g = &ioum->groups[group_i];
     OO_STACK_FOR_EACH_INTF_I(ni, intf_i)
@@ -6806,6 +6989,7 @@ efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
   ni->packets->set[bufset_id].page_offset = -1;
 #endif
   ni->packets->set[bufset_id].dma_addr_base = ni->dma_addr_next;
+  trs->pkt_set_dma_base[bufset_id] = ni->dma_addr_next;
   if( page_order > CI_CFG_PKTS_PER_SET_S ) {
     /* page_order=INT_MAX means that there are no hardware interfaces associated
      * with this stack. */
@@ -7113,6 +7297,40 @@ static int oo_handle_wakeup_or_timeout(void* context, int is_timeout,
 }
 
 
+/* Re-enable interrupts after an interrupt-driven poll that handled [n_evs]
+ * events.  With EF_INT_MODERATION_ADAPTIVE a busy interface is given the
+ * evq timer instead of an immediate wakeup, so that the next interrupt
+ * arrives a little after the next event rather than straight away.
+ */
+static void
+tcp_helper_int_driven_rearm(tcp_helper_resource_t* trs, int intf_i, int n_evs)
+{
+  ci_netif* ni = &trs->netif;
+  ef_vi* vi = ci_netif_vi(ni, intf_i);
+  ci_uint64 now;
+  unsigned usec;
+
+  if( NI_OPTS(ni).int_moderation_adaptive &&
+      vi->nic_type.arch == EF_VI_ARCH_EF10 ) {
+    ci_frc64(&now);
+    usec = ci_irqmod_update(&ni->state->nic[intf_i].irqmod, n_evs, now,
+                            IPTIMER_STATE(ni)->khz,
+                            NI_OPTS(ni).int_moderation_rate,
+                            NI_OPTS(ni).int_moderation_max_usec);
+    if( usec != 0 ) {
+      /* The timer is started by the next event to arrive, so it only
+       * covers us if nothing arrived since we polled. */
+      ef_eventq_timer_prime(vi, usec);
+      if( ! ci_netif_intf_has_event(ni, intf_i) ) {
+        CITP_STATS_NETIF_INC(ni, interrupt_moderated);
+        return;
+      }
+    }
+  }
+  tcp_helper_request_wakeup_nic(trs, intf_i);
+}
+
+
 static int oo_handle_wakeup_int_driven(void* context, int is_timeout,
                                         struct efhw_nic* nic_, int budget)
 {
@@ -7137,7 +7355,9 @@ static int oo_handle_wakeup_int_driven(void* context, int is_timeout,
     /* otherwise continue as though POLL_AND_PRIME wasn't initially set */
   }
 
-  ci_assert( ! is_timeout );
+  /* Timeouts come only from adaptive moderation, and are handled just as
+   * wakeups are. */
+  ci_assert( ! is_timeout || NI_OPTS(ni).int_moderation_adaptive );
   TCP_HELPER_RESOURCE_ASSERT_VALID(trs, -1);
   CITP_STATS_NETIF_INC(ni, interrupts);
 
@@ -7183,7 +7403,7 @@ static int oo_handle_wakeup_int_driven(void* context, int is_timeout,
          */
         if( ci_bit_test(&ni->state->evq_prime_deferred, tcph_nic->thn_intf_i) )
           ci_bit_clear(&ni->state->evq_prime_deferred, tcph_nic->thn_intf_i);
-        tcp_helper_request_wakeup_nic(trs, tcph_nic->thn_intf_i);
+        tcp_helper_int_driven_rearm(trs, tcph_nic->thn_intf_i, n);
         efab_tcp_helper_netif_unlock(trs, 1);
         break;
       }
@@ -7332,6 +7552,164 @@ ci_netif_collect_periodic_metrics(ci_netif* ni)
     ni->state->stats.lowest_free_pkts = free_pkts;
 }
 
+/* Return the highest packet set to the system.  The set must be entirely
+ * free, and must not be one of the sets allocated at stack creation or the
+ * set that we are currently allocating from.
+ */
+static int efab_tcp_helper_pkt_set_retire(tcp_helper_resource_t* trs)
+{
+  struct oo_iobufset* iobrs[CI_CFG_MAX_INTERFACES];
+  struct oo_buffer_pages* pages;
+  ci_irqlock_state_t lock_flags;
+  ci_netif* ni = &trs->netif;
+  int bufset_id = ni->pkt_sets_n - 1;
+  int intf_i, n;
+  ci_ip_pkt_fmt* pkt;
+  oo_pkt_p pp;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  if( bufset_id < (int) trs->pkt_sets_hot ||
+      bufset_id == ni->packets->id ||
+      ni->packets->set[bufset_id].n_free != PKTS_PER_SET )
+    return -EBUSY;
+  /* The shared state is not to be trusted when giving memory back, so
+   * check that every buffer in the set really is on its free list. */
+  for( pp = ni->packets->set[bufset_id].free, n = 0;
+       OO_PP_NOT_NULL(pp) && n <= PKTS_PER_SET; pp = pkt->next, ++n ) {
+    pkt = PKT_CHK(ni, pp);
+    if( PKT_SET_ID(pkt) != bufset_id || pkt->refcount != 0 )
+      return -EBUSY;
+  }
+  if( n != PKTS_PER_SET )
+    return -EBUSY;
+#ifdef OO_DO_HUGE_PAGES
+  /* User-level maps huge pages via shm, and we can't revoke that. */
+  if( oo_iobufset_get_hugetlb_page(ni->pkt_bufs[bufset_id]) )
+    return -EBUSY;
+#endif
+
+  ci_irqlock_lock(&THR_TABLE.lock, &lock_flags);
+  pages = ni->pkt_bufs[bufset_id];
+  ni->pkt_bufs[bufset_id] = NULL;
+  OO_STACK_FOR_EACH_INTF_I(ni, intf_i) {
+    iobrs[intf_i] = ni->nic_hw[intf_i].pkt_rs[bufset_id];
+    ni->nic_hw[intf_i].pkt_rs[bufset_id] = NULL;
+  }
+  --ni->pkt_sets_n;
+  ci_irqlock_unlock(&THR_TABLE.lock, &lock_flags);
+
+  ni->packets->sets_n = ni->pkt_sets_n;
+  ni->packets->n_pkts_allocated = ni->pkt_sets_n << CI_CFG_PKTS_PER_SET_S;
+  ni->packets->n_free -= PKTS_PER_SET;
+  ni->packets->set[bufset_id].free = OO_PP_NULL;
+  ni->packets->set[bufset_id].n_free = 0;
+  /* This was the last set allocated, so its DMA addresses are at the end.
+   * Take the base from our own copy, as user-level can write the one in
+   * the shared state. */
+  ni->dma_addr_next = trs->pkt_set_dma_base[bufset_id];
+  trs->pkt_sets_retired_hwm = CI_MAX(trs->pkt_sets_retired_hwm,
+                                     (unsigned) bufset_id + 1);
+
+  /* Zap the user mappings of this set.  User-level keeps its pointer to
+   * the set, and if the set id is reused the new pages are faulted in. */
+  unmap_mapping_range(trs->mapping_inode->i_mapping,
+                      OO_MMAP_MAKE_OFFSET(OO_MMAP_TYPE_NETIF,
+                                          CI_NETIF_MMAP_ID_PKTSET(bufset_id)),
+                      CI_CFG_PKT_BUF_SIZE * PKTS_PER_SET, 1);
+
+  OO_STACK_FOR_EACH_INTF_I(ni, intf_i)
+    oo_iobufset_resource_release(iobrs[intf_i],
+                                 intfs_suspended(trs) & (1 << intf_i));
+  oo_iobufset_pages_release(pages);
+
+  OO_DEBUG_SHM(ci_log("[%d] returned bufset id %d, current=%d n_freepkts=%d",
+                      NI_ID(ni), bufset_id, ni->packets->id,
+                      ni->packets->n_free));
+  CHECK_FREEPKTS(ni);
+  return 0;
+}
+
+/* Return packet sets to the system once fewer than EF_PKT_SHRINK_THRESHOLD
+ * percent of packet buffers have been in use for EF_PKT_SHRINK_IDLE ms.
+ * Called with the stack locked from the periodic timer, which only gets
+ * here when the stack is otherwise idle.
+ */
+static void efab_tcp_helper_pkt_shrink(tcp_helper_resource_t* trs)
+{
+  ci_netif* ni = &trs->netif;
+  ci_ip_pkt_fmt* pkt;
+  unsigned long now = jiffies;
+  int below, bufset_id, n_free_b4, n_retired = 0;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  if( trs->mapping_inode == NULL || ni->pkt_sets_n <= trs->pkt_sets_hot )
+    return;
+
+  below = (ci_uint64) (ni->packets->n_pkts_allocated - ni->packets->n_free)
+          * 100 < (ci_uint64) ni->packets->n_pkts_allocated *
+          NI_OPTS(ni).pkt_shrink_threshold;
+  /* If we've not looked for a while then the stack has been busy, and we
+   * don't know what usage was in the meantime. */
+  if( ! below || time_after(now, trs->pkt_shrink_checked +
+                                 2 * (periodic_poll + periodic_poll_skew)) )
+    trs->pkt_shrink_since = now;
+  trs->pkt_shrink_checked = now;
+  if( ! below || time_before(now, trs->pkt_shrink_since +
+                             msecs_to_jiffies(NI_OPTS(ni).pkt_shrink_idle)) )
+    return;
+
+  /* Free buffers that are idling in reserves, so that more sets drain. */
+  n_free_b4 = ni->packets->n_free;
+  while( (pkt = ci_netif_pkt_alloc_nonb(ni)) != NULL ) {
+    --ni->state->n_async_pkts;
+    pkt->flags &= ~CI_PKT_FLAG_NONB_POOL;
+    ci_netif_pkt_release_1ref(ni, pkt);
+  }
+  ci_netif_try_to_reap(ni, PKTS_PER_SET);
+  ni->state->stats.pkt_shrink_trimmed += ni->packets->n_free - n_free_b4;
+
+  /* Move allocation off the highest set so that it can drain. */
+  if( ni->packets->id == ni->pkt_sets_n - 1 )
+    for( bufset_id = 0; bufset_id < ni->packets->id; ++bufset_id )
+      if( ! ci_netif_pkt_set_is_underfilled(ni, bufset_id) ) {
+        ci_netif_pkt_set_change(ni, bufset_id, 0);
+        break;
+      }
+
+  while( efab_tcp_helper_pkt_set_retire(trs) == 0 )
+    ++n_retired;
+  ni->state->stats.pkt_sets_shrunk += n_retired;
+}
+
+/* The periodic timer found the stack locked: if that's because a thread
+ * has been sitting on the lock for longer than EF_LOCK_WATCHDOG_USEC,
+ * add the holder's kernel stack to what ci_netif_lock_watchdog() logs.
+ */
+static void efab_tcp_helper_lock_watchdog(tcp_helper_resource_t* rs)
+{
+  ci_netif* ni = &rs->netif;
+  struct task_struct* task;
+  ci_uint32 tid;
+
+  tid = ci_netif_lock_watchdog(ni, &rs->lock_watchdog_reported);
+  if( tid == 0 )
+    return;
+
+  rcu_read_lock();
+  task = pid_task(ci_netif_pid_lookup(ni, tid), PIDTYPE_PID);
+  if( task != NULL )
+    get_task_struct(task);
+  rcu_read_unlock();
+  if( task == NULL ) {
+    ci_log("[%s]   lock holder %u has exited", ni->state->pretty_name, tid);
+    return;
+  }
+  sched_show_task(task);
+  put_task_struct(task);
+}
+
 static void
 linux_tcp_timer_do(tcp_helper_resource_t* rs, unsigned long* next_timer)
 {
@@ -7355,6 +7733,8 @@ linux_tcp_timer_do(tcp_helper_resource_t* rs, unsigned long* next_timer)
 
       rc = ci_netif_poll(ni);
       oo_inject_packets_kernel_force(ni);
+      if( NI_OPTS(ni).pkt_shrink_idle != 0 )
+        efab_tcp_helper_pkt_shrink(rs);
       *next_timer = tcp_helper_next_ip_timer(ni);
       efab_tcp_helper_netif_unlock(rs, 0);
       CITP_STATS_NETIF_INC(ni, periodic_polls);
@@ -7363,6 +7743,11 @@ linux_tcp_timer_do(tcp_helper_resource_t* rs, unsigned long* next_timer)
     }
     else {
       CITP_STATS_NETIF_INC(ni, periodic_lock_contends);
+      if( NI_OPTS(ni).lock_watchdog_usec != 0 ) {
+        efab_tcp_helper_lock_watchdog(rs);
+        /* Come back soon to see how long the hold lasts. */
+        *next_timer = usecs_to_jiffies(NI_OPTS(ni).lock_watchdog_usec);
+      }
     }
     ci_netif_collect_periodic_metrics(ni);
   }
@@ -7391,6 +7776,7 @@ static void
 tcp_helper_initialize_and_start_periodic_timer(tcp_helper_resource_t* rs)
 {
   atomic_set(&rs->timer_running, 1);
+  rs->pkt_shrink_since = rs->pkt_shrink_checked = jiffies;
 
   INIT_DELAYED_WORK(&rs->timer, linux_tcp_helper_periodic_timer);
 
@@ -290,6 +290,14 @@ int onload_timestamping_request(int fd, unsigned flags)
 }
 
 
+__attribute__((weak))
+int onload_tx_timestamp_read(int fd, struct onload_tx_timestamp* recs,
+                             int max, unsigned* dropped)
+{
+  return -ENOSYS;
+}
+
+
 /**************************************************************************/
 
 __attribute__((weak))
@@ -347,3 +355,31 @@ onload_socket_unicast_nonaccel(int domain, int type, int protocol)
   return socket(domain, type, protocol);
 }
 
+__attribute__((weak))
+int
+onload_mcast_join_bulk(int fd, const struct ip_mreqn* groups, int n_groups)
+{
+  int i;
+  for( i = 0; i < n_groups; ++i )
+    if( setsockopt(fd, SOL_IP, IP_ADD_MEMBERSHIP,
+                   &groups[i], sizeof(groups[i])) < 0 )
+      return i ? i : -1;
+  return n_groups;
+}
+
+__attribute__((weak))
+int
+onload_checkpoint(int out_fd, const int* fds, int n_fds)
+{
+  errno = ENOSYS;
+  return -1;
+}
+
+__attribute__((weak))
+int
+onload_restore(int in_fd, int* fds, int max_fds, unsigned flags)
+{
+  errno = ENOSYS;
+  return -1;
+}
+
@@ -241,6 +241,10 @@ wrap( int, onload_ordered_epoll_wait, (int epfd, struct epoll_event *events,
 wrap(int, onload_timestamping_request, (int fd, unsigned flags),
      (fd, flags), -ENOSYS)
 
+wrap(int, onload_tx_timestamp_read,
+     (int fd, struct onload_tx_timestamp* recs, int max, unsigned* dropped),
+     (fd, recs, max, dropped), -ENOSYS)
+
 wrap(enum onload_delegated_send_rc,  onload_delegated_send_prepare,
      (int fd, int size, unsigned flags, struct onload_delegated_send* out),
      (fd, size, flags, out), ONLOAD_DELEGATED_SEND_RC_BAD_SOCKET)
@@ -267,3 +271,26 @@ wrap_with_fn(int, onload_socket_unicast_nonaccel,
              (int domain, int type, int protocol),
              (domain, type, protocol), socket)
 
+
+static int
+mcast_join_bulk_os(int fd, const struct ip_mreqn* groups, int n_groups)
+{
+  int i;
+  for( i = 0; i < n_groups; ++i )
+    if( setsockopt(fd, SOL_IP, IP_ADD_MEMBERSHIP,
+                   &groups[i], sizeof(groups[i])) < 0 )
+      return i ? i : -1;
+  return n_groups;
+}
+
+wrap_with_fn(int, onload_mcast_join_bulk,
+             (int fd, const struct ip_mreqn* groups, int n_groups),
+             (fd, groups, n_groups), mcast_join_bulk_os)
+
+wrap_with_errno(int, onload_checkpoint,
+                (int out_fd, const int* fds, int n_fds),
+                (out_fd, fds, n_fds), -1, ENOSYS)
+
+wrap_with_errno(int, onload_restore,
+                (int in_fd, int* fds, int max_fds, unsigned flags),
+                (in_fd, fds, max_fds, flags), -1, ENOSYS)
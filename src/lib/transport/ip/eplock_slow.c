@@ -14,10 +14,12 @@
 /*! \cidoxg_lib_transport_ip */
 #include <ci/internal/ip.h>
 #include <ci/internal/ip_log.h>
+#include <ci/internal/probes.h>
 
 #ifndef __KERNEL__
 # include <onload/ul.h>
 # include "ip_internal.h"
+# include <sys/syscall.h>
 #endif
 
 
@@ -50,6 +52,7 @@ int __ef_eplock_lock_slow(ci_netif *ni, long timeout, int maybe_wedged)
 #ifndef __KERNEL__
   ci_assert_equal(maybe_wedged, 0);
 #endif
+  OO_PROBE1(lock_wait, NI_ID(ni));
 
 #ifndef __KERNEL__
   /* Limit to user-level for now.  Could allow spinning in kernel if we did
@@ -62,16 +65,20 @@ int __ef_eplock_lock_slow(ci_netif *ni, long timeout, int maybe_wedged)
     while( now_frc - start_frc < ni->state->buzz_cycles ) {
       ci_spinloop_pause();
       ci_frc64(&now_frc);
-      if( ef_eplock_trylock(&ni->state->lock) )
+      if( ef_eplock_trylock(&ni->state->lock) ) {
+        OO_PROBE2(lock_acquired, NI_ID(ni), 0);
         return 0;
+      }
     }
   }
 #endif
 
   while( 1 ) {
     rc = __oo_eplock_lock(ni, &timeout, maybe_wedged);
-    if( rc == 0 || rc == -ETIMEDOUT )
+    if( rc == 0 || rc == -ETIMEDOUT ) {
+      OO_PROBE2(lock_acquired, NI_ID(ni), rc);
       return rc;
+    }
 
 #ifndef __KERNEL__
     if( rc == -EINTR )
@@ -102,4 +109,66 @@ int __ef_eplock_lock_slow(ci_netif *ni, long timeout, int maybe_wedged)
   return 0;
 }
 
+
+#ifndef __KERNEL__
+/* Not inlined, so that the return address is the code that took the lock.
+ * The thread id is not cached, as it would be wrong in a forked child.
+ *
+ * The thread id is written last, so that ci_netif_lock_watchdog() never
+ * sees it together with the time and site of an earlier hold.
+ */
+void ef_eplock_holder_note(ci_eplock_t* l)
+{
+  ci_frc64(&l->holder_frc);
+  l->holder_site = (ci_uintptr_t) __builtin_return_address(0);
+  ci_wmb();
+  l->holder_tid = syscall(SYS_gettid);
+}
+#endif
+
+
+/* Called by whoever polls a stack in the background (the periodic timer or
+ * onload_helper) when it finds the lock held.  If the holder has had it
+ * for longer than EF_LOCK_WATCHDOG_USEC, logs the holder and the state of
+ * the stack and returns the holder's thread id, so that the caller can add
+ * what it knows of that thread.  [*reported_frc] identifies the last hold
+ * reported by this caller, so each hold is reported once.  Returns 0 if
+ * there is nothing to report, including when the holder is not known.
+ */
+ci_uint32 ci_netif_lock_watchdog(ci_netif* ni, ci_uint64* reported_frc)
+{
+  ci_eplock_t* l = &ni->state->lock;
+  ci_uint64 lock_val, frc, site, now;
+  ci_uint32 tid;
+
+  if( ni->state->lock_watchdog_cycles == 0 )
+    return 0;
+
+  tid = l->holder_tid;
+  ci_rmb();
+  frc = l->holder_frc;
+  site = l->holder_site;
+  lock_val = l->lock;
+  ci_rmb();
+  /* The holder changed while we were looking, so this hold has ended. */
+  if( l->holder_tid != tid )
+    return 0;
+  if( tid == 0 || ! (lock_val & CI_EPLOCK_LOCKED) || frc == *reported_frc )
+    return 0;
+  ci_frc64(&now);
+  if( now - frc < ni->state->lock_watchdog_cycles )
+    return 0;
+
+  *reported_frc = frc;
+  CITP_STATS_NETIF_INC(ni, lock_watchdog_reports);
+  ci_log("[%s] stack lock held for %uus by thread %u from %"CI_PRIx64,
+         ni->state->pretty_name, oo_cycles64_to_usec(ni, now - frc), tid,
+         site);
+  ci_log("[%s]   lock=%"CI_PRIx64" "CI_NETIF_LOCK_FMT" in_poll=%d "
+         "free_pkts=%d", ni->state->pretty_name, lock_val,
+         CI_NETIF_LOCK_PRI_ARG(lock_val), ni->state->in_poll,
+         ni->packets->n_free);
+  return tid;
+}
+
 /*! \cidoxg_end */
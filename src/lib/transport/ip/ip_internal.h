@@ -111,6 +111,10 @@ ci_inline void ci_tcp_update_rtt(ci_netif* netif, ci_tcp_state* ts, int m)
     return;
   }
   m = CI_MAX(1, m);
+#if CI_CFG_TCP_INFO_METRICS
+  if( ts->min_rtt == 0 || m < ts->min_rtt )
+    ts->min_rtt = CI_MIN(m, 0xffff);
+#endif
 
   if( CI_LIKELY(ts->sa) ) {
     /* See Jacobson's SIGCOMM 88 algorithm to calculate (2.3) of
@@ -746,6 +750,49 @@ oo_spinloop_pause_check_signals(ci_netif* ni,
 #endif
 
 
+/**********************************************************************
+ * ci_netif_spin_wait()
+ */
+
+#ifndef __KERNEL__
+/* EF_SPIN_LOW_POWER: wait in a low-power state until the adapter writes
+ * to interface [intf_i], or for at most ni->spin_wait_ticks.  [future] is
+ * from ci_netif_intf_rx_future(); if it is a real RX buffer then we wait for
+ * it to be filled, and otherwise for the next event queue entry.  Returns
+ * straight away if neither location is known.
+ *
+ * Only call this when ni->spin_wait_ticks is non-zero.
+ */
+ci_inline void
+ci_netif_spin_wait(ci_netif* ni, int intf_i, const volatile uint32_t* future,
+                   const uint32_t* poison, ci_uint64 now_frc)
+{
+  ef_vi* vi = ci_netif_vi(ni, intf_i);
+
+  ci_assert_nequal(ni->spin_wait_mode, CI_MONITOR_NONE);
+
+  /* Arm first and then re-check, so that a write between our last poll and
+   * arming the monitor is not missed. */
+  if( future != poison ) {
+    ci_monitor_arm(ni->spin_wait_mode, future);
+    if( *future != CI_PKT_RX_POISON )
+      return;
+  }
+  else if( vi->nic_type.arch == EF_VI_ARCH_EF10 ||
+           vi->nic_type.arch == EF_VI_ARCH_EF100 ) {
+    ci_monitor_arm(ni->spin_wait_mode, vi->evq_base +
+                   (vi->ep_state->evq.evq_ptr & vi->evq_mask));
+    if( ef_eventq_has_event(vi) )
+      return;
+  }
+  else {
+    return;
+  }
+  ci_monitor_wait(ni->spin_wait_mode, now_frc, ni->spin_wait_ticks);
+}
+#endif
+
+
 /*********************************************************************
  ******************************** Per-Thread *************************
  *********************************************************************/
@@ -0,0 +1,284 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+/**************************************************************************\
+*//*! \file
+**  \brief  Reassembly of fragmented UDP datagrams (EF_IP_REASM_MAX)
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_lib_transport_ip */
+
+#include "ip_internal.h"
+#include <ci/internal/ip_reasm.h>
+#include <ci/tools/ipcsum_base.h>
+
+
+#define LPF "ci_ip_reasm_"
+
+#if OO_DO_STACK_POLL
+
+
+ci_inline char* ci_ip_reasm_payload(ci_ip_pkt_fmt* pkt)
+{
+#if CI_CFG_IPV6
+  if( pkt->flags & CI_PKT_FLAG_IS_IP6 )
+    return (char*) (oo_ip6_hdr(pkt) + 1) + sizeof(ci_ip6_frag_hdr);
+#endif
+  return (char*) (oo_ip_hdr(pkt) + 1);
+}
+
+
+static void ci_ip_reasm_drop(ci_netif* ni, ci_ip_reasm_entry* e)
+{
+  int i;
+  for( i = 0; i < e->n_frags; ++i )
+    ci_netif_pkt_release_rx_1ref(ni, PKT_CHK(ni, e->frags[i].pkt));
+  ci_ip_reasm_free(&ni->state->ip_reasm, e);
+}
+
+
+static void ci_ip_reasm_arm(ci_netif* ni)
+{
+  ci_iptime_t expiry = 0;
+  if( ! ci_ip_timer_pending(ni, &ni->state->ip_reasm_tid) &&
+      ci_ip_reasm_next_expiry(ni->ip_reasm, NI_OPTS(ni).ip_reasm_max,
+                              &expiry) )
+    ci_ip_timer_set(ni, &ni->state->ip_reasm_tid, expiry);
+}
+
+
+/* Timer callback: discard the datagrams that have not been completed in
+ * time.
+ */
+void ci_ip_reasm_timeout(ci_netif* ni)
+{
+  ci_ip_reasm_entry* e = ni->ip_reasm;
+  ci_iptime_t now = ci_ip_time_now(ni);
+  unsigned i;
+
+  for( i = 0; i < NI_OPTS(ni).ip_reasm_max; ++i )
+    if( e[i].in_use && ci_ip_reasm_expired(&e[i], now) ) {
+      LOG_U(log(LPF "%d: timed out id=%x with %d/%d bytes", NI_ID(ni),
+                (unsigned) e[i].key.id, e[i].received, e[i].total));
+      CITP_STATS_NETIF_INC(ni, ip_reasm_timeouts);
+      ci_ip_reasm_drop(ni, &e[i]);
+    }
+  ci_ip_reasm_arm(ni);
+}
+
+
+/* Turn the fragments in [e] into a chain of buffers that looks like a
+ * scattered jumbo frame, and fix up the headers in the first fragment to
+ * describe the whole datagram.  Returns the head of the chain.
+ */
+static ci_ip_pkt_fmt* ci_ip_reasm_chain(ci_netif* ni, ci_ip_reasm_entry* e)
+{
+  ci_ip_pkt_fmt* pkt = NULL;
+  oo_pkt_p next = OO_PP_NULL;
+  char* payload;
+  int i;
+
+  ci_assert_equal(e->frags[0].off, 0);
+
+  for( i = e->n_frags - 1; i >= 0; --i ) {
+    pkt = PKT_CHK(ni, e->frags[i].pkt);
+    payload = ci_ip_reasm_payload(pkt);
+    if( i == 0 )
+      oo_offbuf_init(&pkt->buf, PKT_START(pkt),
+                     payload + e->frags[i].len - PKT_START(pkt));
+    else
+      oo_offbuf_init(&pkt->buf, payload, e->frags[i].len);
+    pkt->frag_next = next;
+    pkt->n_buffers = e->n_frags - i;
+    next = OO_PKT_P(pkt);
+  }
+
+#if CI_CFG_IPV6
+  if( pkt->flags & CI_PKT_FLAG_IS_IP6 ) {
+    /* Close the gap left by the fragment header. */
+    ci_ip6_hdr* ip6;
+    int hdrs_len = oo_pre_l3_len(pkt) + sizeof(ci_ip6_hdr);
+    ci_uint8 next_hdr = ((ci_ip6_frag_hdr*) (oo_ip6_hdr(pkt) + 1))->next_hdr;
+
+    memmove(PKT_START(pkt) + sizeof(ci_ip6_frag_hdr), PKT_START(pkt),
+            hdrs_len);
+    pkt->pkt_start_off += sizeof(ci_ip6_frag_hdr);
+    pkt->pkt_eth_payload_off += sizeof(ci_ip6_frag_hdr);
+    oo_offbuf_set_start(&pkt->buf, PKT_START(pkt));
+    ip6 = oo_ip6_hdr(pkt);
+    ip6->next_hdr = next_hdr;
+    ip6->payload_len = CI_BSWAP_BE16(e->total);
+    pkt->pay_len = hdrs_len + e->total;
+    /* The datagram is no longer as received, so any extension headers that
+     * came before the fragment header stay out of the way. */
+    pkt->rx_flags &= ~CI_PKT_RX_FLAG_IP6_EXT_MOVED;
+  }
+  else
+#endif
+  {
+    ci_ip4_hdr* ip = oo_ip_hdr(pkt);
+    ip->ip_tot_len_be16 = CI_BSWAP_BE16(sizeof(ci_ip4_hdr) + e->total);
+    ip->ip_frag_off_be16 &= ~(CI_IP4_OFFSET_MASK | CI_IP4_FRAG_MORE);
+    ip->ip_check_be16 = 0;
+    ip->ip_check_be16 = (ci_uint16) ci_ip_checksum(ip);
+    pkt->pay_len = oo_pre_l3_len(pkt) + sizeof(ci_ip4_hdr) + e->total;
+  }
+  return pkt;
+}
+
+
+/* The NIC can't check the checksum of a fragmented datagram, so we have
+ * to.
+ */
+static int ci_ip_reasm_udp_csum_correct(ci_netif* ni, ci_ip_pkt_fmt* pkt)
+{
+  int af = oo_pkt_af(pkt);
+  ci_ipx_hdr_t* ipx = oo_ipx_hdr(pkt);
+  ci_udp_hdr* udp = oo_ipx_data(af, pkt);
+  ci_iovec iov[CI_IP_REASM_MAX_FRAGS];
+  unsigned csum;
+  int n = 0;
+
+  if( udp->udp_check_be16 == 0
+#if CI_CFG_IPV6
+      /* L4 checksums are mandatory for IPv6 */
+      && ! IS_AF_INET6(af)
+#endif
+     )
+    return 1;  /* RFC768: csum not computed */
+
+  iov[n].iov_base = udp + 1;
+  iov[n].iov_len = oo_offbuf_end(&pkt->buf) - (char*) (udp + 1);
+  while( OO_PP_NOT_NULL(pkt->frag_next) ) {
+    pkt = PKT_CHK(ni, pkt->frag_next);
+    ++n;
+    iov[n].iov_base = oo_offbuf_ptr(&pkt->buf);
+    iov[n].iov_len = oo_offbuf_left(&pkt->buf);
+  }
+
+#if CI_CFG_IPV6
+  if( IS_AF_INET6(af) )
+    csum = ci_ip6_udp_checksum(&ipx->ip6, udp, iov, n + 1);
+  else
+#endif
+    csum = ci_udp_checksum(&ipx->ip4, udp, iov, n + 1);
+  return csum == udp->udp_check_be16;
+}
+
+
+static void ci_ip_reasm_deliver(ci_netif* ni, ci_ip_reasm_entry* e)
+{
+  int total = e->total;
+  ci_ip_pkt_fmt* pkt = ci_ip_reasm_chain(ni, e);
+  int af = oo_pkt_af(pkt);
+
+  ci_ip_reasm_free(&ni->state->ip_reasm, e);
+
+  if( ! ci_ip_reasm_udp_csum_correct(ni, pkt) ) {
+    CI_UDP_STATS_INC_IN_ERRS(ni);
+    CITP_STATS_NETIF_INC(ni, ip_reasm_fails);
+    LOG_U(log(LPF "%d: BAD UDP CHECKSUM len=%d", NI_ID(ni), total));
+    ci_netif_pkt_release_rx_1ref(ni, pkt);
+    return;
+  }
+
+  CITP_STATS_NETIF_INC(ni, ip_reasm_oks);
+  ci_udp_handle_rx(ni, pkt, oo_ipx_data(af, pkt), total);
+#if CI_CFG_IPV6
+  if( IS_AF_INET6(af) )
+    CI_IP_STATS_INC_IN6_DELIVERS(ni);
+  else
+#endif
+    CI_IPV4_STATS_INC_IN_DELIVERS(ni);
+}
+
+
+static void ci_ip_reasm_queue(ci_netif* ni, ci_ip_pkt_fmt* pkt,
+                              const ci_ip_reasm_key* key, unsigned off,
+                              unsigned len, int more, unsigned max_len)
+{
+  ci_ip_reasm_state* s = &ni->state->ip_reasm;
+  unsigned max = NI_OPTS(ni).ip_reasm_max;
+  ci_ip_reasm_entry* e = ci_ip_reasm_find(s, ni->ip_reasm, max, key);
+
+  if( e == NULL ) {
+    e = ci_ip_reasm_victim(ni->ip_reasm, max);
+    if( e->in_use ) {
+      CITP_STATS_NETIF_INC(ni, ip_reasm_evictions);
+      ci_ip_reasm_drop(ni, e);
+    }
+    ci_ip_reasm_start(s, e, key, ci_ip_time_now(ni) +
+                      ci_ip_time_ms2ticks(ni, NI_OPTS(ni).ip_reasm_timeout));
+    ci_ip_reasm_arm(ni);
+  }
+
+  switch( ci_ip_reasm_add(e, off, len, more, OO_PKT_P(pkt), max_len) ) {
+  case CI_IP_REASM_QUEUED:
+    CITP_STATS_NETIF_INC(ni, ip_reasm_frags);
+    break;
+  case CI_IP_REASM_COMPLETE:
+    CITP_STATS_NETIF_INC(ni, ip_reasm_frags);
+    ci_ip_reasm_deliver(ni, e);
+    break;
+  case CI_IP_REASM_DUP:
+    CITP_STATS_NETIF_INC(ni, ip_reasm_dups);
+    ci_netif_pkt_release_rx_1ref(ni, pkt);
+    break;
+  default:
+    LOG_U(CI_RLLOG(10, LPF "%d: discard id=%x off=%u len=%u more=%d",
+                   NI_ID(ni), (unsigned) key->id, off, len,
+                   more));
+    CITP_STATS_NETIF_INC(ni, ip_reasm_fails);
+    ci_netif_pkt_release_rx_1ref(ni, pkt);
+    ci_ip_reasm_drop(ni, e);
+    break;
+  }
+}
+
+
+/* Take IPv4 fragment [pkt] for reassembly.  The caller has checked
+ * [ip_tot_len] against the frame length, and ci_ip4_reasm_ok() and
+ * ci_ip_reasm_pkt_ok().
+ */
+void ci_ip_reasm_rx(ci_netif* ni, ci_ip_pkt_fmt* pkt, int ip_tot_len)
+{
+  ci_ip4_hdr* ip = oo_ip_hdr(pkt);
+  ci_ip_reasm_key key;
+
+  ci_assert(ci_ip4_reasm_ok(ip, ip_tot_len));
+  ci_assert(ci_ip_reasm_pkt_ok(ni, pkt));
+
+  ci_ip_reasm_key_ip4(&key, ip);
+  ci_ip_reasm_queue(ni, pkt, &key, ci_ip4_frag_offset(ip),
+                    ip_tot_len - sizeof(ci_ip4_hdr), ci_ip4_frag_more(ip),
+                    CI_IP4_REASM_MAX_LEN);
+}
+
+
+#if CI_CFG_IPV6
+/* As ci_ip_reasm_rx(), for an IPv6 packet with a fragment header directly
+ * after the base header.  Returns false, without touching [pkt], if it is
+ * not a fragment that we reassemble.
+ */
+int ci_ip6_reasm_rx(ci_netif* ni, ci_ip_pkt_fmt* pkt)
+{
+  ci_ip6_hdr* ip6 = oo_ip6_hdr(pkt);
+  ci_ip6_frag_hdr* fh = (ci_ip6_frag_hdr*) (ip6 + 1);
+  int paylen = CI_BSWAP_BE16(ip6->payload_len);
+  ci_ip_reasm_key key;
+
+  if( ! ci_ip6_reasm_ok(fh, paylen) ||
+      pkt->pay_len < oo_pre_l3_len(pkt) + sizeof(*ip6) + paylen ||
+      ! ci_ip_reasm_pkt_ok(ni, pkt) )
+    return 0;
+
+  ci_ip_reasm_key_ip6(&key, ip6, fh);
+  ci_ip_reasm_queue(ni, pkt, &key, ci_ip6_frag_offset(fh),
+                    paylen - sizeof(*fh), ci_ip6_frag_more(fh),
+                    CI_IP6_REASM_MAX_LEN);
+  return 1;
+}
+#endif
+
+#endif
+/*! \cidoxg_end */
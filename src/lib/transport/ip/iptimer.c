@@ -14,6 +14,7 @@
 /*! \cidoxg_lib_transport_ip */
   
 #include "ip_internal.h"
+#include <ci/internal/probes.h>
 #ifndef __KERNEL__
 # include <limits.h>
 #endif
@@ -302,11 +303,14 @@ static void ci_ip_timer_do_recycle(ci_netif *netif)
 /* unpick the ci_ip_timer structure to actually do the callback */ 
 static void ci_ip_timer_docallback(ci_netif *netif, ci_ip_timer* ts)
 {
-  oo_sp sp;
+  oo_sp sp = OO_SP_NULL;
+  struct oo_sock_cycles_region cycles;
 
   ci_assert( TIME_LE(ts->time, ci_ip_time_now(netif)) );
   ci_assert( ts->time == IPTIMER_STATE(netif)->sched_ticks );
 
+  ci_sock_cycles_enter(netif, &cycles);
+
   switch(ts->fn){
   case CI_IP_TIMER_TCP_RTO:
     sp = oo_statep_to_sockp(netif, ts->statep);
@@ -342,6 +346,12 @@ static void ci_ip_timer_docallback(ci_netif *netif, ci_ip_timer* ts)
   case CI_IP_TIMER_NETIF_TIMEOUT:
     ci_netif_timeout_state(netif);
     break;
+  case CI_IP_TIMER_NETIF_TXSHAPE:
+    ci_netif_txshape_poll(netif);
+    break;
+  case CI_IP_TIMER_NETIF_IP_REASM:
+    ci_ip_reasm_timeout(netif);
+    break;
   case CI_IP_TIMER_PMTU_DISCOVER:
   {
     oo_p pmtu_p = ts->statep;
@@ -374,6 +384,11 @@ static void ci_ip_timer_docallback(ci_netif *netif, ci_ip_timer* ts)
 	       ts->fn, OO_P_FMT(ts->statep)));    
     CI_DEBUG(ci_fail_stop_fn());
   }  
+
+  OO_PROBE3(timer, NI_ID(netif), ts->fn,
+            OO_SP_NOT_NULL(sp) ? OO_SP_TO_INT(sp) : -1);
+  if( OO_SP_NOT_NULL(sp) )
+    ci_sock_cycles_leave(netif, &cycles, &SP_TO_SOCK(netif, sp)->cycles.timer);
 }
 
 /* run any pending timers */
@@ -584,6 +599,8 @@ static const char* ci_ip_timer_dump(const ci_ip_timer* ts)
     MAKECASE(CI_IP_TIMER_TCP_CORK,     "cork")
     MAKECASE(CI_IP_TIMER_NETIF_TIMEOUT, "netif")
     MAKECASE(CI_IP_TIMER_PMTU_DISCOVER, "pmtu")
+    MAKECASE(CI_IP_TIMER_NETIF_TXSHAPE, "txshape")
+    MAKECASE(CI_IP_TIMER_NETIF_IP_REASM, "ip-reasm")
 #if CI_CFG_SUPPORT_STATS_COLLECTION
     MAKECASE(CI_IP_TIMER_TCP_STATS,     "tcp-stats")
     MAKECASE(CI_IP_TIMER_NETIF_STATS,   "ni-stats")
@@ -21,6 +21,7 @@ LIB_SRCS	:=		\
 		tcp_close.c	\
 		tcp_init_shared.c \
 		pmtu.c		\
+		ip_reasm.c	\
 		ip_tx.c		\
 		udp.c		\
 		udp_rx.c	\
@@ -66,6 +67,7 @@ LIB_SRCS	+=		\
                 efabcfg.c       \
 		save_fd.c	\
 		tcp_helper.c	\
+		tcp_checkpoint.c \
 		syscall.c	\
 		per_thread.c	\
 		rwlock.c
@@ -1287,6 +1287,7 @@ void ci_netif_unlock(ci_netif* ni)
   ci_assert_nflags(ni->state->flags, CI_NETIF_FLAG_PKT_ACCOUNT_PENDING);
 
   ci_assert_equal(ni->state->in_poll, 0);
+  ni->state->lock.holder_tid = 0;
   if(CI_LIKELY( ni->state->lock.lock == CI_EPLOCK_LOCKED &&
                 ci_cas64u_succeed(&ni->state->lock.lock,
                                   CI_EPLOCK_LOCKED, 0) ))
@@ -1310,6 +1311,7 @@ void ci_netif_unlock(ci_netif* ni)
 void ci_netif_unlock(ci_netif* ni)
 {
   ci_uint64 l;
+  ni->state->lock.holder_tid = 0;
   do {
     l = ni->state->lock.lock;
   } while( ci_cas64u_fail(&ni->state->lock.lock, l, l & ~CI_EPLOCK_LOCKED) );
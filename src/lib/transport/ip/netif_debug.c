@@ -201,7 +201,10 @@ void __ci_assert_valid_pkt(ci_netif* ni, ci_ip_pkt_fmt* pkt,
   }
   else {
     _ci_assert_gt(pkt->n_buffers, 0, file, line);
-    _ci_assert_le(pkt->n_buffers, CI_IP_PKT_SEGMENTS_MAX, file, line);
+    /* A reassembled datagram may be longer, plus an indirect head. */
+    _ci_assert_le(pkt->n_buffers, (pkt->flags & CI_PKT_FLAG_RX) ?
+                  CI_IP_REASM_MAX_FRAGS + 1 : CI_IP_PKT_SEGMENTS_MAX,
+                  file, line);
 
     /* For a packet of more than one buffer, the buffers should be
     * linked through frag_next
@@ -291,9 +294,10 @@ static void ci_netif_dump_pkt_summary(ci_netif* ni, oo_dump_log_fn_t logger,
   int intf_i, rx_ring = 0, tx_ring = 0, tx_oflow = 0, used, rx_queued, i;
   ci_netif_state* ns = ni->state;
 
-  logger(log_arg, "  pkt_sets: pkt_size=%d set_size=%d max=%d alloc=%d",
-         CI_CFG_PKT_BUF_SIZE, PKTS_PER_SET, ni->packets->sets_max,
-         ni->packets->sets_n);
+  logger(log_arg, "  pkt_sets: pkt_size=%d set_size=%d max=%d alloc=%d "
+         "hot=%d shrunk=%d", CI_CFG_PKT_BUF_SIZE, PKTS_PER_SET,
+         ni->packets->sets_max, ni->packets->sets_n, ni->packets->sets_hot,
+         ns->stats.pkt_sets_shrunk);
 
   for( i = 0; i < ni->packets->sets_n; i++ ) {
     logger(log_arg, "  pkt_set[%d]: free=%d%s", i, ni->packets->set[i].n_free,
@@ -804,6 +808,18 @@ static void ci_netif_dump_vi(ci_netif* ni, int intf_i, oo_dump_log_fn_t logger,
          nic->ctpio_max_frame_len, nic->ctpio_frame_len_check,
          nic->ctpio_ct_threshold);
 #endif
+  if( NI_OPTS(ni).int_moderation_adaptive ) {
+    const ci_irqmod_state* m = &nic->irqmod;
+    logger(log_arg, "  irqmod: usec=%u level=%u changes=%u",
+           m->usec, m->level, m->n_changes);
+    logger(log_arg, "  irqmod: batch: 0=%u 1=%u 2+=%u 4+=%u 8+=%u 16+=%u "
+           "32+=%u 64+=%u", m->batch_hist[0], m->batch_hist[1],
+           m->batch_hist[2], m->batch_hist[3], m->batch_hist[4],
+           m->batch_hist[5], m->batch_hist[6], m->batch_hist[7]);
+    logger(log_arg, "  irqmod: level_irqs: %u %u %u %u %u %u",
+           m->level_hist[0], m->level_hist[1], m->level_hist[2],
+           m->level_hist[3], m->level_hist[4], m->level_hist[5]);
+  }
   if( nic->nic_error_flags )
     logger(log_arg, "  ERRORS: "CI_NETIF_NIC_ERRORS_FMT,
            CI_NETIF_NIC_ERRORS_PRI_ARG(nic->nic_error_flags));
@@ -954,6 +970,13 @@ void ci_netif_dump_to_logger(ci_netif* ni, oo_dump_log_fn_t logger,
   logger(log_arg, "  lock=%"CI_PRIx64" "CI_NETIF_LOCK_FMT"  nics=%"CI_PRIx64
          " primed=%x", tmp, CI_NETIF_LOCK_PRI_ARG(tmp), ni->nic_set.nics,
          ns->evq_primed);
+  if( (tmp & CI_EPLOCK_LOCKED) && ns->lock.holder_tid != 0 ) {
+    ci_uint64 now_frc;
+    ci_frc64(&now_frc);
+    logger(log_arg, "  lock_holder: thread=%u site=%"CI_PRIx64" held=%uus",
+           ns->lock.holder_tid, ns->lock.holder_site,
+           oo_cycles64_to_usec(ni, now_frc - ns->lock.holder_frc));
+  }
 #ifdef __KERNEL__
   {
     /* This is useful mostly for orphaned stacks */
@@ -1025,6 +1048,46 @@ void ci_netif_dump_to_logger(ci_netif* ni, oo_dump_log_fn_t logger,
                                                 ? "EMPTY":"yes",
            ns->ready_list_flags[i]);
   }
+#endif
+  if( ns->txshape.shaped ) {
+    const ci_txshape_state* s = &ns->txshape;
+    unsigned khz = IPTIMER_STATE(ni)->khz;
+    logger(log_arg, "  txshape: root=%"CI_PRIu64"Mbps tokens=%"CI_PRId64
+           " backlog=%u", s->root_rate / 125, s->root_tokens / khz,
+           s->backlog);
+    for( i = CI_TXSHAPE_CLASSES - 1; i >= 0; --i ) {
+      const ci_txshape_class* cl = &s->cls[i];
+      if( ! ((s->shaped >> i) & 1) )
+        continue;
+      logger(log_arg, "  txshape[%d]: rate=%"CI_PRIu64"Mbps ceil=%"
+             CI_PRIu64"Mbps tokens=%"CI_PRId64" ctokens=%"CI_PRId64
+             " backlog=%d max=%u", i, cl->rate / 125, cl->ceil / 125,
+             cl->tokens / khz, cl->ctokens / khz, oo_pktq_num(&cl->backlog),
+             cl->max_backlog);
+      logger(log_arg, "  txshape[%d]: tx_pkts=%u tx_bytes=%"CI_PRIu64
+             " delayed=%u borrowed=%u", i, cl->tx_pkts, cl->tx_bytes,
+             cl->n_delayed, cl->n_borrowed);
+    }
+  }
+  if( NI_OPTS(ni).ip_reasm_max ) {
+    const ci_ip_reasm_state* s = &ns->ip_reasm;
+    logger(log_arg, "  ip_reasm: pending=%u max=%u", s->n_pending,
+           NI_OPTS(ni).ip_reasm_max);
+    for( i = 0; i < NI_OPTS(ni).ip_reasm_max; ++i ) {
+      const ci_ip_reasm_entry* e = &ni->ip_reasm[i];
+      if( ! e->in_use )
+        continue;
+      logger(log_arg, "  ip_reasm[%d]: id=%x proto=%d frags=%d bytes=%d/%d"
+             " expiry=%u", i, (unsigned) e->key.id,
+             e->key.protocol, e->n_frags, e->received, e->total, e->expiry);
+    }
+  }
+#if CI_CFG_TIMESTAMPING
+  if( NI_OPTS(ni).tx_timestamp_ring ) {
+    const oo_tx_ts_ring_state* s = &ns->tx_ts_ring;
+    logger(log_arg, "  tx_ts_ring: size=%u write=%u read=%u dropped=%u",
+           NI_OPTS(ni).tx_timestamp_ring, s->write, s->read, s->dropped);
+  }
 #endif
   OO_STACK_FOR_EACH_INTF_I(ni, intf_i)
     ci_netif_dump_vi(ni, intf_i, logger, log_arg);
@@ -17,11 +17,15 @@
 #include "netif_tx.h"
 #include "tcp_rx.h"
 #include "udp_internal.h"
+#include <ci/internal/probes.h>
 #include <ci/tools/ipcsum_base.h>
 #include <ci/tools/pktdump.h>
 #include <etherfabric/timer.h>
 #include <etherfabric/vi.h>
 #include <ci/internal/pio_buddy.h>
+#include <ci/internal/ip_reasm.h>
+#include <ci/internal/tcp_info.h>
+#include <ci/internal/tx_ts_ring.h>
 #include <ci/driver/efab/hardware/efct.h>
 
 #if OO_DO_STACK_POLL
@@ -182,6 +186,90 @@ int ci_ip_options_parse(ci_netif* netif, ci_ip4_hdr* ip, const int hdr_size)
   return error;
 }
 
+#if CI_CFG_IPV6
+/* With EF_IP6_EXT_HDRS, find the TCP or UDP header that follows the
+ * extension headers of [pkt], and swap the link-layer and IPv6 headers with
+ * the extension headers, so that the rest of the stack sees the upper-layer
+ * header directly after the IPv6 header.  This is done after tcpdump has
+ * seen the packet as received, and ci_netif_pkt_pass_to_kernel() swaps them
+ * back if no socket takes the packet.
+ *
+ * Returns false if the packet must be dropped.  Otherwise the packet is
+ * left as it was if it is not one that we handle, such as an MLD report
+ * after a hop-by-hop header, for the caller to pass to the kernel.
+ */
+static int ci_ip6_rx_ext_hdrs(ci_netif* netif, ci_ip_pkt_fmt* pkt)
+{
+  char hdrs[ETH_HLEN + ETH_VLAN_HLEN + sizeof(ci_ip6_hdr)];
+  ci_ip6_hdr* ip6_orig = oo_ip6_hdr(pkt);
+  int hdrs_len = oo_pre_l3_len(pkt) + sizeof(ci_ip6_hdr);
+  int paylen = CI_BSWAP_BE16(ip6_orig->payload_len);
+  int ext_len, l4_len, rc;
+  ci_ip6_hdr* ip6;
+  ci_udp_hdr* udp;
+  ci_uint8 proto;
+
+  /* The extension headers must be in the first buffer. */
+  rc = ci_ip6_ext_walk(ip6_orig, CI_MIN(paylen, pkt->pay_len - hdrs_len),
+                       &proto, &ext_len);
+  if( rc == CI_IP6_EXT_OK ) {
+    if( ext_len == 0 ||
+        ! (proto == IPPROTO_TCP || proto == IPPROTO_UDP ||
+           (proto == CI_NEXTHDR_FRAGMENT && NI_OPTS(netif).ip_reasm_max)) ||
+        hdrs_len + paylen > pkt->pay_len ||
+        hdrs_len > sizeof(hdrs) ||
+        OO_PP_NOT_NULL(pkt->frag_next) ||
+        (pkt->rx_flags & CI_PKT_RX_FLAG_RX_SHARED) )
+      return 1;
+
+    pkt->ip6_ext_next_hdr = ip6_orig->next_hdr;
+    pkt->ip6_ext_len = ext_len;
+    pkt->rx_flags |= CI_PKT_RX_FLAG_IP6_EXT_MOVED;
+    memcpy(hdrs, PKT_START(pkt), hdrs_len);
+    memmove(PKT_START(pkt), PKT_START(pkt) + hdrs_len, ext_len);
+    memcpy(PKT_START(pkt) + ext_len, hdrs, hdrs_len);
+    pkt->pkt_start_off += ext_len;
+    pkt->pkt_eth_payload_off += ext_len;
+    pkt->pay_len -= ext_len;
+    oo_offbuf_set_start(&pkt->buf, PKT_START(pkt));
+    ip6 = oo_ip6_hdr(pkt);
+    ip6->next_hdr = proto;
+    l4_len = paylen - ext_len;
+    ip6->payload_len = CI_BSWAP_BE16(l4_len);
+    CITP_STATS_NETIF_INC(netif, rx_ip6_ext_hdrs);
+
+    /* The NIC may not have looked past the extension headers to check the
+     * checksum, so we do. */
+    if( proto == IPPROTO_TCP ) {
+      if( l4_len < sizeof(ci_tcp_hdr) || ! ci_tcp_csum_correct(pkt, l4_len) )
+        goto bad_csum;
+    }
+    else if( proto == IPPROTO_UDP ) {
+      udp = (ci_udp_hdr*) (ip6 + 1);
+      if( l4_len < sizeof(ci_udp_hdr) ||
+          CI_BSWAP_BE16(udp->udp_len_be16) < sizeof(ci_udp_hdr) )
+        goto bad_csum;
+      pkt->pf.udp.pay_len = CI_BSWAP_BE16(udp->udp_len_be16) -
+                            sizeof(ci_udp_hdr);
+      if( ! ci_udp_csum_correct(pkt, udp) )
+        goto bad_csum;
+    }
+    return 1;
+  }
+
+  LOG_U(CI_RLLOG(10, LPF "[%d] IPv6 extension headers not handled: "
+                 "next_hdr=%d rc=%d", NI_ID(netif), ip6_orig->next_hdr, rc));
+  CITP_STATS_NETIF_INC(netif, rx_ip6_ext_hdrs_unknown);
+  return NI_OPTS(netif).ip6_ext_hdrs != 2;
+
+ bad_csum:
+  LOG_U(CI_RLLOG(10, LPF "[%d] IPv6 BAD %s CHECKSUM after extension headers",
+                 NI_ID(netif), proto == IPPROTO_TCP ? "TCP" : "UDP"));
+  return 0;
+}
+#endif
+
+
 static void record_rx_timestamp(ci_netif* netif, ci_netif_state_nic_t* nsn,
                                 ci_ip_pkt_fmt* pkt,
                                 ef_timespec stamp, unsigned sync_flags)
@@ -273,6 +361,7 @@ static void handle_rx_pkt(ci_netif* netif, struct ci_netif_poll_state* ps,
 #endif
 
   pkt->tstamp_frc = IPTIMER_STATE(netif)->frc;
+  OO_PROBE4(rx_pkt, NI_ID(netif), pkt->intf_i, OO_PKT_ID(pkt), pkt->pay_len);
 
   /* Is this an IP packet? */
   if(CI_LIKELY( ether_type == CI_ETHERTYPE_IP )) {
@@ -307,6 +396,19 @@ static void handle_rx_pkt(ci_netif* netif, struct ci_netif_poll_state* ps,
 #endif
                ;
 
+    /* With EF_IP_REASM_MAX we reassemble UDP fragments ourselves, rather
+     * than passing them to the kernel. */
+    if(CI_UNLIKELY( not_fast ) && NI_OPTS(netif).ip_reasm_max != 0 &&
+       (ip->ip_frag_off_be16 & (CI_IP4_OFFSET_MASK | CI_IP4_FRAG_MORE)) &&
+       ip_tot_len <= pkt->pay_len - oo_pre_l3_len(pkt) &&
+       ci_ip4_reasm_ok(ip, ip_tot_len) && ci_ip_reasm_pkt_ok(netif, pkt) ) {
+      get_rx_timestamp(netif, pkt);
+      if( oo_tcpdump_check(netif, pkt, pkt->intf_i) )
+        oo_tcpdump_dump_pkt(netif, pkt);
+      ci_ip_reasm_rx(netif, pkt, ip_tot_len);
+      return;
+    }
+
     hdr_size = CI_IP4_IHL(ip);
 
     /* Accepting but ignoring IP options.
@@ -401,6 +503,18 @@ static void handle_rx_pkt(ci_netif* netif, struct ci_netif_poll_state* ps,
     if( oo_tcpdump_check(netif, pkt, pkt->intf_i) )
       oo_tcpdump_dump_pkt(netif, pkt);
 
+    if(CI_UNLIKELY( ip6_hdr->next_hdr != IPPROTO_TCP &&
+                    ip6_hdr->next_hdr != IPPROTO_UDP &&
+                    NI_OPTS(netif).ip6_ext_hdrs != 0 )) {
+      if( ! ci_ip6_rx_ext_hdrs(netif, pkt) ) {
+        CI_IP_STATS_INC_IN6_DISCARDS( netif );
+        ci_netif_pkt_release_rx_1ref(netif, pkt);
+        return;
+      }
+      ip6_hdr = oo_ip6_hdr(pkt);
+      payload = ip6_hdr + 1;
+    }
+
     if( ip6_hdr->next_hdr == IPPROTO_TCP ) {
       ci_tcp_handle_rx(netif, ps, pkt, (ci_tcp_hdr*) payload,
                        CI_BSWAP_BE16(ip6_hdr->payload_len));
@@ -413,6 +527,11 @@ static void handle_rx_pkt(ci_netif* netif, struct ci_netif_poll_state* ps,
       CI_IP_STATS_INC_IN6_DELIVERS( netif );
       return;
     }
+    else if( ip6_hdr->next_hdr == CI_NEXTHDR_FRAGMENT &&
+             NI_OPTS(netif).ip_reasm_max != 0 &&
+             ci_ip6_reasm_rx(netif, pkt) ) {
+      return;
+    }
 
     CI_IP_STATS_INC_IN6_DISCARDS( netif );
 
@@ -716,6 +835,31 @@ ci_inline int oo_xdp_check_pkt(ci_netif* ni, ci_ip_pkt_fmt** pkt)
 #endif
 
 
+#if CI_CFG_SOCK_CYCLES
+/* With EF_SOCK_CYCLES, the cycles spent handling a packet are charged to
+ * the socket that the transport delivers it to (see
+ * ci_sock_cycles_rx_mark()).
+ */
+ci_inline void sock_cycles_rx_begin(ci_netif* ni,
+                                    struct oo_sock_cycles_region* r)
+{
+  ci_sock_cycles_enter(ni, r);
+  ni->cycles_sock = OO_SP_NULL;
+}
+
+
+ci_inline void sock_cycles_rx_end(ci_netif* ni,
+                                  struct oo_sock_cycles_region* r)
+{
+  if(CI_UNLIKELY( r->start != 0 ) && OO_SP_NOT_NULL(ni->cycles_sock) )
+    ci_sock_cycles_leave(ni, r, &SP_TO_SOCK(ni, ni->cycles_sock)->cycles.rx);
+}
+#else
+#define sock_cycles_rx_begin(ni, r)  ((void) (r))
+#define sock_cycles_rx_end(ni, r)    ((void) (r))
+#endif
+
+
 ci_inline void __handle_rx_pkt(ci_netif* ni, struct ci_netif_poll_state* ps,
                                ci_ip_pkt_fmt** pkt)
 {
@@ -727,8 +871,11 @@ ci_inline void __handle_rx_pkt(ci_netif* ni, struct ci_netif_poll_state* ps,
     }
 #endif
     if( oo_xdp_check_pkt(ni, pkt) ) {
+      struct oo_sock_cycles_region r;
       ci_parse_rx_vlan(*pkt);
+      sock_cycles_rx_begin(ni, &r);
       handle_rx_pkt(ni, ps, *pkt);
+      sock_cycles_rx_end(ni, &r);
     }
   }
 }
@@ -1634,6 +1781,7 @@ static void ci_netif_tx_pkt_complete_udp(ci_netif* netif,
    * If the outgoing packet has to be fragmented, then only the first
    * fragment is time stamped and returned to the sending socket. */
   if( pkt->flags & CI_PKT_FLAG_TX_TIMESTAMPED &&
+      NI_OPTS(netif).tx_timestamp_ring == 0 &&
       ci_udp_timestamp_q_enqueue(netif, us, pkt) == 0 )
     return;
 #endif
@@ -1660,6 +1808,23 @@ static void ci_netif_rx_pkt_complete_tcp(ci_netif* ni,
                                          struct ci_netif_poll_state* ps,
                                          ci_ip_pkt_fmt* pkt)
 {
+  if( pkt->rx_flags & CI_PKT_TX_FLAG_TXQ_ACCOUNTED ) {
+    /* Return the bytes to the socket's EF_TCP_TXQ_LIMIT budget.  As with
+     * timestamps below, the socket may have been closed or reused since;
+     * at worst we under-count a fresh socket's usage for a moment. */
+    citp_waitable_obj* wo = SP_TO_WAITABLE_OBJ(ni, pkt->pf.tcp_tx.sock_id);
+    pkt->rx_flags &= ~CI_PKT_TX_FLAG_TXQ_ACCOUNTED;
+    if( wo->waitable.state & CI_TCP_STATE_TCP_CONN ) {
+      ci_tcp_state* ts = &wo->tcp;
+      ts->txq_bytes -= CI_MIN(ts->txq_bytes, TX_PKT_LEN(pkt));
+      if( (ts->tcpflags & CI_TCPT_FLAG_TXQ_LIMITED) &&
+          ts->txq_bytes <= NI_OPTS(ni).tcp_txq_limit / 2 ) {
+        ts->tcpflags &= ~CI_TCPT_FLAG_TXQ_LIMITED;
+        ts->s.b.sb_flags |= CI_SB_FLAG_TCP_POST_POLL;
+        ci_netif_put_on_post_poll(ni, &ts->s.b);
+      }
+    }
+  }
 #if CI_CFG_TIMESTAMPING
   if( pkt->flags & (CI_PKT_FLAG_TX_TIMESTAMPED | CI_PKT_FLAG_INDIRECT) ) {
     /* This packet is destined for the timestamp_q. We need to check if our
@@ -1698,6 +1863,51 @@ static void ci_netif_rx_pkt_complete_tcp(ci_netif* ni,
 }
 
 
+#if CI_CFG_TIMESTAMPING
+/* Report the TX timestamp of [pkt] in the stack's EF_TX_TIMESTAMP_RING. */
+static void ci_netif_tx_ts_ring_put(ci_netif* ni, ci_ip_pkt_fmt* pkt)
+{
+  struct onload_tx_timestamp rec;
+  citp_waitable_obj* wo;
+  int af = oo_pkt_af(pkt);
+
+  memset(&rec, 0, sizeof(rec));
+  rec.stamp.sec = pkt->hw_stamp.tv_sec;
+  rec.stamp.nsec = pkt->hw_stamp.tv_nsec & ~CI_IP_PKT_HW_STAMP_FLAG_IN_SYNC;
+  if( pkt->hw_stamp.tv_nsec & CI_IP_PKT_HW_STAMP_FLAG_IN_SYNC )
+    rec.flags |= ONLOAD_TX_TIMESTAMP_IN_SYNC;
+
+  if( pkt->flags & CI_PKT_FLAG_UDP ) {
+    ci_udp_hdr* udp = TX_PKT_IPX_UDP(af, pkt,
+                                     TX_PKT_PROTOCOL(af, pkt) != IPPROTO_UDP);
+    wo = SP_TO_WAITABLE_OBJ(ni, pkt->pf.udp.tx_sock_id);
+    rec.endpoint_id = OO_SP_FMT(pkt->pf.udp.tx_sock_id);
+    rec.len = CI_BSWAP_BE16(udp->udp_len_be16) - sizeof(*udp);
+    if( wo->sock.timestamping_flags & ONLOAD_SOF_TIMESTAMPING_OPT_ID )
+      rec.key = pkt->ts_key;
+  }
+  else {
+    ci_tcp_hdr* tcp = TX_PKT_IPX_TCP(af, pkt);
+    wo = SP_TO_WAITABLE_OBJ(ni, pkt->pf.tcp_tx.sock_id);
+    rec.endpoint_id = OO_SP_FMT(pkt->pf.tcp_tx.sock_id);
+    rec.len = ci_tcp_tx_pkt_data_len(pkt, tcp);
+    if( pkt->flags & CI_PKT_FLAG_RTQ_RETRANS )
+      rec.flags |= ONLOAD_TX_TIMESTAMP_RETRANS;
+    /* As for the error queue, but the socket may have been closed since */
+    if( (wo->waitable.state & CI_TCP_STATE_TCP_CONN) &&
+        (wo->sock.timestamping_flags & ONLOAD_SOF_TIMESTAMPING_OPT_ID) ) {
+      rec.key = pkt->pf.tcp_tx.end_seq - 1 - wo->sock.ts_key;
+      if( tcp->tcp_flags & (CI_TCP_FLAG_SYN | CI_TCP_FLAG_FIN) )
+        --rec.key;
+    }
+  }
+
+  oo_tx_ts_ring_put(&ni->state->tx_ts_ring, ni->tx_ts_ring,
+                    NI_OPTS(ni).tx_timestamp_ring, &rec);
+}
+#endif
+
+
 ci_inline void __ci_netif_tx_pkt_complete(ci_netif* ni,
                                           struct ci_netif_poll_state* ps,
                                           ci_ip_pkt_fmt* pkt, ef_event* ev)
@@ -1749,6 +1959,12 @@ ci_inline void __ci_netif_tx_pkt_complete(ci_netif* ni,
     /* Ensure that timestamp is written down before
      * CI_PKT_FLAG_TX_PENDING removal. */
     ci_wmb();
+
+    /* With the ring the packet isn't queued for the error queue, and is
+     * freed below as usual. */
+    if( (pkt->flags & CI_PKT_FLAG_TX_TIMESTAMPED) &&
+        NI_OPTS(ni).tx_timestamp_ring )
+      ci_netif_tx_ts_ring_put(ni, pkt);
   }
 #endif
 
@@ -2206,8 +2422,11 @@ int ci_netif_poll_intf_future(ci_netif* ni, int intf_i, ci_uint64 start_frc)
   /* maybe handle other simple events like TX? */
 
   if( handle_future ) {
+    struct oo_sock_cycles_region r;
     oo_offbuf_init(&pkt->buf, PKT_START(pkt), pkt->pay_len);
+    sock_cycles_rx_begin(ni, &r);
     handle_rx_post_future(ni, &ps, pkt, status, &future);
+    sock_cycles_rx_end(ni, &r);
 
     if(CI_UNLIKELY( rc > 1 )) {
       /* We have handled the first event, so remove it from the array and
@@ -2383,6 +2602,9 @@ int ci_netif_poll_n(ci_netif* netif, int max_evs)
   /* Timers MUST NOT send via loopback. */
   ci_assert(OO_PP_IS_NULL(netif->state->looppkts));
 
+  if(CI_UNLIKELY( netif->state->txshape.backlog != 0 ))
+    ci_netif_txshape_poll(netif);
+
   /* Perform proactive socket allocation check.
    * Proactive packet allocation check is more expensive, so we perform it
    * from the unlock hook only.
@@ -15,6 +15,7 @@
 #include "uk_intf_ver.h"
 #include <ci/internal/efabcfg.h>
 #include <ci/internal/banner.h>
+#include <ci/internal/tx_shaper.h>
 #include <onload/version.h>
 #include <etherfabric/internal/internal.h>
 #include <etherfabric/internal/efct_uk_api.h>
@@ -169,6 +170,9 @@ void ci_netif_state_init(ci_netif* ni, int cpu_khz, const char* name)
             __oo_usec_to_cycles64(cpu_khz, NI_OPTS(ni).buzz_usec);
   nis->timer_prime_cycles =
             __oo_usec_to_cycles64(cpu_khz, NI_OPTS(ni).timer_prime_usec);
+  nis->lock_watchdog_cycles =
+            __oo_usec_to_cycles64(cpu_khz, NI_OPTS(ni).lock_watchdog_usec);
+  nis->lock.holder_track = NI_OPTS(ni).lock_watchdog_usec != 0;
 #if CI_CFG_INJECT_PACKETS
   nis->kernel_packets_cycles =
             __oo_usec_to_cycles64(cpu_khz,
@@ -178,6 +182,22 @@ void ci_netif_state_init(ci_netif* ni, int cpu_khz, const char* name)
   ci_ip_timer_state_init(ni, cpu_khz);
   nis->last_spin_poll_frc = IPTIMER_STATE(ni)->frc;
   nis->last_sleep_frc = IPTIMER_STATE(ni)->frc;
+
+  ci_ip_timer_init(ni, &nis->txshape_tid,
+                   oo_ptr_to_statep(ni, &nis->txshape_tid),
+                   "txsh");
+  nis->txshape_tid.fn = CI_IP_TIMER_NETIF_TXSHAPE;
+  if( ci_txshape_parse(&nis->txshape, NI_OPTS(ni).tx_shape) < 0 ) {
+    ci_log("%s: ignoring invalid EF_TX_SHAPE=\"%s\"", __FUNCTION__,
+           NI_OPTS(ni).tx_shape);
+    memset(&nis->txshape, 0, sizeof(nis->txshape));
+  }
+  ci_txshape_init(&nis->txshape, IPTIMER_STATE(ni)->frc, cpu_khz);
+
+  ci_ip_timer_init(ni, &nis->ip_reasm_tid,
+                   oo_ptr_to_statep(ni, &nis->ip_reasm_tid),
+                   "reas");
+  nis->ip_reasm_tid.fn = CI_IP_TIMER_NETIF_IP_REASM;
   
   oo_timesync_update(efab_tcp_driver.timesync);
 
@@ -620,6 +640,13 @@ void ci_netif_config_opts_rangecheck(ci_netif_config_opts* opts)
 
   /* EF_MAX_ENDPOINTS should must be divisible by 2048 */
   round_opts("EF_MAX_ENDPOINTS", &opts->max_ep_bufs, EP_BUF_PER_CHUNK);
+
+  if( opts->tx_timestamp_ring && ! CI_IS_POW2(opts->tx_timestamp_ring) ) {
+    unsigned n = ci_pow2(ci_log2_ge(opts->tx_timestamp_ring, 0));
+    ci_log("config: EF_TX_TIMESTAMP_RING is rounded up from %u to %u",
+           opts->tx_timestamp_ring, n);
+    opts->tx_timestamp_ring = n;
+  }
 }
 
 
@@ -749,6 +776,12 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
 
   if( (s = getenv("EF_INT_DRIVEN")) )
     opts->int_driven = atoi(s);
+  if( (s = getenv("EF_INT_MODERATION_ADAPTIVE")) )
+    opts->int_moderation_adaptive = atoi(s);
+  if( (s = getenv("EF_INT_MODERATION_MAX_USEC")) )
+    opts->int_moderation_max_usec = atoi(s);
+  if( (s = getenv("EF_INT_MODERATION_RATE")) )
+    opts->int_moderation_rate = atoi(s);
 #if CI_CFG_WANT_BPF_NATIVE
   if( (s = getenv("EF_POLL_IN_KERNEL")) )
     opts->poll_in_kernel = atoi(s);
@@ -758,6 +791,10 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     /* for now only in-kernel XDP is supported - enabling in-kernel mode implicitly */
     opts->poll_in_kernel = 1;
   }
+#endif
+#if CI_CFG_UL_INTERRUPT_HELPER
+  if( (s = getenv("EF_HELPER_SHARED")) )
+    opts->helper_shared = atoi(s);
 #endif
   if( opts->int_driven )
     /* Disable count-down timer when interrupt driven. */
@@ -774,6 +811,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   if( (s = getenv("EF_BUZZ_USEC")) ) {
     opts->buzz_usec = atoi(s);
   }
+  if( (s = getenv("EF_SPIN_LOW_POWER")) )
+    opts->spin_low_power_usec = atoi(s);
 
   /* The options that follow are (at time of writing) not sensitive to the
    * order in which they are read.
@@ -854,6 +893,12 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   }
   if ( (s = getenv("EF_PREALLOC_PACKETS")) )
     opts->prealloc_packets = atoi(s);
+  if( (s = getenv("EF_PKT_SHRINK_IDLE")) )
+    opts->pkt_shrink_idle = atoi(s);
+  if( (s = getenv("EF_PKT_SHRINK_THRESHOLD")) )
+    opts->pkt_shrink_threshold = atoi(s);
+  if( (s = getenv("EF_ZC_REG_CACHE")) )
+    opts->zc_reg_cache = atoi(s);
   if ( (s = getenv("EF_RXQ_MIN")) )
     opts->rxq_min = atoi(s);
   if ( (s = getenv("EF_MIN_FREE_PACKETS")) )
@@ -964,6 +1009,10 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     opts->rst_delayed_conn = atoi(s);
   if( (s = getenv("EF_TCP_SNDBUF_MODE")) )
     opts->tcp_sndbuf_mode = atoi(s);
+  if( (s = getenv("EF_TCP_NOTSENT_LOWAT")) )
+    opts->tcp_notsent_lowat = atoi(s);
+  if( (s = getenv("EF_TCP_TXQ_LIMIT")) )
+    opts->tcp_txq_limit = atoi(s);
   if( (s = getenv("EF_TCP_COMBINE_SENDS_MODE")) )
     opts->tcp_combine_sends_mode = atoi(s);
   if( (s = getenv("EF_TCP_SEND_NONBLOCK_NO_PACKETS_MODE")) )
@@ -1153,6 +1202,10 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   if ( (s = getenv("EF_CONG_NOTIFY_THRESH")))
     opts->cong_notify_thresh = atoi(s);
 #endif
+#if CI_CFG_SOCK_CYCLES
+  if ( (s = getenv("EF_SOCK_CYCLES")))
+    opts->sock_cycles = atoi(s);
+#endif
 #if CI_CFG_TAIL_DROP_PROBE
   if ( (s = getenv("EF_TAIL_DROP_PROBE")))
     opts->tail_drop_probe = atoi(s);
@@ -1257,6 +1310,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
                  sizeof(opts->iface_whitelist));
   handle_str_opt(opts, "EF_INTERFACE_BLACKLIST", opts->iface_blacklist,
                  sizeof(opts->iface_blacklist));
+  handle_str_opt(opts, "EF_TX_SHAPE", opts->tx_shape,
+                 sizeof(opts->tx_shape));
 
   if( (s = getenv("EF_KERNEL_PACKETS_BATCH_SIZE")) )
     opts->kernel_packets_batch_size = atoi(s);
@@ -1710,6 +1765,13 @@ static void netif_tcp_helper_build2(ci_netif* ni)
   ni->deferred_pkts =
     (struct oo_deferred_pkt*) ((char*) ni->state +
                                ni->state->deferred_pkts_ofs);
+#if CI_CFG_TIMESTAMPING
+  ni->tx_ts_ring =
+    (struct onload_tx_timestamp*) ((char*) ni->state +
+                                   ni->state->tx_ts_ring_ofs);
+#endif
+  ni->ip_reasm =
+    (ci_ip_reasm_entry*) ((char*) ni->state + ni->state->ip_reasm_ofs);
   ni->filter_table =
     (ci_netif_filter_table*) ((char*) ni->state + ni->state->table_ofs);
   ni->filter_table_ext =
@@ -2088,6 +2150,34 @@ unsigned ci_netif_build_future_intf_mask(ci_netif* ni)
   return mask;
 }
 
+
+/* Choose the low-power wait for EF_SPIN_LOW_POWER, falling back to plain
+ * spinning if the CPU has nothing suitable. */
+static void netif_spin_wait_init(ci_netif* ni)
+{
+  ni->spin_wait_mode = CI_MONITOR_NONE;
+  ni->spin_wait_ticks = 0;
+  if( NI_OPTS(ni).spin_low_power_usec == 0 )
+    return;
+
+#if defined(__x86_64__) || defined(__i386__)
+  if( ci_cpu_has_feature("waitpkg") )
+    ni->spin_wait_mode = CI_MONITOR_UMWAIT;
+  else if( ci_cpu_has_feature("mwaitx") )
+    ni->spin_wait_mode = CI_MONITOR_MWAITX;
+#elif defined(__aarch64__)
+  if( ci_cpu_has_feature("wfe") )
+    ni->spin_wait_mode = CI_MONITOR_WFE;
+#endif
+  if( ni->spin_wait_mode == CI_MONITOR_NONE ) {
+    NI_LOG_ONCE(ni, CONFIG_WARNINGS, "EF_SPIN_LOW_POWER is not supported "
+                "by this CPU; spinning without waiting");
+    return;
+  }
+  ni->spin_wait_ticks = (ci_uint64) NI_OPTS(ni).spin_low_power_usec *
+                        IPTIMER_STATE(ni)->khz / 1000;
+}
+
 static int af_xdp_kick(ef_vi* vi)
 {
   ci_netif* ni = vi->xdp_kick_context;
@@ -2237,6 +2327,7 @@ static int netif_tcp_helper_build(ci_netif* ni)
 #endif
   }
   ni->future_intf_mask = ci_netif_build_future_intf_mask(ni);
+  netif_spin_wait_init(ni);
 
 #if CI_CFG_CTPIO
   ci_assert_equal(ctpio_io_offset, ns->ctpio_mmap_bytes);
@@ -2756,6 +2847,8 @@ static int ci_netif_init(ci_netif* ni, ef_driver_handle fd)
   ni->flags = 0;
   ni->error_flags = 0;
   ni->cplane_init_net = NULL;
+  ni->zc_reg_cache = NULL;
+  ni->zc_reg_cache_idle = 0;
 
   ni->cplane = malloc(sizeof(struct oo_cplane_handle));
   if( ni->cplane == NULL )
@@ -2821,25 +2914,33 @@ static void ci_netif_deinit(ci_netif* ni)
 #if CI_CFG_UL_INTERRUPT_HELPER
 #include <sys/wait.h>
 #include <ci/internal/syscall.h>
+#include <onload/ul/helper.h>
 
 #define ONLOAD_HELPER_NAME "onload_helper"
 
 /* Run this in the second-level cloned process: exec */
-static void ci_netif_start_helper2(ci_netif* ni) __attribute__((noreturn));
-static void ci_netif_start_helper2(ci_netif* ni)
+static void ci_netif_start_helper2(ci_netif* ni, bool shared)
+  __attribute__((noreturn));
+static void ci_netif_start_helper2(ci_netif* ni, bool shared)
 {
   char* argv[5];
   char stack_id_str[strlen(OO_STRINGIFY(INT_MAX)) + 1];
   int rc;
 
   argv[0] = ONLOAD_HELPER_NAME;
-  argv[1] = "-s";
-  snprintf(stack_id_str, sizeof(stack_id_str), "%d", NI_ID(ni));
-  argv[2] = stack_id_str;
+  if( shared ) {
+    argv[1] = "-m";
+    argv[2] = NULL;
+  }
+  else {
+    argv[1] = "-s";
+    snprintf(stack_id_str, sizeof(stack_id_str), "%d", NI_ID(ni));
+    argv[2] = stack_id_str;
+  }
   argv[3] = NULL;
   if( CITP_OPTS.log_via_ioctl ) {
-    argv[3] = "-K";
-    argv[4] = NULL;
+    argv[shared ? 2 : 3] = "-K";
+    argv[shared ? 3 : 4] = NULL;
   }
 
   rc = ci_sys_execvpe(ONLOAD_HELPER_NAME, argv, NULL);
@@ -2852,8 +2953,9 @@ static void ci_netif_start_helper2(ci_netif* ni)
 
 /* Run this in the first-level cloned process: fork and exit.
  * We should not exec here, because execve() overwrites exit_signal. */
-static void ci_netif_start_helper1(ci_netif* ni) __attribute__((noreturn));
-static void ci_netif_start_helper1(ci_netif* ni)
+static void ci_netif_start_helper1(ci_netif* ni, bool shared)
+  __attribute__((noreturn));
+static void ci_netif_start_helper1(ci_netif* ni, bool shared)
 {
   int i;
   sigset_t sigset;
@@ -2898,7 +3000,7 @@ static void ci_netif_start_helper1(ci_netif* ni)
   rc = my_do_syscall3(__NR_clone, CLONE_FILES | CLONE_VFORK | SIGCHLD,
                       0, 0);
   if( rc == 0 )
-    ci_netif_start_helper2(ni);
+    ci_netif_start_helper2(ni, shared);
 
   if( rc < 0 ) {
     ci_log("spawning "ONLOAD_HELPER_NAME" for [%s]: "
@@ -2916,7 +3018,7 @@ static void ci_netif_start_helper1(ci_netif* ni)
   _exit(3);
 }
 
-static int ci_netif_start_helper(ci_netif* ni)
+static int ci_netif_spawn_helper(ci_netif* ni, bool shared)
 {
   int rc;
   int wstatus;
@@ -2927,7 +3029,7 @@ static int ci_netif_start_helper(ci_netif* ni)
    */
   rc = my_do_syscall3(__NR_clone, CLONE_FILES | CLONE_VFORK, 0, 0);
   if( rc == 0 )
-    ci_netif_start_helper1(ni);
+    ci_netif_start_helper1(ni, shared);
 
   if( rc < 0 ) {
     ci_log("spawning "ONLOAD_HELPER_NAME" for [%s]: "
@@ -2944,6 +3046,63 @@ static int ci_netif_start_helper(ci_netif* ni)
                __func__, ni->state->pretty_name, wstatus));
   return -1;
 }
+
+/* Ask the shared helper to service this stack.  Returns 0 if it has
+ * attached to the stack. */
+static int ci_netif_attach_shared_helper(ci_netif* ni)
+{
+  struct sockaddr_un sun;
+  socklen_t sun_len = oo_ulh_shared_addr(&sun, geteuid());
+  struct ucred cred;
+  socklen_t cred_len = sizeof(cred);
+  ci_int32 msg = NI_ID(ni);
+  int fd, rc;
+
+  fd = ci_sys_socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if( fd < 0 )
+    return -errno;
+  rc = ci_sys_connect(fd, (struct sockaddr*) &sun, sun_len);
+  /* Anyone can bind the name, so don't hand the stack to a helper running
+   * as another user. */
+  if( rc == 0 &&
+      (rc = ci_sys_getsockopt(fd, SOL_SOCKET, SO_PEERCRED,
+                              &cred, &cred_len)) == 0 &&
+      cred.uid != geteuid() ) {
+    ci_log("%s: "ONLOAD_HELPER_NAME" socket is owned by uid %u, not %u",
+           __func__, (unsigned) cred.uid, (unsigned) geteuid());
+    ci_sys_close(fd);
+    return -EPERM;
+  }
+  if( rc == 0 && ci_sys_send(fd, &msg, sizeof(msg), 0) != sizeof(msg) )
+    rc = -1;
+  if( rc == 0 && ci_sys_recv(fd, &msg, sizeof(msg), 0) != sizeof(msg) )
+    rc = -1;
+  rc = rc < 0 ? -errno : msg;
+  ci_sys_close(fd);
+  return rc;
+}
+
+static int ci_netif_start_helper(ci_netif* ni)
+{
+  int rc;
+
+  if( NI_OPTS(ni).helper_shared ) {
+    rc = ci_netif_attach_shared_helper(ni);
+    /* Start the shared helper if it is not running yet.  If another
+     * process races with us then one of the two helpers fails to bind and
+     * exits quietly, and we attach to the other. */
+    if( rc == -ECONNREFUSED || rc == -ENOENT ) {
+      if( ci_netif_spawn_helper(ni, true) == 0 )
+        rc = ci_netif_attach_shared_helper(ni);
+    }
+    if( rc == 0 )
+      return 0;
+    LOG_S(ci_log("%s: shared "ONLOAD_HELPER_NAME" did not take [%s]: "
+                 "rc=%d; starting a dedicated helper", __func__,
+                 ni->state->pretty_name, rc));
+  }
+  return ci_netif_spawn_helper(ni, false);
+}
 #endif
 
 int ci_netif_ctor(ci_netif* ni, ef_driver_handle fd, const char* stack_name,
@@ -3185,6 +3344,13 @@ int ci_netif_dtor(ci_netif* ni)
 {
   ci_assert(ni);
 
+  /* The kernel releases cached zc registrations along with the stack. */
+  while( ni->zc_reg_cache != NULL ) {
+    struct ci_zc_usermem* um = ni->zc_reg_cache;
+    ni->zc_reg_cache = um->cache_next;
+    free(um);
+  }
+
   /* \TODO Check if we should be calling ci_ipid_dtor() here. */
   /* Free the TCP helper resource */
   netif_tcp_helper_free(ni);
@@ -371,6 +371,33 @@ int ci_netif_pkt_alloc_block(ci_netif* ni, ci_sock_cmn* s,
 }
 
 
+#if CI_CFG_IPV6 && CI_CFG_INJECT_PACKETS
+/* Undo ci_ip6_rx_ext_hdrs(): move the extension headers back to between the
+ * IPv6 header and the upper-layer header, so that the kernel gets the
+ * packet as it was received. */
+static void ci_netif_pkt_ip6_ext_restore(ci_ip_pkt_fmt* pkt)
+{
+  char hdrs[ETH_HLEN + ETH_VLAN_HLEN + sizeof(ci_ip6_hdr)];
+  int hdrs_len = oo_pre_l3_len(pkt) + sizeof(ci_ip6_hdr);
+  int ext_len = pkt->ip6_ext_len;
+  ci_ip6_hdr* ip6 = oo_ip6_hdr(pkt);
+  char* start = PKT_START(pkt) - ext_len;
+
+  ci_assert_le(hdrs_len, sizeof(hdrs));
+  ip6->next_hdr = pkt->ip6_ext_next_hdr;
+  ip6->payload_len =
+    CI_BSWAP_BE16(CI_BSWAP_BE16(ip6->payload_len) + ext_len);
+  memcpy(hdrs, PKT_START(pkt), hdrs_len);
+  memmove(start + hdrs_len, start, ext_len);
+  memcpy(start, hdrs, hdrs_len);
+  pkt->pkt_start_off -= ext_len;
+  pkt->pkt_eth_payload_off -= ext_len;
+  pkt->pay_len += ext_len;
+  pkt->rx_flags &= ~CI_PKT_RX_FLAG_IP6_EXT_MOVED;
+}
+#endif
+
+
 int ci_netif_pkt_pass_to_kernel(ci_netif* ni, ci_ip_pkt_fmt* pkt)
 {
   ci_assert(ci_netif_is_locked(ni));
@@ -389,6 +416,11 @@ int ci_netif_pkt_pass_to_kernel(ci_netif* ni, ci_ip_pkt_fmt* pkt)
     return 0;
   }
 
+#if CI_CFG_IPV6
+  if( pkt->rx_flags & CI_PKT_RX_FLAG_IP6_EXT_MOVED )
+    ci_netif_pkt_ip6_ext_restore(pkt);
+#endif
+
   /* offbuf for the first segment may be tweaked in attempt to deliver this
    * packet to Onload.  We have to restore it now. */
   oo_offbuf_set_start(&pkt->buf, oo_ether_hdr(pkt));
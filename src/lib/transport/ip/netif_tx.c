@@ -17,6 +17,7 @@
 #include "netif_tx.h"
 #include <ci/tools/pktdump.h>
 #include <ci/internal/pio_buddy.h>
+#include <ci/internal/tx_shaper.h>
 
 #if OO_DO_STACK_POLL
 
@@ -241,7 +242,7 @@ void ci_netif_dmaq_shove_plugin(ci_netif* ni, int intf_i, int q_id)
 #endif
 
 
-void __ci_netif_send(ci_netif* netif, ci_ip_pkt_fmt* pkt)
+static void __ci_netif_send_now(ci_netif* netif, ci_ip_pkt_fmt* pkt)
 {
   int intf_i, rc;
   oo_pktq* dmaq;
@@ -390,6 +391,108 @@ void __ci_netif_send(ci_netif* netif, ci_ip_pkt_fmt* pkt)
 }
 
 
+static int ci_netif_txshape_pkt_class(ci_ip_pkt_fmt* pkt)
+{
+  if( oo_tx_ether_type_get(pkt) == CI_ETHERTYPE_IP )
+    return ci_txshape_class_of_tos(oo_tx_ip_hdr(pkt)->ip_tos);
+#if CI_CFG_IPV6
+  if( oo_tx_ether_type_get(pkt) == CI_ETHERTYPE_IP6 )
+    return ci_txshape_class_of_tos(ci_ip6_tclass(oo_tx_ip6_hdr(pkt)));
+#endif
+  return -1;
+}
+
+
+static void ci_netif_txshape_arm(ci_netif* ni)
+{
+  if( ! ci_ip_timer_pending(ni, &ni->state->txshape_tid) )
+    ci_ip_timer_set(ni, &ni->state->txshape_tid, ci_ip_time_now(ni) + 1);
+}
+
+
+/* Returns true if the shaper has taken [pkt] into its class's backlog,
+ * or false if it should be sent now.
+ */
+static bool ci_netif_txshape_hold(ci_netif* ni, ci_ip_pkt_fmt* pkt)
+{
+  ci_txshape_state* s = &ni->state->txshape;
+  unsigned khz = IPTIMER_STATE(ni)->khz;
+  unsigned len = TX_PKT_LEN(pkt);
+  ci_txshape_class* cl;
+  ci_uint64 now;
+  int c, how;
+
+  if( ! is_to_primary_vi(pkt) ||
+      (c = ci_netif_txshape_pkt_class(pkt)) < 0 )
+    return false;
+
+  ci_frc64(&now);
+  ci_txshape_refill(s, now, khz);
+  cl = &s->cls[c];
+  if( ! ci_txshape_is_shaped(s, c) ) {
+    ci_txshape_charge(s, c, len, khz, CI_TXSHAPE_SEND);
+    return false;
+  }
+  /* Don't overtake packets already waiting in this class. */
+  if( oo_pktq_is_empty(&cl->backlog) &&
+      (how = ci_txshape_check(s, c, len, khz)) != CI_TXSHAPE_WAIT ) {
+    ci_txshape_charge(s, c, len, khz, how);
+    return false;
+  }
+
+  __oo_pktq_put(ni, &cl->backlog, pkt, netif.tx.dmaq_next);
+  ++s->backlog;
+  ++cl->n_delayed;
+  if( (ci_uint32) cl->backlog.num > cl->max_backlog )
+    cl->max_backlog = cl->backlog.num;
+  ci_netif_txshape_arm(ni);
+  return true;
+}
+
+
+void ci_netif_txshape_poll(ci_netif* ni)
+{
+  ci_txshape_state* s = &ni->state->txshape;
+  unsigned khz = IPTIMER_STATE(ni)->khz;
+  unsigned head_len[CI_TXSHAPE_CLASSES];
+  ci_ip_pkt_fmt* pkt;
+  ci_uint64 now;
+  int c, how;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  ci_frc64(&now);
+  ci_txshape_refill(s, now, khz);
+  while( s->backlog != 0 ) {
+    /* Sending may poll the stack and get back here, so look afresh at the
+     * backlogs each time round. */
+    for( c = 0; c < CI_TXSHAPE_CLASSES; ++c ) {
+      oo_pktq* q = &s->cls[c].backlog;
+      head_len[c] = oo_pktq_is_empty(q) ? 0 :
+                    TX_PKT_LEN(PKT_CHK(ni, q->head));
+    }
+    if( (c = ci_txshape_pick(s, head_len, khz, &how)) < 0 )
+      break;
+    pkt = PKT_CHK(ni, s->cls[c].backlog.head);
+    __oo_pktq_next(ni, &s->cls[c].backlog, pkt, netif.tx.dmaq_next);
+    --s->backlog;
+    ci_txshape_charge(s, c, TX_PKT_LEN(pkt), khz, how);
+    __ci_netif_send_now(ni, pkt);
+  }
+  if( s->backlog != 0 )
+    ci_netif_txshape_arm(ni);
+}
+
+
+void __ci_netif_send(ci_netif* netif, ci_ip_pkt_fmt* pkt)
+{
+  if(CI_UNLIKELY( netif->state->txshape.shaped != 0 ) &&
+     ci_netif_txshape_hold(netif, pkt) )
+    return;
+  __ci_netif_send_now(netif, pkt);
+}
+
+
 /* Transmit the given packet right now, failing if it can't be done
  * (ci_netif_send() will put deferrals on to the dmaq for later). This is a
  * low-level function used by VIs which are used for communicating with
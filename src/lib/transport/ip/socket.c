@@ -91,6 +91,9 @@ void ci_sock_cmn_init(ci_netif* ni, ci_sock_cmn* s, int can_poison)
   s->timestamping_flags = 0u;
 #endif
   s->os_sock_status = OO_OS_STATUS_TX;
+#if CI_CFG_SOCK_CYCLES
+  memset(&s->cycles, 0, sizeof(s->cycles));
+#endif
 
 #if CI_CFG_IPV6
   {
@@ -137,6 +140,13 @@ void ci_sock_cmn_dump(ci_netif* ni, ci_sock_cmn* s, const char* pf,
          s->os_sock_status >> OO_OS_STATUS_SEQ_SHIFT,
          (s->os_sock_status & OO_OS_STATUS_RX) ? ",RX":"",
          (s->os_sock_status & OO_OS_STATUS_TX) ? ",TX":"");
+#if CI_CFG_SOCK_CYCLES
+  if( NI_OPTS(ni).sock_cycles )
+    logger(log_arg, "%s  cycles: rx=%"CI_PRIu64" tx=%"CI_PRIu64
+           " timer=%"CI_PRIu64" recv=%"CI_PRIu64" send=%"CI_PRIu64, pf,
+           s->cycles.rx, s->cycles.tx, s->cycles.timer, s->cycles.recv,
+           s->cycles.send);
+#endif
 
   if( s->b.ready_lists_in_use != 0 ) {
     ci_uint32 tmp, i;
@@ -0,0 +1,429 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  Checkpoint and restore of established TCP connections
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_lib_transport_ip */
+
+#include "ip_internal.h"
+#include "tcp_rx.h"
+#include <onload/ul/checkpoint.h>
+
+
+#define LPF "TCP CHECKPOINT "
+
+
+/* Check that every packet on [q] is a plain single-buffer packet, as we
+ * only know how to read the payload of those.
+ */
+static int ci_tcp_checkpoint_txq_ok(ci_netif* ni, ci_ip_pkt_queue* q)
+{
+  ci_ip_pkt_fmt* pkt;
+  oo_pkt_p id;
+
+  for( id = q->head; OO_PP_NOT_NULL(id); id = pkt->next ) {
+    pkt = PKT_CHK(ni, id);
+    if( pkt->n_buffers != 1 || (pkt->flags & CI_PKT_FLAG_INDIRECT) )
+      return 0;
+  }
+  return 1;
+}
+
+
+/* Freeze an established connection and describe it in [cp].
+ *
+ * From here on the connection neither sends nor receives: incoming
+ * segments are dropped unacknowledged and all timers are stopped, so the
+ * state captured here stays valid until the connection is either taken
+ * over by ci_tcp_restore() in another stack or thawed again.  Its filters
+ * stay in place so that the peer's segments do not reach the kernel (which
+ * would reset the connection).
+ */
+int ci_tcp_checkpoint(ci_netif* ni, ci_tcp_state* ts,
+                      struct oo_checkpoint_sock* cp)
+{
+  ci_assert(ci_netif_is_locked(ni));
+
+  if( ts->s.b.state != CI_TCP_ESTABLISHED ||
+      (ts->tcpflags & CI_TCPT_FLAG_CHECKPOINTED) ||
+      OO_SP_NOT_NULL(ts->local_peer) ||
+      (ts->s.pkt.flags & CI_IP_CACHE_IS_LOCALROUTE) ||
+      ci_tcp_is_pluginized(ts) ||
+      ! tcp_rx_urg_fast_path(ts) || ! ci_ip_queue_is_empty(&ts->recv2) )
+    return -EOPNOTSUPP;
+
+  /* Anything sent without the lock is part of the send queue too. */
+  ci_tcp_sendmsg_enqueue_prequeue(ni, ts, 0);
+  if( ! ci_tcp_checkpoint_txq_ok(ni, &ts->retrans) ||
+      ! ci_tcp_checkpoint_txq_ok(ni, &ts->send) )
+    return -EOPNOTSUPP;
+
+  ci_tcp_stop_timers(ni, ts);
+  ts->tcpflags |= CI_TCPT_FLAG_CHECKPOINTED;
+  ts->tcpflags &=~ CI_TCPT_FLAG_TXQ_LIMITED;
+  /* Send every segment to handle_rx_slow(), which drops it. */
+  ts->fast_path_check = ~CI_TCP_FAST_PATH_MASK;
+  ts->s.tx_errno = EPIPE;
+
+  cp->sock_id = OO_SP_TO_INT(S_SP(ts));
+  cp->state = CI_TCP_ESTABLISHED;
+  cp->laddr = tcp_ipx_laddr(ts);
+  cp->raddr = tcp_ipx_raddr(ts);
+  cp->lport_be16 = tcp_lport_be16(ts);
+  cp->rport_be16 = tcp_rport_be16(ts);
+  cp->s_flags = ts->s.s_flags;
+  cp->tcpflags = ts->tcpflags & CI_TCPT_NEG_FLAGS;
+  cp->snd_una = tcp_snd_una(ts);
+  cp->snd_max = ts->snd_max;
+  cp->rcv_nxt = tcp_rcv_nxt(ts);
+  cp->rcv_wnd_right_edge_sent = tcp_rcv_wnd_right_edge_sent(ts);
+  cp->tsrecent = ts->tsrecent;
+  cp->ssthresh = ts->ssthresh;
+  cp->sa = ts->sa;
+  cp->sv = ts->sv;
+  cp->rto = ts->rto;
+  cp->smss = ts->smss;
+  cp->user_mss = ts->c.user_mss;
+  cp->snd_wscl = ts->snd_wscl;
+  cp->rcv_wscl = ts->rcv_wscl;
+  cp->snd_len = SEQ_SUB(tcp_enq_nxt(ts), tcp_snd_una(ts));
+  cp->rcv_len = tcp_rcv_usr(ts);
+
+  LOG_TC(log(LNTS_FMT "CHECKPOINTED snd=%08x+%u rcv=%08x-%u",
+             LNTS_PRI_ARGS(ni, ts), cp->snd_una, cp->snd_len,
+             cp->rcv_nxt, cp->rcv_len));
+  return 0;
+}
+
+
+static char* ci_tcp_checkpoint_copy_txq(ci_netif* ni, ci_tcp_state* ts,
+                                        ci_ip_pkt_queue* q, char* p)
+{
+  int af = ipcache_af(&ts->s.pkt);
+  ci_ip_pkt_fmt* pkt;
+  oo_pkt_p id;
+  int len, off;
+
+  for( id = q->head; OO_PP_NOT_NULL(id); id = pkt->next ) {
+    pkt = PKT_CHK(ni, id);
+    len = PKT_TCP_TX_SEQ_SPACE(pkt);
+    /* The head of the retransmit queue may be partially acknowledged. */
+    off = 0;
+    if( SEQ_LT(pkt->pf.tcp_tx.start_seq, tcp_snd_una(ts)) )
+      off = SEQ_SUB(tcp_snd_una(ts), pkt->pf.tcp_tx.start_seq);
+    if( off >= len )
+      continue;
+    memcpy(p, CI_TCP_PAYLOAD(TX_PKT_IPX_TCP(af, pkt)) + off, len - off);
+    p += len - off;
+  }
+  return p;
+}
+
+
+/* Copy the send and receive data of a connection frozen by
+ * ci_tcp_checkpoint() to [buf], which must have room for
+ * [cp->snd_len + cp->rcv_len] bytes.
+ */
+void ci_tcp_checkpoint_copy(ci_netif* ni, ci_tcp_state* ts,
+                            const struct oo_checkpoint_sock* cp, char* buf)
+{
+  ci_ip_pkt_fmt* pkt;
+  oo_pkt_p id;
+  char* p;
+
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert(ts->tcpflags & CI_TCPT_FLAG_CHECKPOINTED);
+
+  p = ci_tcp_checkpoint_copy_txq(ni, ts, &ts->retrans, buf);
+  p = ci_tcp_checkpoint_copy_txq(ni, ts, &ts->send, p);
+  ci_assert_equal(p - buf, cp->snd_len);
+
+  for( id = ts->recv1_extract; OO_PP_NOT_NULL(id); id = pkt->next ) {
+    pkt = PKT_CHK(ni, id);
+    memcpy(p, oo_offbuf_ptr(&pkt->buf), oo_offbuf_left(&pkt->buf));
+    p += oo_offbuf_left(&pkt->buf);
+  }
+  ci_assert_equal(p - buf, cp->snd_len + cp->rcv_len);
+}
+
+
+/* Undo ci_tcp_checkpoint() when the checkpoint could not be completed. */
+void ci_tcp_checkpoint_thaw(ci_netif* ni, ci_tcp_state* ts)
+{
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert(ts->tcpflags & CI_TCPT_FLAG_CHECKPOINTED);
+
+  ts->tcpflags &=~ CI_TCPT_FLAG_CHECKPOINTED;
+  ts->s.tx_errno = 0;
+  if( ci_tcp_can_use_fast_path(ts) )
+    ci_tcp_fast_path_enable(ts);
+  ci_tcp_kalive_restart(ni, ts, ci_tcp_kalive_idle_get(ts));
+  if( ! ci_tcp_retransq_is_empty(ts) )
+    ci_tcp_rto_restart(ni, ts);
+  if( ci_tcp_sendq_not_empty(ts) )
+    ci_tcp_tx_advance(ts, ni);
+}
+
+
+static ci_tcp_state*
+ci_tcp_checkpoint_lookup(ci_netif* ni, const struct oo_checkpoint_sock* cp)
+{
+  citp_waitable* w;
+  ci_tcp_state* ts;
+
+  if( ! IS_VALID_SOCK_ID(ni, cp->sock_id) )
+    return NULL;
+  w = SP_TO_WAITABLE(ni, OO_SP_FROM_INT(ni, cp->sock_id));
+  if( w->state != CI_TCP_ESTABLISHED )
+    return NULL;
+  ts = SP_TO_TCP(ni, W_SP(w));
+  if( ! (ts->tcpflags & CI_TCPT_FLAG_CHECKPOINTED) ||
+      tcp_lport_be16(ts) != cp->lport_be16 ||
+      tcp_rport_be16(ts) != cp->rport_be16 ||
+      ! CI_IPX_ADDR_EQ(tcp_ipx_raddr(ts), cp->raddr) )
+    return NULL;
+  return ts;
+}
+
+
+/* Called in the checkpointed stack when the connection described by [cp]
+ * is about to be restored elsewhere.  Removes the frozen connection's
+ * filters so that the restored one can take their place; the frozen socket
+ * itself goes away silently when the checkpointing process closes it.
+ */
+int ci_tcp_checkpoint_release(ci_netif* ni,
+                              const struct oo_checkpoint_sock* cp)
+{
+  ci_tcp_state* ts;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  ts = ci_tcp_checkpoint_lookup(ni, cp);
+  if( ts == NULL )
+    return -ESRCH;
+  return ci_tcp_ep_clear_filters(ni, S_SP(ts), 0);
+}
+
+
+/* Called in the checkpointed stack when the connection described by [cp]
+ * could not be restored, to hand it back to the checkpointing process.
+ * [released] says whether ci_tcp_checkpoint_release() had already removed
+ * its filters.
+ */
+int ci_tcp_checkpoint_reclaim(ci_netif* ni,
+                              const struct oo_checkpoint_sock* cp,
+                              int released)
+{
+  ci_tcp_state* ts;
+  int rc = 0;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  ts = ci_tcp_checkpoint_lookup(ni, cp);
+  if( ts == NULL )
+    return -ESRCH;
+  if( released ) {
+    rc = ci_tcp_ep_set_filters(ni, S_SP(ts), ts->s.cp.so_bindtodevice,
+                               OO_SP_NULL);
+    if( rc < 0 ) {
+      /* Without its filters the peer's segments go to the kernel, which
+       * resets the connection anyway. */
+      LOG_E(log(LNTS_FMT "failed to reinstall filters (rc=%d)",
+                LNTS_PRI_ARGS(ni, ts), rc));
+      ci_tcp_drop(ni, ts, EPIPE);
+      return rc;
+    }
+  }
+  ci_tcp_checkpoint_thaw(ni, ts);
+  return 0;
+}
+
+
+/* Build the packets for the receive queue from data that had been
+ * acknowledged but not read when the connection was checkpointed.  The
+ * data goes into packets with TCP headers carrying the sequence numbers it
+ * originally had, just as if it had been received in order.
+ */
+static int ci_tcp_restore_recvq(ci_netif* ni, ci_tcp_state* ts,
+                                const char* data, int len,
+                                ci_ip_pkt_queue* rxq)
+{
+  int af = ipcache_af(&ts->s.pkt);
+  ci_uint32 seq = tcp_rcv_nxt(ts) - len;
+  ci_ip_pkt_fmt* pkt;
+  ci_tcp_hdr* tcp;
+  char* payload;
+  int n;
+
+  while( len > 0 ) {
+    pkt = ci_netif_pkt_alloc(ni, 0);
+    if( pkt == NULL ) {
+      ci_ip_queue_drop(ni, rxq);
+      return -ENOBUFS;
+    }
+    oo_tx_pkt_layout_init(pkt);
+    ci_pkt_init_from_ipcache(pkt, &ts->s.pkt);
+    oo_pkt_af_set(pkt, af);
+    tcp = TX_PKT_IPX_TCP(af, pkt);
+    tcp->tcp_seq_be32 = CI_BSWAP_BE32(seq);
+    payload = CI_TCP_PAYLOAD(tcp);
+
+    n = CI_MIN(len, tcp_eff_mss(ts));
+    memcpy(payload, data, n);
+    pkt->buf_len = pkt->pay_len = payload + n - (char*) PKT_START(pkt);
+    oo_offbuf_init(&pkt->buf, payload, n);
+    pkt->pf.tcp_rx.pay_len = n;
+    pkt->pf.tcp_rx.end_seq = seq + n;
+    pkt->flags &= CI_PKT_FLAG_NONB_POOL | CI_PKT_FLAG_IS_IP6;
+    pkt->flags |= CI_PKT_FLAG_RX;
+    ++ni->state->n_rx_pkts;
+
+    ci_ip_queue_enqueue(ni, rxq, pkt);
+    data += n;
+    len -= n;
+    seq += n;
+  }
+  return 0;
+}
+
+
+/* Turn [ts], a newly created socket, into the connection described by
+ * [cp].  This is done in two steps, either side of the checkpointed
+ * connection's filters being released with ci_tcp_checkpoint_release().
+ *
+ * ci_tcp_restore_prepare() does everything that can fail short of
+ * inserting filters: it looks up the route and builds the receive queue in
+ * [rxq] from the [cp->rcv_len] bytes of unread data at [rcv_data].
+ * ci_tcp_restore() then inserts the filters and brings the connection up.
+ * Both leave [rxq] empty if they fail, and [ts] can then be closed without
+ * anything being sent.
+ *
+ * The unacknowledged send data is not handled here: the caller sends it
+ * once ci_tcp_restore() has returned, and since the send sequence starts
+ * at [cp->snd_una] it goes out with its original sequence numbers.
+ */
+int ci_tcp_restore_prepare(ci_netif* ni, ci_tcp_state* ts,
+                           const struct oo_checkpoint_sock* cp,
+                           const char* rcv_data, ci_ip_pkt_queue* rxq)
+{
+  WITH_CI_CFG_IPV6( int af = CI_ADDR_AF(cp->raddr); )
+  ci_ip_cached_hdrs* ipcache = &ts->s.pkt;
+
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert(ci_ip_queue_is_empty(rxq));
+
+  if( ts->s.b.state != CI_TCP_CLOSED )
+    return -EISCONN;
+
+#if CI_CFG_IPV6
+  ci_tcp_ipcache_convert(af, ts);
+#endif
+  ci_ipcache_set_saddr(ipcache, cp->laddr);
+  ci_sock_set_laddr(&ts->s, cp->laddr);
+  TS_IPX_TCP(ts)->tcp_source_be16 = cp->lport_be16;
+  ts->s.cp.laddr = cp->laddr;
+  ts->s.cp.lport_be16 = cp->lport_be16;
+  ts->s.cp.sock_cp_flags |= OO_SCP_BOUND_ADDR;
+
+  ci_sock_set_raddr_port(&ts->s, cp->raddr, cp->rport_be16);
+  ci_ip_cache_invalidate(ipcache);
+  cicp_user_retrieve(ni, ipcache, &ts->s.cp);
+  if( ipcache->status != retrrc_success && ipcache->status != retrrc_nomac &&
+      ipcache->status >= 0 )
+    return -ENETUNREACH;
+  ci_tcp_set_peer(ts, cp->raddr, cp->rport_be16);
+
+  ts->amss = ci_tcp_amss(ni, &ts->c, ipcache, __func__);
+  ts->c.user_mss = cp->user_mss;
+  ts->tcpflags = cp->tcpflags & CI_TCPT_NEG_FLAGS;
+  ts->snd_wscl = cp->snd_wscl;
+  ts->rcv_wscl = cp->rcv_wscl;
+  CI_IP_SOCK_STATS_VAL_TXWSCL(ts, ts->snd_wscl);
+  CI_IP_SOCK_STATS_VAL_RXWSCL(ts, ts->rcv_wscl);
+
+  tcp_snd_una(ts) = tcp_snd_nxt(ts) = tcp_enq_nxt(ts) = tcp_snd_up(ts) =
+    cp->snd_una;
+  ci_tcp_set_snd_max(ts, cp->rcv_nxt, cp->snd_una,
+                     SEQ_SUB(cp->snd_max, cp->snd_una));
+  ci_tcp_rx_set_isn(ts, cp->rcv_nxt - cp->rcv_len);
+  tcp_rcv_nxt(ts) = cp->rcv_nxt;
+  tcp_rcv_up(ts) = SEQ_SUB(tcp_rcv_nxt(ts), 1);
+
+  ts->incoming_tcp_hdr_len = sizeof(ci_tcp_hdr);
+  ts->outgoing_hdrs_len = CI_IPX_HDR_SIZE(af) + sizeof(ci_tcp_hdr);
+  if( ts->tcpflags & CI_TCPT_FLAG_TSO ) {
+    ts->incoming_tcp_hdr_len += 12;
+    ts->outgoing_hdrs_len += 12;
+    ts->tspaws = ci_tcp_time_now(ni);
+    ts->tsrecent = cp->tsrecent;
+    ts->tslastack = cp->rcv_nxt;
+  }
+  else {
+    ci_tcp_clear_rtt_timing(ts);
+  }
+  ci_tcp_set_hdr_len(ts, ts->outgoing_hdrs_len - CI_IPX_HDR_SIZE(af));
+
+  ts->smss = cp->smss;
+  ci_tcp_set_eff_mss(ni, ts);
+  ci_tcp_set_initialcwnd(ni, ts);
+
+  return ci_tcp_restore_recvq(ni, ts, rcv_data, cp->rcv_len, rxq);
+}
+
+
+int ci_tcp_restore(ci_netif* ni, ci_tcp_state* ts,
+                   const struct oo_checkpoint_sock* cp, ci_ip_pkt_queue* rxq)
+{
+  ci_ip_pkt_fmt* pkt;
+  int rc;
+
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert_equal(ts->s.b.state, CI_TCP_CLOSED);
+
+  rc = ci_tcp_ep_set_filters(ni, S_SP(ts), ts->s.cp.so_bindtodevice,
+                             OO_SP_NULL);
+  if( rc < 0 ) {
+    ci_ip_queue_drop(ni, rxq);
+    return rc;
+  }
+
+  ci_tcp_set_established_state(ni, ts);
+  /* Keep what we had learnt about the path, but restart the congestion
+   * window from its initial value as after an idle period. */
+  ts->ssthresh = cp->ssthresh;
+  ts->sa = cp->sa;
+  ts->sv = cp->sv;
+  ts->rto = cp->rto;
+
+  ci_tcp_init_rcv_wnd(ts, "RESTORE");
+  /* The peer may already be using a window we advertised. */
+  if( SEQ_LT(tcp_rcv_wnd_right_edge_sent(ts), cp->rcv_wnd_right_edge_sent) )
+    tcp_rcv_wnd_right_edge_sent(ts) = cp->rcv_wnd_right_edge_sent;
+
+  ci_tcp_kalive_restart(ni, ts, ci_tcp_kalive_idle_get(ts));
+  ci_tcp_set_flags(ts, CI_TCP_FLAG_ACK);
+
+  while( ci_ip_queue_not_empty(rxq) ) {
+    pkt = PKT_CHK(ni, rxq->head);
+    ci_ip_queue_dequeue(ni, rxq, pkt);
+    ci_tcp_rx_enqueue_restored(ni, ts, pkt, pkt->pf.tcp_rx.pay_len);
+  }
+
+  /* Let the peer know where we are: it may have been retransmitting into
+   * the frozen connection. */
+  pkt = ci_netif_pkt_alloc(ni, 0);
+  if( pkt != NULL )
+    ci_tcp_send_ack(ni, ts, pkt, CI_FALSE);
+
+  LOG_TC(log(LNTS_FMT "RESTORED " RCV_WND_FMT " snd=%08x-%08x-%08x",
+             LNTS_PRI_ARGS(ni, ts), RCV_WND_ARGS(ts),
+             tcp_snd_una(ts), tcp_snd_nxt(ts), ts->snd_max));
+  return 0;
+}
+
+/*! \cidoxg_end */
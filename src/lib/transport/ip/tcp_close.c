@@ -535,7 +535,8 @@ int ci_tcp_close(ci_netif* netif, ci_tcp_state* ts)
     return 0;
   }
 
-  if( (ts->s.b.sb_flags & CI_SB_FLAG_MOVED) )
+  if( (ts->s.b.sb_flags & CI_SB_FLAG_MOVED) ||
+      (ts->tcpflags & CI_TCPT_FLAG_CHECKPOINTED) )
     goto drop;
 
 #if CI_CFG_TCP_OFFLOAD_RECYCLER
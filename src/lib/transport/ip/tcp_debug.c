@@ -674,7 +674,9 @@ static void ci_tcp_socket_cmn_dump(ci_netif* ni, ci_tcp_socket_cmn* tsc,
                                    const char* pf,
                                    oo_dump_log_fn_t logger, void* log_arg)
 {
-  /* fixme: dump tsc fields */
+  /* fixme: dump remaining tsc fields */
+  if( tsc->notsent_lowat != 0 )
+    logger(log_arg, "%s  notsent_lowat=%u", pf, tsc->notsent_lowat);
 }
 
 
@@ -798,9 +800,13 @@ void ci_tcp_state_dump(ci_netif* ni, ci_tcp_state* ts,
 	 OOF_IPCACHE_DETAIL,
 	 pf, ts->so_sndbuf_pkts, OOFA_IPCACHE_STATE(ni, &ts->s.pkt),
          OOFA_IPCACHE_DETAIL(&ts->s.pkt));
-  logger(log_arg, "%s  snd: limited rwnd=%d cwnd=%d nagle=%d more=%d app=%d",
-         pf, stats.tx_stop_rwnd, stats.tx_stop_cwnd, stats.tx_stop_nagle,
-         stats.tx_stop_more, stats.tx_stop_app);
+  logger(log_arg, "%s  snd: limited rwnd=%d cwnd=%d nagle=%d more=%d app=%d "
+         "txq=%d", pf, stats.tx_stop_rwnd, stats.tx_stop_cwnd,
+         stats.tx_stop_nagle, stats.tx_stop_more, stats.tx_stop_app,
+         stats.tx_stop_txq);
+  if( NI_OPTS(ni).tcp_txq_limit != 0 )
+    logger(log_arg, "%s  snd: txq_bytes=%u limit=%u", pf, ts->txq_bytes,
+           NI_OPTS(ni).tcp_txq_limit);
 #if CI_CFG_TAIL_DROP_PROBE
   if( ts->tcpflags & CI_TCPT_FLAG_TAIL_DROP_MARKED )
     logger(log_arg, "%s  snd: tail loss probe at %x", pf, ts->taildrop_mark);
@@ -836,6 +842,15 @@ void ci_tcp_state_dump(ci_netif* ni, ci_tcp_state* ts,
          "ooo=%d", pf, stats.rtos,
          stats.fast_recovers, stats.rx_seq_errs, stats.rx_ack_seq_errs,
          stats.rx_ooo_pkts, stats.rx_ooo_fill);
+#if CI_CFG_TCP_INFO_METRICS
+  logger(log_arg, "%s  info: tx=%u,%u,%" PRIu64 " retrans=%" PRIu64
+                  " rx=%u,%" PRIu64 " min_rtt=%u rate=%u"
+                  " chrono=%" PRIu64 ",%" PRIu64 ",%" PRIu64
+                  " (%d)", pf, stats.tx_pkts, stats.tx_data_pkts,
+         stats.tx_bytes, stats.tx_bytes_retrans, stats.rx_data_pkts,
+         stats.rx_bytes, ts->min_rtt, stats.rate_bpms, stats.chrono[0],
+         stats.chrono[1], stats.chrono[2], ts->chrono_type);
+#endif
   logger(log_arg, "%s  tx: defer=%d nomac=%u warm=%u warm_aborted=%u", pf,
          stats.tx_defer, stats.tx_nomac_defer, stats.tx_msg_warm,
          stats.tx_msg_warm_abort);
@@ -226,6 +226,38 @@ int ci_tcp_helper_ep_mcast_add_del(ci_fd_t           fd,
 }
 
 
+int ci_tcp_helper_ep_mcast_add_bulk(ci_fd_t           fd,
+                                    oo_sp             ep,
+                                    const ci_uint32*  mcast_addrs,
+                                    int               n_addrs,
+                                    ci_ifid_t         ifindex,
+                                    int*              n_added_out)
+{
+  oo_tcp_filter_mcast_bulk_t op;
+  int rc;
+
+  CI_USER_PTR_SET(op.addrs, mcast_addrs);
+  op.tcp_id     = ep;
+  op.ifindex    = ifindex;
+  op.n_addrs    = n_addrs;
+
+  VERB(ci_log("%s: id=%d n=%d", __FUNCTION__, OO_SP_FMT(ep), n_addrs));
+  rc = oo_resource_op(fd, OO_IOC_EP_FILTER_MCAST_ADD_BULK, &op);
+  if( rc == 0 ) {
+    rc = op.rc;
+    *n_added_out = op.n_addrs;
+  }
+  else {
+    *n_added_out = 0;
+  }
+
+  if( rc < 0 )
+    LOG_SV(ci_log("%s: failed for %d after %d/%d (rc=%d)", __FUNCTION__,
+                  OO_SP_FMT(ep), op.n_addrs, n_addrs, rc));
+  return rc;
+}
+
+
 int __ci_tcp_helper_stack_attach(ci_fd_t from_fd,
                                  efrm_nic_set_t *out_ptr_nic_set,
                                  ci_uint32 *out_map_size,
@@ -57,6 +57,7 @@ static void ci_tcp_state_connected_opts_init(ci_netif* netif, ci_tcp_state* ts)
   oo_atomic_set(&ts->send_prequeue_in, 0);
   ts->send_in = 0;
   ts->send_out = 0;
+  ts->txq_bytes = 0;
 
   /* Queues. */
   ci_ip_queue_init(&ts->recv1);
@@ -93,6 +94,7 @@ static void ci_tcp_state_tcb_init_fixed(ci_netif* netif, ci_tcp_state* ts,
   ts->c.t_ka_time_in_secs = NI_OPTS(netif).keepalive_time / 1000;
   ts->c.t_ka_intvl = NI_CONF(netif).tconst_keepalive_intvl;
   ts->c.t_ka_intvl_in_secs = NI_OPTS(netif).keepalive_intvl / 1000;
+  ts->c.notsent_lowat = 0;
 
   /* Initialise packet header and flow control state. */
   ci_ipx_hdr_init_fixed(&ts->s.pkt.ipx, AF_INET, IPPROTO_TCP,
@@ -236,6 +238,14 @@ static void ci_tcp_state_tcb_reinit(ci_netif* netif, ci_tcp_state* ts,
   ts->t_last_invalid_ack = ci_tcp_time_now(netif) -
                            NI_CONF(netif).tconst_invalid_ack_ratelimit;
 
+#if CI_CFG_TCP_INFO_METRICS
+  /* TCP_INFO chronograph and delivery rate */
+  ts->chrono_type = CI_TCP_CHRONO_NONE;
+  ts->chrono_start = ts->rate_start = ci_tcp_time_now(netif);
+  ts->rate_una = 0;
+  ts->min_rtt = 0;
+#endif
+
   /* TCP_MAXSEG */
   ts->c.user_mss = 0;
   ts->amss = 0;
@@ -14,6 +14,7 @@
 /*! \cidoxg_lib_transport_ip */
 
 #include "ip_internal.h"
+#include <ci/internal/probes.h>
 #include <onload/sleep.h>
 #include <onload/tmpl.h>
 
@@ -261,6 +262,7 @@ static void __ci_tcp_state_free(ci_netif *ni, ci_tcp_state *ts)
 
 static void ci_tcp_set_state(ci_netif* ni, ci_tcp_state* ts, int new_state)
 {
+  OO_PROBE4(tcp_state, NI_ID(ni), S_ID(ts), ts->s.b.state, new_state);
   ci_tcp_rx_buf_account_begin(ni, ts);
   ts->s.b.state = new_state;
   ci_tcp_rx_buf_account_end(ni, ts);
@@ -687,6 +687,8 @@ static int ci_tcp_recvmsg_spin(ci_netif* ni, ci_tcp_state* ts,
     if( tcp_rcv_usr(ts) || TCP_RX_DONE(ts) )
       goto out;
 
+    if( ni->spin_wait_ticks )
+      ci_netif_spin_wait(ni, intf_i, future, &poison, now_frc);
     ci_frc64(&now_frc);
     rc = OO_SPINLOOP_PAUSE_CHECK_SIGNALS(ni, now_frc, &schedule_frc, 
                                          ts->s.so.rcvtimeo_msec, &ts->s.b, si);
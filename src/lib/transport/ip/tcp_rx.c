@@ -32,6 +32,8 @@
 
 #include "ip_internal.h"
 #include "tcp_rx.h"
+#include <ci/internal/probes.h>
+#include <ci/internal/tcp_info.h>
 #if CI_CFG_TCP_OFFLOAD_RECYCLER
 #include <onload/tcp-ceph.h>
 #endif
@@ -114,6 +116,7 @@ ci_inline void ci_tcp_rx_update_state_on_add(ci_tcp_state* ts, int recvd)
   ci_wmb();
   /* Only then make data available to receive path. */
   ts->rcv_added += recvd;
+  ci_tcp_info_rx_bytes(ts, recvd);
   /* This tells the receive path at what point it should send a window
   ** update after freeing space in the recv queue.
   */
@@ -207,6 +210,18 @@ static void ci_tcp_rx_add_to_recvq(ci_netif *netif, ci_tcp_state *ts,
 }
 
 
+#ifndef __KERNEL__
+/* Used by ci_tcp_restore() to refill the receive queue of a restored
+ * connection with the data that had been received but not read.
+ */
+void ci_tcp_rx_enqueue_restored(ci_netif* netif, ci_tcp_state* ts,
+                                ci_ip_pkt_fmt* pkt, int bytes)
+{
+  ci_tcp_rx_add_to_recvq(netif, ts, pkt, bytes);
+}
+#endif
+
+
 static void ci_tcp_rx_clean_plugin_rob(ci_netif *netif, ci_tcp_state *ts,
                                        uint32_t nxt)
 {
@@ -670,9 +685,6 @@ ci_inline void ci_tcp_tso_update(ci_netif* ni, ci_tcp_state* ts,
       ) {
       ts->tsrecent = tsval;
       ts->tspaws = ci_tcp_time_now(ni);
-#ifndef NDEBUG
-      ts->tslastseq = beg_seq; /* temporary debugging */
-#endif
   }
 }
 
@@ -1415,7 +1427,8 @@ static void ci_tcp_rx_free_acked_bufs(ci_netif* netif, ci_tcp_state* ts,
 
 #if CI_CFG_TIMESTAMPING
     if( (p->flags & CI_PKT_FLAG_TX_TIMESTAMPED &&
-         onload_timestamping_want_tx_nic(ts->s.timestamping_flags)) ||
+         onload_timestamping_want_tx_nic(ts->s.timestamping_flags) &&
+         NI_OPTS(netif).tx_timestamp_ring == 0) ||
         (p->flags & CI_PKT_FLAG_INDIRECT &&
          ci_tcp_zc_has_cookies(netif, p)) ) {
       ci_udp_recv_q_put_pending(netif, &ts->timestamp_q, p);
@@ -1591,6 +1604,7 @@ static void ci_tcp_rx_handle_ack(ci_tcp_state* ts, ci_netif* netif,
 
     /* Free TX buffers that have been acked. */
     ci_tcp_rx_free_acked_bufs(netif, ts, rxp);
+    ci_tcp_info_acked(netif, ts, rxp->ack);
 
     if( ts->congstate != CI_TCP_CONG_OPEN && ts->congstate != CI_TCP_CONG_NOTIFIED)
       /* Congested: try to recover. */
@@ -3283,9 +3297,6 @@ static int handle_syn_sent_opts(ci_netif* netif, ci_tcp_state* ts,
       ts->incoming_tcp_hdr_len += 12;
       optlen = 12;
 
-#ifndef NDEBUG
-      ts->tslastseq = rxp->seq;
-#endif
       ts->tsrecent = rxp->timestamp;
       ts->tspaws = ci_tcp_time_now(netif);
     }
@@ -3794,20 +3805,16 @@ static void explain_why_seq_unacceptable(ci_netif* netif, ci_tcp_state* ts,
   if( ts->tcpflags & rxp->flags & CI_TCPT_FLAG_TSO ) {
     if( ci_tcp_paws_check(netif, rxp->timestamp,
                           ts->tspaws, ts->tsrecent) ) {
-      /* Possible PAWS failure, try and work out if it's interesting.  If
-       * this is in sequence, zero length, and the same seqno as the one
-       * that updated tsrecent, it could have been undetectably reordered.
+      /* Possible PAWS failure.  If this is in sequence and zero length it
+       * could have been undetectably reordered.
        */
       if( SEQ_EQ(rxp->seq, ts->tslastack)
-          && SEQ_EQ(ts->tslastack, ts->tslastseq)
           && SEQ_EQ(rxp->seq, pkt->pf.tcp_rx.end_seq) )
-        log("\tPAWS reordered tsval=0x%x tsrecent=0x%x "
-            "tslastack=0x%x tslastseq=0x%x", rxp->timestamp,
-            ts->tsrecent, ts->tslastack, ts->tslastseq);
+        log("\tPAWS reordered? tsval=0x%x tsrecent=0x%x tslastack=0x%x",
+            rxp->timestamp, ts->tsrecent, ts->tslastack);
       else
-        log("\tPAWS FAILED tsval=0x%x tsrecent=0x%x "
-            "tslastack=0x%x tslastseq=0x%x", rxp->timestamp,
-            ts->tsrecent, ts->tslastack, ts->tslastseq);
+        log("\tPAWS FAILED tsval=0x%x tsrecent=0x%x tslastack=0x%x",
+            rxp->timestamp, ts->tsrecent, ts->tslastack);
     }
   }
   else if( ts->tcpflags & CI_TCPT_FLAG_TSO )
@@ -4011,6 +4018,15 @@ static void handle_rx_slow(ci_tcp_state* ts, ci_netif* netif,
   LOG_TV(explain_why_on_slow_path(netif, ts, rxp));
   CITP_STATS_NETIF_INC(netif, rx_slow);
 
+  /* A checkpointed connection belongs to whoever restores it, and the
+   * peer will retransmit anything we drop here to them.  (The fast path
+   * is disabled for these sockets, so this is the only place to check.)
+   */
+  if(CI_UNLIKELY( ts->tcpflags & CI_TCPT_FLAG_CHECKPOINTED )) {
+    ci_netif_pkt_release_rx(netif, pkt);
+    return;
+  }
+
   /* We may have gotten these wrong in [ci_tcp_handle_rx()], 'cos we
   ** assumed the fast path.
   */
@@ -4611,6 +4627,9 @@ int ci_tcp_rx_deliver_to_conn(ci_sock_cmn* s, void* opaque_arg)
   int not_fast;
 
   CHECK_TS(ni, ts);
+  ci_sock_cycles_rx_mark(ni, s);
+  OO_PROBE5(tcp_rx, NI_ID(ni), S_ID(ts), rxp->seq, rxp->ack,
+            pkt->pf.tcp_rx.pay_len - CI_TCP_HDR_LEN(tcp));
 
   ci_assert(CI_IPX_ADDR_EQ(RX_PKT_DADDR(pkt),
                              ipcache_laddr(&s->pkt)));
@@ -4626,6 +4645,7 @@ int ci_tcp_rx_deliver_to_conn(ci_sock_cmn* s, void* opaque_arg)
 
   CI_IP_SOCK_STATS_ADD_RXBYTE( ts, pkt->pf.tcp_rx.pay_len );
   ++ts->stats.rx_pkts;
+  ci_tcp_info_rx(ts, pkt->pf.tcp_rx.pay_len > CI_TCP_HDR_LEN(tcp));
 
   LOG_TR(log(LNTS_FMT RCV_WND_FMT " snd=%08x-%08x-%08x",
              LNTS_PRI_ARGS(ni, ts), RCV_WND_ARGS(ts),
@@ -4776,6 +4796,7 @@ static int ci_tcp_rx_deliver_to_listen(ci_sock_cmn* s, void* opaque_arg)
 {
   ciip_tcp_rx_pkt* rxp = opaque_arg;
 
+  ci_sock_cycles_rx_mark(rxp->ni, s);
   if( s->b.state == CI_TCP_STATE_ACTIVE_WILD ) {
     /* do not inject into kernel, but handle inside Onload */
     handle_no_match(rxp->ni, rxp);
@@ -32,6 +32,7 @@
 #include <onload/sleep.h>
 #include <onload/tmpl.h>
 #include <ci/internal/pio_buddy.h>
+#include <ci/internal/tcp_info.h>
 
 
 #if OO_DO_STACK_POLL
@@ -1839,6 +1840,7 @@ unroll_msg_warm(ci_netif* ni, ci_tcp_state* ts, struct tcp_send_info* sinf,
     ci_tcp_clear_rtt_timing(ts);
 
   --ts->stats.tx_stop_app;
+  ci_tcp_info_tx_undo(ts, sinf->fill_list_bytes);
   CI_TCP_STATS_DEC_OUT_SEGS(ni);
   if( ! is_zc_send ) {
     pkt = PKT_CHK(ni, ts->send.tail);
@@ -2212,6 +2214,9 @@ int ci_tcp_sendmsg(ci_netif* ni, ci_tcp_state* ts,
   ** polled recently (or is contended, in which case it will be polled
   ** soon).  We either want to block or return.
   */
+  if( sinf.stack_locked )
+    ci_tcp_chrono_start(ts, CI_TCP_CHRONO_SNDBUF_LIMITED,
+                        ci_ip_time_now(ni));
   if( flags & MSG_DONTWAIT ) {
     /* We don't need to check tx_errno here.  We are here because the send
     ** queue is (was) full.  Therefore tx_errno was not set when we did
@@ -16,6 +16,8 @@
 #include "ip_internal.h"
 #include <ci/internal/ip_stats.h>
 #include <ci/net/sockopts.h>
+#include <ci/internal/tcp_info.h>
+#include <onload/sleep.h>
 
 #if !defined(__KERNEL__)
 #  include <onload/extensions_zc.h>
@@ -61,9 +63,11 @@ static const struct ci_offload_type tcp_offloads[] = {
 #endif
 
 
-static int
-ci_tcp_info_get(ci_netif* netif, ci_sock_cmn* s, struct ci_tcp_info* uinfo,
-                socklen_t* optlen)
+/* Fill in [info] for TCP_INFO.  This only reads the socket state, and so
+ * may be used without the stack lock by tools that can tolerate the fields
+ * being inconsistent with each other.
+ */
+void ci_tcp_info_fill(ci_netif* netif, ci_sock_cmn* s, struct ci_tcp_info* i)
 {
   ci_iptime_t now = ci_ip_time_now(netif);
   struct ci_tcp_info info;
@@ -151,12 +155,55 @@ ci_tcp_info_get(ci_netif* netif, ci_sock_cmn* s, struct ci_tcp_info* uinfo,
     }
     info.tcpi_total_retrans = ts->stats.total_retrans;
 
-    /* Starting from linux-3.15, there are tcpi_pacing_rate and
-     * tcpi_max_pacing_rate fields.  However, as Onload does not support
-     * pacing, we might as well pretend that we simulate older kernel
-     * with smaller tcp_info size. */
+    /* Onload does not pace, which Linux reports as an unlimited rate. */
+    info.tcpi_pacing_rate = info.tcpi_max_pacing_rate = ~0ull;
+    info.tcpi_segs_in = ts->stats.rx_pkts;
+    info.tcpi_rcv_ooopack = ts->stats.rx_ooo_pkts;
+    info.tcpi_notsent_bytes = SEQ_SUB(tcp_enq_nxt(ts), tcp_snd_nxt(ts));
+    if( s->b.state & CI_TCP_STATE_SYNCHRONISED )
+      info.tcpi_snd_wnd = CI_MAX(0, tcp_snd_wnd(ts));
+
+#if CI_CFG_TCP_INFO_METRICS
+    /* Every byte sent for the first time and no longer in flight has been
+     * acked.  SYN and FIN take sequence space but carry no data. */
+    info.tcpi_bytes_acked = ts->stats.tx_bytes - ts->stats.tx_bytes_retrans;
+    info.tcpi_bytes_acked -= CI_MIN(info.tcpi_bytes_acked,
+                               SEQ_SUB(tcp_snd_nxt(ts), tcp_snd_una(ts)));
+    info.tcpi_bytes_received = ts->stats.rx_bytes;
+    info.tcpi_segs_out = ts->stats.tx_pkts;
+    info.tcpi_data_segs_out = ts->stats.tx_data_pkts;
+    info.tcpi_data_segs_in = ts->stats.rx_data_pkts;
+    info.tcpi_bytes_sent = ts->stats.tx_bytes;
+    info.tcpi_bytes_retrans = ts->stats.tx_bytes_retrans;
+    info.tcpi_min_rtt = ts->min_rtt == 0 ? ~0u :
+                        ci_ip_time_ticks2us(netif, ts->min_rtt);
+    info.tcpi_delivery_rate = (ci_uint64) ts->stats.rate_bpms * 1000;
+
+    /* Linux counts the time limited by either window as busy too. */
+    info.tcpi_rwnd_limited = ci_ip_time_ticks2us(netif,
+                 ci_tcp_chrono_ticks(ts, CI_TCP_CHRONO_RWND_LIMITED, now));
+    info.tcpi_sndbuf_limited = ci_ip_time_ticks2us(netif,
+                 ci_tcp_chrono_ticks(ts, CI_TCP_CHRONO_SNDBUF_LIMITED, now));
+    info.tcpi_busy_time = ci_ip_time_ticks2us(netif,
+                 ci_tcp_chrono_ticks(ts, CI_TCP_CHRONO_BUSY, now)) +
+                 info.tcpi_rwnd_limited + info.tcpi_sndbuf_limited;
+#endif
+
+    /* We don't track delivered packets, CE marks, DSACKs or reordering,
+     * so those fields are left as zero. */
   }
 
+  *i = info;
+}
+
+
+static int
+ci_tcp_info_get(ci_netif* netif, ci_sock_cmn* s, struct ci_tcp_info* uinfo,
+                socklen_t* optlen)
+{
+  struct ci_tcp_info info;
+
+  ci_tcp_info_fill(netif, s, &info);
   if( *optlen > sizeof(info) )
     *optlen = sizeof(info);
   memcpy(uinfo, &info, *optlen);
@@ -238,6 +285,11 @@ int ci_get_sol_tcp(ci_netif* netif, ci_sock_cmn* s, int optname, void *optval,
         u = ci_tcp_is_in_faststart(SOCK_TO_TCP(s));
       goto u_out;
     }
+#ifdef TCP_NOTSENT_LOWAT
+  case TCP_NOTSENT_LOWAT:
+    u = c->notsent_lowat;
+    goto u_out;
+#endif
 #ifndef __KERNEL__
 #if CI_CFG_TCP_OFFLOAD_RECYCLER
   case ONLOAD_TCP_OFFLOAD:
@@ -509,6 +561,17 @@ static int ci_tcp_setsockopt_lk(citp_socket* ep, ci_fd_t fd, int level,
         }
       }
       break;
+#ifdef TCP_NOTSENT_LOWAT
+    case TCP_NOTSENT_LOWAT:
+      c->notsent_lowat = *(unsigned*) optval;
+      /* Raising the limit may make a connected socket writable. */
+      if( s->b.state & CI_TCP_STATE_TCP_CONN ) {
+        ci_tcp_state* ts = SOCK_TO_TCP(s);
+        if( ci_tcp_tx_advertise_space(netif, ts) )
+          ci_tcp_wake_possibly_not_in_poll(netif, ts, CI_SB_FLAG_WAKE_TX);
+      }
+      break;
+#endif
 #if CI_CFG_TCP_OFFLOAD_RECYCLER
     case ONLOAD_TCP_OFFLOAD:
       {
@@ -908,6 +971,16 @@ static int ci_tcp_sync_tcp_sockopts(ci_netif* ni, ci_tcp_state* ts,
     ci_tcp_sock_ops_setsockopt(sock, &err, SOL_TCP, TCP_DEFER_ACCEPT,
                                &optval, sizeof(optval));
   }
+#ifdef TCP_NOTSENT_LOWAT
+  if( ts->c.notsent_lowat != 0 ) {
+    optlen = sizeof(optval);
+    rc = ci_get_sol_tcp(ni, &ts->s, TCP_NOTSENT_LOWAT, &optval, &optlen);
+    ci_assert_equal(rc, 0);
+    (void)rc;
+    ci_tcp_sock_ops_setsockopt(sock, &err, SOL_TCP, TCP_NOTSENT_LOWAT,
+                               &optval, sizeof(optval));
+  }
+#endif
 
   optval = 1;
   if( ts->s.s_aflags & CI_SOCK_AFLAG_CORK_BIT )
@@ -648,6 +648,8 @@ static void ci_tcp_inherit_options(ci_netif* ni, ci_sock_cmn* s,
   ts->c.t_ka_intvl         = c->t_ka_intvl;
   ts->c.t_ka_intvl_in_secs = c->t_ka_intvl_in_secs;
   ts->c.ka_probe_th        = c->ka_probe_th;
+  /* TCP_NOTSENT_LOWAT */
+  ts->c.notsent_lowat      = c->notsent_lowat;
   {
     int af = ipcache_af(&ts->s.pkt);
     ci_ipx_hdr_init_fixed(&ts->s.pkt.ipx, af, IPPROTO_TCP,
@@ -17,6 +17,7 @@
 #include <onload/sleep.h>
 #include "ip_tx.h"
 #include <ci/internal/pio_buddy.h>
+#include <ci/internal/tcp_info.h>
 #include "tcp_tx.h"
 
 #ifndef __KERNEL__
@@ -42,6 +43,22 @@ ci_inline void check_tx_timestamping(ci_tcp_state* ts, int af,
 }
 
 
+/* Account [pkt] against the socket's EF_TCP_TXQ_LIMIT budget.  The mark
+ * is cleared and the bytes returned by ci_netif_rx_pkt_complete_tcp().
+ */
+ci_inline void ci_tcp_txq_account(ci_netif* ni, ci_tcp_state* ts,
+                                  ci_ip_pkt_fmt* pkt)
+{
+  if( NI_OPTS(ni).tcp_txq_limit == 0 ||
+      (ts->tcpflags & CI_TCPT_FLAG_MSG_WARM) ||
+      (pkt->rx_flags & CI_PKT_TX_FLAG_TXQ_ACCOUNTED) )
+    return;
+  pkt->rx_flags |= CI_PKT_TX_FLAG_TXQ_ACCOUNTED;
+  pkt->pf.tcp_tx.sock_id = ts->s.b.bufid;
+  ts->txq_bytes += TX_PKT_LEN(pkt);
+}
+
+
 ci_inline void ci_ip_tcp_list_to_dmaq(ci_netif* ni, ci_tcp_state* ts,
                                       oo_pkt_p head_id, 
                                       ci_ip_pkt_fmt* tail_pkt)
@@ -64,6 +81,7 @@ ci_inline void ci_ip_tcp_list_to_dmaq(ci_netif* ni, ci_tcp_state* ts,
     pkt = PKT_CHK(ni, pp);
     pp = pkt->next;
     check_tx_timestamping(ts, oo_pkt_af(pkt), pkt);
+    ci_tcp_txq_account(ni, ts, pkt);
     ci_ip_set_mac_and_port(ni, &ts->s.pkt, pkt);
     ci_netif_pkt_hold(ni, pkt);
     if(CI_UNLIKELY( ts->tcpflags & CI_TCPT_FLAG_MSG_WARM ))
@@ -129,6 +147,28 @@ ci_inline void ci_ip_tcp_list_to_dmaq(ci_netif* ni, ci_tcp_state* ts,
 }
 
 
+/* With EF_TX_SHAPE each packet goes through the shaper in
+ * __ci_netif_send() rather than straight onto the dmaq.
+ */
+static void ci_ip_tcp_list_to_shaper(ci_netif* ni, ci_tcp_state* ts,
+                                     oo_pkt_p head_id,
+                                     ci_ip_pkt_fmt* tail_pkt)
+{
+  ci_ip_pkt_fmt* pkt;
+  oo_pkt_p pp = head_id;
+
+  do {
+    pkt = PKT_CHK(ni, pp);
+    pp = pkt->next;
+    check_tx_timestamping(ts, oo_pkt_af(pkt), pkt);
+    ci_tcp_txq_account(ni, ts, pkt);
+    ci_ip_set_mac_and_port(ni, &ts->s.pkt, pkt);
+    ci_netif_pkt_hold(ni, pkt);
+    ci_netif_send(ni, pkt);
+  } while( pkt != tail_pkt );
+}
+
+
 #if CI_CFG_PORT_STRIPING
 static void ci_ip_tcp_list_to_dmaq_striping(ci_netif* ni, ci_tcp_state* ts,
                                             oo_pkt_p head_id, 
@@ -147,6 +187,7 @@ static void ci_ip_tcp_list_to_dmaq_striping(ci_netif* ni, ci_tcp_state* ts,
   do {
     pkt = PKT_CHK(ni, pp);
     check_tx_timestamping(ts, af, pkt);
+    ci_tcp_txq_account(ni, ts, pkt);
     ci_ip_set_mac_and_port(ni, &ts->s.pkt, pkt);
     pp = pkt->next;
     ci_netif_pkt_hold(ni, pkt);
@@ -248,6 +289,11 @@ static void ci_ip_send_tcp_list(ci_netif* ni, ci_tcp_state* ts,
   if(CI_LIKELY( ts->s.pkt.status == retrrc_success &&
                 oo_cp_ipcache_is_valid(ni, &ts->s.pkt) )) {
 fast:
+    if(CI_UNLIKELY( ni->state->txshape.shaped != 0 &&
+                    ~ts->tcpflags & CI_TCPT_FLAG_MSG_WARM )) {
+      ci_ip_tcp_list_to_shaper(ni, ts, head_id, tail_pkt);
+      return;
+    }
 #if CI_CFG_PORT_STRIPING
     if( ts->tcpflags & CI_TCPT_FLAG_STRIPE ) {
       ci_assert(! (ts->tcpflags & CI_TCPT_FLAG_MSG_WARM));
@@ -943,6 +989,7 @@ int ci_tcp_retrans_one(ci_tcp_state* ts, ci_netif* netif, ci_ip_pkt_fmt* pkt)
   ++ts->stats.total_retrans;
 
   tcp = TX_PKT_IPX_TCP(af, pkt);
+  ci_tcp_info_retrans(ts, pkt, tcp);
 
   /* To retransmit a packet it has to have already been sent.  And we
   ** should only retransmit segments that consume sequence space.
@@ -1298,6 +1345,7 @@ void ci_tcp_tx_advance(ci_tcp_state* ts, ci_netif* ni)
 {
   unsigned cwnd_right_edge, right_edge;
   ci_uint32* p_stop_cntr;
+  struct oo_sock_cycles_region cycles;
 
   ci_assert(ci_netif_is_locked(ni));
   ci_assert(ci_ip_queue_not_empty(&ts->send));
@@ -1309,6 +1357,7 @@ void ci_tcp_tx_advance(ci_tcp_state* ts, ci_netif* ni)
   if( CI_UNLIKELY(ts->tcpflags & CI_TCPT_FLAG_NO_TX_ADVANCE) )
     return;
 
+  ci_sock_cycles_enter(ni, &cycles);
   ci_tcp_tx_cwv_idle(ni, ts);
 
   if( OO_SP_NOT_NULL(ts->local_peer) ) {
@@ -1352,6 +1401,7 @@ void ci_tcp_tx_advance(ci_tcp_state* ts, ci_netif* ni)
 #endif
 
   ci_tcp_tx_advance_to(ni, ts, right_edge, p_stop_cntr);
+  ci_sock_cycles_leave(ni, &cycles, &ts->s.cycles.tx);
 }
 
 
@@ -1362,7 +1412,15 @@ void ci_tcp_tx_advance_to(ci_netif* ni, ci_tcp_state* ts,
   ci_ip_pkt_fmt* last_pkt = NULL;
   oo_pkt_p id = sendq->head;
   int sent_num = 0;
+  int rwnd_limited = 0;
   int af = ipcache_af(&ts->s.pkt);
+  unsigned txq_limit = NI_OPTS(ni).tcp_txq_limit;
+  unsigned txq_batch = 0;
+
+  /* Loopback sends never touch the TXQ, and warm sends are undone. */
+  if( (ts->s.pkt.flags & CI_IP_CACHE_IS_LOCALROUTE) ||
+      (ts->tcpflags & CI_TCPT_FLAG_MSG_WARM) )
+    txq_limit = 0;
 
   while( 1 ) {
     ci_ip_pkt_fmt* pkt = PKT_CHK(ni, id);
@@ -1385,6 +1443,7 @@ void ci_tcp_tx_advance_to(ci_netif* ni, ci_tcp_state* ts,
           ci_tcp_tx_split(ni, ts, sendq, pkt,
                           SEQ_SUB(ts->snd_max, pkt->pf.tcp_tx.start_seq), 1) ){
         ++ts->stats.tx_stop_rwnd;
+        rwnd_limited = 1;
         break;
       }
     }
@@ -1397,6 +1456,17 @@ void ci_tcp_tx_advance_to(ci_netif* ni, ci_tcp_state* ts,
         ++ts->stats.tx_stop_more;
         break;
       }
+    if( txq_limit != 0 ) {
+      /* Always allow one packet so that we cannot stall with nothing in
+       * the TXQ to generate the completion that restarts us. */
+      unsigned txq = ts->txq_bytes + txq_batch;
+      if( txq != 0 && txq + TX_PKT_LEN(pkt) > txq_limit ) {
+        ts->tcpflags |= CI_TCPT_FLAG_TXQ_LIMITED;
+        ++ts->stats.tx_stop_txq;
+        break;
+      }
+      txq_batch += TX_PKT_LEN(pkt);
+    }
 
 #if CI_CFG_CONG_AVOID_NOTIFIED
     /* Is there local congestion, suggesting we should back off a bit? */
@@ -1448,6 +1518,7 @@ void ci_tcp_tx_advance_to(ci_netif* ni, ci_tcp_state* ts,
     tcp_snd_nxt(ts) = pkt->pf.tcp_tx.end_seq;
     sent_num++;
     CI_TCP_STATS_INC_OUT_SEGS(ni);
+    ci_tcp_info_tx(ts, pkt, tcp);
     last_pkt = pkt;
 
     /* Prep the packet for the retransmit queue. */
@@ -1465,6 +1536,8 @@ void ci_tcp_tx_advance_to(ci_netif* ni, ci_tcp_state* ts,
 
   if( ts->tcpflags & CI_TCPT_FLAG_MSG_WARM )
     ci_assert(sent_num == 1);
+  else
+    ci_tcp_chrono_tx(ni, ts, sent_num, rwnd_limited);
 
   if( sent_num != 0 ) {
     LOG_TT(log(LNT_FMT "%d packets sent in tx_advance: from %d to %d",
@@ -1524,8 +1597,10 @@ void ci_tcp_tx_advance_to(ci_netif* ni, ci_tcp_state* ts,
     ci_ip_queue_move(ni, sendq, &ts->retrans, last_pkt, sent_num);
     ts->send_out += sent_num;
 
-    /* Wake up TX if necessary */
-    if( NI_OPTS(ni).tcp_sndbuf_mode == 0 &&
+    /* Wake up TX if necessary.  With TCP_NOTSENT_LOWAT the space may
+     * have opened by sending rather than by an ACK. */
+    if( (NI_OPTS(ni).tcp_sndbuf_mode == 0 ||
+         ci_tcp_notsent_lowat(ni, ts) != 0) &&
         ci_tcp_tx_advertise_space(ni, ts) )
       ci_tcp_wake_possibly_not_in_poll(ni, ts, CI_SB_FLAG_WAKE_TX);
 
@@ -2037,6 +2112,7 @@ void ci_tcp_send_ack_rx(ci_netif* netif, ci_tcp_state* ts, ci_ip_pkt_fmt* pkt,
   ci_tcp_tx_maybe_do_striping(pkt, ts);
   __ci_ip_send_tcp(netif, pkt, ts);
   CI_TCP_STATS_INC_OUT_SEGS(netif);
+  ci_tcp_info_tx_ack(ts);
   CI_IP_SOCK_STATS_ADD_TXBYTE(ts,  pkt->buf_len);
   ci_netif_pkt_release(netif, pkt);
 }
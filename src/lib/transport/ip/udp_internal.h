@@ -122,6 +122,7 @@ ci_inline void ci_udp_handle_rx_post_future(ci_netif* ni, ci_ip_pkt_fmt* pkt,
     ci_assert_nflags(pkt->rx_flags, CI_PKT_RX_FLAG_KEEP);
     ci_assert_gt(pkt->pay_len, ip_paylen);
 
+    ci_sock_cycles_rx_mark(ni, &us->s);
     oo_offbuf_set_start(&pkt->buf, udp + 1);
     ci_udp_recv_q_put(ni, &us->recv_q, pkt);
     us->s.b.sb_flags |= CI_SB_FLAG_RX_DELIVERED;
@@ -628,6 +628,11 @@ ci_udp_recvmsg_socklocked_spin(ci_netif* ni, ci_udp_state* us,
       if( ! ni->state->is_spinner )
         ni->state->is_spinner = 1;
     }
+#ifndef __KERNEL__
+    if( ni->spin_wait_ticks )
+      ci_netif_spin_wait(ni, us->future_intf_i, spin_state->future,
+                         &spin_state->poison, now_frc);
+#endif
     return OO_SPINLOOP_PAUSE_CHECK_SIGNALS(ni, now_frc, 
                                            &spin_state->schedule_frc,
                                            us->s.so.rcvtimeo_msec,
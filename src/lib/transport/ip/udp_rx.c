@@ -136,6 +136,7 @@ int ci_udp_rx_deliver(ci_sock_cmn* s, void* opaque_arg)
              CI_IP_PRINTF_ARGS(&oo_ip_hdr(pkt)->ip_saddr_be32),
              CI_IP_PRINTF_ARGS(&oo_ip_hdr(pkt)->ip_daddr_be32)));
 
+  ci_sock_cycles_rx_mark(ni, s);
   state->delivered = 1;
 
   if( (recvq_depth <= us->stats.max_recvq_pkts) &&
@@ -84,33 +84,28 @@ llap_param_from_ip(struct oo_cplane_handle* cp,
   return 1;
 }
 
-static int ci_mcast_join_leave(ci_netif* ni, ci_udp_state* us,
-                               ci_ifid_t ifindex, ci_uint32 laddr,
-                               ci_uint32 maddr, int /*bool*/ add)
+/* Find the RX hwports on which to join [maddr], and the interface if the
+ * caller did not specify one.  Returns non-zero if the group cannot be
+ * joined via the control plane.
+ */
+static int ci_mcast_resolve(ci_netif* ni, ci_udp_state* us,
+                            ci_ifid_t* ifindex, ci_uint32 laddr,
+                            ci_uint32 maddr, cicp_hwport_mask_t* hwports)
 {
-  cicp_hwport_mask_t hwports = 0;
   int rc;
 
-  if( add )
-    us->udpflags |= CI_UDPF_MCAST_JOIN;
-
-  if( NI_OPTS(ni).mcast_join_handover == 2 )
-    return CI_SOCKET_HANDOVER;
-  if( ! NI_OPTS(ni).mcast_recv )
-    return 0;
-
   /* Find the RX hwports on which to join the group. */
-  if( ifindex != 0 ) {
+  if( *ifindex != 0 ) {
     /* The application specified the ifindex on which to join the group. */
-    rc = oo_cp_find_llap(ni->cplane, ifindex, NULL, NULL, &hwports, NULL,
+    rc = oo_cp_find_llap(ni->cplane, *ifindex, NULL, NULL, hwports, NULL,
                          NULL);
   }
   else if( laddr != 0 ) {
     /* The application specified an IP address of the interface on which to
      * join the group. */
     struct llap_param_data data;
-    data.hwports = &hwports;
-    data.ifindex = &ifindex;
+    data.hwports = hwports;
+    data.ifindex = ifindex;
     rc = ! oo_cp_find_llap_by_ip(ni->cplane, laddr, llap_param_from_ip, &data);
   }
   else {
@@ -141,42 +136,24 @@ static int ci_mcast_join_leave(ci_netif* ni, ci_udp_state* us,
       rc = cicp_user_resolve(ni, ni->cplane, &ipcache.fwd_ver,
                              sock_cp.sock_cp_flags, &key, &data);
     if( rc == 0 && data.base.ifindex != CI_IFID_BAD ) {
-      ifindex = data.base.ifindex;
-      rc = cicp_user_get_fwd_rx_hwports(ni, &data, &hwports);
+      *ifindex = data.base.ifindex;
+      rc = cicp_user_get_fwd_rx_hwports(ni, &data, hwports);
     }
     else {
       rc = 1;
     }
   }
 
-  if( rc != 0 || hwports == 0 )
-    /* Not acceleratable.  NB. The mcast_join_handover takes effect even if
-     * this socket has joined a group that is accelerated.  This is
-     * deliberate.
-     */
-    return NI_OPTS(ni).mcast_join_handover ? CI_SOCKET_HANDOVER : 0;
-
-  rc = ci_tcp_ep_mcast_add_del(ni, S_SP(us), ifindex, maddr, add);
-  if( rc != 0 ) {
-    LOG_E(log(FNS_FMT "%s ifindex=%d maddr="CI_IP_PRINTF_FORMAT" failed "
-              "%d", FNS_PRI_ARGS(ni, &us->s), add ? "ADD" : "DROP",
-              (int) ifindex, CI_IP_PRINTF_ARGS(&maddr), rc));
-    if( CITP_OPTS.no_fail )
-      return 0;
-    else {
-      /* The caller is responsible for rolling back the OS socket state */
-      RET_WITH_ERRNO(-rc);
-    }
-  }
+  return rc;
+}
 
-  LOG_UC(log(FNS_FMT "ci_tcp_ep_mcast_add_del(%s, %d, "CI_IP_PRINTF_FORMAT")",
-             FNS_PRI_ARGS(ni, &us->s), add ? "ADD" : "DROP", 
-             (int) ifindex, CI_IP_PRINTF_ARGS(&maddr)));
 
-  if( add )
-    us->udpflags |= CI_UDPF_MCAST_FILTER;
+static void ci_mcast_join_bind2dev(ci_netif* ni, ci_udp_state* us,
+                                   ci_ifid_t ifindex)
+{
+  int rc;
 
-  if( add && NI_OPTS(ni).mcast_join_bindtodevice &&
+  if( NI_OPTS(ni).mcast_join_bindtodevice &&
       ! (us->udpflags & CI_UDPF_NO_MCAST_B2D) &&
       us->s.cp.so_bindtodevice == CI_IFID_BAD ) {
     /* When app does IP_ADD_MEMBERSHIP, automatically bind the socket to
@@ -202,6 +179,53 @@ static int ci_mcast_join_leave(ci_netif* ni, ci_udp_state* us,
       us->s.rx_bind2dev_vlan = 0;
     }
   }
+}
+
+
+static int ci_mcast_join_leave(ci_netif* ni, ci_udp_state* us,
+                               ci_ifid_t ifindex, ci_uint32 laddr,
+                               ci_uint32 maddr, int /*bool*/ add)
+{
+  cicp_hwport_mask_t hwports = 0;
+  int rc;
+
+  if( add )
+    us->udpflags |= CI_UDPF_MCAST_JOIN;
+
+  if( NI_OPTS(ni).mcast_join_handover == 2 )
+    return CI_SOCKET_HANDOVER;
+  if( ! NI_OPTS(ni).mcast_recv )
+    return 0;
+
+  rc = ci_mcast_resolve(ni, us, &ifindex, laddr, maddr, &hwports);
+  if( rc != 0 || hwports == 0 )
+    /* Not acceleratable.  NB. The mcast_join_handover takes effect even if
+     * this socket has joined a group that is accelerated.  This is
+     * deliberate.
+     */
+    return NI_OPTS(ni).mcast_join_handover ? CI_SOCKET_HANDOVER : 0;
+
+  rc = ci_tcp_ep_mcast_add_del(ni, S_SP(us), ifindex, maddr, add);
+  if( rc != 0 ) {
+    LOG_E(log(FNS_FMT "%s ifindex=%d maddr="CI_IP_PRINTF_FORMAT" failed "
+              "%d", FNS_PRI_ARGS(ni, &us->s), add ? "ADD" : "DROP",
+              (int) ifindex, CI_IP_PRINTF_ARGS(&maddr), rc));
+    if( CITP_OPTS.no_fail )
+      return 0;
+    else {
+      /* The caller is responsible for rolling back the OS socket state */
+      RET_WITH_ERRNO(-rc);
+    }
+  }
+
+  LOG_UC(log(FNS_FMT "ci_tcp_ep_mcast_add_del(%s, %d, "CI_IP_PRINTF_FORMAT")",
+             FNS_PRI_ARGS(ni, &us->s), add ? "ADD" : "DROP", 
+             (int) ifindex, CI_IP_PRINTF_ARGS(&maddr)));
+
+  if( add ) {
+    us->udpflags |= CI_UDPF_MCAST_FILTER;
+    ci_mcast_join_bind2dev(ni, us, ifindex);
+  }
 
   return 0;
 }
@@ -691,4 +715,149 @@ int ci_udp_setsockopt(citp_socket* ep, ci_fd_t fd, int level,
   return rc;
 }
 
+
+#define CI_MCAST_JOIN_BATCH  256
+
+/* Installs the filters for a batch of groups that the OS socket has
+ * already joined on [ifindex].  On failure, drops the OS membership of
+ * every group from the first one that failed up to [groups[last]], and
+ * returns the number of groups that remain joined in [*n_joined].
+ */
+static int ci_mcast_join_batch(ci_netif* ni, ci_udp_state* us,
+                               ci_fd_t os_sock,
+                               const struct ip_mreqn* groups,
+                               const int* batch, const ci_uint32* maddrs,
+                               int n_batch, ci_ifid_t ifindex, int last,
+                               int* n_joined)
+{
+  int n_added, i, rc;
+
+  rc = ci_tcp_helper_ep_mcast_add_bulk(ci_netif_get_driver_handle(ni),
+                                       S_SP(us), maddrs, n_batch, ifindex,
+                                       &n_added);
+  if( n_added > 0 ) {
+    us->udpflags |= CI_UDPF_MCAST_FILTER;
+    ci_mcast_join_bind2dev(ni, us, ifindex);
+  }
+  if( rc == 0 )
+    return 0;
+
+  LOG_E(log(FNS_FMT "ADD ifindex=%d maddr="CI_IP_PRINTF_FORMAT" failed %d",
+            FNS_PRI_ARGS(ni, &us->s), (int) ifindex,
+            CI_IP_PRINTF_ARGS(&maddrs[n_added]), rc));
+  if( CITP_OPTS.no_fail )
+    return 0;
+
+  for( i = batch[n_added]; i <= last; ++i )
+    ci_sys_setsockopt(os_sock, SOL_IP, IP_DROP_MEMBERSHIP,
+                      &groups[i], sizeof(groups[i]));
+  *n_joined = batch[n_added];
+  RET_WITH_ERRNO(-rc);
+}
+
+
+/* Joins [n_groups] groups.  Each group is joined on the OS socket as for
+ * IP_ADD_MEMBERSHIP, but the filters for runs of groups on the same
+ * interface are installed with a single call into the driver.  The stack
+ * lock is dropped and retaken after every CI_MCAST_JOIN_BATCH groups, so
+ * that a large request doesn't hold off the rest of the stack.
+ *
+ * Returns 0 or -1 (with errno set), and the number of groups joined in
+ * [*n_joined]; on failure, the groups after those are not joined.  Returns
+ * CI_SOCKET_HANDOVER if the socket must be handed over, in which case
+ * the OS socket has joined the first [*n_joined] groups.
+ */
+int ci_udp_mcast_join_bulk(citp_socket* ep, ci_fd_t fd,
+                           const struct ip_mreqn* groups, int n_groups,
+                           int* n_joined)
+{
+  ci_netif* ni = ep->netif;
+  ci_udp_state* us = SOCK_TO_UDP(ep->s);
+  ci_uint32 maddrs[CI_MCAST_JOIN_BATCH];
+  int batch[CI_MCAST_JOIN_BATCH];
+  ci_ifid_t batch_ifindex = CI_IFID_BAD;
+  int i, n_batch = 0, n_locked = 0, rc = 0;
+  ci_fd_t os_sock;
+
+  ci_netif_lock_id(ni, SC_SP(ep->s));
+  os_sock = ci_get_os_sock_fd(fd);
+  ci_assert(CI_IS_VALID_SOCKET(os_sock));
+
+  for( i = 0; i < n_groups; ++i ) {
+    ci_ifid_t ifindex = groups[i].imr_ifindex;
+    cicp_hwport_mask_t hwports = 0;
+
+    if( n_locked == CI_MCAST_JOIN_BATCH ) {
+      if( n_batch > 0 ) {
+        rc = ci_mcast_join_batch(ni, us, os_sock, groups, batch, maddrs,
+                                 n_batch, batch_ifindex, i - 1, &i);
+        n_batch = 0;
+        if( rc != 0 )
+          break;
+      }
+      ci_rel_os_sock_fd(os_sock);
+      ci_netif_unlock(ni);
+      ci_netif_lock_id(ni, SC_SP(ep->s));
+      os_sock = ci_get_os_sock_fd(fd);
+      ci_assert(CI_IS_VALID_SOCKET(os_sock));
+      n_locked = 0;
+    }
+    ++n_locked;
+
+    if( ci_sys_setsockopt(os_sock, SOL_IP, IP_ADD_MEMBERSHIP,
+                          &groups[i], sizeof(groups[i])) < 0 ) {
+      rc = -1;
+      break;
+    }
+    us->udpflags |= CI_UDPF_MCAST_JOIN;
+
+    if( NI_OPTS(ni).mcast_join_handover == 2 ) {
+      rc = CI_SOCKET_HANDOVER;
+      ++i;
+      break;
+    }
+    if( ! NI_OPTS(ni).mcast_recv )
+      continue;
+
+    if( ci_mcast_resolve(ni, us, &ifindex, groups[i].imr_address.s_addr,
+                         groups[i].imr_multiaddr.s_addr, &hwports) != 0 ||
+        hwports == 0 ) {
+      if( NI_OPTS(ni).mcast_join_handover ) {
+        rc = CI_SOCKET_HANDOVER;
+        ++i;
+        break;
+      }
+      continue;
+    }
+
+    if( n_batch > 0 && ifindex != batch_ifindex ) {
+      rc = ci_mcast_join_batch(ni, us, os_sock, groups, batch, maddrs,
+                               n_batch, batch_ifindex, i, &i);
+      n_batch = 0;
+      if( rc != 0 )
+        break;
+    }
+    batch_ifindex = ifindex;
+    batch[n_batch] = i;
+    maddrs[n_batch++] = groups[i].imr_multiaddr.s_addr;
+  }
+
+  /* On handover the OS socket takes over, so there is no need to install
+   * the remaining filters.
+   */
+  if( n_batch > 0 && rc != CI_SOCKET_HANDOVER ) {
+    int saved_errno = errno;
+    if( ci_mcast_join_batch(ni, us, os_sock, groups, batch, maddrs,
+                            n_batch, batch_ifindex, i - 1, &i) != 0 )
+      rc = -1;
+    else
+      errno = saved_errno;
+  }
+
+  *n_joined = i;
+  ci_rel_os_sock_fd(os_sock);
+  ci_netif_unlock(ni);
+  return rc;
+}
+
 /*! \cidoxg_end */
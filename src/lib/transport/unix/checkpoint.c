@@ -0,0 +1,531 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+/**************************************************************************\
+*//*! \file
+** <L5_PRIVATE L5_SOURCE>
+**  \brief  onload_checkpoint() and onload_restore()
+** </L5_PRIVATE>
+*//*
+\**************************************************************************/
+
+#include "internal.h"
+#include <onload/extensions.h>
+#include <onload/ul/checkpoint.h>
+#include <netinet/tcp.h>
+
+
+extern int onload_socket(int domain, int type, int protocol);
+extern int onload_bind(int fd, const struct sockaddr* sa, socklen_t len);
+extern int onload_connect(int fd, const struct sockaddr* sa, socklen_t len);
+extern int onload_getsockopt(int fd, int level, int optname,
+                             void* optval, socklen_t* optlen);
+extern int onload_setsockopt(int fd, int level, int optname,
+                             const void* optval, socklen_t optlen);
+extern ssize_t onload_send(int fd, const void* buf, size_t len, int flags);
+extern int onload_close(int fd);
+extern int onload_dup2(int oldfd, int newfd);
+
+
+/* Options carried over to the restored socket.  Buffer sizes are only
+ * carried if the application set them, so that the new socket otherwise
+ * gets the defaults of the new stack.
+ */
+static const struct {
+  int level;
+  int name;
+  ci_uint32 only_if_flag;
+} checkpoint_opts[] = {
+  { SOL_SOCKET,  SO_KEEPALIVE,  0 },
+  { SOL_SOCKET,  SO_LINGER,     0 },
+  { SOL_SOCKET,  SO_RCVTIMEO,   0 },
+  { SOL_SOCKET,  SO_SNDTIMEO,   0 },
+  { SOL_SOCKET,  SO_PRIORITY,   0 },
+  { SOL_SOCKET,  SO_SNDBUF,     CI_SOCK_FLAG_SET_SNDBUF },
+  { SOL_SOCKET,  SO_RCVBUF,     CI_SOCK_FLAG_SET_RCVBUF },
+  { IPPROTO_IP,  IP_TOS,        0 },
+  { IPPROTO_IP,  IP_TTL,        0 },
+  { IPPROTO_TCP, TCP_NODELAY,   0 },
+  { IPPROTO_TCP, TCP_KEEPIDLE,  0 },
+  { IPPROTO_TCP, TCP_KEEPINTVL, 0 },
+  { IPPROTO_TCP, TCP_KEEPCNT,   0 },
+};
+#define N_CHECKPOINT_OPTS \
+  (sizeof(checkpoint_opts) / sizeof(checkpoint_opts[0]))
+
+
+struct checkpoint_rec {
+  struct oo_checkpoint_sock cp;
+  struct oo_checkpoint_opt  opts[N_CHECKPOINT_OPTS];
+  char*                     data;
+  citp_fdinfo*              fdi;
+  int                       frozen;
+};
+
+
+static void checkpoint_get_opts(struct checkpoint_rec* r)
+{
+  struct oo_checkpoint_opt* o;
+  socklen_t len;
+  unsigned i;
+
+  r->cp.n_opts = 0;
+  for( i = 0; i < N_CHECKPOINT_OPTS; ++i ) {
+    if( checkpoint_opts[i].level == IPPROTO_TCP &&
+        r->cp.type != SOCK_STREAM )
+      continue;
+    if( checkpoint_opts[i].only_if_flag &&
+        ! (r->cp.s_flags & checkpoint_opts[i].only_if_flag) )
+      continue;
+    o = &r->opts[r->cp.n_opts];
+    len = sizeof(o->val);
+    if( onload_getsockopt(r->cp.fd, checkpoint_opts[i].level,
+                          checkpoint_opts[i].name, o->val, &len) < 0 )
+      continue;
+    o->level = checkpoint_opts[i].level;
+    o->name = checkpoint_opts[i].name;
+    o->len = len;
+    /* getsockopt() reports twice what was passed to setsockopt(). */
+    if( o->level == SOL_SOCKET &&
+        (o->name == SO_SNDBUF || o->name == SO_RCVBUF) )
+      *(int*) o->val /= 2;
+    ++r->cp.n_opts;
+  }
+}
+
+
+/* Freeze the socket behind [r->fdi] and fill in the rest of [r->cp]. */
+static int checkpoint_sock(struct checkpoint_rec* r, ci_netif** ni_out)
+{
+  citp_sock_fdi* epi = fdi_to_sock_fdi(r->fdi);
+  ci_netif* ni = epi->sock.netif;
+  ci_sock_cmn* s = epi->sock.s;
+  int rc = 0;
+
+  if( *ni_out != NULL && *ni_out != ni )
+    return -EXDEV;
+  *ni_out = ni;
+
+  r->cp.sock_id = SC_ID(s);
+  r->cp.domain = s->domain;
+  r->cp.s_flags = s->s_flags;
+
+  if( citp_fdinfo_get_type(r->fdi) == CITP_UDP_SOCKET ) {
+    ci_udp_state* us = SOCK_TO_UDP(s);
+    r->cp.state = CI_TCP_STATE_UDP;
+    r->cp.laddr = udp_ipx_laddr(us);
+    r->cp.raddr = udp_ipx_raddr(us);
+    r->cp.lport_be16 = udp_lport_be16(us);
+    r->cp.rport_be16 = udp_rport_be16(us);
+    return 0;
+  }
+
+  ci_netif_lock(ni);
+  rc = ci_tcp_checkpoint(ni, SOCK_TO_TCP(s), &r->cp);
+  if( rc == 0 ) {
+    r->frozen = 1;
+    r->data = malloc(r->cp.snd_len + r->cp.rcv_len);
+    if( r->data != NULL )
+      ci_tcp_checkpoint_copy(ni, SOCK_TO_TCP(s), &r->cp, r->data);
+    else
+      rc = -ENOMEM;
+  }
+  ci_netif_unlock(ni);
+  return rc;
+}
+
+
+static int checkpoint_write(int fd, const void* buf, size_t len)
+{
+  const char* p = buf;
+  ssize_t n;
+
+  while( len > 0 ) {
+    n = ci_sys_write(fd, p, len);
+    if( n < 0 ) {
+      if( errno == EINTR )
+        continue;
+      return -errno;
+    }
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+
+int onload_checkpoint(int out_fd, const int* fds, int n_fds)
+{
+  citp_lib_context_t lib_context;
+  struct oo_checkpoint_hdr hdr;
+  struct checkpoint_rec* recs;
+  ci_netif* ni = NULL;
+  int i, rc = 0;
+
+  Log_CALL(ci_log("%s(%d, %p, %d)", __FUNCTION__, out_fd, fds, n_fds));
+
+  if( n_fds <= 0 ) {
+    errno = EINVAL;
+    return -1;
+  }
+  recs = calloc(n_fds, sizeof(*recs));
+  if( recs == NULL ) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  citp_enter_lib(&lib_context);
+  for( i = 0; i < n_fds && rc == 0; ++i ) {
+    struct checkpoint_rec* r = &recs[i];
+    r->cp.fd = fds[i];
+    r->fdi = citp_fdtable_lookup(fds[i]);
+    if( r->fdi == NULL )
+      rc = -EOPNOTSUPP;
+    else if( citp_fdinfo_get_type(r->fdi) == CITP_TCP_SOCKET )
+      r->cp.type = SOCK_STREAM;
+    else if( citp_fdinfo_get_type(r->fdi) == CITP_UDP_SOCKET )
+      r->cp.type = SOCK_DGRAM;
+    else
+      rc = -EOPNOTSUPP;
+    if( rc == 0 )
+      r->cp.s_flags = fdi_to_sock_fdi(r->fdi)->sock.s->s_flags;
+  }
+  citp_exit_lib(&lib_context, rc == 0);
+
+  /* Socket options are read through the normal getsockopt() path, before
+   * anything is frozen.
+   */
+  if( rc == 0 )
+    for( i = 0; i < n_fds; ++i )
+      checkpoint_get_opts(&recs[i]);
+
+  citp_enter_lib(&lib_context);
+  for( i = 0; i < n_fds && rc == 0; ++i )
+    rc = checkpoint_sock(&recs[i], &ni);
+
+  if( rc == 0 ) {
+    hdr.magic = OO_CHECKPOINT_MAGIC;
+    hdr.version = OO_CHECKPOINT_VERSION;
+    hdr.stack_id = NI_ID(ni);
+    hdr.n_socks = n_fds;
+    rc = checkpoint_write(out_fd, &hdr, sizeof(hdr));
+    for( i = 0; i < n_fds && rc == 0; ++i ) {
+      struct checkpoint_rec* r = &recs[i];
+      rc = checkpoint_write(out_fd, &r->cp, sizeof(r->cp));
+      if( rc == 0 )
+        rc = checkpoint_write(out_fd, r->opts,
+                              r->cp.n_opts * sizeof(r->opts[0]));
+      if( rc == 0 && r->data != NULL )
+        rc = checkpoint_write(out_fd, r->data,
+                              r->cp.snd_len + r->cp.rcv_len);
+    }
+  }
+
+  for( i = 0; i < n_fds; ++i ) {
+    struct checkpoint_rec* r = &recs[i];
+    if( r->frozen && rc != 0 ) {
+      citp_sock_fdi* epi = fdi_to_sock_fdi(r->fdi);
+      ci_netif_lock(epi->sock.netif);
+      ci_tcp_checkpoint_thaw(epi->sock.netif, SOCK_TO_TCP(epi->sock.s));
+      ci_netif_unlock(epi->sock.netif);
+    }
+    if( r->fdi != NULL )
+      citp_fdinfo_release_ref(r->fdi, 0);
+    free(r->data);
+  }
+  citp_exit_lib(&lib_context, rc == 0);
+  free(recs);
+
+  if( rc != 0 ) {
+    errno = -rc;
+    rc = -1;
+  }
+  Log_CALL_RESULT(rc);
+  return rc;
+}
+
+
+static int restore_read(int fd, void* buf, size_t len)
+{
+  char* p = buf;
+  ssize_t n;
+
+  while( len > 0 ) {
+    n = ci_sys_read(fd, p, len);
+    if( n < 0 ) {
+      if( errno == EINTR )
+        continue;
+      return -errno;
+    }
+    if( n == 0 )
+      return -EINVAL;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+
+static socklen_t restore_sockaddr(struct sockaddr_storage* ss, int domain,
+                                  ci_addr_t addr, ci_uint16 port_be16)
+{
+  socklen_t len = sizeof(*ss);
+  const ci_uint32* addr_p = &addr.ip4;
+#if CI_CFG_IPV6
+  if( CI_IS_ADDR_IP6(addr) )
+    addr_p = addr.u32;
+#endif
+  ci_addr_to_user(CI_SA(ss), &len, CI_ADDR_AF(addr), domain, port_be16,
+                  addr_p, 0);
+  return len;
+}
+
+
+/* Hand the connection described by [r] back to the checkpointing process
+ * when it could not be restored.
+ */
+static void restore_reclaim(struct checkpoint_rec* r, ci_netif* old_ni,
+                            int released)
+{
+  citp_lib_context_t lib_context;
+
+  citp_enter_lib(&lib_context);
+  ci_netif_lock(old_ni);
+  ci_tcp_checkpoint_reclaim(old_ni, &r->cp, released);
+  ci_netif_unlock(old_ni);
+  citp_exit_lib(&lib_context, 1);
+}
+
+
+/* Take over the connection described by [r] into [fd], a new socket in
+ * our own stack.  [old_ni] is the checkpointed stack.  If this fails, the
+ * checkpointed connection is thawed.
+ */
+static int restore_tcp(struct checkpoint_rec* r, int fd, ci_netif* old_ni)
+{
+  citp_lib_context_t lib_context;
+  ci_ip_pkt_queue rxq;
+  citp_fdinfo* fdi;
+  ci_netif* ni = NULL;
+  ci_tcp_state* ts = NULL;
+  int released = 0;
+  const char* p;
+  size_t left;
+  ssize_t n;
+  int rc;
+
+  ci_ip_queue_init(&rxq);
+  citp_enter_lib(&lib_context);
+  fdi = citp_fdtable_lookup(fd);
+  if( fdi == NULL || citp_fdinfo_get_type(fdi) != CITP_TCP_SOCKET ) {
+    rc = -EOPNOTSUPP;
+  }
+  else {
+    ni = fdi_to_sock_fdi(fdi)->sock.netif;
+    ts = SOCK_TO_TCP(fdi_to_sock_fdi(fdi)->sock.s);
+    ci_netif_lock(ni);
+    rc = ci_tcp_restore_prepare(ni, ts, &r->cp, r->data + r->cp.snd_len,
+                                &rxq);
+    ci_netif_unlock(ni);
+  }
+  /* Only once everything short of inserting the new filters has been done
+   * do we take the connection away from the old stack.
+   */
+  if( rc == 0 ) {
+    ci_netif_lock(old_ni);
+    rc = ci_tcp_checkpoint_release(old_ni, &r->cp);
+    ci_netif_unlock(old_ni);
+    released = rc == 0;
+    ci_netif_lock(ni);
+    if( rc == 0 )
+      rc = ci_tcp_restore(ni, ts, &r->cp, &rxq);
+    else
+      ci_ip_queue_drop(ni, &rxq);
+    ci_netif_unlock(ni);
+  }
+  if( fdi != NULL )
+    citp_fdinfo_release_ref(fdi, 0);
+  citp_exit_lib(&lib_context, rc == 0);
+  if( rc != 0 ) {
+    restore_reclaim(r, old_ni, released);
+    return rc;
+  }
+
+  /* The send sequence starts at the old snd_una, so the unacknowledged
+   * data goes out again with its original sequence numbers.
+   */
+  for( p = r->data, left = r->cp.snd_len; left > 0; p += n, left -= n ) {
+    n = onload_send(fd, p, left, MSG_NOSIGNAL);
+    if( n < 0 ) {
+      if( errno == EINTR ) {
+        n = 0;
+        continue;
+      }
+      return -errno;
+    }
+  }
+  return 0;
+}
+
+
+static int restore_udp(struct checkpoint_rec* r, int fd)
+{
+  struct sockaddr_storage ss;
+  socklen_t len;
+  int one = 1;
+
+  if( (r->cp.s_flags & CI_SOCK_FLAG_REUSEADDR) &&
+      onload_setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 )
+    return -errno;
+  if( r->cp.lport_be16 != 0 ) {
+    len = restore_sockaddr(&ss, r->cp.domain, r->cp.laddr, r->cp.lport_be16);
+    if( onload_bind(fd, CI_SA(&ss), len) < 0 )
+      return -errno;
+  }
+  if( r->cp.s_flags & CI_SOCK_FLAG_CONNECTED ) {
+    len = restore_sockaddr(&ss, r->cp.domain, r->cp.raddr, r->cp.rport_be16);
+    if( onload_connect(fd, CI_SA(&ss), len) < 0 )
+      return -errno;
+  }
+  return 0;
+}
+
+
+static int restore_old_stack(ci_netif** old_ni, ci_uint32 stack_id)
+{
+  citp_lib_context_t lib_context;
+  int rc;
+
+  if( *old_ni != NULL )
+    return 0;
+  citp_enter_lib(&lib_context);
+  rc = citp_netif_by_id(stack_id, old_ni, 0);
+  citp_exit_lib(&lib_context, rc == 0);
+  return rc;
+}
+
+
+static int restore_sock(struct checkpoint_rec* r, ci_netif** old_ni,
+                        ci_uint32 stack_id, int* fd_out)
+{
+  unsigned i;
+  int fd, rc = 0;
+
+  if( r->cp.state == CI_TCP_ESTABLISHED ) {
+    rc = restore_old_stack(old_ni, stack_id);
+    if( rc != 0 )
+      return rc;
+  }
+
+  fd = onload_socket(r->cp.domain, r->cp.type, 0);
+  if( fd < 0 )
+    rc = -errno;
+  for( i = 0; i < r->cp.n_opts && rc == 0; ++i )
+    if( onload_setsockopt(fd, r->opts[i].level, r->opts[i].name,
+                          r->opts[i].val, r->opts[i].len) < 0 )
+      rc = -errno;
+  if( rc == 0 ) {
+    if( r->cp.state == CI_TCP_ESTABLISHED )
+      rc = restore_tcp(r, fd, *old_ni);
+    else
+      rc = restore_udp(r, fd);
+  }
+  else if( r->cp.state == CI_TCP_ESTABLISHED ) {
+    restore_reclaim(r, *old_ni, 0);
+  }
+  if( rc != 0 ) {
+    if( fd >= 0 )
+      onload_close(fd);
+    return rc;
+  }
+  *fd_out = fd;
+  return 0;
+}
+
+
+/* Read the next record of the checkpoint into [r]. */
+static int restore_read_rec(int in_fd, struct checkpoint_rec* r)
+{
+  int rc;
+
+  memset(r, 0, sizeof(*r));
+  rc = restore_read(in_fd, &r->cp, sizeof(r->cp));
+  if( rc == 0 && (r->cp.n_opts > N_CHECKPOINT_OPTS ||
+                  (r->cp.state != CI_TCP_ESTABLISHED &&
+                   r->cp.state != CI_TCP_STATE_UDP)) )
+    rc = -EINVAL;
+  if( rc == 0 )
+    rc = restore_read(in_fd, r->opts, r->cp.n_opts * sizeof(r->opts[0]));
+  if( rc == 0 && r->cp.state == CI_TCP_ESTABLISHED ) {
+    r->data = malloc(r->cp.snd_len + r->cp.rcv_len);
+    if( r->data == NULL )
+      rc = -ENOMEM;
+    else
+      rc = restore_read(in_fd, r->data, r->cp.snd_len + r->cp.rcv_len);
+  }
+  if( rc != 0 ) {
+    free(r->data);
+    r->data = NULL;
+  }
+  return rc;
+}
+
+
+int onload_restore(int in_fd, int* fds, int max_fds, unsigned flags)
+{
+  struct oo_checkpoint_hdr hdr;
+  struct checkpoint_rec r;
+  ci_netif* old_ni = NULL;
+  unsigned i;
+  int n = 0, rc, restore_rc = 0;
+
+  Log_CALL(ci_log("%s(%d, %p, %d, %x)", __FUNCTION__, in_fd, fds, max_fds,
+                  flags));
+
+  rc = restore_read(in_fd, &hdr, sizeof(hdr));
+  if( rc == 0 && (hdr.magic != OO_CHECKPOINT_MAGIC ||
+                  hdr.version != OO_CHECKPOINT_VERSION ||
+                  hdr.n_socks > (unsigned) max_fds) )
+    rc = -EINVAL;
+
+  for( i = 0; rc == 0 && i < hdr.n_socks; ++i ) {
+    rc = restore_read_rec(in_fd, &r);
+    if( rc != 0 )
+      break;
+    if( restore_rc == 0 ) {
+      restore_rc = restore_sock(&r, &old_ni, hdr.stack_id, &fds[n]);
+      if( restore_rc == 0 && (flags & ONLOAD_RESTORE_SAME_FD) &&
+          fds[n] != r.cp.fd ) {
+        if( onload_dup2(fds[n], r.cp.fd) < 0 ) {
+          restore_rc = -errno;
+        }
+        else {
+          onload_close(fds[n]);
+          fds[n] = r.cp.fd;
+        }
+      }
+      if( restore_rc == 0 )
+        ++n;
+    }
+    else if( r.cp.state == CI_TCP_ESTABLISHED &&
+             restore_old_stack(&old_ni, hdr.stack_id) == 0 ) {
+      /* Once one socket has failed we stop restoring, and hand the rest
+       * of the connections back to the checkpointing process. */
+      restore_reclaim(&r, old_ni, 0);
+    }
+    free(r.data);
+  }
+  if( rc == 0 )
+    rc = restore_rc;
+
+  if( old_ni != NULL )
+    citp_netif_release_ref(old_ni, 0);
+
+  /* Sockets restored before a failure are still returned. */
+  if( rc != 0 ) {
+    errno = -rc;
+    if( n == 0 )
+      n = -1;
+  }
+  Log_CALL_RESULT(n);
+  return n;
+}
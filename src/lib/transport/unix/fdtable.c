@@ -38,6 +38,14 @@
 
 
 citp_fdtable_globals	citp_fdtable;
+pthread_mutex_t citp_fdtable_busy_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Threads that have marked an fdtable entry busy, and the sum of the counts
+** of those that have exited.  See citp_fdtable_busy_inc(). */
+static ci_dllist citp_fdtable_busy_threads =
+  CI_DLLIST_INITIALISER(citp_fdtable_busy_threads);
+static int citp_fdtable_busy_exited;
+static pthread_key_t citp_fdtable_busy_key;
 
 /* Initial seqno should differ from the seqno in special fdi, such as
  * citp_the_closed_fd */
@@ -439,6 +447,30 @@ static int patch_libc_close_nocancel(void)
 }
 
 
+/* Called as a thread that has marked an fdtable entry busy exits. */
+static void citp_fdtable_busy_thread_exit(void* arg)
+{
+  struct oo_per_thread* pt = arg;
+
+  pthread_mutex_lock(&citp_fdtable_busy_lock);
+  citp_fdtable_busy_exited += pt->fdt_n_busy;
+  ci_dllist_remove(&pt->fdt_busy_link);
+  pthread_mutex_unlock(&citp_fdtable_busy_lock);
+  /* Another destructor may yet mark an entry busy, and add us again. */
+  pt->fdt_n_busy = 0;
+  pt->fdt_busy_link.next = NULL;
+}
+
+
+void citp_fdtable_busy_thread_add(struct oo_per_thread* pt)
+{
+  pthread_mutex_lock(&citp_fdtable_busy_lock);
+  ci_dllist_push(&citp_fdtable_busy_threads, &pt->fdt_busy_link);
+  pthread_mutex_unlock(&citp_fdtable_busy_lock);
+  pthread_setspecific(citp_fdtable_busy_key, pt);
+}
+
+
 int citp_fdtable_ctor()
 {
   struct rlimit rlim;
@@ -488,6 +520,18 @@ int citp_fdtable_ctor()
               citp_fdtable.size));
     return -1;
   }
+  citp_fdtable.passthru_map =
+    calloc(CITP_PASSTHRU_MAP_WORD(citp_fdtable.size) + 1, sizeof(ci_uint32));
+  if( ! citp_fdtable.passthru_map ) {
+    Log_U(log("%s: failed to allocate passthru map (0x%x)", __FUNCTION__,
+              citp_fdtable.size));
+    return -1;
+  }
+  if( (rc = pthread_key_create(&citp_fdtable_busy_key,
+                               citp_fdtable_busy_thread_exit)) != 0 ) {
+    Log_E(log("%s: pthread_key_create(busy) %d", __FUNCTION__, rc));
+    return -1;
+  }
 
   /* The whole table is not initialised at start-of-day, but is initialised
   ** on demand.  citp_fdtable.inited_count counts the number of initialised
@@ -573,12 +617,15 @@ static void fdtable_swap(unsigned fd, citp_fdinfo_p from,
   citp_fdinfo_p fdip;
 
   p_fdip = &citp_fdtable.table[fd].fdip;
+  if( to == fdip_busy )
+    citp_fdtable_busy_inc();
 
  again:
   fdip = *p_fdip;
   if( fdip_is_busy(fdip) )  fdip = citp_fdtable_busy_wait(fd, fdt_locked);
   ci_assert_equal(fdip, from);
   if( fdip_cas_fail(p_fdip, from, to) )  goto again;
+  citp_fdtable_passthru_left(fd, from);
 }
 
 /* If this is called with OO_IOC_TCP_HANDOVER the stack lock must be held */
@@ -800,7 +847,7 @@ citp_fdtable_probe_locked(unsigned fd, int print_banner,
     fdip = *p_fdip;
     if( fdip_is_busy(fdip) )  fdip = citp_fdtable_busy_wait(fd, 1);
     if( ! fdip_is_unknown(fdip) && ! fdip_is_normal(fdip) )  goto exit;
-    if( fdip_cas_fail(p_fdip, fdip, fdip_busy) )  goto again;
+    if( ! fdip_cas_busy(p_fdip, fdip) )  goto again;
     
     if( fdip_is_normal(fdip) ) {
       fdi = fdip_to_fdi(fdip);
@@ -965,7 +1012,7 @@ citp_fdtable_lookup(unsigned fd)
 
     if( fdip_is_normal(fdip) ) {
       if( citp_fdtable_not_mt_safe() ) {
-	if( fdip_cas_succeed(p_fdip, fdip, fdip_busy) ) {
+	if( fdip_cas_busy(p_fdip, fdip) ) {
 	  fdi = fdip_to_fdi(fdip);
 	  ci_assert(fdi);
 	  ci_assert_gt(oo_atomic_read(&fdi->ref_count), 0);
@@ -1072,7 +1119,7 @@ citp_fdtable_lookup_fast(citp_lib_context_t* ctx, unsigned fd)
       }
       else {
         /* Swap in the busy marker. */
-	if( fdip_cas_succeed(p_fdip, fdip, fdip_busy) ) {
+	if( fdip_cas_busy(p_fdip, fdip) ) {
 	  fdi = fdip_to_fdi(fdip);
 
 	  ci_assert(fdi);
@@ -1095,8 +1142,10 @@ citp_fdtable_lookup_fast(citp_lib_context_t* ctx, unsigned fd)
     }
 
     /* Not normal! */
-    if( fdip_is_passthru(fdip) )
+    if( fdip_is_passthru(fdip) ) {
+      citp_fdtable_passthru_map_set(fd);
       return NULL;
+    }
 
     citp_enter_lib_if(ctx);
     if( fdip_is_busy(fdip) ) {
@@ -1158,7 +1207,7 @@ citp_fdinfo* citp_fdtable_lookup_noprobe(unsigned fd, int fdt_locked)
     /* Swap in the busy marker. */
     fdip = *p_fdip;
     if( fdip_is_normal(fdip) ) {
-      if( fdip_cas_succeed(p_fdip, fdip, fdip_busy) ) {
+      if( fdip_cas_busy(p_fdip, fdip) ) {
 	/* Bump the reference count. */
 	citp_fdinfo* fdi = fdip_to_fdi(fdip);
 	citp_fdinfo_ref(fdi);
@@ -1503,7 +1552,7 @@ void citp_fdinfo_handover(citp_fdinfo* fdi, int nonb_switch)
   if( fdip_is_busy(fdip) )  fdip = citp_fdtable_busy_wait(fd, 1);
 
   if( fdip == fdi_to_fdip(fdi) ) {
-    if( fdip_cas_fail(p_fdip, fdip, fdip_busy) )
+    if( ! fdip_cas_busy(p_fdip, fdip) )
       goto again;
   }
   else {
@@ -1535,12 +1584,23 @@ void citp_fdinfo_handover(citp_fdinfo* fdi, int nonb_switch)
 
 /* This function is called from citp_netif_child_fork_hook() only.
  * It handles any non-standard fdip - currently is "fixes" busy fdip.
+ *
+ * Other entries are left alone, so the cost of fork() does not grow with
+ * the number of fds: we only walk the table if some entry was busy when
+ * the parent forked, and stop as soon as we have found them all.
  */
 void citp_fdtable_fork_hook(void)
 {
+  struct oo_per_thread* self = __oo_per_thread_get();
+  struct oo_per_thread* pt;
   unsigned fd;
+  int n_busy = citp_fdtable_busy_exited;
 
-  for (fd = 0; fd < citp_fdtable.inited_count; fd++) {
+  CI_DLLIST_FOR_EACH2(struct oo_per_thread, pt, fdt_busy_link,
+                      &citp_fdtable_busy_threads)
+    n_busy += pt->fdt_n_busy;
+
+  for (fd = 0; n_busy > 0 && fd < citp_fdtable.inited_count; fd++) {
     citp_fdinfo_p fdip = citp_fdtable.table[fd].fdip;
 
     /* Parent has forked when one of its threads had made an fdtable
@@ -1549,9 +1609,17 @@ void citp_fdtable_fork_hook(void)
      * state. */
     if (fdip_is_busy(fdip)) {
       citp_fdtable.table[fd].fdip = fdip_unknown;
+      --n_busy;
       continue;
     }
   }
+
+  /* The other threads are gone, and this one holds no busy entries. */
+  ci_dllist_init(&citp_fdtable_busy_threads);
+  citp_fdtable_busy_exited = 0;
+  self->fdt_n_busy = 0;
+  if( self->fdt_busy_link.next != NULL )
+    ci_dllist_push(&citp_fdtable_busy_threads, &self->fdt_busy_link);
 }
 
 
@@ -1569,6 +1637,8 @@ citp_fdtable_new_fd_set(unsigned fd, citp_fdinfo_p new_fdip, int fdt_locked)
   }
 
   p_fdip = &citp_fdtable.table[fd].fdip;
+  if( new_fdip == fdip_busy )
+    citp_fdtable_busy_inc();
 
   do {
     prev = *p_fdip;
@@ -1585,6 +1655,7 @@ citp_fdtable_new_fd_set(unsigned fd, citp_fdinfo_p new_fdip, int fdt_locked)
     /* Reserved?  Perhaps it was a netif fd that has just been closed.  So it
     ** should be about to be unreserved. */
   } while (fdip_is_reserved(prev) || fdip_cas_fail(p_fdip, prev, new_fdip) );
+  citp_fdtable_passthru_left(fd, prev);
 
   if( fdip_is_normal(prev) ) {
     /* We can get here is close-trampolining fails.  So for release
@@ -1805,8 +1876,9 @@ int citp_ep_dup(unsigned oldfd, int (*syscall)(int oldfd, long arg),
       citp_fdinfo_release_ref(oldfdi, CI_TRUE);
   }
 #endif
-  if( fdip_cas_fail(p_oldfdip, oldfdip, fdip_busy) )
+  if( ! fdip_cas_busy(p_oldfdip, oldfdip) )
     goto again;
+  citp_fdtable_passthru_left(oldfd, oldfdip);
 
 #if CI_CFG_FD_CACHING
   /* May end up with multiple refs to this, don't allow it to be cached. */
@@ -1901,8 +1973,9 @@ static void dup2_complete(citp_fdinfo* prev_tofdi,
       citp_fdinfo_release_ref(fromfdi, CI_TRUE);
   }
 #endif
-  if( fdip_cas_fail(p_fromfdip, fromfdip, fdip_busy) )
+  if( ! fdip_cas_busy(p_fromfdip, fromfdip) )
     goto lock_fromfdip_again;
+  citp_fdtable_passthru_left(fromfd, fromfdip);
 
   oo_rwlock_lock_write(&citp_dup2_lock);
   rc = ci_sys_dup3(fromfd, tofd, flags);
@@ -2025,8 +2098,9 @@ int citp_ep_dup3(unsigned fromfd, unsigned tofd, int flags)
     tofd = -1;
     goto out;
   }
-  if( fdip_cas_fail(p_tofdip, tofdip, fdip_busy) )
+  if( ! fdip_cas_busy(p_tofdip, tofdip) )
     goto lock_tofdip_again;
+  citp_fdtable_passthru_left(tofd, tofdip);
   CITP_FDTABLE_UNLOCK();
   ci_assert(fdip_is_normal(tofdip) | fdip_is_passthru(tofdip) |
  	    fdip_is_unknown(tofdip));
@@ -2188,6 +2262,7 @@ int citp_ep_close(unsigned fd)
   */
   if( fdip_cas_fail(p_fdip, fdip, fdip_closing) )
     goto again;
+  citp_fdtable_passthru_left(fd, fdip);
 
   if( fdip_is_normal(fdip) ) {
     fdi = fdip_to_fdi(fdip);
@@ -2269,7 +2344,8 @@ int citp_reprobe_moved_common(citp_fdinfo* fdinfo, int from_fast_lookup,
     fdip = *p_fdip;
     if( fdip_is_busy(fdip) )  fdip = citp_fdtable_busy_wait(fd, 1);
     ci_assert( fdip_is_normal(fdip) || fdip_is_passthru(fdip) );
-    if( fdip_cas_fail(p_fdip, fdip, fdip_busy) )  goto again;
+    if( ! fdip_cas_busy(p_fdip, fdip) )  goto again;
+    citp_fdtable_passthru_left(fd, fdip);
     
     /* Possibly, a parrallel thread have already called
      * citp_reprobe_moved() for us. */
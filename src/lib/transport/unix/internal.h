@@ -604,12 +604,56 @@ typedef struct {
   citp_fdtable_entry*	table;
   unsigned		size;
   unsigned		inited_count;
+  /* One bit per fd, set when the fd is known to be pass-through.  See
+  ** citp_fdtable_is_passthru_fast(). */
+  volatile ci_uint32*	passthru_map;
 } citp_fdtable_globals;
 
 
 extern citp_fdtable_globals	citp_fdtable CI_HV;
 
 
+/* Count of the fdtable entries that are busy, or about to be, kept per
+** thread in [oo_per_thread::fdt_n_busy].  A thread raises its count before
+** it marks an entry busy and drops it after the busy marker is cleared, so
+** the sum over all threads is never less than the true count, and the
+** child after fork() can trust it in its copy of memory: when it is zero
+** there are no busy entries left behind by other threads and
+** citp_fdtable_fork_hook() has nothing to do.  Each thread writes only its
+** own count, so the lookup fast path doesn't share a cache line with other
+** threads.
+**
+** A thread is put on the list that the fork hook sums the first time it
+** marks an entry busy.  [citp_fdtable_busy_lock] protects the list, and is
+** held across fork().
+*/
+extern pthread_mutex_t citp_fdtable_busy_lock;
+extern void citp_fdtable_busy_thread_add(struct oo_per_thread*) CI_HF;
+
+ci_inline void citp_fdtable_busy_inc(void) {
+  struct oo_per_thread* pt = __oo_per_thread_get();
+  if(CI_UNLIKELY( pt->fdt_busy_link.next == NULL ))
+    citp_fdtable_busy_thread_add(pt);
+  ++pt->fdt_n_busy;
+}
+
+/* A busy marker may be cleared by a different thread from the one that set
+** it.  The counts of both are still correct in sum. */
+ci_inline void citp_fdtable_busy_dec(void) {
+  --__oo_per_thread_get()->fdt_n_busy;
+}
+
+/* Mark entry busy if it is still [fdip].  Returns true on success. */
+ci_inline int fdip_cas_busy(volatile citp_fdinfo_p* p_fdip,
+                            citp_fdinfo_p fdip) {
+  citp_fdtable_busy_inc();
+  if( fdip_cas_succeed(p_fdip, fdip, fdip_busy) )
+    return 1;
+  citp_fdtable_busy_dec();
+  return 0;
+}
+
+
 /* The following stuff is used to block when an fdtable entry is busy. */
 typedef struct {
   citp_fdinfo_p		next;
@@ -628,6 +672,7 @@ ci_inline void citp_fdtable_busy_clear(unsigned fd, citp_fdinfo_p fdip,
 				       int fdt_locked) {
   if( fdip_cas_fail(&citp_fdtable.table[fd].fdip, fdip_busy, fdip) )
     __citp_fdtable_busy_clear_slow(fd, fdip, fdt_locked);
+  citp_fdtable_busy_dec();
 }
 
 /*! Block until fdtable entry is not busy, and return the new (non-busy)
@@ -635,6 +680,50 @@ ci_inline void citp_fdtable_busy_clear(unsigned fd, citp_fdinfo_p fdip,
 extern citp_fdinfo_p citp_fdtable_busy_wait(unsigned fd, int fdt_locked) CI_HF;
 
 
+/* The pass-through map lets interceptors send calls on fds that Onload
+** does not accelerate straight to libc, without touching the fdtable
+** entry or the per-thread state.
+**
+** A bit is only ever set by citp_fdtable_lookup_fast() when it finds the
+** entry pass-through, and must be cleared by anyone who moves an entry
+** out of the pass-through state.  The setter re-checks the entry after
+** setting the bit, so a race with a concurrent state change leaves the
+** bit clear.  A clear bit just means we take the normal path.
+*/
+#define CITP_PASSTHRU_MAP_WORD(fd)  ((fd) >> 5)
+#define CITP_PASSTHRU_MAP_BIT(fd)   (1u << ((fd) & 31))
+
+ci_inline int citp_fdtable_is_passthru_fast(unsigned fd) {
+  return fd < citp_fdtable.inited_count &&
+    (citp_fdtable.passthru_map[CITP_PASSTHRU_MAP_WORD(fd)] &
+     CITP_PASSTHRU_MAP_BIT(fd));
+}
+
+ci_inline void citp_fdtable_passthru_map_clear(unsigned fd) {
+  volatile ci_uint32* w =
+    &citp_fdtable.passthru_map[CITP_PASSTHRU_MAP_WORD(fd)];
+  if( *w & CITP_PASSTHRU_MAP_BIT(fd) )
+    ci_atomic32_and(w, ~CITP_PASSTHRU_MAP_BIT(fd));
+}
+
+ci_inline void citp_fdtable_passthru_map_set(unsigned fd) {
+  volatile ci_uint32* w =
+    &citp_fdtable.passthru_map[CITP_PASSTHRU_MAP_WORD(fd)];
+  if( *w & CITP_PASSTHRU_MAP_BIT(fd) )
+    return;
+  ci_atomic32_or(w, CITP_PASSTHRU_MAP_BIT(fd));
+  ci_mb();
+  if( ! fdip_is_passthru(citp_fdtable.table[fd].fdip) )
+    ci_atomic32_and(w, ~CITP_PASSTHRU_MAP_BIT(fd));
+}
+
+/* Call after an entry has left [fdip], if it may have been pass-through. */
+ci_inline void citp_fdtable_passthru_left(unsigned fd, citp_fdinfo_p fdip) {
+  if( fdip_is_passthru(fdip) )
+    citp_fdtable_passthru_map_clear(fd);
+}
+
+
 
 
 /**********************************************************************
@@ -23,6 +23,7 @@ LIB_SRCS	:=			\
 		sys.c			\
 		sockcall_intercept.c	\
 		onload_ext_intercept.c	\
+		checkpoint.c		\
 		zc_intercept.c          \
 		zc_hlrx.c          \
 		tmpl_intercept.c	\
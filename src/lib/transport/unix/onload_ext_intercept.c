@@ -23,6 +23,7 @@
 #include <onload/extensions.h>
 #include <onload/ul/stackname.h>
 #include <ci/internal/ip_timestamp.h>
+#include <ci/internal/tx_ts_ring.h>
 
 #include "ul_pipe.h"
 #include "ul_epoll.h"
@@ -301,6 +302,47 @@ int onload_timestamping_request(int fd, unsigned flags)
 }
 
 
+int onload_tx_timestamp_read(int fd, struct onload_tx_timestamp* recs,
+                             int max, unsigned* dropped)
+{
+#if CI_CFG_TIMESTAMPING
+  citp_fdinfo* fdi;
+  int rc;
+  citp_lib_context_t lib_context;
+
+  if( max < 0 )
+    return -EINVAL;
+
+  citp_enter_lib(&lib_context);
+
+  if( (fdi = citp_fdtable_lookup(fd)) != NULL && citp_fdinfo_is_socket(fdi) ) {
+    ci_netif* ni = fdi_to_socket(fdi)->netif;
+    oo_tx_ts_ring_state* st = &ni->state->tx_ts_ring;
+    if( NI_OPTS(ni).tx_timestamp_ring == 0 ) {
+      rc = -ENOENT;
+    }
+    else {
+      rc = oo_tx_ts_ring_get(st, ni->tx_ts_ring,
+                             NI_OPTS(ni).tx_timestamp_ring, recs, max);
+      if( dropped != NULL )
+        *dropped = OO_ACCESS_ONCE(st->dropped);
+    }
+    citp_fdinfo_release_ref(fdi, 0);
+  }
+  else {
+    if( fdi != NULL )
+      citp_fdinfo_release_ref(fdi, 0);
+    rc = -ENOTTY;
+  }
+
+  citp_exit_lib(&lib_context, 0);
+  return rc;
+#else
+  return -EOPNOTSUPP;
+#endif
+}
+
+
 static int oo_extensions_version_check(void)
 {
   static unsigned int* oev;
@@ -577,3 +619,47 @@ int onload_socket_unicast_nonaccel(int domain, int type, int protocol)
   return fd;
 }
 
+
+
+int onload_mcast_join_bulk(int fd, const struct ip_mreqn* groups, int n_groups)
+{
+  citp_lib_context_t lib_context;
+  citp_fdinfo* fdi;
+  int n_joined = 0;
+  int rc = 0;
+
+  Log_CALL(ci_log("%s(%d, %p, %d)", __FUNCTION__, fd, groups, n_groups));
+
+  citp_enter_lib(&lib_context);
+  fdi = citp_fdtable_lookup(fd);
+  if( fdi != NULL && citp_fdinfo_get_type(fdi) == CITP_UDP_SOCKET ) {
+    citp_sock_fdi* epi = fdi_to_sock_fdi(fdi);
+    rc = ci_udp_mcast_join_bulk(&epi->sock, fd, groups, n_groups, &n_joined);
+    if( rc == CI_SOCKET_HANDOVER ) {
+      CITP_STATS_NETIF(++epi->sock.netif->state->stats.
+                       udp_handover_setsockopt);
+      citp_fdinfo_handover(fdi, -1);
+      fdi = NULL;
+      rc = 0;
+    }
+  }
+  if( fdi != NULL )
+    citp_fdinfo_release_ref(fdi, 0);
+  citp_exit_lib(&lib_context, rc == 0);
+
+  /* Anything not handled by Onload (including the remaining groups after
+   * a handover) is joined through the kernel.
+   */
+  if( rc == 0 )
+    for( ; n_joined < n_groups; ++n_joined )
+      if( ci_sys_setsockopt(fd, SOL_IP, IP_ADD_MEMBERSHIP,
+                            &groups[n_joined], sizeof(groups[n_joined])) < 0 ) {
+        rc = -1;
+        break;
+      }
+
+  if( rc != 0 && n_joined == 0 )
+    n_joined = -1;
+  Log_CALL_RESULT(n_joined);
+  return n_joined;
+}
@@ -760,6 +760,9 @@ OO_INTERCEPT(ssize_t, recv,
     return ci_sys_recv(fd, buf, len, flags);
   }
 
+  if( citp_fdtable_is_passthru_fast(fd) )
+    return ci_sys_recv(fd, buf, len, flags);
+
   Log_CALL(ci_log("%s(%d, %p, %u, 0x%x)", __FUNCTION__, fd, buf, (unsigned)len, flags));
 
   if( (fdi = citp_fdtable_lookup_fast(&lib_context, fd)) ) {
@@ -810,6 +813,9 @@ OO_INTERCEPT(ssize_t, recvfrom,
     return ci_sys_recvfrom(fd, buf, len, flags, from, fromlen);
   }
 
+  if( citp_fdtable_is_passthru_fast(fd) )
+    return ci_sys_recvfrom(fd, buf, len, flags, from, fromlen);
+
   Log_CALL(ci_log("%s(%d,%p,%u,0x%x,"OO_PRINT_SOCKADDR_FMT_OUT")",
                   __FUNCTION__,
                   fd, buf, (unsigned)len, flags,
@@ -874,6 +880,9 @@ OO_INTERCEPT(ssize_t, recvmsg,
     return ci_sys_recvmsg(fd, msg, flags);
   }
 
+  if( citp_fdtable_is_passthru_fast(fd) )
+    return ci_sys_recvmsg(fd, msg, flags);
+
   Log_CALL(ci_log("%s(%d, %p, 0x%x)", __FUNCTION__, fd,msg,flags));
 
   if( (fdi = citp_fdtable_lookup_fast(&lib_context, fd)) ) {
@@ -907,6 +916,9 @@ OO_INTERCEPT(int, recvmmsg,
     return ci_sys_recvmmsg(fd, msg, vlen, flags, timeout);
   }
 
+  if( citp_fdtable_is_passthru_fast(fd) )
+    return ci_sys_recvmmsg(fd, msg, vlen, flags, timeout);
+
   Log_CALL(ci_log("%s(%d, %p, %u, 0x%x)", __FUNCTION__, fd, msg, vlen, flags));
 
   if( (fdi = citp_fdtable_lookup_fast(&lib_context, fd)) ) {
@@ -948,6 +960,9 @@ OO_INTERCEPT(ssize_t, send,
     return ci_sys_send(fd, msg, len, flags);
   }
 
+  if( citp_fdtable_is_passthru_fast(fd) )
+    return ci_sys_send(fd, msg, len, flags);
+
   Log_CALL(log("%s(%d, %p, %u, %x)", __FUNCTION__, fd, msg, (unsigned)len, flags));
 
   if( (fdi = citp_fdtable_lookup_fast(&lib_context, fd)) ) {
@@ -991,6 +1006,9 @@ OO_INTERCEPT(ssize_t, sendto,
     return ci_sys_sendto(fd, msg, len, flags, to, tolen);
   }
 
+  if( citp_fdtable_is_passthru_fast(fd) )
+    return ci_sys_sendto(fd, msg, len, flags, to, tolen);
+
   Log_CALL(
     ci_log("%s(%d, %p, %u, %d, "OO_PRINT_SOCKADDR_FMT")", __FUNCTION__,
            fd, msg,(unsigned)len,flags,
@@ -1037,6 +1055,9 @@ OO_INTERCEPT(ssize_t, sendmsg,
     return ci_sys_sendmsg(fd, msg, flags);
   }
 
+  if( citp_fdtable_is_passthru_fast(fd) )
+    return ci_sys_sendmsg(fd, msg, flags);
+
   Log_CALL(
     ci_log("%s(%d, %p(iov[%zu]:%p, "OO_PRINT_SOCKADDR_FMT", cmsg[%zu]:%p),"
            " 0x%x)", __FUNCTION__, fd, msg, msg->msg_iovlen, msg->msg_iov,
@@ -1074,6 +1095,9 @@ OO_INTERCEPT(int, sendmmsg,
     return ci_sys_sendmmsg(fd, msg, vlen, flags);
   }
 
+  if( citp_fdtable_is_passthru_fast(fd) )
+    return ci_sys_sendmmsg(fd, msg, vlen, flags);
+
   Log_CALL(ci_log("%s(%d, %p, %u, 0x%x)", __FUNCTION__, fd, msg, vlen, flags));
 
   if( (fdi = citp_fdtable_lookup_fast(&lib_context, fd)) ) {
@@ -1587,6 +1611,9 @@ OO_INTERCEPT(ssize_t, read,
     return ci_sys_read(fd, buf, count);
   }
 
+  if( citp_fdtable_is_passthru_fast(fd) )
+    return ci_sys_read(fd, buf, count);
+
   Log_CALL(ci_log("%s(%d, %p, %u)", __FUNCTION__, fd, buf, (unsigned)count));
 
   if( (fdi = citp_fdtable_lookup_fast(&lib_context, fd)) ) {
@@ -1641,6 +1668,9 @@ OO_INTERCEPT(ssize_t, write,
     return ci_sys_write(fd, buf, count);
   }
 
+  if( citp_fdtable_is_passthru_fast(fd) )
+    return ci_sys_write(fd, buf, count);
+
   Log_CALL(ci_log("%s(%d, %p, %u)", __FUNCTION__, fd, buf, (unsigned)count));
 
   if( (fdi = citp_fdtable_lookup_fast(&lib_context, fd)) ) {
@@ -1684,6 +1714,9 @@ OO_INTERCEPT(ssize_t, readv,
     return ci_sys_readv(fd, vector, count);
   }
 
+  if( citp_fdtable_is_passthru_fast(fd) )
+    return ci_sys_readv(fd, vector, count);
+
   Log_CALL(ci_log("%s(%d, %p, %d)", __FUNCTION__, fd, vector, count));
 
   if( (fdi = citp_fdtable_lookup_fast(&lib_context, fd)) ) {
@@ -1740,6 +1773,9 @@ OO_INTERCEPT(ssize_t, writev,
     return ci_sys_writev(fd, vector, count);
   }
 
+  if( citp_fdtable_is_passthru_fast(fd) )
+    return ci_sys_writev(fd, vector, count);
+
   Log_CALL(ci_log("%s(%d, %p, %d)", __FUNCTION__, fd, vector, count));
 
   if( (fdi = citp_fdtable_lookup_fast(&lib_context, fd)) ) {
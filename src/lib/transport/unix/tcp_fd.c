@@ -23,6 +23,7 @@
 #include <ci/internal/transport_common.h>
 #include <ci/internal/ip.h>
 #include <ci/internal/ip_timestamp.h>
+#include <ci/internal/probes.h>
 #include <onload/ul.h>
 #include <onload/tcp_poll.h>
 #include <onload/ul/tcp_helper.h>
@@ -1713,15 +1714,22 @@ static int citp_tcp_recv(citp_fdinfo* fdinfo, struct msghdr* msg, int flags)
             CI_SOCKCALL_FLAGS_PRI_ARG(flags)));
 
   if( epi->sock.s->b.state != CI_TCP_LISTEN ) {
+    ci_uint64 cycles;
+
     if( (msg->msg_iovlen == 0 || msg->msg_iov == NULL) &&
         ! (flags & MSG_ERRQUEUE) ) {
       msg->msg_flags = 0;
       msg->msg_controllen = 0;
       return 0;
     }
+    cycles = ci_sock_cycles_start(epi->sock.netif);
+    OO_PROBE4(recv_entry, NI_ID(epi->sock.netif), SC_ID(epi->sock.s), msg,
+              flags);
     ci_tcp_recvmsg_args_init(&a, epi->sock.netif, SOCK_TO_TCP(epi->sock.s),
                              msg, flags);
     rc = ci_tcp_recvmsg(&a);
+    ci_sock_cycles_add(cycles, &epi->sock.s->cycles.recv);
+    OO_PROBE3(recv_return, NI_ID(epi->sock.netif), SC_ID(epi->sock.s), rc);
     Log_V(ci_log(LPF "recv("EF_FMT") = %d", EF_PRI_ARGS(epi, fdinfo->fd), rc));
     return rc;
   }
@@ -1786,8 +1794,15 @@ static int citp_tcp_send(citp_fdinfo* fdinfo, const struct msghdr* msg,
         CI_SET_ERROR(rc, EPIPE);
     }
     else {
+      ci_uint64 cycles;
+
+      cycles = ci_sock_cycles_start(epi->sock.netif);
+      OO_PROBE4(send_entry, NI_ID(epi->sock.netif), SC_ID(epi->sock.s), msg,
+                flags);
       rc = ci_tcp_sendmsg(epi->sock.netif, SOCK_TO_TCP(epi->sock.s),
                           msg->msg_iov, msg->msg_iovlen, flags); 
+      ci_sock_cycles_add(cycles, &epi->sock.s->cycles.send);
+      OO_PROBE3(send_return, NI_ID(epi->sock.netif), SC_ID(epi->sock.s), rc);
     }
   }
   else if( msg != NULL && msg->msg_iovlen == 0 ) {
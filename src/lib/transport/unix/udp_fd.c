@@ -19,6 +19,7 @@
 #include "ul_poll.h"
 #include "ul_select.h"
 #include <ci/internal/ip_timestamp.h>
+#include <ci/internal/probes.h>
 #include <onload/ul/tcp_helper.h>
 #include <onload/tcp_poll.h>
 
@@ -382,6 +383,8 @@ static int citp_udp_recvmmsg(citp_fdinfo* fdinfo, struct mmsghdr* msg,
 {
   citp_sock_fdi* epi = fdi_to_sock_fdi(fdinfo);
   ci_udp_iomsg_args a;
+  ci_uint64 cycles = ci_sock_cycles_start(epi->sock.netif);
+  int rc;
 
   Log_V(log(LPF "recvmmsg(%d, msg, %u, %#x)", fdinfo->fd, vlen, 
             (unsigned) flags));
@@ -391,13 +394,20 @@ static int citp_udp_recvmmsg(citp_fdinfo* fdinfo, struct mmsghdr* msg,
   a.ni = epi->sock.netif;
   a.us = SOCK_TO_UDP(epi->sock.s);
 
-  return ci_udp_recvmmsg(&a, msg, vlen, flags, timeout);
+  OO_PROBE4(recv_entry, NI_ID(a.ni), SC_ID(epi->sock.s), &msg->msg_hdr,
+            flags);
+  rc = ci_udp_recvmmsg(&a, msg, vlen, flags, timeout);
+  ci_sock_cycles_add(cycles, &epi->sock.s->cycles.recv);
+  OO_PROBE3(recv_return, NI_ID(a.ni), SC_ID(epi->sock.s), rc);
+  return rc;
 }
 
 static int citp_udp_recv(citp_fdinfo* fdinfo, struct msghdr* msg, int flags)
 {
   citp_sock_fdi* epi = fdi_to_sock_fdi(fdinfo);
   ci_udp_iomsg_args a;
+  ci_uint64 cycles = ci_sock_cycles_start(epi->sock.netif);
+  int rc;
 
   Log_V(log(LPF "recv(%d, msg, %#x)", fdinfo->fd, (unsigned) flags));
 
@@ -406,7 +416,11 @@ static int citp_udp_recv(citp_fdinfo* fdinfo, struct msghdr* msg, int flags)
   a.ni = epi->sock.netif;
   a.us = SOCK_TO_UDP(epi->sock.s);
 
-  return ci_udp_recvmsg( &a, msg, flags);
+  OO_PROBE4(recv_entry, NI_ID(a.ni), SC_ID(epi->sock.s), msg, flags);
+  rc = ci_udp_recvmsg( &a, msg, flags);
+  ci_sock_cycles_add(cycles, &epi->sock.s->cycles.recv);
+  OO_PROBE3(recv_return, NI_ID(a.ni), SC_ID(epi->sock.s), rc);
+  return rc;
 }
 
 
@@ -415,6 +429,7 @@ static int citp_udp_send(citp_fdinfo* fdinfo, const struct msghdr * msg,
 {
   citp_sock_fdi *epi = fdi_to_sock_fdi(fdinfo);
   ci_udp_iomsg_args a;
+  ci_uint64 cycles = ci_sock_cycles_start(epi->sock.netif);
   int rc;
 
   ci_assert(msg != NULL);
@@ -425,6 +440,7 @@ static int citp_udp_send(citp_fdinfo* fdinfo, const struct msghdr * msg,
   a.us = SOCK_TO_UDP(epi->sock.s);
 
   /* NB. msg_name[len] validated in ci_udp_sendmsg(). */
+  OO_PROBE4(send_entry, NI_ID(a.ni), SC_ID(epi->sock.s), msg, flags);
   if(CI_LIKELY( msg->msg_iov != NULL || msg->msg_iovlen == 0 )) {
     rc = ci_udp_sendmsg( &a, msg, flags);
   }
@@ -432,6 +448,8 @@ static int citp_udp_send(citp_fdinfo* fdinfo, const struct msghdr * msg,
     rc = -1;
     errno = EFAULT;
   }
+  ci_sock_cycles_add(cycles, &epi->sock.s->cycles.send);
+  OO_PROBE3(send_return, NI_ID(a.ni), SC_ID(epi->sock.s), rc);
   return rc;
 }
 
@@ -441,6 +459,7 @@ static int citp_udp_sendmmsg(citp_fdinfo* fdinfo, struct mmsghdr* mmsg,
 {
   citp_sock_fdi* epi = fdi_to_sock_fdi(fdinfo);
   ci_udp_iomsg_args a;
+  ci_uint64 cycles;
   int i, rc;
 
   Log_V(log(LPF "sendmmsg(%d, msg, %u, %#x)", fdinfo->fd, vlen, 
@@ -455,13 +474,18 @@ static int citp_udp_sendmmsg(citp_fdinfo* fdinfo, struct mmsghdr* mmsg,
   a.us = SOCK_TO_UDP(epi->sock.s);
 
   i = 0;
+  cycles = ci_sock_cycles_start(a.ni);
 
   do {
+    OO_PROBE4(send_entry, NI_ID(a.ni), SC_ID(epi->sock.s), &mmsg[i].msg_hdr,
+              flags);
     rc = ci_udp_sendmsg(&a, &mmsg[i].msg_hdr, flags);
+    OO_PROBE3(send_return, NI_ID(a.ni), SC_ID(epi->sock.s), rc);
     if(CI_LIKELY( rc >= 0 ) )
       mmsg[i].msg_len = rc;
     ++i;
   } while( rc >= 0 && i < vlen );
+  ci_sock_cycles_add(cycles, &epi->sock.s->cycles.send);
   return (rc>=0) ? i : rc;
 }
 
@@ -455,6 +455,267 @@ static bool have_unsupported_nic(ci_netif* ni)
 }
 
 
+static struct ci_zc_usermem*
+zc_usermem_alloc(ci_netif* ni, ef_addrspace addr_space, uint64_t base,
+                 uint64_t len)
+{
+  int num_pages = len >> EF_VI_NIC_PAGE_SHIFT;
+  struct ci_zc_usermem* um = malloc(sizeof(struct ci_zc_usermem) +
+                                    sizeof(um->hw_addrs[0]) * num_pages *
+                                    oo_stack_intf_max(ni));
+  if( um ) {
+    um->addr_space = addr_space;
+    um->base = base;
+    um->size = len;
+    um->cache_next = NULL;
+    um->cache_refs = 0;
+    um->cache_inval_seq = 0;
+  }
+  return um;
+}
+
+
+static int zc_usermem_register(ci_netif* ni, struct ci_zc_usermem* um)
+{
+  /* Sample the invalidation count first, so that an unmap which races with
+   * registration leaves the new registration looking stale. */
+  um->cache_inval_seq = CI_READ_ONCE(ni->state->zc_reg_inval_seq);
+  return ci_tcp_helper_zc_register_buffers(ni, (void*)(uintptr_t)um->base,
+                                           um->size >> EF_VI_NIC_PAGE_SHIFT,
+                                           um->hw_addrs, &um->kernel_id);
+}
+
+
+/**********************************************************************
+ * Registration cache (EF_ZC_REG_CACHE)
+ *
+ * Registrations stay on ni->zc_reg_cache while in use, and up to
+ * EF_ZC_REG_CACHE of them stay registered with the kernel once the app has
+ * unregistered them, so that registering the same (or a covered) range
+ * again is just a list lookup.  The kernel bumps zc_reg_inval_seq whenever
+ * cached memory is unmapped; registrations made before that can no longer
+ * be trusted to map the memory now at their address, so are released as
+ * soon as they are idle.
+ */
+
+static bool zc_reg_cache_stale(ci_netif* ni, const struct ci_zc_usermem* um)
+{
+  return um->cache_inval_seq != ni->state->zc_reg_inval_seq;
+}
+
+
+static void zc_reg_cache_push(ci_netif* ni, struct ci_zc_usermem* um)
+{
+  ci_assert(ci_netif_is_locked(ni));
+  um->cache_next = ni->zc_reg_cache;
+  ni->zc_reg_cache = um;
+}
+
+
+static void zc_reg_cache_unlink(ci_netif* ni, struct ci_zc_usermem* um)
+{
+  struct ci_zc_usermem** pprev = &ni->zc_reg_cache;
+
+  ci_assert(ci_netif_is_locked(ni));
+  while( *pprev != um ) {
+    ci_assert(*pprev);
+    pprev = &(*pprev)->cache_next;
+  }
+  *pprev = um->cache_next;
+}
+
+
+/* Move idle entries for which [pred] is true from the cache to [*list]. */
+static int zc_reg_cache_take_idle(ci_netif* ni, struct ci_zc_usermem** list,
+                                  bool (*pred)(ci_netif*,
+                                               const struct ci_zc_usermem*,
+                                               void*),
+                                  void* arg)
+{
+  struct ci_zc_usermem** pprev = &ni->zc_reg_cache;
+  struct ci_zc_usermem* um;
+  int n = 0;
+
+  ci_assert(ci_netif_is_locked(ni));
+  while( (um = *pprev) != NULL ) {
+    if( um->cache_refs == 0 && pred(ni, um, arg) ) {
+      *pprev = um->cache_next;
+      um->cache_next = *list;
+      *list = um;
+      --ni->zc_reg_cache_idle;
+      ++n;
+    }
+    else {
+      pprev = &um->cache_next;
+    }
+  }
+  return n;
+}
+
+
+static bool zc_reg_pred_stale(ci_netif* ni, const struct ci_zc_usermem* um,
+                              void* arg)
+{
+  return zc_reg_cache_stale(ni, um);
+}
+
+
+/* [arg] is a [base, end) range, which is grown to cover each match. */
+static bool zc_reg_pred_neighbour(ci_netif* ni,
+                                  const struct ci_zc_usermem* um, void* arg)
+{
+  uint64_t* range = arg;
+  if( um->base > range[1] || um->base + um->size < range[0] )
+    return false;
+  range[0] = CI_MIN(range[0], um->base);
+  range[1] = CI_MAX(range[1], um->base + um->size);
+  return true;
+}
+
+
+/* Release the least recently used idle entries beyond the limit. */
+static void zc_reg_cache_trim(ci_netif* ni, struct ci_zc_usermem** list)
+{
+  while( ni->zc_reg_cache_idle > NI_OPTS(ni).zc_reg_cache ) {
+    struct ci_zc_usermem* um;
+    struct ci_zc_usermem* lru = NULL;
+    for( um = ni->zc_reg_cache; um != NULL; um = um->cache_next )
+      if( um->cache_refs == 0 )
+        lru = um;
+    ci_assert(lru);
+    zc_reg_cache_unlink(ni, lru);
+    lru->cache_next = *list;
+    *list = lru;
+    --ni->zc_reg_cache_idle;
+    CITP_STATS_NETIF_INC(ni, zc_reg_cache_evictions);
+  }
+}
+
+
+/* Unregister entries removed from the cache.  Called without the lock. */
+static int zc_reg_release_list(ci_netif* ni, struct ci_zc_usermem* list)
+{
+  int rc = 0;
+  while( list != NULL ) {
+    struct ci_zc_usermem* um = list;
+    int rc1 = ci_tcp_helper_zc_unregister_buffers(ni, um->kernel_id);
+    if( rc1 < 0 )
+      rc = rc1;
+    list = um->cache_next;
+    free(um);
+  }
+  return rc;
+}
+
+
+static int zc_reg_cache_get(ci_netif* ni, uint64_t base, uint64_t len,
+                            struct ci_zc_usermem** um_out)
+{
+  struct ci_zc_usermem* stale = NULL;
+  struct ci_zc_usermem* merge = NULL;
+  struct ci_zc_usermem* um;
+  uint64_t range[2] = { base, base + len };
+  int rc, n;
+
+  ci_netif_lock(ni);
+  n = zc_reg_cache_take_idle(ni, &stale, zc_reg_pred_stale, NULL);
+  CITP_STATS_NETIF_ADD(ni, zc_reg_cache_invalidated, n);
+  for( um = ni->zc_reg_cache; um != NULL; um = um->cache_next )
+    if( um->base <= base && base + len <= um->base + um->size &&
+        ! zc_reg_cache_stale(ni, um) )
+      break;
+  if( um != NULL ) {
+    if( um->cache_refs++ == 0 )
+      --ni->zc_reg_cache_idle;
+    zc_reg_cache_unlink(ni, um);
+    zc_reg_cache_push(ni, um);
+    CITP_STATS_NETIF_INC(ni, zc_reg_cache_hits);
+  }
+  else {
+    CITP_STATS_NETIF_INC(ni, zc_reg_cache_misses);
+    /* Absorbing a neighbour can bring others into reach. */
+    while( zc_reg_cache_take_idle(ni, &merge, zc_reg_pred_neighbour,
+                                  range) )
+      ;
+  }
+  ci_netif_unlock(ni);
+  zc_reg_release_list(ni, stale);
+
+  if( um != NULL ) {
+    *um_out = um;
+    return 0;
+  }
+
+  if( merge != NULL ) {
+    /* Replace the neighbours with a single registration of the combined
+     * range.  That can fail (e.g. if the combination isn't suitably
+     * aligned for huge pages) in which case they go back in the cache. */
+    um = zc_usermem_alloc(ni, EF_ADDRSPACE_LOCAL, range[0],
+                          range[1] - range[0]);
+    if( um != NULL && zc_usermem_register(ni, um) < 0 ) {
+      free(um);
+      um = NULL;
+    }
+    if( um != NULL ) {
+      zc_reg_release_list(ni, merge);
+      ci_netif_lock(ni);
+      CITP_STATS_NETIF_INC(ni, zc_reg_cache_merges);
+    }
+    else {
+      ci_netif_lock(ni);
+      while( merge != NULL ) {
+        struct ci_zc_usermem* next = merge->cache_next;
+        zc_reg_cache_push(ni, merge);
+        ++ni->zc_reg_cache_idle;
+        merge = next;
+      }
+      ci_netif_unlock(ni);
+    }
+  }
+
+  if( um == NULL ) {
+    um = zc_usermem_alloc(ni, EF_ADDRSPACE_LOCAL, base, len);
+    if( um == NULL )
+      return -ENOMEM;
+    if( (rc = zc_usermem_register(ni, um)) < 0 ) {
+      free(um);
+      return rc;
+    }
+    ci_netif_lock(ni);
+  }
+
+  um->cache_refs = 1;
+  zc_reg_cache_push(ni, um);
+  ci_netif_unlock(ni);
+  *um_out = um;
+  return 0;
+}
+
+
+static int zc_reg_cache_put(ci_netif* ni, struct ci_zc_usermem* um)
+{
+  struct ci_zc_usermem* release = NULL;
+
+  ci_netif_lock(ni);
+  ci_assert_gt(um->cache_refs, 0);
+  if( --um->cache_refs == 0 ) {
+    zc_reg_cache_unlink(ni, um);
+    if( zc_reg_cache_stale(ni, um) ) {
+      um->cache_next = NULL;
+      release = um;
+      CITP_STATS_NETIF_INC(ni, zc_reg_cache_invalidated);
+    }
+    else {
+      zc_reg_cache_push(ni, um);
+      ++ni->zc_reg_cache_idle;
+      zc_reg_cache_trim(ni, &release);
+    }
+  }
+  ci_netif_unlock(ni);
+  return zc_reg_release_list(ni, release);
+}
+
+
 int onload_zc_register_buffers(int fd, ef_addrspace addr_space,
                                uint64_t base_ptr, uint64_t len, int flags,
                                onload_zc_handle* handle)
@@ -479,14 +740,10 @@ int onload_zc_register_buffers(int fd, ef_addrspace addr_space,
   else if( len >> EF_VI_NIC_PAGE_SHIFT > INT_MAX )
     rc = -E2BIG;
   else if( (rc = fd_to_stack(fd, &ni, &fdi)) == 0 ) {
-    int num_pages = len >> EF_VI_NIC_PAGE_SHIFT;
-    struct ci_zc_usermem* um = malloc(sizeof(struct ci_zc_usermem) +
-                                      sizeof(um->hw_addrs[0]) * num_pages *
-                                      oo_stack_intf_max(ni));
-    if( ! um )
-      rc = -ENOMEM;
-    else if( addr_space != EF_ADDRSPACE_LOCAL &&
-             (rc = verify_addrspace_override(ni)) < 0 ) {
+    struct ci_zc_usermem* um = NULL;
+
+    if( addr_space != EF_ADDRSPACE_LOCAL &&
+        (rc = verify_addrspace_override(ni)) < 0 ) {
       /* error code already set appropriately */
     }
     else if( have_unsupported_nic(ni) ) {
@@ -494,20 +751,19 @@ int onload_zc_register_buffers(int fd, ef_addrspace addr_space,
        * to compute checksums on the host is gnarly and thus non-existant. */
       rc = -ENOTSUP;
     }
-    else {
-      um->addr_space = addr_space;
-      um->base = base_ptr;
-      um->size = len;
-
-      if( addr_space == EF_ADDRSPACE_LOCAL )
-        rc = ci_tcp_helper_zc_register_buffers(ni, (void*)(uintptr_t)base_ptr,
-                                               num_pages, um->hw_addrs,
-                                               &um->kernel_id);
-
-      if( rc == 0 )
-        *handle = zc_usermem_to_handle(um);
+    else if( addr_space == EF_ADDRSPACE_LOCAL && NI_OPTS(ni).zc_reg_cache ) {
+      rc = zc_reg_cache_get(ni, base_ptr, len, &um);
+    }
+    else if( (um = zc_usermem_alloc(ni, addr_space, base_ptr, len)) == NULL ) {
+      rc = -ENOMEM;
     }
-    if( rc )
+    else if( addr_space == EF_ADDRSPACE_LOCAL ) {
+      rc = zc_usermem_register(ni, um);
+    }
+
+    if( rc == 0 )
+      *handle = zc_usermem_to_handle(um);
+    else
       free(um);
 
     citp_fdinfo_release_ref(fdi, 0);
@@ -537,11 +793,16 @@ int onload_zc_unregister_buffers(int fd, onload_zc_handle handle, int flags)
   else if( (rc = fd_to_stack(fd, &ni, &fdi)) == 0 ) {
     struct ci_zc_usermem* um = zc_handle_to_usermem(handle);
 
-    if( um->addr_space == EF_ADDRSPACE_LOCAL )
-      rc = ci_tcp_helper_zc_unregister_buffers(ni, um->kernel_id);
+    if( um->cache_refs != 0 ) {
+      rc = zc_reg_cache_put(ni, um);
+    }
+    else {
+      if( um->addr_space == EF_ADDRSPACE_LOCAL )
+        rc = ci_tcp_helper_zc_unregister_buffers(ni, um->kernel_id);
 
-    if( rc == 0 )
-      free(um);
+      if( rc == 0 )
+        free(um);
+    }
 
     citp_fdinfo_release_ref(fdi, 0);
   }
@@ -0,0 +1,242 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+/* efpktpool_bench
+ *
+ * Compare buffer alloc/free rates of ef_pktpool with the simple free list
+ * used by the ef_vi samples.  Each thread repeatedly allocates a burst of
+ * buffers, touches them, and frees them again.  Neither a NIC nor the
+ * driver is needed: the pool's memory is not registered.
+ *
+ * With more than one thread the simple free list is protected by a mutex,
+ * as it would have to be if shared.
+ */
+
+#define _GNU_SOURCE
+
+#include <etherfabric/pktpool.h>
+
+#include "utils.h"
+
+#include <time.h>
+#include <stdarg.h>
+
+
+#define PKT_BUF_SIZE  2048
+
+
+static unsigned cfg_threads = 1;
+static unsigned cfg_bufs = 65536;
+static unsigned cfg_burst = 32;
+static unsigned cfg_cache = 256;
+static unsigned long cfg_iters = 1000000;
+static int cfg_numa = -1;
+
+
+/* The free list from the samples, e.g. efforward.c. */
+struct pkt_buf {
+  int             id;
+  struct pkt_buf* next;
+};
+
+static struct {
+  void*           mem;
+  struct pkt_buf* free;
+  pthread_mutex_t lock;
+} simple;
+
+
+static struct pkt_buf* simple_alloc(void)
+{
+  struct pkt_buf* pb;
+  if( cfg_threads > 1 )
+    pthread_mutex_lock(&simple.lock);
+  pb = simple.free;
+  if( pb != NULL )
+    simple.free = pb->next;
+  if( cfg_threads > 1 )
+    pthread_mutex_unlock(&simple.lock);
+  return pb;
+}
+
+
+static void simple_free(struct pkt_buf* pb)
+{
+  if( cfg_threads > 1 )
+    pthread_mutex_lock(&simple.lock);
+  pb->next = simple.free;
+  simple.free = pb;
+  if( cfg_threads > 1 )
+    pthread_mutex_unlock(&simple.lock);
+}
+
+
+static void* simple_thread(void* arg)
+{
+  struct pkt_buf** bufs = calloc(cfg_burst, sizeof(*bufs));
+  uintptr_t tag = (uintptr_t) arg;
+  unsigned long it;
+  unsigned i;
+
+  TEST(bufs);
+  for( it = 0; it < cfg_iters; ++it ) {
+    for( i = 0; i < cfg_burst; ++i ) {
+      TEST((bufs[i] = simple_alloc()) != NULL);
+      *(uintptr_t*) (bufs[i] + 1) = tag;
+    }
+    for( i = 0; i < cfg_burst; ++i ) {
+      TEST(*(uintptr_t*) (bufs[i] + 1) == tag);
+      simple_free(bufs[i]);
+    }
+  }
+  free(bufs);
+  return NULL;
+}
+
+
+static ef_pktpool* pool;
+
+
+static void* pool_thread(void* arg)
+{
+  int* ids = calloc(cfg_burst, sizeof(*ids));
+  uintptr_t tag = (uintptr_t) arg;
+  ef_pktpool_cache* cache;
+  unsigned long it;
+  unsigned i;
+
+  TEST(ids);
+  TRY(ef_pktpool_cache_alloc(&cache, pool, cfg_cache));
+  for( it = 0; it < cfg_iters; ++it ) {
+    for( i = 0; i < cfg_burst; ++i ) {
+      TRY(ids[i] = ef_pktpool_buf_alloc(cache));
+      *(uintptr_t*) ef_pktpool_buf_ptr(pool, ids[i]) = tag;
+    }
+    for( i = 0; i < cfg_burst; ++i ) {
+      TEST(*(uintptr_t*) ef_pktpool_buf_ptr(pool, ids[i]) == tag);
+      ef_pktpool_buf_release(cache, ids[i]);
+    }
+  }
+  ef_pktpool_cache_free(cache);
+  free(ids);
+  return NULL;
+}
+
+
+static double run(const char* name, void* (*fn)(void*))
+{
+  pthread_t* threads = calloc(cfg_threads, sizeof(*threads));
+  struct timespec start, end;
+  double secs, mops;
+  uintptr_t t;
+
+  TEST(threads);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for( t = 0; t < cfg_threads; ++t )
+    TEST(pthread_create(&threads[t], NULL, fn, (void*) (t + 1)) == 0);
+  for( t = 0; t < cfg_threads; ++t )
+    pthread_join(threads[t], NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  free(threads);
+
+  secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  mops = (double) cfg_threads * cfg_iters * cfg_burst / secs / 1e6;
+  printf("%-8s %10.2f Mallocs/s  %6.2f ns/alloc+free per thread\n",
+         name, mops, secs * 1e9 / ((double) cfg_iters * cfg_burst));
+  return mops;
+}
+
+
+static void simple_init(void)
+{
+  size_t bytes = (size_t) cfg_bufs * PKT_BUF_SIZE;
+  unsigned i;
+
+  simple.mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  TEST(simple.mem != MAP_FAILED);
+  pthread_mutex_init(&simple.lock, NULL);
+  for( i = 0; i < cfg_bufs; ++i ) {
+    struct pkt_buf* pb = (void*) ((char*) simple.mem + i * PKT_BUF_SIZE);
+    pb->id = i;
+    simple_free(pb);
+  }
+}
+
+
+static void usage(const char* fmt, ...) __attribute__((noreturn));
+
+static void usage(const char* fmt, ...)
+{
+  if( fmt ) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+  }
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  efpktpool_bench [options]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -t <threads>     - number of threads (default 1)\n");
+  fprintf(stderr, "  -n <bufs>        - number of buffers (default 65536)\n");
+  fprintf(stderr, "  -b <burst>       - buffers per burst (default 32)\n");
+  fprintf(stderr, "  -c <cache>       - per-thread cache size (default 256)\n");
+  fprintf(stderr, "  -i <iterations>  - bursts per thread (default 1000000)\n");
+  fprintf(stderr, "  -N <node>        - NUMA node for the pool\n");
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+int main(int argc, char* argv[])
+{
+  ef_pktpool_attr attr;
+  int c;
+
+  while( (c = getopt(argc, argv, "t:n:b:c:i:N:")) != -1 )
+    switch( c ) {
+    case 't':
+      cfg_threads = atoi(optarg);
+      break;
+    case 'n':
+      cfg_bufs = atoi(optarg);
+      break;
+    case 'b':
+      cfg_burst = atoi(optarg);
+      break;
+    case 'c':
+      cfg_cache = atoi(optarg);
+      break;
+    case 'i':
+      cfg_iters = strtoul(optarg, NULL, 0);
+      break;
+    case 'N':
+      cfg_numa = atoi(optarg);
+      break;
+    default:
+      usage(NULL);
+    }
+  if( optind != argc )
+    usage(NULL);
+  if( cfg_threads == 0 || cfg_burst == 0 || cfg_cache < 2 )
+    usage("threads, burst and cache must be non-zero");
+  /* Leave each thread room for a full burst plus a full cache. */
+  if( (unsigned long) cfg_threads * (cfg_burst + cfg_cache) > cfg_bufs )
+    usage("Need at least threads * (burst + cache) buffers");
+
+  simple_init();
+  ef_pktpool_attr_init(&attr, cfg_bufs);
+  attr.buf_size = PKT_BUF_SIZE;
+  attr.numa_node = cfg_numa;
+  TRY(ef_pktpool_alloc(&pool, &attr));
+
+  printf("# threads=%u bufs=%u burst=%u cache=%u iters=%lu huge_pages=%d\n",
+         cfg_threads, cfg_bufs, cfg_burst, cfg_cache, cfg_iters,
+         pool->huge_pages);
+  run("simple", simple_thread);
+  run("pktpool", pool_thread);
+
+  ef_pktpool_free(pool);
+  munmap(simple.mem, (size_t) cfg_bufs * PKT_BUF_SIZE);
+  return 0;
+}
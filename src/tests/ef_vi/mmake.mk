@@ -4,7 +4,7 @@
 EFSEND_APPS := efsend efsend_pio efsend_timestamping efsend_pio_warm
 TEST_APPS	:= efforward efrss efsink \
 		   efsink_packed efforward_packed eflatency efexclusivity stats \
-		   efjumborx $(EFSEND_APPS)
+		   efjumborx efpktpool_bench $(EFSEND_APPS)
 
 ifeq (${PLATFORM},gnu_x86_64)
 	TEST_APPS += efrink_controller efrink_consumer
@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+
+/* This test checks how the --multi-ns server opens the network namespaces
+ * it is asked to serve: the namespace must be the one the driver named even
+ * if the pid it gave has been reused, and the helper process which does the
+ * opening must pass the fd back and go away with the server. */
+
+#include "cplane_unit.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "../../tap/tap.h"
+
+
+static ci_uint32 netns_ino(int fd)
+{
+  struct stat ns_stat;
+  CP_TRY(fstat(fd, &ns_stat));
+  return ns_stat.st_ino;
+}
+
+
+static ci_uint32 self_netns_ino(void)
+{
+  struct stat ns_stat;
+  CP_TRY(stat("/proc/self/ns/net", &ns_stat));
+  return ns_stat.st_ino;
+}
+
+
+/* Returns the pid of a process which has exited. */
+static pid_t dead_pid(void)
+{
+  pid_t pid = fork();
+  CP_TRY(pid);
+  if( pid == 0 )
+    _exit(0);
+  CP_TRY(waitpid(pid, NULL, 0));
+  return pid;
+}
+
+
+#define OPEN_TEST_COUNT 4
+static void test_open(void)
+{
+  ci_uint32 ino = self_netns_ino();
+  int fd;
+
+  fd = cp_netns_open(getpid(), ino);
+  ok(fd >= 0 && netns_ino(fd) == ino, "Open namespace by pid and inode");
+  if( fd >= 0 )
+    close(fd);
+
+  fd = cp_netns_open(getpid(), 0);
+  ok(fd >= 0 && netns_ino(fd) == ino, "Open namespace with unknown inode");
+  if( fd >= 0 )
+    close(fd);
+
+  /* The pid has been reused by a process in another namespace. */
+  fd = cp_netns_open(getpid(), ino + 1);
+  cmp_ok(fd, "==", -ESRCH, "Refuse namespace with the wrong inode");
+
+  fd = cp_netns_open(dead_pid(), ino);
+  cmp_ok(fd, "==", -ENOENT, "Fail for a process which has gone");
+}
+
+
+#define OPENER_TEST_COUNT 4
+static void test_opener(void)
+{
+  ci_uint32 ino = self_netns_ino();
+  int status;
+  pid_t pid;
+  int sv[2];
+  int fd;
+
+  CP_TRY(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv));
+  pid = fork();
+  CP_TRY(pid);
+  if( pid == 0 ) {
+    close(sv[0]);
+    cp_netns_opener_run(sv[1]);
+    _exit(0);
+  }
+  close(sv[1]);
+
+  fd = cp_netns_opener_request(sv[0], getpid(), ino);
+  ok(fd >= 0 && netns_ino(fd) == ino, "Opener passes namespace fd");
+  if( fd >= 0 )
+    close(fd);
+
+  fd = cp_netns_opener_request(sv[0], getpid(), ino + 1);
+  cmp_ok(fd, "==", -ESRCH, "Opener refuses namespace with the wrong inode");
+
+  fd = cp_netns_opener_request(sv[0], dead_pid(), ino);
+  cmp_ok(fd, "==", -ENOENT, "Opener fails for a process which has gone");
+
+  /* The opener exits when the server closes its end. */
+  close(sv[0]);
+  CP_TRY(waitpid(pid, &status, 0));
+  ok(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+     "Opener exits with the server");
+}
+
+
+int main(void)
+{
+  plan(OPEN_TEST_COUNT + OPENER_TEST_COUNT);
+
+  test_open();
+  test_opener();
+
+  done_testing();
+}
@@ -0,0 +1,213 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+/*
+ * Round trip of a TCP connection through onload_checkpoint() and
+ * onload_restore().
+ *
+ * Build the file using the following command:
+ *   $ gcc -lonload_ext -o onload_checkpoint onload_checkpoint.c
+ *
+ * Start an echo server without onload:
+ *   $ ./onload_checkpoint server <port>
+ *
+ * Then, on the same host or another, connect to it over an accelerated
+ * interface:
+ *   $ onload ./onload_checkpoint client <server_ip> <port>
+ *
+ * onload_checkpoint_veth.sh does both on a single host, with no network
+ * adapter, over a veth pair accelerated with AF_XDP.
+ *
+ * The client sends a message, leaves the echo unread and checkpoints the
+ * connection.  A child process which does not accelerate its sockets then
+ * fails to restore it, and the client checks that the connection has been
+ * handed back to it.  Finally the client checkpoints the connection again
+ * and re-executes itself.  The new image restores the connection onto the
+ * same fd, reads the echo that was received before the checkpoint and
+ * checks that the connection still works.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <onload/extensions.h>
+
+#define MSG_LEN  16
+
+#define TRY(x)                                                  \
+  do {                                                          \
+    if( (x) < 0 ) {                                             \
+      fprintf(stderr, "ERROR: %s failed at line %d\n", #x,      \
+              __LINE__);                                        \
+      perror("");                                               \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+
+static void do_server(int port)
+{
+  struct sockaddr_in sa;
+  char buf[MSG_LEN];
+  int sl, s, one = 1;
+  ssize_t n;
+
+  TRY(sl = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(setsockopt(sl, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_ANY);
+  sa.sin_port = htons(port);
+  TRY(bind(sl, (struct sockaddr*) &sa, sizeof(sa)));
+  TRY(listen(sl, 1));
+  while( 1 ) {
+    TRY(s = accept(sl, NULL, NULL));
+    while( (n = recv(s, buf, sizeof(buf), MSG_WAITALL)) == sizeof(buf) )
+      TRY(send(s, buf, n, 0));
+    close(s);
+  }
+}
+
+
+static void ping(int s, int i, int wait_echo)
+{
+  char msg[MSG_LEN], buf[MSG_LEN];
+
+  snprintf(msg, sizeof(msg), "ping %d", i);
+  TRY(send(s, msg, sizeof(msg), 0));
+  if( ! wait_echo )
+    return;
+  if( recv(s, buf, sizeof(buf), MSG_WAITALL) != sizeof(buf) ||
+      memcmp(msg, buf, sizeof(buf)) ) {
+    fprintf(stderr, "ERROR: bad echo for '%s'\n", msg);
+    exit(1);
+  }
+}
+
+
+static void expect_echo(int s, int i)
+{
+  char msg[MSG_LEN], buf[MSG_LEN];
+
+  snprintf(msg, sizeof(msg), "ping %d", i);
+  if( recv(s, buf, sizeof(buf), MSG_WAITALL) != sizeof(buf) ||
+      memcmp(msg, buf, sizeof(buf)) ) {
+    fprintf(stderr, "ERROR: receive queue not restored\n");
+    exit(1);
+  }
+}
+
+
+/* Check that a failed restore leaves the connection with us. */
+static void failed_restore(int s)
+{
+  char path[] = "/tmp/onload_checkpoint.XXXXXX";
+  int cfd, status, fds[1];
+  pid_t pid;
+
+  ping(s, 1, 0);
+  usleep(100000);
+  TRY(cfd = mkstemp(path));
+  unlink(path);
+  TRY(onload_checkpoint(cfd, &s, 1));
+  TRY(lseek(cfd, 0, SEEK_SET));
+
+  /* A socket that isn't accelerated can't take over the connection. */
+  TRY(pid = fork());
+  if( pid == 0 ) {
+    TRY(onload_set_stackname(ONLOAD_ALL_THREADS, ONLOAD_SCOPE_GLOBAL,
+                             ONLOAD_DONT_ACCELERATE));
+    if( onload_restore(cfd, fds, 1, 0) != -1 || errno != EOPNOTSUPP ) {
+      fprintf(stderr, "ERROR: restore to a kernel socket didn't fail\n");
+      exit(1);
+    }
+    exit(0);
+  }
+  TRY(waitpid(pid, &status, 0));
+  if( ! WIFEXITED(status) || WEXITSTATUS(status) != 0 )
+    exit(1);
+  close(cfd);
+
+  expect_echo(s, 1);
+  ping(s, 2, 1);
+  printf("Failed restore handed back fd %d\n", s);
+}
+
+
+static void do_client(char* self, const char* ip, int port)
+{
+  struct sockaddr_in sa;
+  char path[] = "/tmp/onload_checkpoint.XXXXXX";
+  char fd_str[16], s_str[16];
+  int s, cfd;
+
+  TRY(s = socket(AF_INET, SOCK_STREAM, 0));
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = inet_addr(ip);
+  sa.sin_port = htons(port);
+  TRY(connect(s, (struct sockaddr*) &sa, sizeof(sa)));
+
+  ping(s, 0, 1);
+  failed_restore(s);
+  /* Leave this echo in the receive queue. */
+  ping(s, 3, 0);
+  usleep(100000);
+
+  TRY(cfd = mkstemp(path));
+  TRY(onload_checkpoint(cfd, &s, 1));
+  printf("Checkpointed fd %d to %s\n", s, path);
+  TRY(lseek(cfd, 0, SEEK_SET));
+
+  /* The frozen socket stays open across exec until it is replaced. */
+  snprintf(fd_str, sizeof(fd_str), "%d", cfd);
+  snprintf(s_str, sizeof(s_str), "%d", s);
+  execl(self, self, "restore", fd_str, path, s_str, NULL);
+  perror("execl");
+  exit(1);
+}
+
+
+static void do_restore(int cfd, const char* path, int s)
+{
+  int fds[1];
+
+  if( onload_restore(cfd, fds, 1, ONLOAD_RESTORE_SAME_FD) != 1 ) {
+    perror("onload_restore");
+    exit(1);
+  }
+  close(cfd);
+  unlink(path);
+  printf("Restored fd %d\n", fds[0]);
+  if( fds[0] != s ) {
+    fprintf(stderr, "ERROR: restored onto fd %d, expected %d\n", fds[0], s);
+    exit(1);
+  }
+
+  expect_echo(s, 3);
+  ping(s, 4, 1);
+  close(s);
+  printf("PASS\n");
+  exit(0);
+}
+
+
+int main(int argc, char* argv[])
+{
+  if( argc == 3 && ! strcmp(argv[1], "server") )
+    do_server(atoi(argv[2]));
+  else if( argc == 4 && ! strcmp(argv[1], "client") )
+    do_client(argv[0], argv[2], atoi(argv[3]));
+  else if( argc == 5 && ! strcmp(argv[1], "restore") )
+    do_restore(atoi(argv[2]), argv[3], atoi(argv[4]));
+  else
+    fprintf(stderr, "usage: %s server <port> | client <ip> <port>\n",
+            argv[0]);
+  return 1;
+}
@@ -0,0 +1,46 @@
+#!/bin/bash
+# SPDX-License-Identifier: BSD-2-Clause
+# X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc.
+#
+# Run onload_checkpoint on a single host with no network adapter.
+#
+# The echo server runs in its own network namespace at the far end of a
+# veth pair, and the client is accelerated over the near end with AF_XDP.
+# Needs root and the Onload drivers loaded.
+#
+#   $ ./onload_checkpoint_veth.sh [port]
+
+set -e
+
+PORT=${1:-7777}
+NS=oo_checkpoint
+IF=oo_ckpt0
+PEER_IF=oo_ckpt1
+ADDR=192.168.251.1
+PEER_ADDR=192.168.251.2
+HERE=$(dirname "$0")
+
+cleanup() {
+  [ -n "$SERVER" ] && kill "$SERVER" 2>/dev/null
+  echo "$IF" >/sys/module/sfc_resource/afxdp/unregister 2>/dev/null
+  ip link del "$IF" 2>/dev/null
+  ip netns del "$NS" 2>/dev/null
+}
+trap cleanup EXIT
+
+ip netns add "$NS"
+ip link add "$IF" type veth peer name "$PEER_IF" netns "$NS"
+ip addr add "$ADDR/24" dev "$IF"
+ip link set "$IF" up
+ip -n "$NS" addr add "$PEER_ADDR/24" dev "$PEER_IF"
+ip -n "$NS" link set "$PEER_IF" up
+ip -n "$NS" link set lo up
+
+ulimit -l unlimited
+echo "$IF" >/sys/module/sfc_resource/afxdp/register
+
+ip netns exec "$NS" "$HERE/onload_checkpoint" server "$PORT" &
+SERVER=$!
+sleep 1
+
+onload "$HERE/onload_checkpoint" client "$PEER_ADDR" "$PORT"
@@ -33,6 +33,7 @@ extern int __test_sanity(int no5tuple);
 extern int test_sanity(void);
 extern int test_sanity_no5tuple(void);
 extern int test_multicast_sanity(void);
+extern int test_multicast_scale(void);
 extern int test_namespace_sanity(void);
 extern int test_namespace_macvlan_move(void);
 
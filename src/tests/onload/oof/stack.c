@@ -154,6 +154,16 @@ int ooft_endpoint_mcast_add(struct ooft_endpoint* ep, unsigned group,
 }
 
 
+int ooft_endpoint_mcast_add_bulk(struct ooft_endpoint* ep,
+                                 const unsigned* groups, int n_groups,
+                                 struct ooft_ifindex* idx, int* n_added)
+{
+  return oof_socket_mcast_add_bulk(ep->thr->ofn->ofn_filter_manager,
+                                   &ep->skf, groups, n_groups, idx->id,
+                                   n_added);
+}
+
+
 /* ---------------------------------------
  * Functions to handle test SW filters
  * --------------------------------------- */
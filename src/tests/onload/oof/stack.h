@@ -92,6 +92,10 @@ extern int ooft_endpoint_add(struct ooft_endpoint* ep, int flags);
 extern int ooft_endpoint_add_wild(struct ooft_endpoint* ep, int flags);
 extern int ooft_endpoint_mcast_add(struct ooft_endpoint* ep, unsigned group,
                                    struct ooft_ifindex* idx);
+extern int ooft_endpoint_mcast_add_bulk(struct ooft_endpoint* ep,
+                                        const unsigned* groups, int n_groups,
+                                        struct ooft_ifindex* idx,
+                                        int* n_added);
 int ooft_endpoint_udp_connect(struct ooft_endpoint* ep, int flags);
 
 /* ---------------------------------------
@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+
+/* Joins a large number of groups on a pair of sockets, one group at a
+ * time on the first and in a single batch on the second, and reports how
+ * long each took.  The number of groups can be set with
+ * OOFT_MCAST_GROUPS.
+ */
+
+#include "../onload_kernel_compat.h"
+#include "../stack.h"
+#include "../../tap/tap.h"
+#include "../oof_test.h"
+#include "../cplane.h"
+#include "../utils.h"
+#include <onload/oof_interface.h>
+#include <onload/oof_onload.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+#define OOFT_MCAST_GROUPS_DEFAULT 1024
+
+
+static double elapsed_us(const struct timespec* start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1e6 +
+         (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+
+int test_multicast_scale(void)
+{
+  tcp_helper_resource_t* thr1;
+  struct ooft_endpoint* e1;
+  struct ooft_endpoint* e2;
+  struct ooft_ifindex* idx;
+  struct timespec start;
+  unsigned* groups;
+  const char* s;
+  int n_groups = OOFT_MCAST_GROUPS_DEFAULT;
+  int i, n_added, rc, rc1;
+
+  if( (s = getenv("OOFT_MCAST_GROUPS")) != NULL && atoi(s) > 0 )
+    n_groups = atoi(s);
+
+  new_test();
+  plan(11);
+
+  test_alloc(32);
+
+  thr1 = ooft_alloc_stack(64);
+
+  TRY(ooft_default_cplane_init(current_ns()));
+
+  groups = malloc(n_groups * sizeof(*groups));
+  TEST(groups);
+  for( i = 0; i < n_groups; ++i )
+    groups[i] = htonl(0xe6000000 | (i + 1));   /* 230.0.0.x */
+
+  e1 = ooft_alloc_endpoint(thr1, IPPROTO_UDP, INADDR_ANY, htons(2000),
+                           INADDR_ANY, 0);
+  e2 = ooft_alloc_endpoint(thr1, IPPROTO_UDP, INADDR_ANY, htons(2001),
+                           INADDR_ANY, 0);
+
+  ooft_endpoint_expect_unicast_filters(e1, 1);
+  rc = ooft_endpoint_add(e1, 0);
+  cmp_ok(rc, "==", 0, "add endpoint 1");
+  ooft_endpoint_expect_unicast_filters(e2, 1);
+  rc = ooft_endpoint_add(e2, 0);
+  cmp_ok(rc, "==", 0, "add endpoint 2");
+
+  idx = IDX_FROM_CP_LINK(ci_dllist_head(&cp->idxs));
+
+  for( i = 0; i < n_groups; ++i )
+    ooft_endpoint_expect_multicast_filters(e1, idx, groups[i]);
+  rc = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for( i = 0; i < n_groups && rc == 0; ++i )
+    rc = ooft_endpoint_mcast_add(e1, groups[i], idx);
+  diag("%d single joins: %.0f us", n_groups, elapsed_us(&start));
+  cmp_ok(rc, "==", 0, "mcast add endpoint 1");
+
+  for( i = 0; i < n_groups; ++i )
+    ooft_endpoint_expect_multicast_filters(e2, idx, groups[i]);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  rc = ooft_endpoint_mcast_add_bulk(e2, groups, n_groups, idx, &n_added);
+  diag("%d bulk joins: %.0f us", n_groups, elapsed_us(&start));
+  cmp_ok(rc, "==", 0, "bulk mcast add endpoint 2");
+  cmp_ok(n_added, "==", n_groups, "bulk mcast add count");
+
+  rc = ooft_endpoint_check_sw_filters(e1);
+  rc |= ooft_endpoint_check_sw_filters(e2);
+  cmp_ok(rc, "==", 0, "check sw filters");
+  rc = ooft_ns_check_hw_filters(thr1->ns);
+  cmp_ok(rc, "==", 0, "check hw filters");
+
+  /* Re-joining is a no-op, and the batch stops at a bad address. */
+  groups[n_groups - 1] = inet_addr("10.0.0.1");
+  rc = ooft_endpoint_mcast_add_bulk(e2, groups, n_groups, idx, &n_added);
+  rc1 = ooft_ns_check_hw_filters(thr1->ns);
+  cmp_ok(rc, "==", -EINVAL, "bulk mcast add rejects unicast address");
+  cmp_ok(rc1, "==", 0, "check hw filters unchanged");
+
+  ooft_endpoint_expect_sw_remove_all(e1);
+  ooft_endpoint_expect_sw_remove_all(e2);
+  ooft_cplane_expect_hw_remove_all(cp);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  oof_socket_del(thr1->ofn->ofn_filter_manager, &e1->skf);
+  oof_socket_del(thr1->ofn->ofn_filter_manager, &e2->skf);
+  diag("%d leaves: %.0f us", 2 * n_groups, elapsed_us(&start));
+
+  rc = ooft_endpoint_check_sw_filters(e1);
+  rc |= ooft_endpoint_check_sw_filters(e2);
+  cmp_ok(rc, "==", 0, "check sw filters");
+  rc = ooft_ns_check_hw_filters(thr1->ns);
+  cmp_ok(rc, "==", 0, "check hw filters");
+
+  free(groups);
+  ooft_free_stack(thr1);
+  test_cleanup();
+
+  done_testing();
+}
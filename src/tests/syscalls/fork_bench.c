@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+/* fork_bench
+ *
+ * Measure fork() and fork()+exec() latency against the number of open
+ * sockets.  For each fd count the process opens TCP sockets (accelerated
+ * when run under onload) until it has that many, and then times:
+ *
+ *   fork      fork() in the parent until the child has exited and been
+ *             reaped; the child calls _exit() straight away
+ *   exec      as fork, but the child execs /bin/true
+ *
+ *   fork_bench [-i iterations] [fd_count ...]
+ *   onload fork_bench [-i iterations] [fd_count ...]
+ *
+ * The default fd counts are 0 100 1000 10000.  The soft RLIMIT_NOFILE is
+ * raised to the hard limit if needed.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+
+static unsigned iters = 100;
+static int n_socks;
+
+
+static double now_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+static int open_socks(int n)
+{
+  while( n_socks < n ) {
+    if( socket(AF_INET, SOCK_STREAM, 0) < 0 ) {
+      perror("fork_bench: socket");
+      return -1;
+    }
+    ++n_socks;
+  }
+  return 0;
+}
+
+
+static double time_fork(int do_exec)
+{
+  static char* const argv[] = { "true", NULL };
+  double start, total = 0;
+  unsigned i;
+  pid_t pid;
+  int status;
+
+  for( i = 0; i < iters; ++i ) {
+    start = now_us();
+    pid = fork();
+    if( pid == 0 ) {
+      if( do_exec )
+        execv("/bin/true", argv);
+      _exit(0);
+    }
+    if( pid < 0 ) {
+      perror("fork_bench: fork");
+      exit(1);
+    }
+    waitpid(pid, &status, 0);
+    total += now_us() - start;
+  }
+  return total / iters;
+}
+
+
+int main(int argc, char* argv[])
+{
+  static const int default_counts[] = { 0, 100, 1000, 10000 };
+  struct rlimit rl;
+  int c, i, n, max_fds = 0;
+
+  while( (c = getopt(argc, argv, "i:")) != -1 )
+    switch( c ) {
+    case 'i':
+      iters = strtoul(optarg, NULL, 0);
+      break;
+    default:
+      iters = 0;
+      break;
+    }
+  if( iters == 0 ) {
+    fprintf(stderr, "usage: fork_bench [-i iterations] [fd_count ...]\n");
+    return 1;
+  }
+
+  n = optind < argc ? argc - optind : 4;
+  for( i = 0; i < n; ++i ) {
+    int count = optind < argc ? atoi(argv[optind + i]) : default_counts[i];
+    if( count > max_fds )
+      max_fds = count;
+  }
+  if( getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < max_fds + 64 ) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+
+  printf("# iterations=%u\n", iters);
+  printf("#%-7s %10s %10s\n", "fds", "fork_us", "exec_us");
+  for( i = 0; i < n; ++i ) {
+    int count = optind < argc ? atoi(argv[optind + i]) : default_counts[i];
+    if( open_socks(count) < 0 )
+      return 1;
+    printf("%-8d %10.1f %10.1f\n", n_socks, time_fork(0), time_fork(1));
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,141 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+/* intercept_bench
+ *
+ * Measure the cost of each intercepted entry point on a descriptor that
+ * Onload does not accelerate.  Each call is made through libc, so is
+ * intercepted when run under onload, and then directly with syscall(2),
+ * which is not.  The difference is the interception overhead per call.
+ *
+ *   intercept_bench [iterations]
+ *   onload intercept_bench [iterations]
+ *
+ * The calls are chosen to return immediately: zero-length reads and
+ * writes on a pipe, and non-blocking sends and receives on an AF_UNIX
+ * datagram socket pair with nothing queued.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+
+static unsigned long iters = 1000000;
+static int rd, wr, s, peer;
+static char buf[1];
+static volatile long rc;
+static struct iovec iov = { buf, 0 };
+static struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+
+/* Zero-length datagrams are queued at the peer, so the send tests drain
+ * them again with a raw receive, which is included in both timings. */
+static void drain(void)
+{
+  rc = syscall(SYS_recvfrom, peer, buf, 1, MSG_DONTWAIT, NULL, NULL);
+}
+
+static void libc_read(void)     { rc = read(rd, buf, 0); }
+static void raw_read(void)      { rc = syscall(SYS_read, rd, buf, 0); }
+static void libc_write(void)    { rc = write(wr, buf, 0); }
+static void raw_write(void)     { rc = syscall(SYS_write, wr, buf, 0); }
+static void libc_readv(void)    { rc = readv(rd, &iov, 1); }
+static void raw_readv(void)     { rc = syscall(SYS_readv, rd, &iov, 1); }
+static void libc_writev(void)   { rc = writev(wr, &iov, 1); }
+static void raw_writev(void)    { rc = syscall(SYS_writev, wr, &iov, 1); }
+static void libc_recv(void)     { rc = recv(s, buf, 1, MSG_DONTWAIT); }
+static void libc_recvfrom(void)
+  { rc = recvfrom(s, buf, 1, MSG_DONTWAIT, NULL, NULL); }
+static void raw_recvfrom(void)
+  { rc = syscall(SYS_recvfrom, s, buf, 1, MSG_DONTWAIT, NULL, NULL); }
+static void libc_recvmsg(void)  { rc = recvmsg(s, &msg, MSG_DONTWAIT); }
+static void raw_recvmsg(void)
+  { rc = syscall(SYS_recvmsg, s, &msg, MSG_DONTWAIT); }
+static void libc_send(void)
+  { rc = send(s, buf, 0, MSG_DONTWAIT); drain(); }
+static void libc_sendto(void)
+  { rc = sendto(s, buf, 0, MSG_DONTWAIT, NULL, 0); drain(); }
+static void raw_sendto(void)
+  { rc = syscall(SYS_sendto, s, buf, 0, MSG_DONTWAIT, NULL, 0); drain(); }
+static void libc_sendmsg(void)
+  { rc = sendmsg(s, &msg, MSG_DONTWAIT); drain(); }
+static void raw_sendmsg(void)
+  { rc = syscall(SYS_sendmsg, s, &msg, MSG_DONTWAIT); drain(); }
+
+
+static const struct {
+  const char* name;
+  void (*libc_fn)(void);
+  void (*raw_fn)(void);
+} benches[] = {
+  { "read",     libc_read,     raw_read },
+  { "write",    libc_write,    raw_write },
+  { "readv",    libc_readv,    raw_readv },
+  { "writev",   libc_writev,   raw_writev },
+  { "recv",     libc_recv,     raw_recvfrom },
+  { "recvfrom", libc_recvfrom, raw_recvfrom },
+  { "recvmsg",  libc_recvmsg,  raw_recvmsg },
+  { "send",     libc_send,     raw_sendto },
+  { "sendto",   libc_sendto,   raw_sendto },
+  { "sendmsg",  libc_sendmsg,  raw_sendmsg },
+};
+
+
+static double ns_per_call(void (*fn)(void))
+{
+  struct timespec start, end;
+  unsigned long i;
+
+  for( i = 0; i < iters / 100; ++i )
+    fn();
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for( i = 0; i < iters; ++i )
+    fn();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return ((end.tv_sec - start.tv_sec) * 1e9 +
+          (end.tv_nsec - start.tv_nsec)) / iters;
+}
+
+
+int main(int argc, char* argv[])
+{
+  int pipe_fds[2], sock_fds[2];
+  unsigned i;
+
+  if( argc > 1 )
+    iters = strtoul(argv[1], NULL, 0);
+  if( iters == 0 || argc > 2 ) {
+    fprintf(stderr, "usage: intercept_bench [iterations]\n");
+    return 1;
+  }
+  if( pipe(pipe_fds) < 0 ||
+      socketpair(AF_UNIX, SOCK_DGRAM, 0, sock_fds) < 0 ) {
+    perror("intercept_bench");
+    return 1;
+  }
+  rd = pipe_fds[0];
+  wr = pipe_fds[1];
+  s = sock_fds[0];
+  peer = sock_fds[1];
+
+  printf("# iterations=%lu\n", iters);
+  printf("#%-9s %8s %8s %8s\n", "call", "libc_ns", "raw_ns", "over_ns");
+  for( i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i ) {
+    double libc_ns = ns_per_call(benches[i].libc_fn);
+    double raw_ns = ns_per_call(benches[i].raw_fn);
+    printf("%-10s %8.1f %8.1f %8.1f\n", benches[i].name,
+           libc_ns, raw_ns, libc_ns - raw_ns);
+  }
+
+  close(s);
+  close(peer);
+  close(rd);
+  close(wr);
+  return 0;
+}
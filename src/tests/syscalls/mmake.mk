@@ -13,9 +13,13 @@ close		:= $(patsubst %,$(AppPattern),close)
 sendfile	:= $(patsubst %,$(AppPattern),sendfile)
 sendfile_clnt	:= $(patsubst %,$(AppPattern),sendfile_clnt)
 splice		:= $(patsubst %,$(AppPattern),splice)
+intercept_bench	:= $(patsubst %,$(AppPattern),intercept_bench)
+fork_bench	:= $(patsubst %,$(AppPattern),fork_bench)
+spin_wait_bench	:= $(patsubst %,$(AppPattern),spin_wait_bench)
 
 TARGETS	:= $(read) $(write) $(writev) $(printf) $(ci_log) $(dup) $(streams) \
-	   $(execve) $(close) $(splice)
+	   $(execve) $(close) $(splice) $(intercept_bench) $(fork_bench) \
+	   $(spin_wait_bench)
 
 ifeq ($(GNU),1)
 TARGETS	+= $(sendfile) $(sendfile_clnt)
@@ -32,6 +36,9 @@ $(ci_log): ci_log.o $(CITOOLS_LIB_DEPEND)
 $(dup): dup.o $(CITOOLS_LIB_DEPEND) $(CIAPP_LIB_DEPEND) $(LINK_CIUL_LIB_DEPEND)
 	libs="$(LINK_CIAPP_LIB) $(LINK_CIUL_LIB) $(LINK_CITOOLS_LIB) -ldl -lrt"; $(MMakeLinkCApp)
 
+$(spin_wait_bench): spin_wait_bench.o $(CITOOLS_LIB_DEPEND)
+	libs="$(LINK_CITOOLS_LIB) -lpthread"; $(MMakeLinkCApp)
+
 $(streams): streams.o $(CITOOLS_LIB_DEPEND) $(CIAPP_LIB_DEPEND)
 	libs="$(LINK_CIAPP_LIB) $(LINK_CITOOLS_LIB) -ldl -lrt"; $(MMakeLinkCApp)
 
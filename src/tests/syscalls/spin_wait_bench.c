@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+/* spin_wait_bench
+ *
+ * Measure how quickly a spinning thread notices a write to memory, for
+ * each of the ways a spin loop can wait (as used by EF_SPIN_LOW_POWER):
+ *
+ *   spin      re-read the word continuously
+ *   pause     re-read with a pause instruction between reads
+ *   monitor   arm a monitor on the word and wait in a low-power state
+ *             (UMWAIT, MWAITX or WFE, whichever the CPU supports)
+ *
+ * A writer thread stores the current frc (TSC) value into a shared word
+ * after a random gap, and the waiter records the frc value when it sees
+ * the write.  The wake latency is the difference, so the two threads
+ * should run on cores with synchronised timestamp counters.  "wakes" is
+ * the mean number of times the waiter looked at the word per write, which
+ * shows how often it left the low-power state early.
+ *
+ *   spin_wait_bench [-i iterations] [-g max_gap_usec] [-c waiter,writer]
+ */
+
+#define _GNU_SOURCE
+
+#include <ci/tools.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+
+enum { WAIT_SPIN, WAIT_PAUSE, WAIT_MONITOR };
+
+static unsigned iters = 10000;
+static unsigned max_gap_usec = 20;
+static int cpus[2] = { -1, -1 };
+static unsigned khz;
+static int monitor_mode = CI_MONITOR_NONE;
+
+static struct {
+  volatile ci_uint64 stamp CI_ALIGN(CI_CACHE_LINE_SIZE);
+  volatile unsigned ack CI_ALIGN(CI_CACHE_LINE_SIZE);
+} shared;
+
+
+static void pin(int cpu)
+{
+  cpu_set_t set;
+
+  if( cpu < 0 )
+    return;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if( pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0 )
+    fprintf(stderr, "spin_wait_bench: could not pin to CPU %d\n", cpu);
+}
+
+
+static void* writer(void* arg)
+{
+  unsigned i;
+  ci_uint64 start, now, gap;
+
+  pin(cpus[1]);
+  for( i = 0; i < iters; ++i ) {
+    while( shared.ack != i )
+      ci_spinloop_pause();
+    gap = (ci_uint64) (rand() % (max_gap_usec + 1)) * khz / 1000;
+    ci_frc64(&start);
+    do
+      ci_frc64(&now);
+    while( now - start < gap );
+    shared.stamp = now;
+  }
+  return NULL;
+}
+
+
+static void run(int how, const char* name)
+{
+  ci_uint64 seen, now, lat, min = ~0ull, max = 0, total = 0, wakes = 0;
+  ci_uint32 ticks = 100 * khz / 1000;
+  pthread_t tid;
+  unsigned i;
+
+  shared.ack = 0;
+  seen = shared.stamp;
+  if( pthread_create(&tid, NULL, writer, NULL) != 0 ) {
+    perror("spin_wait_bench: pthread_create");
+    exit(1);
+  }
+  for( i = 0; i < iters; ++i ) {
+    while( 1 ) {
+      ++wakes;
+      if( shared.stamp != seen )
+        break;
+      if( how == WAIT_PAUSE ) {
+        ci_spinloop_pause();
+      }
+      else if( how == WAIT_MONITOR ) {
+        ci_monitor_arm(monitor_mode, &shared.stamp);
+        if( shared.stamp != seen )
+          continue;
+        ci_frc64(&now);
+        ci_monitor_wait(monitor_mode, now, ticks);
+      }
+    }
+    ci_frc64(&now);
+    seen = shared.stamp;
+    lat = now - seen;
+    total += lat;
+    if( lat < min )
+      min = lat;
+    if( lat > max )
+      max = lat;
+    shared.ack = i + 1;
+  }
+  pthread_join(tid, NULL);
+
+  printf("%-8s %10.1f %10.1f %10.1f %8.1f\n", name,
+         min * 1e6 / khz, (double) total / iters * 1e6 / khz,
+         max * 1e6 / khz, (double) wakes / iters);
+  fflush(stdout);
+}
+
+
+int main(int argc, char* argv[])
+{
+  int c;
+
+  while( (c = getopt(argc, argv, "i:g:c:")) != -1 )
+    switch( c ) {
+    case 'i':
+      iters = strtoul(optarg, NULL, 0);
+      break;
+    case 'g':
+      max_gap_usec = strtoul(optarg, NULL, 0);
+      break;
+    case 'c':
+      if( sscanf(optarg, "%d,%d", &cpus[0], &cpus[1]) != 2 )
+        iters = 0;
+      break;
+    default:
+      iters = 0;
+      break;
+    }
+  if( iters == 0 || optind != argc ) {
+    fprintf(stderr, "usage: spin_wait_bench [-i iterations] "
+            "[-g max_gap_usec] [-c waiter,writer]\n");
+    return 1;
+  }
+  if( ci_get_cpu_khz(&khz) < 0 || khz == 0 ) {
+    fprintf(stderr, "spin_wait_bench: could not get CPU frequency\n");
+    return 1;
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  if( ci_cpu_has_feature("waitpkg") )
+    monitor_mode = CI_MONITOR_UMWAIT;
+  else if( ci_cpu_has_feature("mwaitx") )
+    monitor_mode = CI_MONITOR_MWAITX;
+#elif defined(__aarch64__)
+  if( ci_cpu_has_feature("wfe") )
+    monitor_mode = CI_MONITOR_WFE;
+#endif
+
+  pin(cpus[0]);
+  printf("# iterations=%u max_gap_usec=%u\n", iters, max_gap_usec);
+  printf("#%-7s %10s %10s %10s %8s\n",
+         "wait", "min_ns", "mean_ns", "max_ns", "wakes");
+  run(WAIT_SPIN, "spin");
+  run(WAIT_PAUSE, "pause");
+  if( monitor_mode != CI_MONITOR_NONE )
+    run(WAIT_MONITOR, "monitor");
+  else
+    printf("# monitor: not supported by this CPU\n");
+  return 0;
+}
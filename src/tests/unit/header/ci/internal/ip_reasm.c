@@ -0,0 +1,493 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+
+/* Functions under test */
+#include <ci/internal/ip_reasm.h>
+
+/* Test infrastructure */
+#include "unit_test.h"
+#include "ip_reasm_frags.h"
+
+#define MAX_FRAMES  (CI_IP_REASM_MAX_FRAGS + 8)
+#define FRAME_DATA  1480
+
+/* An IPv4 fragment as it would appear on the wire */
+struct frame {
+  ci_ip4_hdr ip;
+  char data[FRAME_DATA];
+};
+
+static struct frame frames[MAX_FRAMES];
+static char datagram[CI_IP_REASM_MAX_FRAGS * FRAME_DATA];
+static char output[CI_IP_REASM_MAX_FRAGS * FRAME_DATA];
+static ci_ip_reasm_state state;
+static ci_ip_reasm_entry table[CI_IP_REASM_MAX];
+
+
+static void reset(void)
+{
+  memset(&state, 0, sizeof(state));
+  memset(table, 0, sizeof(table));
+}
+
+
+static void make_datagram(int len)
+{
+  int i;
+  for( i = 0; i < len; ++i )
+    datagram[i] = i * 7 + (i >> 8);
+}
+
+
+/* Fill in frame [i] with [len] bytes of [datagram] at [off]. */
+static void make_frame(int i, ci_uint16 id, int off, int len, int more)
+{
+  struct frame* f = &frames[i];
+
+  memset(&f->ip, 0, sizeof(f->ip));
+  f->ip.ip_ihl_version = CI_IP4_IHL_VERSION(sizeof(ci_ip4_hdr));
+  f->ip.ip_tot_len_be16 = CI_BSWAP_BE16(sizeof(ci_ip4_hdr) + len);
+  f->ip.ip_id_be16 = CI_BSWAP_BE16(id);
+  f->ip.ip_frag_off_be16 = CI_IP4_MAKE_OFFSET(off);
+  if( more )
+    CI_IP4_SET_FRAG_MORE(&f->ip);
+  f->ip.ip_ttl = 64;
+  f->ip.ip_protocol = IPPROTO_UDP;
+  f->ip.ip_saddr_be32 = CI_BSWAPC_BE32(0xc0a80001);
+  f->ip.ip_daddr_be32 = CI_BSWAPC_BE32(0xc0a80002);
+  memcpy(f->data, datagram + off, len);
+}
+
+
+/* Split a [len] byte datagram into frames of at most [mtu_data] bytes.
+ * Returns the number of frames.
+ */
+static int fragment(ci_uint16 id, int len, int mtu_data)
+{
+  int n, off;
+
+  make_datagram(len);
+  for( n = 0, off = 0; off < len; ++n, off += mtu_data )
+    make_frame(n, id, off, CI_MIN(mtu_data, len - off),
+               off + mtu_data < len);
+  return n;
+}
+
+
+/* Parse frame [i] as the receive path does, and add it to the table. */
+static int rx_frame(int i, ci_iptime_t now, ci_ip_reasm_entry** e_out)
+{
+  const ci_ip4_hdr* ip = &frames[i].ip;
+  int tot_len = CI_BSWAP_BE16(ip->ip_tot_len_be16);
+  ci_ip_reasm_entry* e;
+  ci_ip_reasm_key key;
+  oo_pkt_p pp;
+
+  CHECK(ci_ip4_reasm_ok(ip, tot_len), ==, 1);
+  ci_ip_reasm_key_ip4(&key, ip);
+  e = ci_ip_reasm_find(&state, table, CI_IP_REASM_MAX, &key);
+  if( e == NULL ) {
+    e = ci_ip_reasm_victim(table, CI_IP_REASM_MAX);
+    if( e->in_use )
+      ci_ip_reasm_free(&state, e);
+    ci_ip_reasm_start(&state, e, &key, now + 1000);
+  }
+  *e_out = e;
+  OO_PP_INIT(NULL, pp, i);
+  return ci_ip_reasm_add(e, ci_ip4_frag_offset(ip),
+                         tot_len - sizeof(ci_ip4_hdr), ci_ip4_frag_more(ip),
+                         pp, CI_IP4_REASM_MAX_LEN);
+}
+
+
+static void expect_rx(int i, ci_iptime_t now, ci_ip_reasm_entry** e_out,
+                      int want)
+{
+  int rc = rx_frame(i, now, e_out);
+  CHECK(rc, ==, want);
+}
+
+
+static void expect_add(ci_ip_reasm_entry* e, unsigned off, unsigned len,
+                       int more, int want)
+{
+  oo_pkt_p pp;
+  int rc;
+
+  OO_PP_INIT(NULL, pp, 0);
+  rc = ci_ip_reasm_add(e, off, len, more, pp, CI_IP4_REASM_MAX_LEN);
+  CHECK(rc, ==, want);
+}
+
+
+/* Copy out the payload held by [e] as ci_ip_reasm_chain() would chain it,
+ * and check it against the original.
+ */
+static void check_payload(const ci_ip_reasm_entry* e, int len)
+{
+  int i, pos = 0;
+
+  for( i = 0; i < e->n_frags; ++i ) {
+    CHECK(e->frags[i].off, ==, pos);
+    memcpy(output + pos, frames[OO_PP_ID(e->frags[i].pkt)].data,
+           e->frags[i].len);
+    pos += e->frags[i].len;
+  }
+  CHECK(pos, ==, len);
+  CHECK_MEM(output, datagram, len);
+}
+
+
+static void run_order(const int* order, int n, int len)
+{
+  ci_ip_reasm_entry* e = NULL;
+  int i, rc;
+
+  reset();
+  for( i = 0; i < n; ++i ) {
+    rc = rx_frame(order[i], 0, &e);
+    CHECK(rc, ==, i == n - 1 ? CI_IP_REASM_COMPLETE : CI_IP_REASM_QUEUED);
+  }
+  CHECK(e->n_frags, ==, n);
+  check_payload(e, len);
+  ci_ip_reasm_free(&state, e);
+  CHECK(state.n_pending, ==, 0);
+}
+
+
+/* Fragments arriving in any order make up the same datagram */
+static void test_reorder(void)
+{
+  const int len = CI_IP_REASM_MAX_FRAGS * 1000 - 100;
+  int order[CI_IP_REASM_MAX_FRAGS];
+  unsigned seed = 1;
+  int i, j, t, n, iter;
+
+  n = fragment(1, len, 1000);
+  CHECK(n, ==, CI_IP_REASM_MAX_FRAGS);
+
+  for( i = 0; i < CI_IP_REASM_MAX_FRAGS; ++i )
+    order[i] = i;
+  run_order(order, n, len);
+  for( i = 0; i < n; ++i )
+    order[i] = n - 1 - i;
+  run_order(order, n, len);
+
+  for( iter = 0; iter < 100; ++iter ) {
+    for( i = n - 1; i > 0; --i ) {
+      seed = seed * 1103515245 + 12345;
+      j = (seed >> 16) % (i + 1);
+      t = order[i];
+      order[i] = order[j];
+      order[j] = t;
+    }
+    run_order(order, n, len);
+  }
+}
+
+
+/* An exact duplicate is dropped on its own */
+static void test_duplicate(void)
+{
+  const int len = 3000;
+  ci_ip_reasm_entry* e;
+  int n;
+
+  reset();
+  n = fragment(2, len, 1480);
+  CHECK(n, ==, 3);
+  expect_rx(1, 0, &e, CI_IP_REASM_QUEUED);
+  expect_rx(1, 0, &e, CI_IP_REASM_DUP);
+  expect_rx(2, 0, &e, CI_IP_REASM_QUEUED);
+  expect_rx(2, 0, &e, CI_IP_REASM_DUP);
+  expect_rx(0, 0, &e, CI_IP_REASM_COMPLETE);
+  CHECK(e->n_frags, ==, 3);
+  check_payload(e, len);
+}
+
+
+/* Overlapping fragments are rejected */
+static void test_overlap(void)
+{
+  ci_ip_reasm_entry* e;
+
+  reset();
+  make_datagram(64);
+  make_frame(0, 3, 0, 32, 1);
+  make_frame(1, 3, 24, 16, 1);   /* overlaps the end of frame 0 */
+  make_frame(2, 3, 32, 16, 1);
+  make_frame(3, 3, 40, 16, 1);   /* overlaps the start of frame 2 */
+  make_frame(4, 3, 0, 16, 1);    /* same offset as frame 0, shorter */
+  expect_rx(0, 0, &e, CI_IP_REASM_QUEUED);
+  expect_rx(1, 0, &e, CI_IP_REASM_BAD);
+  expect_rx(4, 0, &e, CI_IP_REASM_BAD);
+  /* The caller discards the datagram on BAD; an unchanged entry is left
+   * for it to do so.
+   */
+  CHECK(e->n_frags, ==, 1);
+  expect_rx(2, 0, &e, CI_IP_REASM_QUEUED);
+  expect_rx(3, 0, &e, CI_IP_REASM_BAD);
+  CHECK(e->n_frags, ==, 2);
+}
+
+
+/* Malformed fragments are rejected */
+static void test_bad_lengths(void)
+{
+  ci_ip_reasm_entry* e;
+  int i;
+
+  reset();
+  make_datagram(4000);
+  e = &table[0];
+  ci_ip_reasm_start(&state, e, &e->key, 0);
+
+  /* Empty, or not a multiple of 8 and not the last */
+  expect_add(e, 0, 0, 1, CI_IP_REASM_BAD);
+  expect_add(e, 0, 100, 1, CI_IP_REASM_BAD);
+  /* Past the largest datagram */
+  expect_add(e, 0xfff8, 16, 0, CI_IP_REASM_BAD);
+
+  /* Once the last fragment is seen, nothing may lie past its end, and no
+   * other fragment may claim to be last.
+   */
+  expect_add(e, 1000, 100, 0, CI_IP_REASM_QUEUED);
+  CHECK(e->total, ==, 1100);
+  expect_add(e, 1096, 8, 1, CI_IP_REASM_BAD);
+  expect_add(e, 0, 200, 0, CI_IP_REASM_BAD);
+  expect_add(e, 992, 8, 1, CI_IP_REASM_QUEUED);
+  ci_ip_reasm_free(&state, e);
+
+  /* The last fragment may not end before one already held */
+  ci_ip_reasm_start(&state, e, &e->key, 0);
+  expect_add(e, 800, 200, 1, CI_IP_REASM_QUEUED);
+  expect_add(e, 0, 100, 0, CI_IP_REASM_BAD);
+  ci_ip_reasm_free(&state, e);
+
+  /* Too many fragments */
+  ci_ip_reasm_start(&state, e, &e->key, 0);
+  for( i = 0; i < CI_IP_REASM_MAX_FRAGS; ++i )
+    expect_add(e, i * 8, 8, 1, CI_IP_REASM_QUEUED);
+  expect_add(e, i * 8, 8, 0, CI_IP_REASM_BAD);
+}
+
+
+/* A lost fragment leaves the datagram to time out */
+static void test_loss(void)
+{
+  ci_ip_reasm_entry* e;
+  ci_iptime_t expiry;
+  int n;
+
+  reset();
+  CHECK_FALSE(ci_ip_reasm_next_expiry(table, CI_IP_REASM_MAX, &expiry));
+  n = fragment(4, 4000, 1480);
+  CHECK(n, ==, 3);
+  expect_rx(0, 500, &e, CI_IP_REASM_QUEUED);
+  expect_rx(2, 600, &e, CI_IP_REASM_QUEUED);
+  CHECK(state.n_pending, ==, 1);
+  CHECK_TRUE(ci_ip_reasm_next_expiry(table, CI_IP_REASM_MAX, &expiry));
+  CHECK(expiry, ==, 1500);
+  CHECK(ci_ip_reasm_expired(e, 1499), ==, 0);
+  CHECK(ci_ip_reasm_expired(e, 1500), ==, 1);
+}
+
+
+/* Datagrams are told apart by IP ID, and when the table is full the one
+ * that would expire soonest gives way.
+ */
+static void test_table(void)
+{
+  ci_ip_reasm_entry* e[CI_IP_REASM_MAX + 1];
+  ci_ip_reasm_entry* e2;
+  int i;
+
+  reset();
+  make_datagram(16);
+  for( i = 0; i <= CI_IP_REASM_MAX; ++i )
+    make_frame(i, 100 + i, 0, 8, 1);
+  make_frame(CI_IP_REASM_MAX + 1, 100 + 1, 8, 8, 0);
+
+  /* Start entries with expiry times 1000..1015, but not in order */
+  for( i = 0; i < CI_IP_REASM_MAX; ++i )
+    expect_rx(i, (i * 5) % CI_IP_REASM_MAX, &e[i], CI_IP_REASM_QUEUED);
+  CHECK(state.n_pending, ==, CI_IP_REASM_MAX);
+  for( i = 1; i < CI_IP_REASM_MAX; ++i )
+    CHECK_TRUE(e[i] != e[0]);
+
+  /* The other half of datagram 1 finds it */
+  expect_rx(CI_IP_REASM_MAX + 1, 0, &e2, CI_IP_REASM_COMPLETE);
+  CHECK_TRUE(e2 == e[1]);
+  ci_ip_reasm_free(&state, e2);
+
+  /* A free entry is reused before anything is evicted */
+  CHECK_TRUE(ci_ip_reasm_victim(table, CI_IP_REASM_MAX) == e[1]);
+  expect_rx(1, 20, &e2, CI_IP_REASM_QUEUED);
+
+  /* Entry 0 has the earliest expiry, so a new datagram takes its place */
+  expect_rx(CI_IP_REASM_MAX, 20, &e2, CI_IP_REASM_QUEUED);
+  CHECK_TRUE(e2 == e[0]);
+  CHECK(state.n_pending, ==, CI_IP_REASM_MAX);
+}
+
+
+/* The fragments captured in ip_reasm_frags.h */
+#define PCAP_FRAMES    4
+#define PCAP_DATA_LEN  2000
+#define PCAP_UDP_LEN   (sizeof(ci_udp_hdr) + PCAP_DATA_LEN)
+
+struct pcap_frame {
+  const ci_uint8* ip;      /* IPv4 or IPv6 header */
+  int ip6;
+  const ci_uint8* payload; /* after the IP and any fragment header */
+  ci_ip_reasm_key key;
+  unsigned off;
+  unsigned len;
+  int more;
+};
+
+static struct pcap_frame pcap_frames[PCAP_FRAMES];
+
+
+/* Parse the capture as the receive path parses each frame. */
+static void pcap_parse(void)
+{
+  const ci_uint8* p = ip_reasm_frags_pcap + 24;  /* pcap file header */
+  const ci_uint8* end = ip_reasm_frags_pcap + sizeof(ip_reasm_frags_pcap);
+  struct pcap_frame* f;
+  ci_uint32 caplen;
+  int n = 0;
+
+  while( p < end ) {
+    memcpy(&caplen, p + 8, sizeof(caplen));
+    p += 16;  /* record header */
+    CHECK(n, <, PCAP_FRAMES);
+    f = &pcap_frames[n++];
+    f->ip = p + ETH_HLEN;
+    f->ip6 = p[12] == 0x86 && p[13] == 0xdd;
+    if( f->ip6 ) {
+      const ci_ip6_hdr* ip6 = (const void*) f->ip;
+      const ci_ip6_frag_hdr* fh = (const void*) (ip6 + 1);
+      int paylen = CI_BSWAP_BE16(ip6->payload_len);
+
+      CHECK(ip6->next_hdr, ==, CI_NEXTHDR_FRAGMENT);
+      CHECK(ci_ip6_reasm_ok(fh, paylen), ==, 1);
+      ci_ip_reasm_key_ip6(&f->key, ip6, fh);
+      f->payload = (const ci_uint8*) (fh + 1);
+      f->off = ci_ip6_frag_offset(fh);
+      f->len = paylen - sizeof(*fh);
+      f->more = ci_ip6_frag_more(fh);
+    }
+    else {
+      const ci_ip4_hdr* ip = (const void*) f->ip;
+      int tot_len = CI_BSWAP_BE16(ip->ip_tot_len_be16);
+
+      CHECK(ci_ip4_reasm_ok(ip, tot_len), ==, 1);
+      ci_ip_reasm_key_ip4(&f->key, ip);
+      f->payload = (const ci_uint8*) (ip + 1);
+      f->off = ci_ip4_frag_offset(ip);
+      f->len = tot_len - sizeof(*ip);
+      f->more = ci_ip4_frag_more(ip);
+    }
+    p += caplen;
+  }
+  CHECK(n, ==, PCAP_FRAMES);
+}
+
+
+static int pcap_rx(int i, ci_ip_reasm_entry** e_out)
+{
+  const struct pcap_frame* f = &pcap_frames[i];
+  ci_ip_reasm_entry* e;
+  oo_pkt_p pp;
+
+  e = ci_ip_reasm_find(&state, table, CI_IP_REASM_MAX, &f->key);
+  if( e == NULL ) {
+    e = ci_ip_reasm_victim(table, CI_IP_REASM_MAX);
+    CHECK(e->in_use, ==, 0);
+    ci_ip_reasm_start(&state, e, &f->key, 1000);
+  }
+  *e_out = e;
+  OO_PP_INIT(NULL, pp, i);
+  return ci_ip_reasm_add(e, f->off, f->len, f->more, pp,
+                         f->ip6 ? CI_IP6_REASM_MAX_LEN :
+                                  CI_IP4_REASM_MAX_LEN);
+}
+
+
+/* Check the UDP datagram held by [e] against what was sent. */
+static void pcap_check(ci_ip_reasm_entry* e, int ip6)
+{
+  const ci_udp_hdr* udp = (const void*) output;
+  int i, pos = 0;
+
+  make_datagram(PCAP_DATA_LEN);
+  for( i = 0; i < e->n_frags; ++i ) {
+    const struct pcap_frame* f = &pcap_frames[OO_PP_ID(e->frags[i].pkt)];
+    CHECK(f->ip6, ==, ip6);
+    CHECK(e->frags[i].off, ==, pos);
+    memcpy(output + pos, f->payload, e->frags[i].len);
+    pos += e->frags[i].len;
+  }
+  CHECK(e->total, ==, PCAP_UDP_LEN);
+  CHECK(pos, ==, PCAP_UDP_LEN);
+  CHECK(CI_BSWAP_BE16(udp->udp_source_be16), ==, 40000);
+  CHECK(CI_BSWAP_BE16(udp->udp_dest_be16), ==, 40001);
+  CHECK(CI_BSWAP_BE16(udp->udp_len_be16), ==, PCAP_UDP_LEN);
+  CHECK_MEM(output + sizeof(*udp), datagram, PCAP_DATA_LEN);
+  ci_ip_reasm_free(&state, e);
+}
+
+
+/* Replay the captured IPv4 and IPv6 fragments, interleaved, reordered and
+ * duplicated */
+static void test_pcap(void)
+{
+  /* Frames 0 and 1 are IPv4, 2 and 3 IPv6 */
+  static const int orders[][6] = {
+    { 0, 1, 2, 3, -1 },
+    { 0, 2, 1, 3, -1 },
+    { 3, 1, 2, 0, -1 },
+    { 2, 2, 1, 1, 3, 0 },
+  };
+  ci_ip_reasm_entry* e;
+  int held[PCAP_FRAMES];
+  int o, i, rc, f;
+
+  pcap_parse();
+  CHECK(pcap_frames[0].ip6, ==, 0);
+  CHECK(pcap_frames[2].ip6, ==, 1);
+  for( o = 0; o < sizeof(orders) / sizeof(orders[0]); ++o ) {
+    reset();
+    memset(held, 0, sizeof(held));
+    for( i = 0; i < 6 && orders[o][i] >= 0; ++i ) {
+      f = orders[o][i];
+      rc = pcap_rx(f, &e);
+      if( held[f] ) {
+        CHECK(rc, ==, CI_IP_REASM_DUP);
+      }
+      else if( held[f ^ 1] ) {
+        CHECK(rc, ==, CI_IP_REASM_COMPLETE);
+        pcap_check(e, pcap_frames[f].ip6);
+      }
+      else {
+        CHECK(rc, ==, CI_IP_REASM_QUEUED);
+      }
+      held[f] = 1;
+    }
+    CHECK(state.n_pending, ==, 0);
+  }
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_reorder);
+  TEST_RUN(test_duplicate);
+  TEST_RUN(test_overlap);
+  TEST_RUN(test_bad_lengths);
+  TEST_RUN(test_loss);
+  TEST_RUN(test_table);
+  TEST_RUN(test_pcap);
+  TEST_END();
+}
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+
+/* Functions under test */
+#include <ci/internal/irq_moderation.h>
+
+/* Test infrastructure */
+#include "unit_test.h"
+
+/* A 1GHz clock, so that one cycle is one nanosecond */
+#define KHZ       1000000
+#define RATE      20000
+#define MAX_USEC  128
+
+/* Deliver interrupts at [irq_rate] per second, each handling [batch]
+ * events, for [ms] milliseconds.  Returns the last moderation chosen.
+ */
+static unsigned run(ci_irqmod_state* s, ci_uint64* now, unsigned irq_rate,
+                    unsigned batch, unsigned ms)
+{
+  ci_uint64 gap = 1000000000ull / irq_rate;
+  ci_uint64 end = *now + ms * 1000000ull;
+  unsigned usec = 0;
+
+  for( ; *now < end; *now += gap )
+    usec = ci_irqmod_update(s, batch, *now, KHZ, RATE, MAX_USEC);
+  return usec;
+}
+
+static void test_irqmod_levels(void)
+{
+  CHECK(ci_irqmod_level_usec(0, 128), ==, 0);
+  CHECK(ci_irqmod_level_usec(1, 128), ==, 8);
+  CHECK(ci_irqmod_level_usec(CI_IRQMOD_LEVELS - 1, 128), ==, 128);
+  CHECK(ci_irqmod_level_usec(1, 2), ==, 1);
+}
+
+static void test_irqmod_batch_bucket(void)
+{
+  CHECK(ci_irqmod_batch_bucket(0), ==, 0);
+  CHECK(ci_irqmod_batch_bucket(1), ==, 1);
+  CHECK(ci_irqmod_batch_bucket(3), ==, 2);
+  CHECK(ci_irqmod_batch_bucket(4), ==, 3);
+  CHECK(ci_irqmod_batch_bucket(63), ==, 6);
+  CHECK(ci_irqmod_batch_bucket(64), ==, 7);
+  CHECK(ci_irqmod_batch_bucket(100000), ==, 7);
+}
+
+/* Low interrupt rates are never moderated */
+static void test_irqmod_quiet(void)
+{
+  ci_irqmod_state s = {};
+  ci_uint64 now = 1;
+  unsigned usec;
+
+  usec = run(&s, &now, RATE / 2, 1, 100);
+  CHECK(usec, ==, 0);
+  CHECK(s.n_changes, ==, 0);
+  CHECK(s.batch_hist[1], ==, s.level_hist[0]);
+}
+
+/* A high rate of small batches climbs a level per window up to the
+ * maximum, and falls back when the rate drops.
+ */
+static void test_irqmod_busy(void)
+{
+  ci_irqmod_state s = {};
+  ci_uint64 now = 1;
+  unsigned usec;
+
+  run(&s, &now, RATE * 10, 1, 2);
+  CHECK(s.level, >, 0);
+  usec = run(&s, &now, RATE * 10, 1, 20);
+  CHECK(usec, ==, MAX_USEC);
+  CHECK(s.level, ==, CI_IRQMOD_LEVELS - 1);
+
+  usec = run(&s, &now, RATE / 8, 1, 20);
+  CHECK(usec, ==, 0);
+  CHECK(s.n_changes, ==, 2 * (CI_IRQMOD_LEVELS - 1));
+}
+
+/* Large batches mean moderation is already doing its job */
+static void test_irqmod_big_batches(void)
+{
+  ci_irqmod_state s = {};
+  ci_uint64 now = 1;
+  unsigned usec;
+
+  usec = run(&s, &now, RATE * 10, CI_IRQMOD_BATCH_TARGET, 20);
+  CHECK(usec, ==, 0);
+  CHECK(s.batch_hist[ci_irqmod_batch_bucket(CI_IRQMOD_BATCH_TARGET)], >, 0);
+}
+
+/* An idle period drops straight back to no moderation */
+static void test_irqmod_idle(void)
+{
+  ci_irqmod_state s = {};
+  ci_uint64 now = 1;
+  unsigned usec;
+
+  usec = run(&s, &now, RATE * 10, 1, 20);
+  CHECK(usec, ==, MAX_USEC);
+  now += 1000000000ull;
+  usec = ci_irqmod_update(&s, 1, now, KHZ, RATE, MAX_USEC);
+  CHECK(usec, ==, 0);
+}
+
+/* A corrupt level from user-level is clamped */
+static void test_irqmod_bad_level(void)
+{
+  ci_irqmod_state s = {};
+  unsigned usec;
+
+  s.level = 1000;
+  usec = ci_irqmod_update(&s, 1, 1, KHZ, RATE, MAX_USEC);
+  CHECK(usec, ==, MAX_USEC);
+  CHECK(s.level_hist[CI_IRQMOD_LEVELS - 1], ==, 1);
+}
+
+int main(void) {
+  TEST_RUN(test_irqmod_levels);
+  TEST_RUN(test_irqmod_batch_bucket);
+  TEST_RUN(test_irqmod_quiet);
+  TEST_RUN(test_irqmod_busy);
+  TEST_RUN(test_irqmod_big_batches);
+  TEST_RUN(test_irqmod_idle);
+  TEST_RUN(test_irqmod_bad_level);
+  TEST_END();
+}
@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+
+/* Functions under test */
+#include <ci/internal/tcp_info.h>
+
+/* Test infrastructure */
+#include "unit_test.h"
+
+#if CI_CFG_TCP_INFO_METRICS
+
+static ci_netif ni;
+static ci_netif_state ns;
+static ci_tcp_state ts;
+
+
+static void init(void)
+{
+  memset(&ns, 0, sizeof(ns));
+  memset(&ts, 0, sizeof(ts));
+  ni.state = &ns;
+  /* One tick per millisecond */
+  IPTIMER_STATE(&ni)->ci_ip_time_ms2tick_fxp = 1ull << 32;
+  ts.chrono_type = CI_TCP_CHRONO_NONE;
+  ts.send.num = 1;
+}
+
+
+static ci_uint64 chrono(int type, ci_iptime_t now)
+{
+  return ci_tcp_chrono_ticks(&ts, type, now);
+}
+
+
+/* Time is accounted to the highest state that applies */
+static void test_chrono(void)
+{
+  init();
+  ci_tcp_chrono_start(&ts, CI_TCP_CHRONO_BUSY, 100);
+  ci_tcp_chrono_start(&ts, CI_TCP_CHRONO_RWND_LIMITED, 150);
+  CHECK(chrono(CI_TCP_CHRONO_BUSY, 160), ==, 50);
+  CHECK(chrono(CI_TCP_CHRONO_RWND_LIMITED, 160), ==, 10);
+
+  /* Leaving a limited state leaves us busy while data is queued */
+  ci_tcp_chrono_stop(&ts, CI_TCP_CHRONO_RWND_LIMITED, 170);
+  CHECK(ts.chrono_type, ==, CI_TCP_CHRONO_BUSY);
+  ci_tcp_chrono_start(&ts, CI_TCP_CHRONO_SNDBUF_LIMITED, 200);
+
+  /* A lower state doesn't take over, and stopping another is ignored */
+  ci_tcp_chrono_start(&ts, CI_TCP_CHRONO_RWND_LIMITED, 210);
+  ci_tcp_chrono_stop(&ts, CI_TCP_CHRONO_RWND_LIMITED, 220);
+  CHECK(ts.chrono_type, ==, CI_TCP_CHRONO_SNDBUF_LIMITED);
+  ci_tcp_chrono_stop(&ts, CI_TCP_CHRONO_SNDBUF_LIMITED, 230);
+  CHECK(ts.chrono_type, ==, CI_TCP_CHRONO_BUSY);
+
+  /* Once everything is acked we are idle */
+  ts.send.num = 0;
+  ci_tcp_chrono_stop(&ts, CI_TCP_CHRONO_BUSY, 300);
+  CHECK(ts.chrono_type, ==, CI_TCP_CHRONO_NONE);
+  CHECK(chrono(CI_TCP_CHRONO_BUSY, 400), ==, 150);
+  CHECK(chrono(CI_TCP_CHRONO_RWND_LIMITED, 400), ==, 20);
+  CHECK(chrono(CI_TCP_CHRONO_SNDBUF_LIMITED, 400), ==, 30);
+
+  /* Idle time is not counted */
+  ts.send.num = 1;
+  ci_tcp_chrono_start(&ts, CI_TCP_CHRONO_BUSY, 1000);
+  CHECK(chrono(CI_TCP_CHRONO_BUSY, 1005), ==, 155);
+
+  /* Time wraps */
+  init();
+  ci_tcp_chrono_start(&ts, CI_TCP_CHRONO_BUSY, 0xfffffff0u);
+  CHECK(chrono(CI_TCP_CHRONO_BUSY, 0x10), ==, 0x20);
+
+  /* Totals go past 32 bits */
+  init();
+  ci_tcp_chrono_start(&ts, CI_TCP_CHRONO_BUSY, 0);
+  ci_tcp_chrono_start(&ts, CI_TCP_CHRONO_RWND_LIMITED, 0xc0000000u);
+  ci_tcp_chrono_stop(&ts, CI_TCP_CHRONO_RWND_LIMITED, 0x80000000u);
+  CHECK(chrono(CI_TCP_CHRONO_BUSY, 0x40000000u), ==, 0x180000000ull);
+  CHECK(chrono(CI_TCP_CHRONO_RWND_LIMITED, 0x40000000u), ==,
+        0xc0000000ull);
+}
+
+
+/* The delivery rate is sampled over at least one smoothed RTT */
+static void test_rate(void)
+{
+  init();
+  ts.sa = 10 << 3;
+  ts.snd_una = 5000;
+  ci_tcp_chrono_start(&ts, CI_TCP_CHRONO_BUSY, 1000);
+  CHECK(ts.rate_una, ==, 5000);
+
+  ci_tcp_rate_sample(&ni, &ts, 6000, 1005);
+  CHECK(ts.stats.rate_bpms, ==, 0);
+  ci_tcp_rate_sample(&ni, &ts, 15000, 1010);
+  CHECK(ts.stats.rate_bpms, ==, 1000);
+  CHECK(ts.rate_una, ==, 15000);
+
+  /* Becoming busy again after idling starts a new sample */
+  ts.snd_una = 15000;
+  ts.send.num = 0;
+  ci_tcp_chrono_stop(&ts, CI_TCP_CHRONO_BUSY, 1020);
+  ts.send.num = 1;
+  ci_tcp_chrono_start(&ts, CI_TCP_CHRONO_BUSY, 5000);
+  ci_tcp_rate_sample(&ni, &ts, 17000, 5020);
+  CHECK(ts.stats.rate_bpms, ==, 100);
+
+  /* Without an RTT estimate we still need a tick to pass */
+  init();
+  ci_tcp_chrono_start(&ts, CI_TCP_CHRONO_BUSY, 1000);
+  ci_tcp_rate_sample(&ni, &ts, 100, 1000);
+  CHECK(ts.stats.rate_bpms, ==, 0);
+  ci_tcp_rate_sample(&ni, &ts, 100, 1001);
+  CHECK(ts.stats.rate_bpms, ==, 100);
+}
+
+
+/* SYN and FIN take sequence space but aren't data */
+static void test_tx(void)
+{
+  static ci_ip_pkt_fmt pkt;
+  ci_tcp_hdr tcp;
+  unsigned len;
+
+  init();
+  memset(&tcp, 0, sizeof(tcp));
+  pkt.pf.tcp_tx.start_seq = 0xfffffff0u;
+  pkt.pf.tcp_tx.end_seq = 0xfffffff1u;
+  tcp.tcp_flags = CI_TCP_FLAG_SYN;
+  len = ci_tcp_info_tx(&ts, &pkt, &tcp);
+  CHECK(len, ==, 0);
+
+  pkt.pf.tcp_tx.end_seq = 0x65;
+  tcp.tcp_flags = CI_TCP_FLAG_ACK | CI_TCP_FLAG_FIN;
+  len = ci_tcp_info_tx(&ts, &pkt, &tcp);
+  CHECK(len, ==, 116);
+
+  tcp.tcp_flags = CI_TCP_FLAG_ACK;
+  len = ci_tcp_info_tx(&ts, &pkt, &tcp);
+  CHECK(len, ==, 117);
+
+  CHECK(ts.stats.tx_pkts, ==, 3);
+  CHECK(ts.stats.tx_data_pkts, ==, 2);
+  CHECK(ts.stats.tx_bytes, ==, 233);
+}
+
+#endif
+
+
+int main(void)
+{
+#if CI_CFG_TCP_INFO_METRICS
+  TEST_RUN(test_chrono);
+  TEST_RUN(test_rate);
+  TEST_RUN(test_tx);
+#endif
+  TEST_END();
+}
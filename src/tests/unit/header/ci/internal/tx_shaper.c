@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+
+/* Functions under test */
+#include <ci/internal/tx_shaper.h>
+
+/* Test infrastructure */
+#include "unit_test.h"
+
+/* A 1GHz clock, so that one cycle is one nanosecond */
+#define KHZ       1000000
+#define PKT_LEN   1500
+#define TICK_NS   1000
+
+/* A simulated link.  Classes in [busy] always have a packet waiting, and
+ * every [TICK_NS] the shaper releases whatever it allows, which the NIC
+ * completes at once.  Unshaped traffic at [bypass_mbps] is charged to the
+ * root as it would be by __ci_netif_send().
+ */
+struct sim {
+  ci_txshape_state s;
+  unsigned busy;
+  unsigned bypass_mbps;
+  ci_uint64 bypass_credit;
+  ci_uint64 now;
+  ci_uint64 sent[CI_TXSHAPE_CLASSES];
+};
+
+static void sim_init(struct sim* sim, const char* spec, unsigned busy)
+{
+  memset(sim, 0, sizeof(*sim));
+  CHECK(ci_txshape_parse(&sim->s, spec), ==, 0);
+  sim->now = 1;
+  ci_txshape_init(&sim->s, sim->now, KHZ);
+  sim->busy = busy;
+}
+
+static void sim_run(struct sim* sim, unsigned ms)
+{
+  ci_uint64 end = sim->now + ms * 1000000ull;
+  unsigned head_len[CI_TXSHAPE_CLASSES];
+  int c, how;
+
+  for( c = 0; c < CI_TXSHAPE_CLASSES; ++c )
+    head_len[c] = (sim->busy >> c) & 1 ? PKT_LEN : 0;
+
+  for( ; sim->now < end; sim->now += TICK_NS ) {
+    ci_txshape_refill(&sim->s, sim->now, KHZ);
+    /* Mbit/s is 1/8 byte per ns */
+    sim->bypass_credit += (ci_uint64) sim->bypass_mbps * TICK_NS;
+    while( sim->bypass_credit >= PKT_LEN * 8000ull ) {
+      sim->bypass_credit -= PKT_LEN * 8000ull;
+      ci_txshape_charge(&sim->s, 0, PKT_LEN, KHZ, CI_TXSHAPE_SEND);
+    }
+    while( (c = ci_txshape_pick(&sim->s, head_len, KHZ, &how)) >= 0 ) {
+      ci_txshape_charge(&sim->s, c, PKT_LEN, KHZ, how);
+      sim->sent[c] += PKT_LEN;
+    }
+  }
+}
+
+/* Bytes expected in [ms] at [mbps], ignoring the initial burst */
+static ci_uint64 bytes_at(unsigned mbps, unsigned ms)
+{
+  return (ci_uint64) mbps * 125 * ms;
+}
+
+/* [got] is within [pct] percent of [want] */
+static int near(ci_uint64 got, ci_uint64 want, unsigned pct)
+{
+  ci_uint64 slack = want * pct / 100;
+  return got + slack >= want && got <= want + slack;
+}
+
+static void test_txshape_parse(void)
+{
+  ci_txshape_state s;
+
+  memset(&s, 0, sizeof(s));
+  CHECK(ci_txshape_parse(&s, "root=10000,1=100:9000,7=5"), ==, 0);
+  CHECK(s.root_rate, ==, 10000 * 125);
+  CHECK(s.shaped, ==, 0x82);
+  CHECK(s.cls[1].rate, ==, 100 * 125);
+  CHECK(s.cls[1].ceil, ==, 9000 * 125);
+  CHECK(s.cls[7].rate, ==, 5 * 125);
+  CHECK(s.cls[7].ceil, ==, 5 * 125);
+
+  memset(&s, 0, sizeof(s));
+  CHECK(ci_txshape_parse(&s, ""), ==, 0);
+  CHECK(s.shaped, ==, 0);
+  CHECK(ci_txshape_parse(&s, "3=0:100"), ==, 0);
+  CHECK(s.cls[3].rate, ==, 0);
+
+  CHECK(ci_txshape_parse(&s, "8=100"), ==, -EINVAL);
+  CHECK(ci_txshape_parse(&s, "1=100:50"), ==, -EINVAL);
+  CHECK(ci_txshape_parse(&s, "1=0"), ==, -EINVAL);
+  CHECK(ci_txshape_parse(&s, "1="), ==, -EINVAL);
+  CHECK(ci_txshape_parse(&s, "1=100;2=100"), ==, -EINVAL);
+  CHECK(ci_txshape_parse(&s, "root=x"), ==, -EINVAL);
+  CHECK(ci_txshape_parse(&s, "1=99999999999"), ==, -EINVAL);
+}
+
+static void test_txshape_classify(void)
+{
+  CHECK(ci_txshape_class_of_tos(0), ==, 0);
+  CHECK(ci_txshape_class_of_tos(0x10), ==, 0);  /* IPTOS_LOWDELAY */
+  CHECK(ci_txshape_class_of_tos(0x20), ==, 1);
+  CHECK(ci_txshape_class_of_tos(0xb8), ==, 5);  /* DSCP EF */
+  CHECK(ci_txshape_class_of_tos(0xe0), ==, 7);
+}
+
+/* A backlogged class is held to its rate, plus the initial burst */
+static void test_txshape_rate(void)
+{
+  struct sim sim;
+  ci_uint64 want = bytes_at(100, 100);
+
+  sim_init(&sim, "1=100", 1u << 1);
+  sim_run(&sim, 100);
+  CHECK(sim.sent[1], >=, want);
+  CHECK(sim.sent[1], <=, want + CI_TXSHAPE_MIN_BURST + PKT_LEN);
+  CHECK(sim.s.cls[1].n_borrowed, ==, 0);
+
+  /* And carries on at the same rate. */
+  sim.sent[1] = 0;
+  sim_run(&sim, 100);
+  CHECK(near(sim.sent[1], want, 1), ==, 1);
+}
+
+/* A class borrows what the root has to spare, up to its ceil */
+static void test_txshape_borrow(void)
+{
+  struct sim sim;
+
+  sim_init(&sim, "root=1000,1=100:1000,7=200", (1u << 1) | (1u << 7));
+  sim_run(&sim, 10);
+  memset(sim.sent, 0, sizeof(sim.sent));
+  sim_run(&sim, 100);
+  CHECK(near(sim.sent[7], bytes_at(200, 100), 1), ==, 1);
+  CHECK(near(sim.sent[1], bytes_at(800, 100), 1), ==, 1);
+  CHECK(sim.s.cls[1].n_borrowed, >, 0);
+
+  /* Alone, it is held to its ceil. */
+  sim_init(&sim, "root=1000,1=100:400", 1u << 1);
+  sim_run(&sim, 10);
+  sim.sent[1] = 0;
+  sim_run(&sim, 100);
+  CHECK(near(sim.sent[1], bytes_at(400, 100), 1), ==, 1);
+}
+
+/* Classes that compete to borrow are served in strict priority order */
+static void test_txshape_priority(void)
+{
+  struct sim sim;
+
+  sim_init(&sim, "root=100,2=0:100,5=0:100", (1u << 2) | (1u << 5));
+  sim_run(&sim, 10);
+  memset(sim.sent, 0, sizeof(sim.sent));
+  sim_run(&sim, 100);
+  CHECK(near(sim.sent[5], bytes_at(100, 100), 1), ==, 1);
+  CHECK(sim.sent[2], ==, 0);
+}
+
+/* Unshaped traffic is not delayed, but leaves less for borrowers */
+static void test_txshape_bypass(void)
+{
+  struct sim sim;
+
+  sim_init(&sim, "root=100,1=0:100", 1u << 1);
+  sim.bypass_mbps = 60;
+  sim_run(&sim, 10);
+  sim.sent[1] = 0;
+  sim_run(&sim, 100);
+  CHECK(near(sim.sent[1], bytes_at(40, 100), 2), ==, 1);
+}
+
+/* Buckets are capped after a long idle period, and don't go backwards */
+static void test_txshape_refill(void)
+{
+  ci_txshape_state s;
+  ci_int64 depth;
+
+  memset(&s, 0, sizeof(s));
+  CHECK(ci_txshape_parse(&s, "root=100000,1=100000"), ==, 0);
+  ci_txshape_init(&s, 1, KHZ);
+  depth = ci_txshape_depth(s.cls[1].rate, KHZ);
+  CHECK(s.cls[1].tokens, ==, depth);
+
+  ci_txshape_charge(&s, 1, PKT_LEN, KHZ, CI_TXSHAPE_SEND);
+  CHECK(s.cls[1].tokens, ==, depth - PKT_LEN * KHZ);
+  ci_txshape_refill(&s, 1000000000000000ull, KHZ);
+  CHECK(s.cls[1].tokens, ==, depth);
+  CHECK(s.root_tokens, ==, ci_txshape_depth(s.root_rate, KHZ));
+
+  ci_txshape_charge(&s, 1, PKT_LEN, KHZ, CI_TXSHAPE_SEND);
+  ci_txshape_refill(&s, 1000, KHZ);
+  CHECK(s.cls[1].tokens, ==, depth - PKT_LEN * KHZ);
+
+  /* Debt is limited to the depth of the bucket. */
+  s.cls[1].tokens = 0;
+  ci_txshape_spend(&s.cls[1].tokens, s.cls[1].rate, depth * 4, KHZ);
+  CHECK(s.cls[1].tokens, ==, -depth);
+}
+
+int main(void) {
+  TEST_RUN(test_txshape_parse);
+  TEST_RUN(test_txshape_classify);
+  TEST_RUN(test_txshape_rate);
+  TEST_RUN(test_txshape_borrow);
+  TEST_RUN(test_txshape_priority);
+  TEST_RUN(test_txshape_bypass);
+  TEST_RUN(test_txshape_refill);
+  TEST_END();
+}
@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+
+/* Functions under test */
+#include <ci/internal/tx_ts_ring.h>
+
+/* Test infrastructure */
+#include "unit_test.h"
+
+#define SIZE 8
+
+static oo_tx_ts_ring_state st;
+static struct onload_tx_timestamp recs[SIZE];
+static struct onload_tx_timestamp out[SIZE * 2];
+
+
+static void init(ci_uint32 start)
+{
+  memset(&st, 0, sizeof(st));
+  memset(recs, 0, sizeof(recs));
+  st.write = st.read = start;
+}
+
+
+static void put(ci_uint32 key)
+{
+  struct onload_tx_timestamp rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.key = key;
+  oo_tx_ts_ring_put(&st, recs, SIZE, &rec);
+}
+
+
+static int get(int max)
+{
+  memset(out, 0, sizeof(out));
+  return oo_tx_ts_ring_get(&st, recs, SIZE, out, max);
+}
+
+
+/* Records come out in order, no more than asked for */
+static void test_order(void)
+{
+  int n;
+
+  init(0);
+  n = get(SIZE);
+  CHECK(n, ==, 0);
+
+  put(1);
+  put(2);
+  put(3);
+  n = get(2);
+  CHECK(n, ==, 2);
+  CHECK(out[0].key, ==, 1);
+  CHECK(out[1].key, ==, 2);
+  n = get(SIZE);
+  CHECK(n, ==, 1);
+  CHECK(out[0].key, ==, 3);
+  n = get(0);
+  CHECK(n, ==, 0);
+  CHECK(st.read, ==, 3);
+}
+
+
+/* A full ring drops new records rather than overwriting unread ones */
+static void test_full(void)
+{
+  int i, n;
+
+  init(0);
+  for( i = 0; i < SIZE + 3; ++i )
+    put(i);
+  CHECK(st.dropped, ==, 3);
+  n = get(SIZE * 2);
+  CHECK(n, ==, SIZE);
+  CHECK(out[0].key, ==, 0);
+  CHECK(out[SIZE - 1].key, ==, SIZE - 1);
+
+  /* and there's room again once read */
+  put(100);
+  n = get(SIZE * 2);
+  CHECK(n, ==, 1);
+  CHECK(out[0].key, ==, 100);
+  CHECK(st.dropped, ==, 3);
+}
+
+
+/* The counters wrap */
+static void test_wrap(void)
+{
+  int i, n;
+
+  init(0xfffffffd);
+  for( i = 0; i < SIZE; ++i )
+    put(i);
+  CHECK(st.dropped, ==, 0);
+  CHECK(st.write, ==, SIZE - 3);
+  n = get(SIZE * 2);
+  CHECK(n, ==, SIZE);
+  for( i = 0; i < SIZE; ++i )
+    CHECK(out[i].key, ==, i);
+  CHECK(st.read, ==, SIZE - 3);
+}
+
+
+/* A reader doesn't copy more than the ring holds even if the counters in
+ * shared memory have been corrupted */
+static void test_bad_state(void)
+{
+  int n;
+
+  init(0);
+  st.write = 1000;
+  n = get(SIZE * 2);
+  CHECK(n, ==, SIZE);
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_order);
+  TEST_RUN(test_full);
+  TEST_RUN(test_wrap);
+  TEST_RUN(test_bad_state);
+  TEST_END();
+}
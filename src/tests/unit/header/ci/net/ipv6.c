@@ -0,0 +1,232 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+
+/* Functions under test */
+#include <ci/tools.h>
+#include <stdbool.h>
+#include <ci/net/ipv6.h>
+
+/* Test infrastructure */
+#include "unit_test.h"
+
+/* Dependencies */
+#include <netinet/in.h>
+
+/* A packet being crafted: the IPv6 header followed by extension headers */
+static struct {
+  ci_ip6_hdr ip6;
+  ci_uint8 data[512];
+} pkt;
+static int pkt_len;
+static ci_uint8* last_next_hdr;
+
+
+static void pkt_init(void)
+{
+  memset(&pkt, 0, sizeof(pkt));
+  pkt.ip6.prio_version = 6 << 4;
+  pkt.ip6.hop_limit = 64;
+  pkt_len = 0;
+  last_next_hdr = &pkt.ip6.next_hdr;
+}
+
+
+/* Append an extension header of type [type] and [len] bytes, which must be
+ * a multiple of 8, and return a pointer to it.
+ */
+static ci_uint8* pkt_add(ci_uint8 type, int len)
+{
+  ci_uint8* hdr = pkt.data + pkt_len;
+
+  *last_next_hdr = type;
+  last_next_hdr = hdr;
+  hdr[1] = len / 8 - 1;
+  pkt_len += len;
+  return hdr;
+}
+
+
+/* Append hop-by-hop or destination options padded with PadN */
+static ci_uint8* pkt_add_opts(ci_uint8 type, int len)
+{
+  ci_uint8* hdr = pkt_add(type, len);
+  hdr[2] = CI_IP6_OPT_PADN;
+  hdr[3] = len - 4;
+  return hdr;
+}
+
+
+static ci_uint8* pkt_add_routing(int segments_left)
+{
+  ci_uint8* hdr = pkt_add(CI_NEXTHDR_ROUTING, 24);
+  hdr[2] = 4;  /* segment routing */
+  hdr[3] = segments_left;
+  return hdr;
+}
+
+
+static void pkt_end(ci_uint8 proto)
+{
+  *last_next_hdr = proto;
+  pkt_len += 20;
+}
+
+
+static void check_walk(int want_rc, ci_uint8 want_proto, int want_off)
+{
+  ci_uint8 proto = 0xff;
+  int off = -1;
+  int rc = ci_ip6_ext_walk(&pkt.ip6, pkt_len, &proto, &off);
+
+  CHECK(rc, ==, want_rc);
+  if( rc == CI_IP6_EXT_OK ) {
+    CHECK(proto, ==, want_proto);
+    CHECK(off, ==, want_off);
+  }
+}
+
+
+/* No extension headers */
+static void test_plain(void)
+{
+  pkt_init();
+  pkt_end(IPPROTO_TCP);
+  check_walk(CI_IP6_EXT_OK, IPPROTO_TCP, 0);
+}
+
+
+/* The kinds of header that we skip, in the order of RFC8200 4.1 */
+static void test_skip(void)
+{
+  pkt_init();
+  pkt_add_opts(CI_NEXTHDR_HOP, 8);
+  pkt_add_opts(CI_NEXTHDR_DEST, 16);
+  pkt_add_routing(0);
+  pkt_add_opts(CI_NEXTHDR_DEST, 8);
+  pkt_end(IPPROTO_UDP);
+  check_walk(CI_IP6_EXT_OK, IPPROTO_UDP, 56);
+
+  /* A fragment header ends the walk */
+  pkt_init();
+  pkt_add_opts(CI_NEXTHDR_HOP, 8);
+  pkt_add(CI_NEXTHDR_FRAGMENT, 8);
+  pkt_end(IPPROTO_UDP);
+  check_walk(CI_IP6_EXT_OK, CI_NEXTHDR_FRAGMENT, 8);
+
+  /* So does an upper-layer protocol that isn't TCP or UDP */
+  pkt_init();
+  pkt_add_opts(CI_NEXTHDR_HOP, 8);
+  pkt_end(58);  /* ICMPv6, e.g. MLD with router alert */
+  check_walk(CI_IP6_EXT_OK, 58, 8);
+}
+
+
+/* Options are parsed, and those that must not be skipped are noticed */
+static void test_options(void)
+{
+  ci_uint8* hdr;
+
+  /* Pad1, then router alert, then PadN */
+  pkt_init();
+  hdr = pkt_add(CI_NEXTHDR_HOP, 16);
+  hdr[2] = CI_IP6_OPT_PAD1;
+  hdr[3] = 5;
+  hdr[4] = 2;
+  hdr[7] = CI_IP6_OPT_PADN;
+  hdr[8] = 7;
+  pkt_end(IPPROTO_TCP);
+  check_walk(CI_IP6_EXT_OK, IPPROTO_TCP, 16);
+
+  /* An unknown option that may be skipped */
+  hdr[3] = 0x1e;
+  check_walk(CI_IP6_EXT_OK, IPPROTO_TCP, 16);
+
+  /* ...and ones that may not */
+  hdr[3] = 0x5e;
+  check_walk(CI_IP6_EXT_UNKNOWN, 0, 0);
+  hdr[3] = 0xc2;  /* jumbo payload */
+  check_walk(CI_IP6_EXT_UNKNOWN, 0, 0);
+
+  /* An option that runs past the end of the header */
+  hdr[3] = 5;
+  hdr[8] = 8;
+  check_walk(CI_IP6_EXT_BAD, 0, 0);
+}
+
+
+/* Headers that we don't handle are left to the kernel */
+static void test_unknown(void)
+{
+  static const ci_uint8 types[] = {
+    CI_NEXTHDR_ESP, CI_NEXTHDR_AUTH, CI_NEXTHDR_NONE, CI_NEXTHDR_MOBILITY,
+    CI_NEXTHDR_HIP, CI_NEXTHDR_SHIM6, 253, 254,
+  };
+  int i;
+
+  for( i = 0; i < sizeof(types) / sizeof(types[0]); ++i ) {
+    pkt_init();
+    pkt_add_opts(CI_NEXTHDR_DEST, 8);
+    pkt_end(types[i]);
+    check_walk(CI_IP6_EXT_UNKNOWN, 0, 0);
+  }
+
+  /* We are not the final destination */
+  pkt_init();
+  pkt_add_routing(1);
+  pkt_end(IPPROTO_TCP);
+  check_walk(CI_IP6_EXT_UNKNOWN, 0, 0);
+
+  /* The walk is bounded */
+  pkt_init();
+  for( i = 0; i < CI_IP6_EXT_MAX; ++i )
+    pkt_add_opts(CI_NEXTHDR_DEST, 8);
+  pkt_end(IPPROTO_TCP);
+  check_walk(CI_IP6_EXT_OK, IPPROTO_TCP, CI_IP6_EXT_MAX * 8);
+  pkt_init();
+  for( i = 0; i <= CI_IP6_EXT_MAX; ++i )
+    pkt_add_opts(CI_NEXTHDR_DEST, 8);
+  pkt_end(IPPROTO_TCP);
+  check_walk(CI_IP6_EXT_UNKNOWN, 0, 0);
+}
+
+
+/* Malformed headers */
+static void test_bad(void)
+{
+  ci_uint8* hdr;
+
+  /* Hop-by-hop options that aren't first */
+  pkt_init();
+  pkt_add_opts(CI_NEXTHDR_DEST, 8);
+  pkt_add_opts(CI_NEXTHDR_HOP, 8);
+  pkt_end(IPPROTO_TCP);
+  check_walk(CI_IP6_EXT_BAD, 0, 0);
+
+  /* A header that runs past the end of the packet */
+  pkt_init();
+  hdr = pkt_add_opts(CI_NEXTHDR_DEST, 16);
+  pkt_end(IPPROTO_TCP);
+  hdr[1] = 10;
+  check_walk(CI_IP6_EXT_BAD, 0, 0);
+
+  /* A truncated packet */
+  pkt_init();
+  pkt_add_opts(CI_NEXTHDR_HOP, 8);
+  pkt_add_routing(0);
+  pkt_end(IPPROTO_TCP);
+  pkt_len = 20;
+  check_walk(CI_IP6_EXT_BAD, 0, 0);
+  pkt_len = 4;
+  check_walk(CI_IP6_EXT_BAD, 0, 0);
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_plain);
+  TEST_RUN(test_skip);
+  TEST_RUN(test_options);
+  TEST_RUN(test_unknown);
+  TEST_RUN(test_bad);
+  TEST_END();
+}
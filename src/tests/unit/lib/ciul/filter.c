@@ -0,0 +1,336 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+
+/* Functions under test */
+#include <ci/tools.h>
+#include <stdbool.h>
+#include <etherfabric/vi.h>
+#include <ci/efch/op_types.h>
+
+/* Test infrastructure */
+#include "unit_test.h"
+
+/* Dependencies */
+#include <stdarg.h>
+#include <netinet/in.h>
+
+#define MAX_FILTERS  4096
+#define RES_ID       5
+
+/* A mock of the char driver's filter ioctls, which keeps track of what is
+ * installed and fails to add the filter for [fail_port], if set.  The
+ * batch ioctl numbered [fault_ioctl], if set, fails to copy back its
+ * results.
+ */
+static struct {
+  bool batch_supported;
+  int fail_port;
+  int fault_ioctl;
+  int n_ioctls;
+  int n_installed;
+  int next_id;
+  bool installed[MAX_FILTERS];
+} mock;
+
+
+static void mock_reset(bool batch_supported)
+{
+  memset(&mock, 0, sizeof(mock));
+  mock.batch_supported = batch_supported;
+}
+
+
+static int mock_add(ci_filter_add_t* filter_add)
+{
+  int id;
+
+  if( filter_add->in.res_id.index != RES_ID )
+    return -EINVAL;
+  if( mock.fail_port &&
+      filter_add->in.spec.l4.ports.dest == htons(mock.fail_port) )
+    return -EBUSY;
+  if( mock.next_id == MAX_FILTERS )
+    return -ENOSPC;
+  id = mock.next_id++;
+  mock.installed[id] = true;
+  ++mock.n_installed;
+  memset(&filter_add->out, 0, sizeof(filter_add->out));
+  filter_add->out.filter_id = id;
+  return 0;
+}
+
+
+static int mock_del(efch_resource_id_t res_id, int64_t id)
+{
+  if( res_id.index != RES_ID )
+    return -EINVAL;
+  if( id < 0 || id >= MAX_FILTERS || ! mock.installed[id] )
+    return -ENOENT;
+  mock.installed[id] = false;
+  --mock.n_installed;
+  return 0;
+}
+
+
+/* As efch_filter_batch() */
+static int mock_batch_entries(ci_filter_batch_t* batch,
+                              ci_filter_batch_entry_t* e)
+{
+  unsigned i, j;
+  int rc = 0;
+
+  for( i = 0; i < batch->n; ++i ) {
+    if( batch->op == CI_FILTER_BATCH_ADD ) {
+      e[i].res_id = e[i].add.in.res_id;
+      e[i].rc = mock_add(&e[i].add);
+      if( e[i].rc == 0 )
+        e[i].filter_id = e[i].add.out.filter_id;
+    }
+    else {
+      e[i].rc = mock_del(e[i].res_id, e[i].filter_id);
+    }
+    if( e[i].rc < 0 && rc == 0 )
+      rc = e[i].rc;
+    if( e[i].rc < 0 && batch->op == CI_FILTER_BATCH_ADD )
+      break;
+  }
+  if( rc < 0 && batch->op == CI_FILTER_BATCH_ADD )
+    for( j = 0; j < batch->n; ++j ) {
+      if( j < i )
+        mock_del(e[j].res_id, e[j].filter_id);
+      if( j != i )
+        e[j].rc = -ECANCELED;
+    }
+  return rc;
+}
+
+
+/* As ioctl_filter_batch(), which works on a copy of the entries */
+static int mock_batch(ci_filter_batch_t* batch)
+{
+  static ci_filter_batch_entry_t e[CI_FILTER_BATCH_MAX];
+  size_t bytes = batch->n * sizeof(e[0]);
+  unsigned i;
+  int rc;
+
+  if( ! mock.batch_supported )
+    return -ENOTTY;
+  if( batch->n > CI_FILTER_BATCH_MAX )
+    return -E2BIG;
+  memcpy(e, (void*) (uintptr_t) batch->entries, bytes);
+  rc = mock_batch_entries(batch, e);
+  if( mock.n_ioctls == mock.fault_ioctl ) {
+    if( batch->op == CI_FILTER_BATCH_ADD && rc == 0 )
+      for( i = 0; i < batch->n; ++i )
+        mock_del(e[i].res_id, e[i].filter_id);
+    return -EFAULT;
+  }
+  memcpy((void*) (uintptr_t) batch->entries, e, bytes);
+  return rc;
+}
+
+
+int ioctl(int fd, unsigned long req, ...)
+{
+  ci_resource_op_t* op;
+  va_list va;
+  void* arg;
+  int rc;
+
+  va_start(va, req);
+  arg = va_arg(va, void*);
+  va_end(va);
+  ++mock.n_ioctls;
+
+  switch( req ) {
+  case CI_FILTER_ADD:
+    rc = mock_add(arg);
+    break;
+  case CI_FILTER_BATCH:
+    rc = mock_batch(arg);
+    break;
+  case CI_RESOURCE_OP:
+    op = arg;
+    rc = op->op == CI_RSOP_FILTER_DEL ?
+         mock_del(op->id, op->u.filter_del.filter_id) : -EOPNOTSUPP;
+    break;
+  default:
+    rc = -ENOTTY;
+    break;
+  }
+  if( rc < 0 ) {
+    errno = -rc;
+    return -1;
+  }
+  return rc;
+}
+
+
+static ef_vi vi;
+static ef_filter_spec specs[MAX_FILTERS];
+static ef_filter_cookie cookies[MAX_FILTERS];
+static int rcs[MAX_FILTERS];
+
+
+static void init_specs(int n)
+{
+  int i;
+
+  memset(&vi, 0, sizeof(vi));
+  vi.vi_resource_id = RES_ID;
+  for( i = 0; i < n; ++i ) {
+    ef_filter_spec_init(&specs[i], EF_FILTER_FLAG_NONE);
+    ef_filter_spec_set_ip4_local(&specs[i], IPPROTO_UDP,
+                                 htonl(0xe0000000 + i), htons(1000 + i));
+  }
+  memset(cookies, 0, sizeof(cookies));
+  for( i = 0; i < MAX_FILTERS; ++i )
+    rcs[i] = 1;
+}
+
+
+static int count_rcs(int n, int rc)
+{
+  int i, count = 0;
+  for( i = 0; i < n; ++i )
+    count += rcs[i] == rc;
+  return count;
+}
+
+
+/* Several driver-sized chunks go in and come out again */
+static void test_filter_batch(void)
+{
+  const int n = 3000;
+  int rc;
+
+  mock_reset(true);
+  init_specs(n);
+  rc = ef_vi_filter_add_batch(&vi, 0, specs, n, cookies, rcs);
+  CHECK(rc, ==, 0);
+  CHECK(count_rcs(n, 0), ==, n);
+  CHECK(mock.n_installed, ==, n);
+  CHECK(mock.n_ioctls, ==, 3);
+  CHECK(cookies[n - 1].filter_id, ==, n - 1);
+
+  mock.n_ioctls = 0;
+  rc = ef_vi_filter_del_batch(&vi, 0, cookies, n, rcs);
+  CHECK(rc, ==, 0);
+  CHECK(count_rcs(n, 0), ==, n);
+  CHECK(mock.n_installed, ==, 0);
+  CHECK(mock.n_ioctls, ==, 3);
+}
+
+
+/* A failure in a later chunk undoes the earlier ones */
+static void test_filter_batch_fail(void)
+{
+  const int n = 3000, bad = 2500;
+  int rc;
+
+  mock_reset(true);
+  init_specs(n);
+  mock.fail_port = 1000 + bad;
+  rc = ef_vi_filter_add_batch(&vi, 0, specs, n, cookies, rcs);
+  CHECK(rc, ==, -EBUSY);
+  CHECK(rcs[bad], ==, -EBUSY);
+  CHECK(count_rcs(n, -ECANCELED), ==, n - 1);
+  CHECK(mock.n_installed, ==, 0);
+}
+
+
+/* A chunk whose results can't be copied back is removed by the driver, and
+ * the earlier ones by the library */
+static void test_filter_batch_fault(void)
+{
+  const int n = 3000;
+  int rc;
+
+  mock_reset(true);
+  init_specs(n);
+  mock.fault_ioctl = 2;
+  rc = ef_vi_filter_add_batch(&vi, 0, specs, n, cookies, rcs);
+  CHECK(rc, ==, -EFAULT);
+  CHECK(count_rcs(n, -EFAULT), ==, CI_FILTER_BATCH_MAX);
+  CHECK(count_rcs(n, -ECANCELED), ==, n - CI_FILTER_BATCH_MAX);
+  CHECK(mock.n_installed, ==, 0);
+}
+
+
+/* Without driver support, filters go one at a time, with the same result */
+static void test_filter_batch_fallback(void)
+{
+  const int n = 100, bad = 60;
+  int rc;
+
+  mock_reset(false);
+  init_specs(n);
+  rc = ef_vi_filter_add_batch(&vi, 0, specs, n, cookies, rcs);
+  CHECK(rc, ==, 0);
+  CHECK(mock.n_installed, ==, n);
+  CHECK(mock.n_ioctls, ==, 1 + n);
+
+  mock.n_ioctls = 0;
+  rc = ef_vi_filter_del_batch(&vi, 0, cookies, n, rcs);
+  CHECK(rc, ==, 0);
+  CHECK(mock.n_installed, ==, 0);
+  CHECK(mock.n_ioctls, ==, 1 + n);
+
+  mock_reset(false);
+  init_specs(n);
+  mock.fail_port = 1000 + bad;
+  rc = ef_vi_filter_add_batch(&vi, 0, specs, n, cookies, rcs);
+  CHECK(rc, ==, -EBUSY);
+  CHECK(rcs[bad], ==, -EBUSY);
+  CHECK(count_rcs(n, -ECANCELED), ==, n - 1);
+  CHECK(mock.n_installed, ==, 0);
+}
+
+
+/* A bad spec is rejected before anything is installed */
+static void test_filter_batch_invalid(void)
+{
+  const int n = 10;
+  int rc;
+
+  mock_reset(true);
+  init_specs(n);
+  ef_filter_spec_init(&specs[7], EF_FILTER_FLAG_NONE);
+  rc = ef_vi_filter_add_batch(&vi, 0, specs, n, cookies, rcs);
+  CHECK(rc, ==, -EINVAL);
+  CHECK(rcs[7], ==, -EINVAL);
+  CHECK(count_rcs(n, -ECANCELED), ==, n - 1);
+  CHECK(mock.n_ioctls, ==, 0);
+}
+
+
+/* Removal carries on past a filter that can't be removed */
+static void test_filter_batch_del_partial(void)
+{
+  const int n = 10;
+  int rc;
+
+  mock_reset(true);
+  init_specs(n);
+  rc = ef_vi_filter_add_batch(&vi, 0, specs, n, cookies, rcs);
+  CHECK(rc, ==, 0);
+  cookies[3].filter_id = MAX_FILTERS - 1;
+  rc = ef_vi_filter_del_batch(&vi, 0, cookies, n, rcs);
+  CHECK(rc, ==, -ENOENT);
+  CHECK(rcs[3], ==, -ENOENT);
+  CHECK(count_rcs(n, 0), ==, n - 1);
+  CHECK(mock.n_installed, ==, 1);
+  CHECK(mock.installed[3], ==, true);
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_filter_batch);
+  TEST_RUN(test_filter_batch_fail);
+  TEST_RUN(test_filter_batch_fault);
+  TEST_RUN(test_filter_batch_fallback);
+  TEST_RUN(test_filter_batch_invalid);
+  TEST_RUN(test_filter_batch_del_partial);
+  TEST_END();
+}
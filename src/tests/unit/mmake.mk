@@ -12,7 +12,14 @@ UNIT_TEST_WRAPPER ?=
 # All the tests that can be run. Can be filtered using UNIT_TEST_FILTER.
 # In principle, this could be autogenerated by searching the source directory.
 ALL_UNIT_TESTS := \
+  header/ci/internal/ip_reasm \
   header/ci/internal/ip_timestamp \
+  header/ci/internal/irq_moderation \
+  header/ci/internal/tcp_info \
+  header/ci/internal/tx_shaper \
+  header/ci/internal/tx_ts_ring \
+  header/ci/net/ipv6 \
+  lib/ciul/filter \
   lib/transport/ip/netif_init \
   lib/transport/ip/tcp_rx \
 
@@ -23,7 +30,8 @@ OBJECTS := $(TESTS:%=%.o)
 PASSED := $(TESTS:%=%.passed)
 
 # Library objects names are mangled with a prefix. Deal with that madness here.
-LIB_PREFIXES := lib/transport/common/ci_tp_common_ lib/transport/ip/ci_ip_
+LIB_PREFIXES := lib/transport/common/ci_tp_common_ lib/transport/ip/ci_ip_ \
+                lib/ciul/ci_ul_
 
 lib_prefix = $(notdir $(filter $(dir $(1))%,$(LIB_PREFIXES)))
 lib_object = ../../$(dir $(1))$(call lib_prefix,$(1))$(notdir $(1)).o
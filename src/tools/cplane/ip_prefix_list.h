@@ -80,6 +80,15 @@ cp_ippl_init(struct cp_ip_prefix_list* list, size_t stride,
   CP_IPPL_ASSERT_VALID(list);
 }
 
+static inline void
+cp_ippl_free(struct cp_ip_prefix_list* list)
+{
+  free(list->list);
+  free(list->seen);
+  list->list = NULL;
+  list->seen = NULL;
+}
+
 typedef void (*cp_ippl_print_callback)(struct cp_session* s, int i,
                                        struct cp_ip_with_prefix*);
 void cp_ippl_print_cb_ip_prefix(struct cp_session* s, int i,
@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+
+/* Opening the network namespaces to serve with --multi-ns.
+ *
+ * The driver tells us about a namespace by the pid of a process in it and
+ * the inode of the namespace.  The pid is only good for finding the
+ * namespace in /proc; the inode is what says we have found the right one,
+ * as the process may have exited and its pid been reused by the time we
+ * look.
+ *
+ * Opening the namespace of another user's process needs CAP_SYS_PTRACE.
+ * The server does not keep it: a helper process forked at start of day
+ * keeps it and nothing else, opens the namespaces for the server and passes
+ * back the fds over a socket pair.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "private.h"
+
+
+struct netns_req {
+  ci_uint32 pid;
+  ci_uint32 ino;
+};
+
+
+int cp_netns_open(pid_t pid, ci_uint32 ino)
+{
+  struct stat ns_stat;
+  char path[32];
+  int fd;
+
+  snprintf(path, sizeof(path), "/proc/%d/ns/net", pid);
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if( fd < 0 )
+    return -errno;
+  if( fstat(fd, &ns_stat) < 0 ) {
+    int rc = -errno;
+    close(fd);
+    return rc;
+  }
+  /* [ino] is 0 if the kernel could not tell the driver. */
+  if( ino != 0 && ns_stat.st_ino != ino ) {
+    close(fd);
+    return -ESRCH;
+  }
+  return fd;
+}
+
+
+void cp_netns_opener_run(int sock)
+{
+  struct netns_req req;
+  ssize_t n;
+
+  while( (n = recv(sock, &req, sizeof(req), 0)) == sizeof(req) ) {
+    int rc = cp_netns_open(req.pid, req.ino);
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { .iov_base = &rc, .iov_len = sizeof(rc) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    int fd = rc;
+
+    if( fd >= 0 ) {
+      struct cmsghdr* cmsg;
+      rc = 0;
+      msg.msg_control = cbuf;
+      msg.msg_controllen = sizeof(cbuf);
+      cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+      memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    if( fd >= 0 )
+      close(fd);
+    if( n != sizeof(rc) )
+      break;
+  }
+}
+
+
+int cp_netns_opener_request(int sock, pid_t pid, ci_uint32 ino)
+{
+  struct netns_req req = { .pid = pid, .ino = ino };
+  char cbuf[CMSG_SPACE(sizeof(int))];
+  int rc;
+  struct iovec iov = { .iov_base = &rc, .iov_len = sizeof(rc) };
+  struct msghdr msg = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = cbuf,
+    .msg_controllen = sizeof(cbuf),
+  };
+  struct cmsghdr* cmsg;
+  ssize_t n;
+  int fd;
+
+  n = send(sock, &req, sizeof(req), MSG_NOSIGNAL);
+  if( n != sizeof(req) )
+    return n < 0 ? -errno : -EPIPE;
+  n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  if( n != sizeof(rc) )
+    return n < 0 ? -errno : -EPIPE;
+  if( rc < 0 )
+    return rc;
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  if( cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(int)) )
+    return -EPROTO;
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
+}
@@ -466,6 +466,8 @@ struct cp_session {
 #define CP_SESSION_LADDR_USE_PREF_SRC  0x100000
 /* Track XDP programs and tell Onload about them */
 #define CP_SESSION_TRACK_XDP           0x200000
+/* The drivers have asked us to stop serving this namespace */
+#define CP_SESSION_QUIT                0x400000
 
   /* Netlink is dumping a table: */
   enum cp_dump_state state;
@@ -829,6 +831,15 @@ void cp_mibdump_sock_handle(struct cp_session* s, struct cp_epoll_state*);
 void cp_agent_sock_init(struct cp_session* s);
 void cp_agent_sock_handle(struct cp_session* s, struct cp_epoll_state*);
 
+/* Open the network namespace of process [pid], which must have nsfs inode
+ * [ino].  Returns the fd or -errno. */
+int cp_netns_open(pid_t pid, ci_uint32 ino);
+/* Serve cp_netns_opener_request() on a SOCK_SEQPACKET socket until the
+ * other end closes it. */
+void cp_netns_opener_run(int sock);
+/* Ask the process in cp_netns_opener_run() to cp_netns_open(). */
+int cp_netns_opener_request(int sock, pid_t pid, ci_uint32 ino);
+
 void cp_populate_llap_hwports(struct cp_session* s, ci_ifid_t ifindex,
                               ci_hwport_id_t hwport, cp_nic_flags_t nic_flags);
 
@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <syslog.h>
 #include <sched.h>
+#include <pthread.h>
 
 #include <ci/compat.h>
 #include <ci/tools/log.h>
@@ -67,6 +68,7 @@ static int /*bool*/ ci_cfg_ipv6_no_source = false;
 static uint64_t cfg_affinity = -1;
 static int /*bool*/ ci_cfg_verify_routes = 0;
 static int /*bool*/ cfg_track_xdp = false;
+static int /*bool*/ cfg_multi_ns = false;
 
 static int cfg_uid = 0;
 static int cfg_gid = 0;
@@ -90,6 +92,14 @@ static int cfg_bond_peak_msec = 10;
 static int cfg_bond_peak_polls = 20;
 static int cfg_bond_3ad_dump_msec = 100;
 
+/* Table sizes for the namespaces served by a multi-namespace server.  These
+ * are typically containers with a handful of interfaces and peers. */
+static int cfg_ns_llap_max = 16;
+static int cfg_ns_ipif_max = 16;
+static int cfg_ns_bond_max = 8;
+static int cfg_ns_mac_max = 128;
+static int cfg_ns_fwd_max = 128;
+
 static int /*bool*/ ci_cfg_pref_src_as_local = 0;
 
 static ci_cfg_desc cfg_opts[] = {
@@ -178,27 +188,56 @@ static ci_cfg_desc cfg_opts[] = {
     "Track XDP programs linked to network interfaces.  Such tracking "
     "is needed for EF_XDP_MODE=compatible, and prevents dropping "
     "CAP_SYS_ADMIN capability of the server." },
+  { 0, CPLANE_SERVER_MULTI_NS, CI_CFG_FLAG, &cfg_multi_ns,
+    "serve other network namespaces on request from the Onload drivers, "
+    "each from a thread of this process"
+    "; when the Onload drivers launch the control plane server with "
+    "cplane_server_multi_ns=Y, this option is set" },
+  { 0, "ns-llap-max", CI_CFG_UINT, &cfg_ns_llap_max,
+    "llap-max for other namespaces with --"CPLANE_SERVER_MULTI_NS },
+  { 0, "ns-ipif-max", CI_CFG_UINT, &cfg_ns_ipif_max,
+    "ipif-max for other namespaces with --"CPLANE_SERVER_MULTI_NS },
+  { 0, "ns-bond-max", CI_CFG_UINT, &cfg_ns_bond_max,
+    "bond-max for other namespaces with --"CPLANE_SERVER_MULTI_NS },
+  { 0, "ns-mac-max", CI_CFG_UINT, &cfg_ns_mac_max,
+    "mac-max for other namespaces with --"CPLANE_SERVER_MULTI_NS },
+  { 0, "ns-fwd-max", CI_CFG_UINT, &cfg_ns_fwd_max,
+    "fwd-max for other namespaces with --"CPLANE_SERVER_MULTI_NS },
 };
 #define N_CFG_OPTS (sizeof(cfg_opts) / sizeof(cfg_opts[0]))
 
 
+/* We pass the cp_session parameter through the function call chain, and in
+ * the most cases we do not need it to be static.  However, signal handlers
+ * are trickier, so */
+static struct cp_session session;
+
+/* ... and in multi-namespace mode the handlers find the session served by
+ * the thread the signal was sent to here. */
+static __thread struct cp_session* thread_session;
+
+#ifndef CP_ANYUNIT
+static CI_NORETURN ns_session_failed(struct cp_session* s);
+#endif
+
+
 CI_NORETURN init_failed(const char* msg, ...)
 {
   va_list args;
   va_start(args, msg);
   ci_vlog(msg, args);
   va_end(args);
+#ifndef CP_ANYUNIT
+  /* Failing to serve one namespace mustn't take the others down. */
+  if( thread_session != NULL && thread_session != &session )
+    ns_session_failed(thread_session);
+#endif
   ci_log("!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!");
   ci_log("!!! Onload Control Plane server has FAILED TO START !!!");
   ci_log("!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!");
   exit(1);
 }
 
-/* We pass the cp_session parameter through the function call chain, and in
- * the most cases we do not need it to be static.  However, signal handlers
- * are trickier, so */
-static struct cp_session session;
-
 static int init_netlink_sock(struct cp_session* s, int protocol,
                              uint32_t groups)
 {
@@ -357,7 +396,7 @@ cp_session_init_memory(struct cp_session* s, struct cp_tables_dim* m,
     return -ENOMEM;
 
   CHECK_CALLOC(s->llap_priv, m->llap_max);
-  CHECK_CALLOC(s->bond, cfg_bond_max);
+  CHECK_CALLOC(s->bond, s->bond_max);
   CHECK_CALLOC(s->mac, s->mac_mask + 1);
   CHECK_CALLOC(s->ip6_mac, s->mac_mask + 1);
 
@@ -440,6 +479,12 @@ static void free_session(struct cp_session* s)
 
 static void handle_sigquit(int sig, siginfo_t* info, void* context)
 {
+  /* The drivers tell the server for a namespace to go away with SIGQUIT.
+   * The thread serving another namespace exits its main loop. */
+  if( sig == SIGQUIT && thread_session != &session ) {
+    thread_session->flags |= CP_SESSION_QUIT;
+    return;
+  }
   ci_log("Received signal: %s.", strsignal(sig));
   free_session(&session);
   free(cp_log_prefix);
@@ -471,6 +516,10 @@ static void handle_sigalarm(int sig, siginfo_t* info, void* context)
   cp_timer_expire(cpt, cpt->type);
 }
 
+#ifndef CP_ANYUNIT
+static void ns_session_start(pid_t pid, ci_uint32 ino);
+#endif
+
 static void cp_kmsg_handle(struct cp_session* s, struct cp_epoll_state* state)
 {
   struct cp_helper_msg msg;
@@ -504,6 +553,16 @@ static void cp_kmsg_handle(struct cp_session* s, struct cp_epoll_state* state)
           cp_ready_usable(s);
       }
       break;
+    case CP_HMSG_SERVE_NETNS:
+#ifndef CP_ANYUNIT
+      if( cfg_multi_ns ) {
+        ns_session_start(msg.u.serve_netns.pid, msg.u.serve_netns.ino);
+        break;
+      }
+#endif
+      CI_RLLOG(10, "%s: Not serving namespace of pid %u without --%s",
+               __FUNCTION__, msg.u.serve_netns.pid, CPLANE_SERVER_MULTI_NS);
+      break;
     default:
       CI_RLLOG(10, "%s: Unexpected hmsg_type %d", __FUNCTION__, msg.hmsg_type);
       ci_assert(0);
@@ -515,17 +574,17 @@ static void cp_kmsg_handle(struct cp_session* s, struct cp_epoll_state* state)
 
 static void oof_req_sig(int sig, siginfo_t* info, void* context)
 {
-  cp_oof_req_do(&session);
+  cp_oof_req_do(thread_session);
 }
 
 static void llap_update_sig(int sig, siginfo_t* info, void* context)
 {
-  cp_llap_fix_upper_layers(&session);
+  cp_llap_fix_upper_layers(thread_session);
 }
 
 static void handle_os_sync_signal(int sig, siginfo_t* info, void* context)
 {
-  struct cp_session* s = &session;
+  struct cp_session* s = thread_session;
 
   switch( info->si_code ) {
     case CP_SYNC_DUMP:
@@ -657,7 +716,7 @@ static void init_signals(struct cp_session* s)
     init_failed("timer_settime(TIMER_FWD) failed: %s", strerror(errno));
 }
 
-static void init_epoll(struct cp_session* s)
+static void init_epoll(struct cp_session* s, bool main_ns)
 {
   s->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
   if( s->epoll_fd < 0 )
@@ -706,7 +765,7 @@ static void init_epoll(struct cp_session* s)
     init_failed("Can not add %s file descriptor to the epoll fd: %s",
                 pipe_name, strerror(errno));
 #else
-  if( cfg_ns_file == NULL ) {
+  if( main_ns ) {
     s->ep_agent = cp_epoll_register(s, s->agent_sock, cp_agent_sock_handle, 0);
     if( s->ep_agent == NULL )
       init_failed("Can not add agent socket to the epoll fd: %s",
@@ -886,32 +945,32 @@ static void bring_up_kernel_state(void)
 
 #ifndef NO_CAPS
 #ifndef CP_ANYUNIT
-/* Drop all capabilities except CAP_NET_ADMIN; switch uid/gid. */
-static void
-drop_privileges(struct cp_session* s, bool in_main_netns)
+static void permit_capability(cap_t cap, cap_value_t cap_val,
+                              const char* name)
 {
-  int rc;
+  int rc = cap_set_flag(cap, CAP_PERMITTED, 1, &cap_val, CAP_SET);
+  if( rc == -1 )
+    init_failed("Failed to set %s flag to CAP_PERMITTED: %s",
+                name, strerror(errno));
+}
 
-  /* Do not drop CAP_NET_ADMIN when dropping uid/gid if we are in the main
-   * namespace. */
-  if( cfg_gid != 0 || cfg_uid != 0 ) {
-    rc = prctl(PR_SET_KEEPCAPS, 1);
-    if( rc == -1 )
-      init_failed("Failed to keep capablilties via prctl: %s",
-                  strerror(errno));
-  }
 
-  /* UID/GID. */
-  if( cfg_gid != 0 ) {
-    rc = setresgid(cfg_gid, cfg_gid, cfg_gid);
-    if( rc == -1 )
-      init_failed("Failed to drop GID to %d: %s", cfg_gid, strerror(errno));
-  }
-  if( cfg_uid != 0 ) {
-    rc = setresuid(cfg_uid, cfg_uid, cfg_uid);
-    if( rc == -1 )
-      init_failed("Failed to drop UID to %d: %s", cfg_uid, strerror(errno));
-  }
+static void keep_capability(cap_t cap, cap_value_t cap_val, const char* name)
+{
+  int rc = cap_set_flag(cap, CAP_EFFECTIVE, 1, &cap_val, CAP_SET);
+  if( rc == -1 )
+    init_failed("Failed to set %s flag to CAP_EFFECTIVE: %s",
+                name, strerror(errno));
+  permit_capability(cap, cap_val, name);
+}
+
+
+/* Drop all capabilities of the calling thread except CAP_NET_ADMIN and those
+ * needed by the configuration.  [serve_ns] says whether the thread is going
+ * to start serving other namespaces with --multi-ns. */
+static void set_capabilities(bool serve_ns)
+{
+  int rc;
 
   cap_t cap = cap_init();
   if( cap == NULL )
@@ -924,35 +983,23 @@ drop_privileges(struct cp_session* s, bool in_main_netns)
    * permissions break dump state machine, so we keep CAP_NET_ADMIN in all
    * the cases.
    */
-  cap_value_t cap_val = CAP_NET_ADMIN;
-  rc = cap_set_flag(cap, CAP_EFFECTIVE, 1, &cap_val, CAP_SET);
-  if( rc == -1 )
-    init_failed("Failed to set CAP_NET_ADMIN flag to CAP_EFFECTIVE: %s",
-                strerror(errno));
-  rc = cap_set_flag(cap, CAP_PERMITTED, 1, &cap_val, CAP_SET);
-  if( rc == -1 )
-    init_failed("Failed to set CAP_NET_ADMIN flag to CAP_PERMITTED: %s",
-                strerror(errno));
+  keep_capability(cap, CAP_NET_ADMIN, "CAP_NET_ADMIN");
 
   /* We have to obtain a bpf file descriptor to pass it to kernel.
    * It is stupid, bpf_prog_by_id() is not exported, so can't be used by
    * the Onload module.
    *
-   * Unfortunately BPF_PROG_GET_FD_BY_ID requires CAP_SYS_ADMIN
+   * Unfortunately BPF_PROG_GET_FD_BY_ID requires CAP_SYS_ADMIN.  So does
+   * setns(): the threads serving other namespaces inherit it from the main
+   * thread as a permitted capability only, raise it for setns() and drop it
+   * once they have switched namespace.
    */
-  if( cfg_track_xdp ) {
-    cap_val = CAP_SYS_ADMIN;
-    rc = cap_set_flag(cap, CAP_EFFECTIVE, 1, &cap_val, CAP_SET);
-    if( rc == -1 )
-      init_failed("Failed to set CAP_SYS_ADMIN flag to CAP_EFFECTIVE: %s",
-                  strerror(errno));
-    rc = cap_set_flag(cap, CAP_PERMITTED, 1, &cap_val, CAP_SET);
-    if( rc == -1 )
-      init_failed("Failed to set CAP_SYS_ADMIN flag to CAP_PERMITTED: %s",
-                  strerror(errno));
-  }
+  if( cfg_track_xdp )
+    keep_capability(cap, CAP_SYS_ADMIN, "CAP_SYS_ADMIN");
+  else if( serve_ns )
+    permit_capability(cap, CAP_SYS_ADMIN, "CAP_SYS_ADMIN");
 
-  /* Set the capabilities: */
+  /* Set the capabilities.  This affects the calling thread only. */
   rc = cap_set_proc(cap);
   if( rc == -1 )
     init_failed("Failed to set CAP_NET_ADMIN and CAP_SYS_ADMIN to the process: %s",
@@ -960,10 +1007,66 @@ drop_privileges(struct cp_session* s, bool in_main_netns)
   rc = cap_free(cap);
   if( rc == -1 )
     init_failed("Failed to free capabilities: %s", strerror(errno));
+}
+
+
+/* Switch to the configured uid/gid, keeping the permitted capabilities. */
+static void switch_ids(void)
+{
+  int rc;
+
+  /* Do not drop CAP_NET_ADMIN when dropping uid/gid. */
+  if( cfg_gid != 0 || cfg_uid != 0 ) {
+    rc = prctl(PR_SET_KEEPCAPS, 1);
+    if( rc == -1 )
+      init_failed("Failed to keep capablilties via prctl: %s",
+                  strerror(errno));
+  }
+
+  /* UID/GID. */
+  if( cfg_gid != 0 ) {
+    rc = setresgid(cfg_gid, cfg_gid, cfg_gid);
+    if( rc == -1 )
+      init_failed("Failed to drop GID to %d: %s", cfg_gid, strerror(errno));
+  }
+  if( cfg_uid != 0 ) {
+    rc = setresuid(cfg_uid, cfg_uid, cfg_uid);
+    if( rc == -1 )
+      init_failed("Failed to drop UID to %d: %s", cfg_uid, strerror(errno));
+  }
+}
+
+
+/* Raise a capability which the calling thread has permitted. */
+static void raise_capability(cap_value_t cap_val, const char* name)
+{
+  int rc;
+
+  cap_t cap = cap_get_proc();
+  if( cap == NULL )
+    init_failed("Failed to get capabilities: %s", strerror(errno));
+  rc = cap_set_flag(cap, CAP_EFFECTIVE, 1, &cap_val, CAP_SET);
+  if( rc == -1 )
+    init_failed("Failed to set %s flag to CAP_EFFECTIVE: %s",
+                name, strerror(errno));
+  rc = cap_set_proc(cap);
+  if( rc == -1 )
+    init_failed("Failed to raise %s: %s", name, strerror(errno));
+  cap_free(cap);
+}
+
+
+/* Drop all capabilities except CAP_NET_ADMIN; switch uid/gid. */
+static void
+drop_privileges(struct cp_session* s, bool in_main_netns)
+{
+  switch_ids();
+  set_capabilities(cfg_multi_ns && in_main_netns);
 
 #ifndef NDEBUG
   if( cfg_core_size != CFG_CORE_SIZE_DEFAULT ) {
     struct rlimit lim;
+    int rc;
     lim.rlim_cur = lim.rlim_max = cfg_core_size;
     rc = setrlimit(RLIMIT_CORE, &lim);
     if( rc == -1 )
@@ -983,84 +1086,16 @@ oo_op_notify_all(struct cp_session* s)
 }
 
 
-/* This function is used in CP_SYSUNIT builds but not in CP_UNIT builds.  In
- * the latter case, we still build it in order to avoid unused-symbol warnings.
- */
-#ifdef CP_ANYUNIT
-int cp_server_entry(int argc, char** argv)
-#else
-int main(int argc, char** argv)
-#endif
+/* Set up the tables of [s] in the current network namespace.  [ns_thread]
+ * is true for the namespaces served by the threads of a multi-namespace
+ * server, which are sized by the --ns-*-max options. */
+static void session_init_tables(struct cp_session* s, bool ns_thread)
 {
   struct cp_tables_dim dim = {}; /* clears server_pid field for tests */
-  sigset_t sigmask;
-  struct cp_session* s = &session;
-  int rc;
-
-  /* Set sutable prefix */
-  set_log_prefix();
-
-  /* Ensure that early errors are not lost */
-  struct stat stat;
-  if( fstat(STDOUT_FILENO, &stat) != 0 ) {
-    int fd = open(DEV_KMSG, O_WRONLY);
-    if( fd != STDERR_FILENO ) {
-      dup2(fd, STDERR_FILENO);
-      /* Do not check the return code from dup2, as cannot log errors anyway.
-       * Maybe daemonise() will have more luck, let it check for problems. */
-    }
-  }
-
-  ci_app_getopt("", &argc, argv, cfg_opts, N_CFG_OPTS);
-  memset(s, 0, sizeof(*s));
-
-  if( ci_ver ) {
-    ci_log("Version: %s\n%s", onload_version, onload_copyright);
-    return 0;
-  }
-
-  if( cfg_affinity != -1 )
-    sched_setaffinity(0, sizeof(cfg_affinity), (cpu_set_t*)&cfg_affinity);
-
-  if( cfg_daemonise )
-    daemonise();
-
-  /* If a namespace was specified on the command line, switch into it before
-   * bringing up any of our state. */
-  if( cfg_ns_file != NULL ) {
-#ifndef CP_SYSUNIT
-    rc = ci_check_net_namespace("/proc/1/ns/net");
-    if( rc == 1 ) {
-      /* We are in pid 1 network namespace (allegedly the main one),
-       * check if we are going to serve a different network namespace. */
-      /* TODO: Detect being run from within pid namespace */
-      rc = ci_check_net_namespace(cfg_ns_file);
-      if( rc == 0 ) {
-        /* We are going to switch to different network namespace soon.
-         * Before it happens let's obtain handle to pid 1 namespace cplane.
-         * We are going to use it to look up state of lower interfaces. */
-         init_main_cplane(s);
-      }
-    }
-
-    if(ci_switch_net_namespace(cfg_ns_file) < 0) {
-      init_failed("Couldn't switch to %s: %s",
-                  cfg_ns_file, strerror(errno));
-    }
-#else
-    (void) rc;
-
-    /* For CP_SYSUNIT we invoke bring_up_kernel_state() to set shim into server
-     * mode.  We need to do this before initializing main cplane. */
-    bring_up_kernel_state();
-    /* Using initial value of CP_SHIM_FILE */
-    init_main_cplane(s);
-    /* 'Change' namespace by replacing value of CP_SHIM_FILE with cfg_ns_file */
-    ci_log("Switching from %s", getenv("CP_SHIM_FILE"));
-    setenv("CP_SHIM_FILE", cfg_ns_file, 1);
-    ci_log("Switched to %s", cfg_ns_file);
-#endif
-  }
+  int llap_max = ns_thread ? cfg_ns_llap_max : cfg_llap_max;
+  int ipif_max = ns_thread ? cfg_ns_ipif_max : cfg_ipif_max;
+  int fwd_max = ns_thread ? cfg_ns_fwd_max : cfg_fwd_max;
+  int mac_max = ns_thread ? cfg_ns_mac_max : cfg_mac_max;
 
   if( ci_cfg_no_ipv6 )
     s->flags |= CP_SESSION_NO_IPV6;
@@ -1073,22 +1108,19 @@ int main(int argc, char** argv)
   if( cfg_track_xdp )
     s->flags |= CP_SESSION_TRACK_XDP;
 
-  if( ci_cfg_bootstrap )
-    bring_up_kernel_state();
-
-  if( cfg_hwport_max == 0 || cfg_llap_max == 0 || cfg_ipif_max == 0 )
+  if( cfg_hwport_max == 0 || llap_max == 0 || ipif_max == 0 )
     init_failed("Table sizes should be non-zero");
   if( ! CICP_ROWID_IS_VALID(cfg_hwport_max) )
     init_failed("Too large hwport-max parameter");
-  if( ! CICP_ROWID_IS_VALID(cfg_llap_max) )
+  if( ! CICP_ROWID_IS_VALID(llap_max) )
     init_failed("Too large llap-max parameter");
-  if( ! CICP_ROWID_IS_VALID(cfg_ipif_max) )
+  if( ! CICP_ROWID_IS_VALID(ipif_max) )
     init_failed("Too large ipif-max parameter");
   dim.hwport_max = cfg_hwport_max;
-  dim.llap_max = cfg_llap_max;
-  dim.ipif_max = cfg_ipif_max;
-  dim.ip6if_max = ( s->flags & CP_SESSION_NO_IPV6 ) ? 0 : cfg_ipif_max;
-  if( cfg_ns_file == NULL ) {
+  dim.llap_max = llap_max;
+  dim.ipif_max = ipif_max;
+  dim.ip6if_max = ( s->flags & CP_SESSION_NO_IPV6 ) ? 0 : ipif_max;
+  if( cfg_ns_file == NULL && ! ns_thread ) {
     dim.svc_arrays_max = cfg_svc_arrays_max;
     /* Round up to next power of 2 */
     dim.svc_ep_max = ci_pow2(ci_log2_ge(cfg_svc_ep_max, 1));
@@ -1098,7 +1130,7 @@ int main(int argc, char** argv)
     dim.svc_ep_max = 0;
   }
 
-  dim.fwd_ln2 = ci_log2_ge(cfg_fwd_max, 1);
+  dim.fwd_ln2 = ci_log2_ge(fwd_max, 1);
   if( dim.fwd_ln2 >= sizeof(cicp_mac_rowid_t) * 8 ||
       (1 << dim.fwd_ln2) > CP_FWD_FLAG_DUMP )
     init_failed("Too large fwd-max parameter");
@@ -1111,50 +1143,43 @@ int main(int argc, char** argv)
   dim.llap_update_sig = dim.oof_req_sig + 1;
   dim.os_sync_sig = dim.llap_update_sig + 1;
 
-  dim.server_pid = getpid();
+  /* The kernel knows the server for a namespace by the thread that maps the
+   * MIBs, and that is how clients find the mibdump socket. */
+  dim.server_pid = ns_thread ? syscall(SYS_gettid) : getpid();
 
   s->llap_type_os_mask = LLAP_TYPE_OS_MASK_DEFAULT;
+  ci_dllist_init(&s->fwd_req_ul);
 
   init_files(s);
   s->frc_fwd_cache_ttl = cfg_fwd_cache_ttl * s->khz * 1000ULL;
   s->team_dump = NULL;
-  s->bond_max = cfg_bond_max;
-  s->mac_max_ln2 = ci_log2_ge(cfg_mac_max, 1);
+  s->bond_max = ns_thread ? cfg_ns_bond_max : cfg_bond_max;
+  s->mac_max_ln2 = ci_log2_ge(mac_max, 1);
   if( s->mac_max_ln2 > sizeof(cicp_mac_rowid_t) * 8 - 1 )
     init_failed("Too large mac-max parameter");
   s->mac_mask = (1 << s->mac_max_ln2) - 1;
 
   init_memory(&dim, s);
+}
 
-#ifndef CP_ANYUNIT
-  /* We need to create the agent socket before dropping privileges so that we
-   * don't run into permissions problems when binding it to a location in the
-   * filesystem.  We also need to do it _after_ calling init_memory(), to avoid
-   * racing against other cplane server instances. */
-  if( cfg_ns_file == NULL )
-    cp_agent_sock_init(s);
 
-#ifndef NO_CAPS
-  /* Drop all the privileges except CAP_NET_ADMIN in this namespace. */
-  drop_privileges(s, cfg_ns_file == NULL);
-#endif
-#endif
-
-  /* Get current sigmask before we block signals.  This sigmask will be
-   * used for epoll_pwait() to guarantee that signals handling and epoll fd
-   * handling to not need any interlocking. */
-  sigprocmask(SIG_SETMASK, NULL, &sigmask);
+/* Start handling signals and events for [s].  The caller must already have
+ * saved the signal mask to use while waiting. */
+static void session_init_events(struct cp_session* s, bool main_ns)
+{
   init_signals(s);
 
   cp_mibdump_sock_init(s);
 
-  init_epoll(s);
+  init_epoll(s, main_ns);
+}
 
-  ci_dllist_init(&s->fwd_req_ul);
 
-  /* We have some MIBs ready - tell others about us! */
-  ci_log("Onload Control Plane server %s started: id %u, pid %d", onload_version, s->cplane_id,
-         dim.server_pid);
+/* The main loop.  This returns only when the drivers have asked a thread
+ * serving another namespace to stop. */
+static void session_run(struct cp_session* s, sigset_t* sigmask)
+{
+  int rc;
 
   do {
     int i;
@@ -1162,7 +1187,7 @@ int main(int argc, char** argv)
     struct epoll_event events[EVENTS_NUM];
     cp_version_t mib_ver = *s->mib[0].version;
 
-    while( (rc = epoll_pwait(s->epoll_fd, events, EVENTS_NUM, 0, &sigmask)) < 0 )
+    while( (rc = epoll_pwait(s->epoll_fd, events, EVENTS_NUM, 0, sigmask)) < 0 )
       /* handle all signals */;
 
     if( rc == 0 ) {
@@ -1175,8 +1200,8 @@ int main(int argc, char** argv)
       }
 
       /* Sleep until we have some data or user asks for sync */
-      while( (rc = epoll_pwait(s->epoll_fd, events, EVENTS_NUM, -1, &sigmask)) <= 0 &&
-             !(s->flags & CP_SESSION_USER_OS_SYNC) ) {
+      while( (rc = epoll_pwait(s->epoll_fd, events, EVENTS_NUM, -1, sigmask)) <= 0 &&
+             !(s->flags & (CP_SESSION_USER_OS_SYNC | CP_SESSION_QUIT)) ) {
         /* handle signals */
       }
 
@@ -1205,7 +1230,496 @@ int main(int argc, char** argv)
          */
       oo_op_notify_all(s);
     }
-  } while(1);
+  } while( ! (s->flags & CP_SESSION_QUIT) );
+}
+
+
+#ifndef CP_ANYUNIT
+/*
+ *** Multi-namespace mode ***
+ *
+ * With --multi-ns, the server for the main namespace also serves the other
+ * namespaces.  Instead of spawning a server process for a namespace, the
+ * drivers send us CP_HMSG_SERVE_NETNS with the pid of a process in it.  We
+ * start a thread which switches to that namespace and serves it with a
+ * cp_session of its own, so that the rest of the server needs no changes:
+ * the thread has its own netlink sockets, /dev/onload fd and MIBs.  The
+ * drivers treat the thread as the server for the namespace and direct their
+ * signals at it.
+ *
+ * A thread costs much less than a process, the table sizes for these
+ * namespaces are set separately by the --ns-*-max options, and the large
+ * per-fwd-table array in cp_session is only touched for fwd tables in use.
+ */
+struct cp_ns_session {
+  struct cp_session s;
+  /* The namespace served, identified by its nsfs inode */
+  dev_t ns_dev;
+  ino_t ns_ino;
+  int ns_fd;
+  bool running;
+  ci_dllink link;
+};
+
+#define NS_THREAD_STACK_SIZE (256 * 1024)
+
+/* Sessions for the other namespaces; the list is protected by the lock. */
+static ci_dllist ns_sessions;
+static pthread_mutex_t ns_sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+static dev_t main_ns_dev;
+static ino_t main_ns_ino;
+
+/* Signal mask for the threads to use while waiting */
+static sigset_t ns_sigmask;
+
+/* Handle for the main cplane, shared by the threads to look up the state of
+ * lower interfaces. */
+static struct oo_cplane_handle* ns_main_cp;
+static pthread_mutex_t ns_main_cp_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Socket to the process which opens the namespaces for us */
+static int ns_opener_sock = -1;
+
+
+#ifndef NO_CAPS
+/* The helper process needs CAP_SYS_PTRACE to open the namespaces of other
+ * users' processes, and nothing else. */
+static void ns_opener_set_capabilities(void)
+{
+  int rc;
+
+  cap_t cap = cap_init();
+  if( cap == NULL )
+    init_failed("Failed to allocate capabilities: %s", strerror(errno));
+  keep_capability(cap, CAP_SYS_PTRACE, "CAP_SYS_PTRACE");
+  rc = cap_set_proc(cap);
+  if( rc == -1 )
+    init_failed("Failed to set CAP_SYS_PTRACE to the process: %s",
+                strerror(errno));
+  cap_free(cap);
+}
+#endif
+
+
+/* Fork the process which serves cp_netns_opener_request().  This must be
+ * done while we still have our privileges and only one thread. */
+static void ns_opener_start(void)
+{
+  pid_t ppid = getpid();
+  pid_t pid;
+  int sv[2];
+
+  if( socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0 )
+    init_failed("Failed to create namespace opener socket: %s",
+                strerror(errno));
+  pid = fork();
+  if( pid < 0 )
+    init_failed("Failed to fork namespace opener: %s", strerror(errno));
+
+  if( pid == 0 ) {
+    close(sv[0]);
+    /* Go when the server goes, even if it has gone already. */
+    if( prctl(PR_SET_PDEATHSIG, SIGKILL) < 0 || getppid() != ppid )
+      _exit(1);
+#ifndef NO_CAPS
+    switch_ids();
+    ns_opener_set_capabilities();
+#endif
+    cp_netns_opener_run(sv[1]);
+    _exit(0);
+  }
+
+  close(sv[1]);
+  ns_opener_sock = sv[0];
+}
+
+
+static void ns_sessions_init(void)
+{
+  struct stat ns_stat;
+
+  if( stat("/proc/self/ns/net", &ns_stat) < 0 )
+    init_failed("Failed to stat our network namespace: %s", strerror(errno));
+  main_ns_dev = ns_stat.st_dev;
+  main_ns_ino = ns_stat.st_ino;
+  ci_dllist_init(&ns_sessions);
+  ns_opener_start();
+}
+
+
+static struct oo_cplane_handle* ns_main_cplane_get(void)
+{
+  struct oo_cplane_handle* cp;
+  int fd;
+
+  /* This waits for the main thread to sync the main cplane, so it must be
+   * called from another thread. */
+  pthread_mutex_lock(&ns_main_cp_lock);
+  if( ns_main_cp == NULL && (cp = malloc(sizeof(*cp))) != NULL ) {
+    if( oo_fd_open(&fd) == 0 ) {
+      if( oo_cp_create(fd, cp, CP_SYNC_LIGHT, 0) == 0 )
+        ns_main_cp = cp;
+      else
+        close(fd);
+    }
+    if( ns_main_cp != cp )
+      free(cp);
+  }
+  cp = ns_main_cp;
+  pthread_mutex_unlock(&ns_main_cp_lock);
+  return cp;
+}
+
+
+static void free_route_tables(struct cp_route_table* table)
+{
+  while( table != NULL ) {
+    struct cp_route_table* next = table->next;
+    cp_ippl_free(&table->routes);
+    free(table);
+    table = next;
+  }
+}
+
+
+/* Release everything belonging to a session for another namespace.  This
+ * copes with a session that failed part way through its initialisation. */
+static void ns_session_free(struct cp_ns_session* ns)
+{
+  struct cp_session* s = &ns->s;
+  struct cp_tables_dim* dim = s->mib[0].dim;
+  int i;
+
+  if( ns->running ) {
+    timer_delete(s->timer_net.t);
+    timer_delete(s->timer_fwd.t);
+  }
+  if( s->epoll_fd >= 0 ) {
+    free_session(s);
+    close(s->epoll_fd);
+  }
+
+  while( s->team_dump != NULL ) {
+    struct cp_team_dump* next = s->team_dump->next;
+    free(s->team_dump);
+    s->team_dump = next;
+  }
+  while( ci_dllist_not_empty(&s->fwd_req_ul) )
+    free(CI_CONTAINER(struct cp_fwd_req, link,
+                      ci_dllist_pop(&s->fwd_req_ul)));
+  for( i = 0; i < ROUTE_TABLE_HASH_SIZE; ++i ) {
+    free_route_tables(s->rt_table[i]);
+    free_route_tables(s->rt6_table[i]);
+  }
+  cp_ippl_free(&s->route_dst);
+  cp_ippl_free(&s->rule_src);
+  cp_ippl_free(&s->ip6_route_dst);
+  cp_ippl_free(&s->ip6_rule_src);
+  cp_ippl_free(&s->laddr);
+
+  /* Unmapping the MIBs is what tells the drivers that we have gone. */
+  if( dim != NULL ) {
+    for( i = 0; i < CP_MAX_INSTANCES; ++i ) {
+      struct cp_fwd_state* fwd_state = &s->__fwd_state[i];
+      if( fwd_state->fwd_table.rows == NULL )
+        continue;
+      munmap(fwd_state->fwd_table.rows,
+             CI_ROUND_UP(cp_calc_fwd_blob_size(dim), CI_PAGE_SIZE));
+      munmap(fwd_state->fwd_table.rw_rows,
+             CI_ROUND_UP(cp_calc_fwd_rw_size(dim), CI_PAGE_SIZE));
+      free(fwd_state->priv_rows);
+      free(fwd_state->fwd_used);
+    }
+    munmap(dim, CI_ROUND_UP(cp_calc_mib_size(dim), CI_PAGE_SIZE));
+  }
+  free(s->seen);
+  free(s->mac_used);
+  free(s->ip6_mac_used);
+  free(s->service_used);
+  free(s->llap_priv);
+  free(s->bond);
+  free(s->mac);
+  free(s->ip6_mac);
+  free(s->buf);
+
+  if( s->sock_net >= 0 )
+    close(s->sock_net);
+  for( i = 0; i < CP_GENL_GROUP_MAX; ++i )
+    if( s->sock_gen[i] >= 0 )
+      close(s->sock_gen[i]);
+  for( i = 0; i < 2; ++i )
+    if( s->pipe[i] >= 0 )
+      close(s->pipe[i]);
+  if( s->sock >= 0 )
+    close(s->sock);
+  if( s->mibdump_sock >= 0 )
+    close(s->mibdump_sock);
+  if( s->oo_fd >= 0 )
+    close(s->oo_fd);
+  if( ns->ns_fd >= 0 )
+    close(ns->ns_fd);
+
+  pthread_mutex_lock(&ns_sessions_lock);
+  ci_dllist_remove(&ns->link);
+  pthread_mutex_unlock(&ns_sessions_lock);
+  free(ns);
+}
+
+
+static CI_NORETURN ns_session_failed(struct cp_session* s)
+{
+  struct cp_ns_session* ns = CI_CONTAINER(struct cp_ns_session, s, s);
+
+  ci_log("Failed to serve network namespace %lu",
+         (unsigned long) ns->ns_ino);
+  ns_session_free(ns);
+  pthread_exit(NULL);
+}
+
+
+static void* ns_session_thread(void* arg)
+{
+  struct cp_ns_session* ns = arg;
+  struct cp_session* s = &ns->s;
+  int rc;
+
+  thread_session = s;
+
+  /* Get hold of the main cplane before leaving the main namespace. */
+  s->main_cp_handle = ns_main_cplane_get();
+  if( s->main_cp_handle == NULL )
+    init_failed("Can't open main cplane");
+
+#ifndef NO_CAPS
+  raise_capability(CAP_SYS_ADMIN, "CAP_SYS_ADMIN");
+#endif
+  rc = syscall(__NR_setns, ns->ns_fd, CLONE_NEWNET);
+  if( rc < 0 )
+    init_failed("Couldn't switch to network namespace: %s", strerror(errno));
+  close(ns->ns_fd);
+  ns->ns_fd = -1;
+
+  session_init_tables(s, true);
+#ifndef NO_CAPS
+  set_capabilities(false);
+#endif
+  session_init_events(s, false);
+  ns->running = true;
+
+  ci_log("Serving network namespace %lu: id %u, tid %d",
+         (unsigned long) ns->ns_ino, s->cplane_id,
+         s->mib[0].dim->server_pid);
+
+  session_run(s, &ns_sigmask);
+
+  ci_log("Stopped serving network namespace %lu: id %u",
+         (unsigned long) ns->ns_ino, s->cplane_id);
+  ns_session_free(ns);
+  return NULL;
+}
+
+
+/* Start serving the network namespace [ino] of process [pid], if we are
+ * not serving it already. */
+static void ns_session_start(pid_t pid, ci_uint32 ino)
+{
+  struct cp_ns_session* ns;
+  struct stat ns_stat;
+  pthread_attr_t attr;
+  pthread_t thread;
+  ci_dllink* link;
+  int fd;
+  int rc;
+
+  fd = cp_netns_opener_request(ns_opener_sock, pid, ino);
+  if( fd < 0 ) {
+    /* The process may have gone already.  If the namespace is still in use,
+     * the drivers will ask again. */
+    ci_log("%s: Failed to open network namespace %u of pid %d: %s",
+           __FUNCTION__, ino, pid, strerror(-fd));
+    return;
+  }
+  if( fstat(fd, &ns_stat) < 0 ||
+      (ns_stat.st_dev == main_ns_dev && ns_stat.st_ino == main_ns_ino) ) {
+    close(fd);
+    return;
+  }
+
+  /* Clients that are waiting for a server keep asking for one until it is
+   * ready, so we often get here for a namespace we are already serving. */
+  pthread_mutex_lock(&ns_sessions_lock);
+  CI_DLLIST_FOR_EACH(link, &ns_sessions) {
+    ns = CI_CONTAINER(struct cp_ns_session, link, link);
+    if( ns->ns_dev == ns_stat.st_dev && ns->ns_ino == ns_stat.st_ino ) {
+      pthread_mutex_unlock(&ns_sessions_lock);
+      close(fd);
+      return;
+    }
+  }
+
+  ns = calloc(1, sizeof(*ns));
+  if( ns == NULL ) {
+    pthread_mutex_unlock(&ns_sessions_lock);
+    close(fd);
+    ci_log("%s: Out of memory", __FUNCTION__);
+    return;
+  }
+  ns->ns_dev = ns_stat.st_dev;
+  ns->ns_ino = ns_stat.st_ino;
+  ns->ns_fd = fd;
+  ns->s.epoll_fd = -1;
+  ns->s.sock_net = -1;
+  for( rc = 0; rc < CP_GENL_GROUP_MAX; ++rc )
+    ns->s.sock_gen[rc] = -1;
+  ns->s.pipe[0] = ns->s.pipe[1] = -1;
+  ns->s.sock = -1;
+  ns->s.oo_fd = -1;
+  ns->s.mibdump_sock = -1;
+  ns->s.agent_sock = -1;
+  ns->s.main_cp_fd = -1;
+  ci_dllist_init(&ns->s.fwd_req_ul);
+  ci_dllist_push(&ns_sessions, &ns->link);
+  pthread_mutex_unlock(&ns_sessions_lock);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, NS_THREAD_STACK_SIZE);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  rc = pthread_create(&thread, &attr, ns_session_thread, ns);
+  pthread_attr_destroy(&attr);
+  if( rc != 0 ) {
+    ci_log("%s: Failed to start thread for network namespace %lu: %s",
+           __FUNCTION__, (unsigned long) ns->ns_ino, strerror(rc));
+    ns_session_free(ns);
+  }
+}
+#endif
+
+
+/* This function is used in CP_SYSUNIT builds but not in CP_UNIT builds.  In
+ * the latter case, we still build it in order to avoid unused-symbol warnings.
+ */
+#ifdef CP_ANYUNIT
+int cp_server_entry(int argc, char** argv)
+#else
+int main(int argc, char** argv)
+#endif
+{
+  sigset_t sigmask;
+  struct cp_session* s = &session;
+  int rc;
+
+  /* Set sutable prefix */
+  set_log_prefix();
+
+  /* Ensure that early errors are not lost */
+  struct stat stat;
+  if( fstat(STDOUT_FILENO, &stat) != 0 ) {
+    int fd = open(DEV_KMSG, O_WRONLY);
+    if( fd != STDERR_FILENO ) {
+      dup2(fd, STDERR_FILENO);
+      /* Do not check the return code from dup2, as cannot log errors anyway.
+       * Maybe daemonise() will have more luck, let it check for problems. */
+    }
+  }
+
+  ci_app_getopt("", &argc, argv, cfg_opts, N_CFG_OPTS);
+  memset(s, 0, sizeof(*s));
+  thread_session = s;
+
+  if( ci_ver ) {
+    ci_log("Version: %s\n%s", onload_version, onload_copyright);
+    return 0;
+  }
+
+  if( cfg_affinity != -1 )
+    sched_setaffinity(0, sizeof(cfg_affinity), (cpu_set_t*)&cfg_affinity);
+
+  if( cfg_daemonise )
+    daemonise();
+
+  if( cfg_multi_ns ) {
+#ifndef CP_ANYUNIT
+    if( cfg_ns_file != NULL )
+      init_failed("--%s is for the main namespace only",
+                  CPLANE_SERVER_MULTI_NS);
+    ns_sessions_init();
+#else
+    init_failed("--%s is not supported in unit tests",
+                CPLANE_SERVER_MULTI_NS);
+#endif
+  }
+
+  /* If a namespace was specified on the command line, switch into it before
+   * bringing up any of our state. */
+  if( cfg_ns_file != NULL ) {
+#ifndef CP_SYSUNIT
+    rc = ci_check_net_namespace("/proc/1/ns/net");
+    if( rc == 1 ) {
+      /* We are in pid 1 network namespace (allegedly the main one),
+       * check if we are going to serve a different network namespace. */
+      /* TODO: Detect being run from within pid namespace */
+      rc = ci_check_net_namespace(cfg_ns_file);
+      if( rc == 0 ) {
+        /* We are going to switch to different network namespace soon.
+         * Before it happens let's obtain handle to pid 1 namespace cplane.
+         * We are going to use it to look up state of lower interfaces. */
+         init_main_cplane(s);
+      }
+    }
+
+    if(ci_switch_net_namespace(cfg_ns_file) < 0) {
+      init_failed("Couldn't switch to %s: %s",
+                  cfg_ns_file, strerror(errno));
+    }
+#else
+    (void) rc;
+
+    /* For CP_SYSUNIT we invoke bring_up_kernel_state() to set shim into server
+     * mode.  We need to do this before initializing main cplane. */
+    bring_up_kernel_state();
+    /* Using initial value of CP_SHIM_FILE */
+    init_main_cplane(s);
+    /* 'Change' namespace by replacing value of CP_SHIM_FILE with cfg_ns_file */
+    ci_log("Switching from %s", getenv("CP_SHIM_FILE"));
+    setenv("CP_SHIM_FILE", cfg_ns_file, 1);
+    ci_log("Switched to %s", cfg_ns_file);
+#endif
+  }
+
+  if( ci_cfg_bootstrap )
+    bring_up_kernel_state();
+
+  session_init_tables(s, false);
+
+#ifndef CP_ANYUNIT
+  /* We need to create the agent socket before dropping privileges so that we
+   * don't run into permissions problems when binding it to a location in the
+   * filesystem.  We also need to do it _after_ calling init_memory(), to avoid
+   * racing against other cplane server instances. */
+  if( cfg_ns_file == NULL )
+    cp_agent_sock_init(s);
+
+#ifndef NO_CAPS
+  /* Drop all the privileges except CAP_NET_ADMIN in this namespace. */
+  drop_privileges(s, cfg_ns_file == NULL);
+#endif
+#endif
+
+  /* Get current sigmask before we block signals.  This sigmask will be
+   * used for epoll_pwait() to guarantee that signals handling and epoll fd
+   * handling to not need any interlocking. */
+  sigprocmask(SIG_SETMASK, NULL, &sigmask);
+#ifndef CP_ANYUNIT
+  ns_sigmask = sigmask;
+#endif
+  session_init_events(s, cfg_ns_file == NULL);
+
+  /* We have some MIBs ready - tell others about us! */
+  ci_log("Onload Control Plane server %s started: id %u, pid %d%s",
+         onload_version, s->cplane_id, s->mib[0].dim->server_pid,
+         cfg_multi_ns ? ", serving multiple namespaces" : "");
+
+  session_run(s, &sigmask);
 
   return 0;
 }
@@ -5,7 +5,7 @@
 # tests.
 SERVER_OBJS := server.o netlink.o llap.o route.o services.o teambond.o team.o \
 	debug.o bond.o ip_prefix_list.o dump.o print.o mibdump.o \
-	epoll.o agent.o
+	epoll.o agent.o netns.o
 
 CLIENT_OBJS := client.o
 
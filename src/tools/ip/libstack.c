@@ -34,6 +34,7 @@
 #include <ci/internal/more_stats.h>
 #include <ci/internal/stats_dump.h>
 #include "sockbuf_filter.h"
+#include <ci/net/sockopts.h>
 
 #undef DO
 #undef IGNORE
@@ -1259,6 +1260,110 @@ static void stack_netstat(ci_netif* ni)
   ci_netif_print_sockets(ni);
 }
 
+/* As "ss -tuinm", indexed by TCP_INFO state */
+static const char* const ss_state_str[] = {
+  "UNKNOWN", "ESTAB", "SYN-SENT", "SYN-RECV", "FIN-WAIT-1", "FIN-WAIT-2",
+  "TIME-WAIT", "UNCONN", "CLOSE-WAIT", "LAST-ACK", "LISTEN", "CLOSING",
+};
+
+static void ss_tcp_info(ci_netif* ni, ci_tcp_state* ts, int sendq)
+{
+  struct ci_tcp_info i;
+
+  ci_tcp_info_fill(ni, &ts->s, &i);
+  ci_log("\t %s%s%s%swscale:%d,%d rto:%g rtt:%g/%g ato:%g mss:%u pmtu:%u "
+         "rcvmss:%u advmss:%u cwnd:%u ssthresh:%u retrans:%u/%u unacked:%u "
+         "lastsnd:%u lastrcv:%u rcv_space:%u "
+         "bytes_sent:%llu bytes_retrans:%llu bytes_acked:%llu "
+         "bytes_received:%llu segs_out:%u segs_in:%u data_segs_out:%u "
+         "data_segs_in:%u delivery_rate:%llubps busy:%llums "
+         "rwnd_limited:%llums sndbuf_limited:%llums notsent:%u minrtt:%g "
+         "snd_wnd:%u skmem:(r%u,rb%d,t%d,tb%d)",
+         i.tcpi_options & CI_TCPI_OPT_TIMESTAMPS ? "ts " : "",
+         i.tcpi_options & CI_TCPI_OPT_SACK ? "sack " : "",
+         i.tcpi_options & CI_TCPI_OPT_ECN ? "ecn " : "",
+         ts->s.s_aflags & CI_SOCK_AFLAG_NODELAY ? "nodelay " : "",
+         i.tcpi_snd_wscale, i.tcpi_rcv_wscale,
+         i.tcpi_rto / 1000.0, i.tcpi_rtt / 1000.0, i.tcpi_rttvar / 1000.0,
+         i.tcpi_ato / 1000.0, i.tcpi_snd_mss, i.tcpi_pmtu, i.tcpi_rcv_mss,
+         i.tcpi_advmss, i.tcpi_snd_cwnd, i.tcpi_snd_ssthresh,
+         i.tcpi_retransmits, i.tcpi_total_retrans, i.tcpi_unacked,
+         i.tcpi_last_data_sent, i.tcpi_last_data_recv, i.tcpi_rcv_space,
+         (unsigned long long) i.tcpi_bytes_sent,
+         (unsigned long long) i.tcpi_bytes_retrans,
+         (unsigned long long) i.tcpi_bytes_acked,
+         (unsigned long long) i.tcpi_bytes_received,
+         i.tcpi_segs_out, i.tcpi_segs_in,
+         i.tcpi_data_segs_out, i.tcpi_data_segs_in,
+         (unsigned long long) i.tcpi_delivery_rate * 8,
+         (unsigned long long) i.tcpi_busy_time / 1000,
+         (unsigned long long) i.tcpi_rwnd_limited / 1000,
+         (unsigned long long) i.tcpi_sndbuf_limited / 1000,
+         i.tcpi_notsent_bytes,
+         i.tcpi_min_rtt == ~0u ? 0 : i.tcpi_min_rtt / 1000.0,
+         i.tcpi_snd_wnd, tcp_rcv_usr(ts), ts->s.so.rcvbuf, sendq, ts->s.so.sndbuf);
+}
+
+/* Output like "ss -tuinm" for the sockets in the stack, so that monitoring
+ * can see the state that the kernel doesn't have.  The stack lock is not
+ * taken, so values may be inconsistent with each other.
+ */
+static void stack_ss(ci_netif* ni)
+{
+  int id;
+
+  ci_log("%-5s %-10s %8s %8s %25s %25s  %s", "Netid", "State", "Recv-Q",
+         "Send-Q", "Local Address:Port", "Peer Address:Port", "Stack:Id");
+  for( id = 0; id < (int) ni->state->n_ep_bufs; ++id ) {
+    citp_waitable_obj* wo = SP_TO_WAITABLE_OBJ(ni, id);
+    citp_waitable* w = &wo->waitable;
+    ci_sock_cmn* s = &wo->sock;
+    const char* state;
+    char laddr[64], raddr[64];
+    int recvq = 0, sendq = 0;
+
+    if( w->state == CI_TCP_STATE_FREE || w->state == CI_TCP_CLOSED ||
+        ! CI_TCP_STATE_IS_SOCKET(w->state) ||
+        ! sockbuf_filter_matches(&sft, wo) )
+      continue;
+
+    if( w->state == CI_TCP_STATE_UDP ) {
+      /* The UDP receive queue doesn't count bytes, so Recv-Q is datagrams
+       * as for netstat. */
+      state = CI_IPX_ADDR_IS_ANY(sock_ipx_raddr(s)) ? "UNCONN" : "ESTAB";
+      recvq = ci_udp_recv_q_pkts(&wo->udp.recv_q);
+      sendq = wo->udp.tx_count;
+    }
+    else if( w->state & CI_TCP_STATE_TCP ) {
+      state = ss_state_str[ci_sock_states_linux_map[
+                                          CI_TCP_STATE_NUM(w->state)]];
+      if( w->state == CI_TCP_LISTEN ) {
+        recvq = ci_tcp_acceptq_n(&wo->tcp_listen);
+        sendq = wo->tcp_listen.acceptq_max;
+      }
+      else if( w->state != CI_TCP_SYN_SENT ) {
+        recvq = tcp_rcv_usr(&wo->tcp);
+        sendq = SEQ_SUB(tcp_enq_nxt(&wo->tcp), tcp_snd_una(&wo->tcp));
+      }
+    }
+    else {
+      continue;
+    }
+
+    snprintf(laddr, sizeof(laddr), OOF_IPXPORT,
+             OOFA_IPXPORT(sock_ipx_laddr(s), sock_lport_be16(s)));
+    snprintf(raddr, sizeof(raddr), OOF_IPXPORT,
+             OOFA_IPXPORT(sock_ipx_raddr(s), sock_rport_be16(s)));
+    ci_log("%-5s %-10s %8d %8d %25s %25s  %d:%d",
+           w->state == CI_TCP_STATE_UDP ? "udp" : "tcp", state, recvq, sendq,
+           laddr, raddr, NI_ID(ni), id);
+    if( (w->state & CI_TCP_STATE_TCP) && w->state != CI_TCP_LISTEN )
+      ss_tcp_info(ni, &wo->tcp, sendq);
+    else if( w->state == CI_TCP_STATE_UDP )
+      ci_log("\t skmem:(rb%d,t%d,tb%d)", s->so.rcvbuf, sendq, s->so.sndbuf);
+  }
+}
+
 static void stack_dmaq(ci_netif* ni)
 {
   ci_netif_dump_dmaq(ni, cfg_dump);
@@ -1516,6 +1621,82 @@ static void stack_qs(ci_netif* ni)
     libstack_netif_unlock(ni);
 }
 
+#if CI_CFG_SOCK_CYCLES
+struct sock_cycles_ent {
+  int       id;
+  ci_uint64 stack;
+};
+
+/* oo_cycles64_to_usec() gives 32 bits, which the per-socket totals
+ * outgrow in about 71 minutes. */
+static ci_uint64 sock_cycles_to_usec(ci_netif* ni, ci_uint64 cycles)
+{
+  unsigned khz = IPTIMER_STATE(ni)->khz;
+  return cycles / khz * 1000 + cycles % khz * 1000 / khz;
+}
+
+static int sock_cycles_ent_cmp(const void* a, const void* b)
+{
+  const struct sock_cycles_ent* ea = a;
+  const struct sock_cycles_ent* eb = b;
+  if( ea->stack != eb->stack )
+    return ea->stack < eb->stack ? 1 : -1;
+  return ea->id - eb->id;
+}
+
+static void stack_top_sockets(ci_netif* ni)
+{
+  ci_netif_state* ns = ni->state;
+  struct sock_cycles_ent* ents;
+  ci_uint64 total = 0;
+  int id, i, n = 0;
+
+  if( ! NI_OPTS(ni).sock_cycles ) {
+    ci_log("%s: stack %d: EF_SOCK_CYCLES is not set", __FUNCTION__,
+           NI_ID(ni));
+    return;
+  }
+  ents = malloc(ns->n_ep_bufs * sizeof(*ents));
+  CI_TEST(ents != NULL);
+
+  for( id = 0; id < (int) ns->n_ep_bufs; ++id ) {
+    citp_waitable_obj* wo = ID_TO_WAITABLE_OBJ(ni, id);
+    struct oo_sock_cycles* c = &wo->sock.cycles;
+    if( wo->waitable.state == CI_TCP_STATE_FREE ||
+        ! CI_TCP_STATE_IS_SOCKET(wo->waitable.state) ||
+        ! sockbuf_filter_matches(&sft, wo) )
+      continue;
+    if( (c->rx | c->tx | c->timer | c->recv | c->send) == 0 )
+      continue;
+    ents[n].id = id;
+    ents[n].stack = c->rx + c->tx + c->timer;
+    total += ents[n].stack;
+    ++n;
+  }
+  qsort(ents, n, sizeof(*ents), sock_cycles_ent_cmp);
+
+  /* Stack processing (rx, tx, timer) is what the sockets cost the stack,
+   * so rank by that.  recv and send include time blocked in the call. */
+  ci_log("stack %d: top sockets by stack processing (usec)", NI_ID(ni));
+  ci_log("%8s %-12s %6s %12s %12s %12s %12s %12s %12s", "id", "state",
+         "stack%", "stack", "rx", "tx", "timer", "recv", "send");
+  for( i = 0; i < n; ++i ) {
+    citp_waitable_obj* wo = ID_TO_WAITABLE_OBJ(ni, ents[i].id);
+    struct oo_sock_cycles* c = &wo->sock.cycles;
+    ci_log("%3d:%-4d %-12s %6.2f %12"CI_PRIu64" %12"CI_PRIu64
+           " %12"CI_PRIu64" %12"CI_PRIu64" %12"CI_PRIu64" %12"CI_PRIu64,
+           NI_ID(ni), ents[i].id, ci_tcp_state_str(wo->waitable.state),
+           total ? 100.0 * ents[i].stack / total : 0.0,
+           sock_cycles_to_usec(ni, ents[i].stack),
+           sock_cycles_to_usec(ni, c->rx), sock_cycles_to_usec(ni, c->tx),
+           sock_cycles_to_usec(ni, c->timer),
+           sock_cycles_to_usec(ni, c->recv),
+           sock_cycles_to_usec(ni, c->send));
+  }
+  free(ents);
+}
+#endif
+
 static void stack_lock(ci_netif* ni)
 {
   if( cfg_lock )
@@ -2222,6 +2403,8 @@ static const stack_op_t stack_ops[] = {
 #endif
   STACK_OP(netif_extra,        "show extra per-stack state"),
   STACK_OP(netstat,            "show netstat like output for sockets"),
+  STACK_OP(ss,                 "show ss -tuinm like output for sockets, "
+                                 "with TCP_INFO, without locking"),
   STACK_OP(dmaq,               "show state of DMA queue"),
   STACK_OP(timeoutq,           "show state of timeout queue"),
   STACK_OP(opts,               "show configuration options"),
@@ -2250,6 +2433,10 @@ static const stack_op_t stack_ops[] = {
   STACK_OP_F(clusters,         "show clusters", FL_ONCE),
 #endif
   STACK_OP(qs,                 "show queues for each socket in stack"),
+#if CI_CFG_SOCK_CYCLES
+  STACK_OP(top_sockets,        "rank sockets by cycles spent processing "
+                                 "them (needs EF_SOCK_CYCLES)"),
+#endif
   STACK_OP(lock,               "lock the stack"),
   STACK_OP_AX(lock_flags,      "lock the stack and set lock flags", "<flags>"),
   STACK_OP(trylock,            "try to lock the stack"),
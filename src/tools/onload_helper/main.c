@@ -7,6 +7,8 @@
  *
  * This process does not use the Socket APi, so it does not need
  * libonload.so to work.  It uses low-level Onload primitives.
+ *
+ * With -m, one helper process services many stacks; see shared.c.
  */
 
 #define _GNU_SOURCE
@@ -24,20 +26,27 @@
 #include <onload/common.h>
 #include <onload/ioctl.h>
 #include <onload/netif_dtor.h>
+#include <onload/ul.h>
 #include <ci/internal/ip.h>
-
+#include "onload_helper.h"
 
 
 static char* log_prefix;
 
 static int cfg_ni_id = -1;
 static int /*bool*/ ci_cfg_log_to_kern = false;
+static int /*bool*/ cfg_shared = false;
+static unsigned cfg_workers = 2;
 
 static ci_cfg_desc cfg_opts[] = {
   { 's', "stack", CI_CFG_UINT, &cfg_ni_id,
     "Stack id, numeric" },
   { 'K', "log-to-kmsg", CI_CFG_FLAG, &ci_cfg_log_to_kern,
     "log via kernel messages" },
+  { 'm', "shared", CI_CFG_FLAG, &cfg_shared,
+    "service all stacks that ask for a shared helper" },
+  { 'w', "workers", CI_CFG_UINT, &cfg_workers,
+    "number of worker threads in shared mode" },
 };
 #define N_CFG_OPTS (sizeof(cfg_opts) / sizeof(cfg_opts[0]))
 
@@ -57,7 +66,7 @@ static void citp_log_fn_drv(const char* msg)
   ioctl(log_fd, OO_IOC_PRINTK, (long) msg);
 }
 
-static ci_uint32
+ci_uint32
 stack_next_timer_ms(ci_netif* ni)
 {
   /* Find the timer value based on closest_timer */
@@ -78,6 +87,32 @@ stack_next_timer_ms(ci_netif* ni)
   return ms_delay + 1;
 }
 
+void
+stack_lock_watchdog(ci_netif* ni, ci_uint64* reported_frc)
+{
+  char path[64], line[256];
+  ci_uint32 tid;
+  FILE* f;
+
+  tid = ci_netif_lock_watchdog(ni, reported_frc);
+  if( tid == 0 )
+    return;
+
+  /* The kernel stack tells us whether the holder is blocked, and where. */
+  snprintf(path, sizeof(path), "/proc/%u/stack", tid);
+  f = fopen(path, "r");
+  if( f == NULL ) {
+    ci_log("[%s]   lock holder %u: %s", ni->state->pretty_name, tid,
+           strerror(errno));
+    return;
+  }
+  while( fgets(line, sizeof(line), f) != NULL ) {
+    line[strcspn(line, "\n")] = '\0';
+    ci_log("[%s]   %s", ni->state->pretty_name, line);
+  }
+  fclose(f);
+}
+
 /* Finalize stack.  Exit with the stack locked, allowing module code to
  * shut down the queues, free the memory, etc.
  */
@@ -116,6 +151,7 @@ main_loop(ci_netif* ni)
   struct oo_ulh_waiter arg;
   bool is_last = false;
   bool is_locked = false;
+  ci_uint64 lock_watchdog_reported = 0;
 
   arg.timeout_ms = 0;
 
@@ -129,6 +165,9 @@ main_loop(ci_netif* ni)
       CITP_STATS_NETIF_ADD(ni, interrupt_evs, n);
       is_locked = true;
     }
+    else {
+      stack_lock_watchdog(ni, &lock_watchdog_reported);
+    }
 
     if( arg.rs_ref_count == 0 ) {
       if( ! is_last ) {
@@ -172,14 +211,18 @@ int main(int argc, char** argv)
   ci_app_getopt("", &argc, argv, cfg_opts, N_CFG_OPTS);
 
   ci_set_log_prefix("");
-  if( cfg_ni_id < 0 ) {
+  if( (cfg_ni_id < 0) == ! cfg_shared || cfg_workers == 0 ) {
     ci_log("Usage: %s -s <stack id>", argv[0]);
+    ci_log("       %s -m [-w <workers>]", argv[0]);
     ci_log("Version: %s\n%s", onload_version, onload_copyright);
     return 1;
   }
 
   /* We have the stack number: set up logging prefix */
-  snprintf(stack_name, sizeof(stack_name), "%d", cfg_ni_id);
+  if( cfg_shared )
+    strcpy(stack_name, "shared");
+  else
+    snprintf(stack_name, sizeof(stack_name), "%d", cfg_ni_id);
   stack_name[sizeof(stack_name) - 1] ='\0';
   set_log_prefix(stack_name);
 
@@ -228,6 +271,21 @@ int main(int argc, char** argv)
     openlog(NULL, LOG_PID, LOG_DAEMON);
   }
 
+  if( cfg_shared ) {
+    /* Set up logging via ioctl on a stackless driver handle. */
+    if( ci_cfg_log_to_kern ) {
+      ef_driver_handle dh;
+      if( ef_onload_driver_open(&dh, OO_STACK_DEV, 1) != 0 ) {
+        ci_log("Failed to open Onload driver: %s", strerror(errno));
+        return 1;
+      }
+      close(log_fd);
+      log_fd = dh;
+      ci_log_fn = citp_log_fn_drv;
+    }
+    return shared_helper_main(cfg_workers);
+  }
+
   /* Find the stack */
   rc = ci_netif_restore_id(ni, cfg_ni_id, true);
   if( rc != 0 ) {
@@ -16,8 +16,8 @@ MMAKE_LIB_DEPS	:= $(CIIP_LIB_DEPEND) $(CIAPP_LIB_DEPEND) \
 		   $(CITOOLS_LIB_DEPEND) $(CIUL_LIB_DEPEND) \
 		   $(CPLANE_LIB_DEPEND)
 
-$(onload_helper): main.o $(MMAKE_LIB_DEPS)
-	(libs="$(MMAKE_LIBS) $(MMAKE_STACKDUMP_LIBS)"; $(MMakeLinkCApp))
+$(onload_helper): main.o shared.o $(MMAKE_LIB_DEPS)
+	(libs="$(MMAKE_LIBS) $(MMAKE_STACKDUMP_LIBS) -lpthread"; $(MMakeLinkCApp))
 
 
 TARGETS	:= $(APPS:%=$(AppPattern))
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+#ifndef __ONLOAD_HELPER_H__
+#define __ONLOAD_HELPER_H__
+
+#include <ci/internal/ip.h>
+
+/* How long until the next IP timer of [ni] is due, or 0 if unknown. */
+extern ci_uint32 stack_next_timer_ms(ci_netif* ni);
+
+/* Report the holder of [ni]'s lock if it has held it for too long; see
+ * EF_LOCK_WATCHDOG_USEC. */
+extern void stack_lock_watchdog(ci_netif* ni, ci_uint64* reported_frc);
+
+/* Run the shared helper (-m).  Returns the process exit code. */
+extern int shared_helper_main(unsigned n_workers);
+
+#endif  /* __ONLOAD_HELPER_H__ */
@@ -0,0 +1,525 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2024 Advanced Micro Devices, Inc. */
+
+/* Shared helper: service many Onload stacks from one process.
+ *
+ * Stacks created with EF_HELPER_SHARED=1 hand their id to us over an
+ * abstract AF_UNIX socket (see <onload/ul/helper.h>) instead of starting
+ * a helper process of their own.
+ *
+ * Each stack has a deadline: its next IP timer, or the periodic poll
+ * interval if it has none.  A poller thread waits in epoll for the
+ * earliest deadline or for a stack fd to become readable (which it does
+ * when an interrupt needs handling in user level), and moves due stacks
+ * onto a FIFO run queue.  A small pool of workers takes stacks off the run
+ * queue and does what main_loop() does for a single stack, without ever
+ * blocking on a stack lock: if the application holds the lock then it is
+ * doing the work, and we back off.  A stack that still has events after
+ * one poll goes to the back of the run queue, so a busy stack cannot
+ * starve the others.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <ci/compat.h>
+#include <ci/tools/log.h>
+#include <ci/tools/debug.h>
+#include <ci/tools.h>
+
+#include <onload/common.h>
+#include <onload/ioctl.h>
+#include <onload/netif_dtor.h>
+#include <onload/ul/helper.h>
+#include <ci/internal/ip.h>
+#include "onload_helper.h"
+
+
+/* Service every stack at least this often, as the kernel does for a
+ * dedicated helper. */
+#define ULH_PERIODIC_MS        100
+/* Lock contention backoff: first step, and the cap. */
+#define ULH_BACKOFF_MIN_MS     1
+#define ULH_BACKOFF_MAX_MS     ULH_PERIODIC_MS
+/* Give up on a stack we must lock to finish, after failing for this long.
+ * This matches the SIGALRM in a dedicated helper. */
+#define ULH_LOCK_GIVE_UP_MS    1000
+/* Exit when no stacks have been attached for this long. */
+#define ULH_IDLE_EXIT_MS       10000
+
+
+struct ulh_stack {
+  ci_netif ni;
+  ci_uint64 deadline_ms;
+  /* Index in the deadline heap, or -1 if queued to run or running. */
+  int heap_i;
+  /* Set if an event arrived while the stack was not in the heap. */
+  bool kicked;
+  /* The application has gone, and we are closing the orphans. */
+  bool is_last;
+  unsigned backoff_ms;
+  ci_uint64 lock_fail_since_ms;
+  ci_uint64 lock_watchdog_reported;
+  struct ulh_stack* run_next;
+};
+
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t run_cond;
+
+  /* Binary min-heap of stacks waiting for their deadline. */
+  struct ulh_stack** heap;
+  int heap_n;
+  int heap_size;
+
+  /* FIFO of stacks that are due. */
+  struct ulh_stack* run_head;
+  struct ulh_stack** run_tail;
+
+  int n_stacks;
+  /* Released stacks, freed by the poller once it can no longer hold an
+   * epoll event for them. */
+  struct ulh_stack* dead;
+  int epoll_fd;
+  /* Wakes the poller when the earliest deadline moves. */
+  int event_fd;
+} ulh = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .run_cond = PTHREAD_COND_INITIALIZER,
+  .run_tail = &ulh.run_head,
+};
+
+
+static ci_uint64 now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ci_uint64) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/**********************************************************************
+ * Deadline heap and run queue.  All under ulh.lock.
+ */
+
+static void heap_set(int i, struct ulh_stack* st)
+{
+  ulh.heap[i] = st;
+  st->heap_i = i;
+}
+
+static void heap_up(int i)
+{
+  struct ulh_stack* st = ulh.heap[i];
+  while( i > 0 && ulh.heap[(i - 1) / 2]->deadline_ms > st->deadline_ms ) {
+    heap_set(i, ulh.heap[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  heap_set(i, st);
+}
+
+static void heap_down(int i)
+{
+  struct ulh_stack* st = ulh.heap[i];
+  int child;
+  while( (child = 2 * i + 1) < ulh.heap_n ) {
+    if( child + 1 < ulh.heap_n &&
+        ulh.heap[child + 1]->deadline_ms < ulh.heap[child]->deadline_ms )
+      ++child;
+    if( ulh.heap[child]->deadline_ms >= st->deadline_ms )
+      break;
+    heap_set(i, ulh.heap[child]);
+    i = child;
+  }
+  heap_set(i, st);
+}
+
+static int heap_push(struct ulh_stack* st)
+{
+  if( ulh.heap_n == ulh.heap_size ) {
+    int size = ulh.heap_size ? ulh.heap_size * 2 : 64;
+    void* p = realloc(ulh.heap, size * sizeof(ulh.heap[0]));
+    if( p == NULL )
+      return -ENOMEM;
+    ulh.heap = p;
+    ulh.heap_size = size;
+  }
+  heap_set(ulh.heap_n++, st);
+  heap_up(st->heap_i);
+  return 0;
+}
+
+static void heap_remove(struct ulh_stack* st)
+{
+  int i = st->heap_i;
+  ci_assert_ge(i, 0);
+  st->heap_i = -1;
+  if( --ulh.heap_n == i )
+    return;
+  heap_set(i, ulh.heap[ulh.heap_n]);
+  heap_down(i);
+  heap_up(ulh.heap[i]->heap_i);
+}
+
+static void run_enqueue(struct ulh_stack* st)
+{
+  st->run_next = NULL;
+  *ulh.run_tail = st;
+  ulh.run_tail = &st->run_next;
+  pthread_cond_signal(&ulh.run_cond);
+}
+
+static void poller_wake(void)
+{
+  ci_uint64 one = 1;
+  if( write(ulh.event_fd, &one, sizeof(one)) != sizeof(one) )
+    ci_log("%s: eventfd write failed: %s", __func__, strerror(errno));
+}
+
+/* Put a serviced stack back into the heap, or straight onto the run queue
+ * if it is due already or was kicked while we had it. */
+static void stack_reschedule(struct ulh_stack* st, ci_uint64 now)
+{
+  bool wake;
+
+  pthread_mutex_lock(&ulh.lock);
+  if( st->kicked || st->deadline_ms <= now ) {
+    st->kicked = false;
+    run_enqueue(st);
+    pthread_mutex_unlock(&ulh.lock);
+    return;
+  }
+  if( heap_push(st) < 0 ) {
+    /* Can't wait for the deadline, so do the next best thing. */
+    run_enqueue(st);
+    pthread_mutex_unlock(&ulh.lock);
+    return;
+  }
+  wake = st->heap_i == 0;
+  pthread_mutex_unlock(&ulh.lock);
+  if( wake )
+    poller_wake();
+}
+
+
+/**********************************************************************
+ * Stack servicing.
+ */
+
+static void stack_backoff(struct ulh_stack* st, ci_uint64 now)
+{
+  if( st->backoff_ms == 0 ) {
+    st->backoff_ms = ULH_BACKOFF_MIN_MS;
+    st->lock_fail_since_ms = now;
+  }
+  else {
+    st->backoff_ms = CI_MIN(st->backoff_ms * 2, ULH_BACKOFF_MAX_MS);
+  }
+  st->deadline_ms = now + st->backoff_ms;
+}
+
+static void stack_free(struct ulh_stack* st)
+{
+  epoll_ctl(ulh.epoll_fd, EPOLL_CTL_DEL, st->ni.driver_handle, NULL);
+  ci_netif_dtor(&st->ni);
+  pthread_mutex_lock(&ulh.lock);
+  --ulh.n_stacks;
+  st->run_next = ulh.dead;
+  ulh.dead = st;
+  pthread_mutex_unlock(&ulh.lock);
+}
+
+/* Do for one stack what main_loop() does for each interrupt.  Returns
+ * false if the stack has gone. */
+static bool stack_service(struct ulh_stack* st)
+{
+  ci_netif* ni = &st->ni;
+  struct oo_ulh_waiter arg;
+  bool is_locked = false;
+  ci_uint64 now = now_ms();
+  ci_uint32 timer_ms;
+
+  arg.flags = OO_ULH_WAIT_FLAG_NONBLOCK;
+  arg.timeout_ms = 0;
+  if( ioctl(ni->driver_handle, OO_IOC_WAIT_FOR_INTERRUPT, &arg) != 0 ) {
+    st->deadline_ms = now + ULH_PERIODIC_MS;
+    return true;
+  }
+  if( arg.flags & OO_ULH_WAIT_FLAG_LOCKED )
+    is_locked = true;
+  if( is_locked || ci_netif_trylock(ni) ) {
+    int n = ci_netif_poll(ni);
+    CITP_STATS_NETIF_ADD(ni, interrupt_evs, n);
+    is_locked = true;
+    st->backoff_ms = 0;
+  }
+
+  if( arg.rs_ref_count == 0 ) {
+    if( ! is_locked ) {
+      if( st->backoff_ms != 0 &&
+          now - st->lock_fail_since_ms > ULH_LOCK_GIVE_UP_MS ) {
+        ci_log("[%s]: failed to get stack lock for %dms; "
+               "leaving it", ni->state->pretty_name, ULH_LOCK_GIVE_UP_MS);
+        stack_free(st);
+        return false;
+      }
+      stack_backoff(st, now);
+      return true;
+    }
+
+    if( ! st->is_last ) {
+      st->is_last = true;
+
+      /* Ensure all close() requests are handled */
+      ci_netif_close_pending(ni);
+
+      ci_assert_equal(ni->state->n_ep_orphaned, OO_N_EP_ORPHANED_INIT);
+      ni->state->n_ep_orphaned = oo_netif_apps_gone(ni);
+      ci_log("[%s]: user application gone, %d sockets to be closed",
+             ni->state->pretty_name, ni->state->n_ep_orphaned);
+    }
+
+    if( ni->state->n_ep_orphaned == 0 ) {
+      /* As do_exit(): release the stack with the lock held. */
+      ci_log("[%s]: no time-waiting sockets: releasing stack",
+             ni->state->pretty_name);
+      oo_netif_dtor_pkts(ni);
+      stack_free(st);
+      return false;
+    }
+  }
+
+  if( ! is_locked ) {
+    stack_lock_watchdog(ni, &st->lock_watchdog_reported);
+    stack_backoff(st, now);
+    return true;
+  }
+
+  /* Events left over after a full poll: go to the back of the queue. */
+  st->kicked = ci_netif_has_event(ni);
+  ci_netif_unlock(ni);
+  timer_ms = stack_next_timer_ms(ni);
+  st->deadline_ms = now + (timer_ms != 0 && timer_ms < ULH_PERIODIC_MS ?
+                           timer_ms : ULH_PERIODIC_MS);
+  return true;
+}
+
+static void* worker_thread(void* arg)
+{
+  struct ulh_stack* st;
+
+  while( 1 ) {
+    pthread_mutex_lock(&ulh.lock);
+    while( ulh.run_head == NULL )
+      pthread_cond_wait(&ulh.run_cond, &ulh.lock);
+    st = ulh.run_head;
+    ulh.run_head = st->run_next;
+    if( ulh.run_head == NULL )
+      ulh.run_tail = &ulh.run_head;
+    pthread_mutex_unlock(&ulh.lock);
+
+    if( stack_service(st) )
+      stack_reschedule(st, now_ms());
+  }
+  return NULL;
+}
+
+static void* poller_thread(void* arg)
+{
+  struct epoll_event evs[64];
+  int i, n, timeout;
+  ci_uint64 now;
+
+  while( 1 ) {
+    pthread_mutex_lock(&ulh.lock);
+    now = now_ms();
+    while( ulh.heap_n > 0 && ulh.heap[0]->deadline_ms <= now ) {
+      struct ulh_stack* st = ulh.heap[0];
+      heap_remove(st);
+      run_enqueue(st);
+    }
+    timeout = ulh.heap_n > 0 ? (int) (ulh.heap[0]->deadline_ms - now) : -1;
+    pthread_mutex_unlock(&ulh.lock);
+
+    n = epoll_wait(ulh.epoll_fd, evs, sizeof(evs) / sizeof(evs[0]), timeout);
+
+    pthread_mutex_lock(&ulh.lock);
+    for( i = 0; i < n; ++i ) {
+      struct ulh_stack* st = evs[i].data.ptr;
+      if( st == NULL ) {
+        ci_uint64 v;
+        if( read(ulh.event_fd, &v, sizeof(v)) < 0 )
+          ci_log("%s: eventfd read failed: %s", __func__, strerror(errno));
+      }
+      else if( st->heap_i >= 0 ) {
+        heap_remove(st);
+        run_enqueue(st);
+      }
+      else {
+        st->kicked = true;
+      }
+    }
+    while( ulh.dead != NULL ) {
+      struct ulh_stack* st = ulh.dead;
+      ulh.dead = st->run_next;
+      free(st);
+    }
+    pthread_mutex_unlock(&ulh.lock);
+  }
+  return NULL;
+}
+
+
+/**********************************************************************
+ * Attaching stacks.
+ */
+
+static int stack_attach(int id)
+{
+  struct ulh_stack* st = calloc(1, sizeof(*st));
+  struct epoll_event ev;
+  int rc;
+
+  if( st == NULL )
+    return -ENOMEM;
+  rc = ci_netif_restore_id(&st->ni, id, true);
+  if( rc != 0 ) {
+    free(st);
+    return rc < 0 ? rc : -rc;
+  }
+
+  /* Edge-triggered: the kernel wakes the fd for each interrupt that is
+   * left for us, and the worker collects them all. */
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.ptr = st;
+  if( epoll_ctl(ulh.epoll_fd, EPOLL_CTL_ADD, st->ni.driver_handle, &ev) ) {
+    rc = -errno;
+    ci_netif_dtor(&st->ni);
+    free(st);
+    return rc;
+  }
+
+  ci_log("[%s]: attached stack %d", st->ni.state->pretty_name, id);
+  pthread_mutex_lock(&ulh.lock);
+  ++ulh.n_stacks;
+  st->heap_i = -1;
+  run_enqueue(st);
+  pthread_mutex_unlock(&ulh.lock);
+  return 0;
+}
+
+static void handle_client(int listen_fd)
+{
+  struct ucred cred;
+  socklen_t cred_len = sizeof(cred);
+  ci_int32 msg;
+  int fd, rc;
+
+  fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+  if( fd < 0 )
+    return;
+  if( recv(fd, &msg, sizeof(msg), 0) == sizeof(msg) ) {
+    /* Only serve our own user's stacks; see ul/helper.h. */
+    if( getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 )
+      rc = -errno;
+    else if( cred.uid != geteuid() )
+      rc = -EPERM;
+    else
+      rc = stack_attach(msg);
+    if( rc != 0 )
+      ci_log("failed to attach stack %d: %d", msg, rc);
+    msg = rc;
+    if( send(fd, &msg, sizeof(msg), MSG_NOSIGNAL) != sizeof(msg) )
+      ci_log("stack %d: failed to reply: %s", msg, strerror(errno));
+  }
+  close(fd);
+}
+
+int shared_helper_main(unsigned n_workers)
+{
+  struct sockaddr_un sun;
+  socklen_t sun_len = oo_ulh_shared_addr(&sun, geteuid());
+  struct epoll_event ev;
+  pthread_t thread;
+  ci_uint64 idle_since;
+  int listen_fd, rc;
+  unsigned i;
+
+  listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if( listen_fd < 0 ) {
+    ci_log("Failed to create socket: %s", strerror(errno));
+    return 1;
+  }
+  if( bind(listen_fd, (struct sockaddr*) &sun, sun_len) != 0 ) {
+    /* Another process has started a shared helper: use that one. */
+    if( errno == EADDRINUSE )
+      return 0;
+    ci_log("Failed to bind: %s", strerror(errno));
+    return 1;
+  }
+  if( listen(listen_fd, 128) != 0 ) {
+    ci_log("Failed to listen: %s", strerror(errno));
+    return 1;
+  }
+
+  /* As for a dedicated helper, fork() for the last time to tell the
+   * caller that we have started.  It can connect straight away. */
+  rc = fork();
+  if( rc != 0 ) {
+    if( rc > 0 )
+      return 0;
+    ci_log("Failed to spawn helper: %s", strerror(errno));
+    return 1;
+  }
+
+  ulh.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  ulh.event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if( ulh.epoll_fd < 0 || ulh.event_fd < 0 ) {
+    ci_log("Failed to create epoll set: %s", strerror(errno));
+    return 1;
+  }
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  epoll_ctl(ulh.epoll_fd, EPOLL_CTL_ADD, ulh.event_fd, &ev);
+
+  if( pthread_create(&thread, NULL, poller_thread, NULL) != 0 ) {
+    ci_log("Failed to start poller thread");
+    return 1;
+  }
+  for( i = 0; i < n_workers; ++i )
+    if( pthread_create(&thread, NULL, worker_thread, NULL) != 0 ) {
+      ci_log("Failed to start worker thread");
+      return 1;
+    }
+
+  ci_log("Starting shared helper %s with %u workers", onload_version,
+         n_workers);
+
+  idle_since = now_ms();
+  while( 1 ) {
+    struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+    int n_stacks;
+
+    if( poll(&pfd, 1, ULH_PERIODIC_MS * 10) > 0 )
+      handle_client(listen_fd);
+
+    pthread_mutex_lock(&ulh.lock);
+    n_stacks = ulh.n_stacks;
+    pthread_mutex_unlock(&ulh.lock);
+    if( n_stacks != 0 )
+      idle_since = now_ms();
+    else if( now_ms() - idle_since > ULH_IDLE_EXIT_MS ) {
+      /* Stop taking new stacks before we go, so that anyone who races
+       * with us starts a new helper. */
+      close(listen_fd);
+      ci_log("No stacks: exit");
+      return 0;
+    }
+  }
+}
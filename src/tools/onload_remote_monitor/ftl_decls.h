@@ -8,6 +8,12 @@ FTL_DECLARE(STRUCT_EF_EVENTQ_STATE)
 FTL_DECLARE(STRUCT_OO_P_DLLIST)
 FTL_DECLARE(STRUCT_PIO_BUDDY_ALLOCATOR)
 FTL_DECLARE(STRUCT_OO_TIMESPEC)
+FTL_DECLARE(STRUCT_IRQMOD_STATE)
+FTL_DECLARE(STRUCT_TXSHAPE_CLASS)
+FTL_DECLARE(STRUCT_TXSHAPE_STATE)
+#if CI_CFG_TIMESTAMPING
+FTL_DECLARE(STRUCT_TX_TS_RING_STATE)
+#endif
 FTL_DECLARE(STRUCT_NETIF_STATE_NIC)
 FTL_DECLARE(STRUCT_CI_EPLOCK)
 FTL_DECLARE(STRUCT_NETIF_CONFIG)
@@ -42,6 +48,7 @@ FTL_DECLARE(STRUCT_UDP_HDR)
 FTL_DECLARE(STRUCT_TIMEVAL)
 FTL_DECLARE(STRUCT_ATOMIC)
 FTL_DECLARE(STRUCT_SOCK_CPLANE)
+FTL_DECLARE(STRUCT_SOCK_CYCLES)
 FTL_DECLARE(STRUCT_SOCK)
 FTL_DECLARE(STRUCT_IP_PKT_QUEUE)
 FTL_DECLARE(STRUCT_UDP_SOCKET_STATS)
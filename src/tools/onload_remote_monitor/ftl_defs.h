@@ -41,6 +41,18 @@
 #define ON_CI_CFG_TCP_SOCK_STATS IGNORE
 #endif
 
+#if CI_CFG_SOCK_CYCLES
+#define ON_CI_CFG_SOCK_CYCLES DO
+#else
+#define ON_CI_CFG_SOCK_CYCLES IGNORE
+#endif
+
+#if CI_CFG_TCP_INFO_METRICS
+#define ON_CI_CFG_TCP_INFO_METRICS DO
+#else
+#define ON_CI_CFG_TCP_INFO_METRICS IGNORE
+#endif
+
 #if CI_CFG_ZC_RECV_FILTER
 #define ON_CI_CFG_ZC_RECV_FILTER DO
 #else
@@ -233,6 +245,51 @@ typedef struct oo_p_dllink oo_p_dllink_t;
   FTL_TFIELD_INT(ctx, ci_int32, tv_nsec, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))          \
   FTL_TSTRUCT_END(ctx)
 
+#define STRUCT_IRQMOD_STATE(ctx)                                        \
+  FTL_TSTRUCT_BEGIN(ctx, ci_irqmod_state, )                             \
+  FTL_TFIELD_INT(ctx, ci_uint64, window_start, ORM_OUTPUT_STACK)        \
+  FTL_TFIELD_INT(ctx, ci_uint32, window_irqs, ORM_OUTPUT_STACK)         \
+  FTL_TFIELD_INT(ctx, ci_uint32, window_evs, ORM_OUTPUT_STACK)          \
+  FTL_TFIELD_INT(ctx, ci_uint32, level, ORM_OUTPUT_STACK)               \
+  FTL_TFIELD_INT(ctx, ci_uint32, usec, ORM_OUTPUT_STACK)                \
+  FTL_TFIELD_INT(ctx, ci_uint32, n_changes, ORM_OUTPUT_STACK)           \
+  FTL_TFIELD_ARRAYOFINT(ctx, ci_uint32, batch_hist, CI_IRQMOD_BATCH_HIST, \
+                        ORM_OUTPUT_STACK)                               \
+  FTL_TFIELD_ARRAYOFINT(ctx, ci_uint32, level_hist, CI_IRQMOD_LEVELS,   \
+                        ORM_OUTPUT_STACK)                               \
+  FTL_TSTRUCT_END(ctx)
+
+#define STRUCT_TXSHAPE_CLASS(ctx)                                       \
+  FTL_TSTRUCT_BEGIN(ctx, ci_txshape_class, )                            \
+  FTL_TFIELD_INT(ctx, ci_uint64, rate, ORM_OUTPUT_STACK)                \
+  FTL_TFIELD_INT(ctx, ci_uint64, ceil, ORM_OUTPUT_STACK)                \
+  FTL_TFIELD_INT(ctx, ci_int64, tokens, ORM_OUTPUT_STACK)               \
+  FTL_TFIELD_INT(ctx, ci_int64, ctokens, ORM_OUTPUT_STACK)              \
+  FTL_TFIELD_INT(ctx, ci_uint64, tx_bytes, ORM_OUTPUT_STACK)            \
+  FTL_TFIELD_INT(ctx, ci_uint32, tx_pkts, ORM_OUTPUT_STACK)             \
+  FTL_TFIELD_INT(ctx, ci_uint32, n_borrowed, ORM_OUTPUT_STACK)          \
+  FTL_TFIELD_INT(ctx, ci_uint32, n_delayed, ORM_OUTPUT_STACK)           \
+  FTL_TFIELD_INT(ctx, ci_uint32, max_backlog, ORM_OUTPUT_STACK)         \
+  FTL_TFIELD_STRUCT(ctx, oo_pktq, backlog, ORM_OUTPUT_STACK)            \
+  FTL_TSTRUCT_END(ctx)
+
+#define STRUCT_TXSHAPE_STATE(ctx)                                       \
+  FTL_TSTRUCT_BEGIN(ctx, ci_txshape_state, )                            \
+  FTL_TFIELD_INT(ctx, ci_uint64, last_frc, ORM_OUTPUT_STACK)            \
+  FTL_TFIELD_INT(ctx, ci_uint64, root_rate, ORM_OUTPUT_STACK)           \
+  FTL_TFIELD_INT(ctx, ci_int64, root_tokens, ORM_OUTPUT_STACK)          \
+  FTL_TFIELD_INT(ctx, ci_uint32, shaped, ORM_OUTPUT_STACK)              \
+  FTL_TFIELD_INT(ctx, ci_uint32, backlog, ORM_OUTPUT_STACK)             \
+  FTL_TFIELD_ARRAYOFSTRUCT(ctx, ci_txshape_class, cls,                  \
+                           CI_TXSHAPE_CLASSES, ORM_OUTPUT_STACK, 1)     \
+  FTL_TSTRUCT_END(ctx)
+
+#define STRUCT_TX_TS_RING_STATE(ctx)                                    \
+  FTL_TSTRUCT_BEGIN(ctx, oo_tx_ts_ring_state, )                         \
+  FTL_TFIELD_INT(ctx, ci_uint32, write, ORM_OUTPUT_STACK)               \
+  FTL_TFIELD_INT(ctx, ci_uint32, dropped, ORM_OUTPUT_STACK)             \
+  FTL_TFIELD_INT(ctx, ci_uint32, read, ORM_OUTPUT_STACK)                \
+  FTL_TSTRUCT_END(ctx)
 
 #define STRUCT_NETIF_STATE_NIC(ctx)                                     \
   FTL_TSTRUCT_BEGIN(ctx, ci_netif_state_nic_t, )                        \
@@ -279,6 +336,7 @@ typedef struct oo_p_dllink oo_p_dllink_t;
     FTL_TFIELD_INT(ctx, ci_uint32, last_sync_flags, ORM_OUTPUT_STACK) \
   ) \
   FTL_TFIELD_INT(ctx, ci_uint32, nic_error_flags, ORM_OUTPUT_STACK) \
+  FTL_TFIELD_STRUCT(ctx, ci_irqmod_state, irqmod, ORM_OUTPUT_STACK) \
   ON_CI_HAVE_CTPIO(                                                 \
     FTL_TFIELD_INT(ctx, ci_uint32, ctpio_ct_threshold, ORM_OUTPUT_STACK) \
     FTL_TFIELD_INT(ctx, ci_uint32, ctpio_frame_len_check, ORM_OUTPUT_STACK) \
@@ -289,6 +347,10 @@ typedef struct oo_p_dllink oo_p_dllink_t;
 #define STRUCT_CI_EPLOCK(ctx) \
   FTL_TSTRUCT_BEGIN(ctx, ci_eplock_t,)                                  \
   FTL_TFIELD_INT(ctx, ci_uint64, lock, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS)) \
+  FTL_TFIELD_INT(ctx, ci_uint32, holder_track, ORM_OUTPUT_STACK)        \
+  FTL_TFIELD_INT(ctx, ci_uint32, holder_tid, ORM_OUTPUT_STACK)          \
+  FTL_TFIELD_INT(ctx, ci_uint64, holder_frc, ORM_OUTPUT_STACK)          \
+  FTL_TFIELD_INT(ctx, ci_uint64, holder_site, ORM_OUTPUT_STACK)         \
   FTL_TSTRUCT_END(ctx)                                                 
 
 #define STRUCT_NETIF_CONFIG(ctx)                                        \
@@ -518,6 +580,12 @@ typedef struct oo_p_dllink oo_p_dllink_t;
   FTL_TFIELD_STRUCT(ctx, ci_ip_timer, timeout_tid, ORM_OUTPUT_STACK)      \
   FTL_TFIELD_ARRAYOFSTRUCT(ctx, oo_p_dllink_t, timeout_q, \
                            OO_TIMEOUT_Q_MAX, ORM_OUTPUT_STACK, 1)         \
+  FTL_TFIELD_STRUCT(ctx, ci_txshape_state, txshape, ORM_OUTPUT_STACK)    \
+  FTL_TFIELD_STRUCT(ctx, ci_ip_timer, txshape_tid, ORM_OUTPUT_STACK)      \
+  ON_CI_CFG_TIMESTAMPING(                                               \
+    FTL_TFIELD_STRUCT(ctx, oo_tx_ts_ring_state, tx_ts_ring,             \
+                      ORM_OUTPUT_STACK)                                 \
+  )                                                                     \
   FTL_TFIELD_STRUCT(ctx, oo_p_dllink_t, reap_list, ORM_OUTPUT_EXTRA)     \
   FTL_TFIELD_INT(ctx, ci_uint32, challenge_ack_num, ORM_OUTPUT_STACK)     \
   FTL_TFIELD_INT(ctx, ci_iptime_t, challenge_ack_time, ORM_OUTPUT_STACK)  \
@@ -558,6 +626,7 @@ typedef struct oo_p_dllink oo_p_dllink_t;
   FTL_TFIELD_INT(ctx, ci_uint64, sock_spin_cycles, ORM_OUTPUT_STACK)      \
   FTL_TFIELD_INT(ctx, ci_uint64, buzz_cycles, ORM_OUTPUT_STACK)           \
   FTL_TFIELD_INT(ctx, ci_uint64, timer_prime_cycles, ORM_OUTPUT_STACK)    \
+  FTL_TFIELD_INT(ctx, ci_uint64, lock_watchdog_cycles, ORM_OUTPUT_STACK)  \
   FTL_TFIELD_INT(ctx, ci_uint32, timesync_bytes, ORM_OUTPUT_STACK)        \
   FTL_TFIELD_INT(ctx, ci_uint32, io_mmap_bytes, ORM_OUTPUT_STACK)         \
   FTL_TFIELD_INT(ctx, ci_uint32, buf_mmap_bytes, ORM_OUTPUT_STACK)        \
@@ -783,6 +852,17 @@ typedef struct oo_sock_cplane oo_sock_cplane_t;
   FTL_TFIELD_INT(ctx, ci_uint8, sock_cp_flags, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))        \
   FTL_TSTRUCT_END(ctx)
 
+typedef struct oo_sock_cycles oo_sock_cycles_t;
+
+#define STRUCT_SOCK_CYCLES(ctx)                                         \
+  FTL_TSTRUCT_BEGIN(ctx, oo_sock_cycles_t, )                            \
+  FTL_TFIELD_INT(ctx, ci_uint64, rx, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))    \
+  FTL_TFIELD_INT(ctx, ci_uint64, tx, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))    \
+  FTL_TFIELD_INT(ctx, ci_uint64, timer, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS)) \
+  FTL_TFIELD_INT(ctx, ci_uint64, recv, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))  \
+  FTL_TFIELD_INT(ctx, ci_uint64, send, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))  \
+  FTL_TSTRUCT_END(ctx)
+
 
 #define STRUCT_SOCK(ctx)                                                \
   FTL_TSTRUCT_BEGIN(ctx, ci_sock_cmn, )                                 \
@@ -820,6 +900,9 @@ typedef struct oo_sock_cplane oo_sock_cplane_t;
   ) \
   FTL_TFIELD_INT(ctx, ci_uint32, uuid, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                      \
   FTL_TFIELD_INT(ctx, ci_int32, pid, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                       \
+  ON_CI_CFG_SOCK_CYCLES( \
+    FTL_TFIELD_STRUCT(ctx, oo_sock_cycles_t, cycles, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))       \
+  ) \
   FTL_TFIELD_INT(ctx, ci_uint8, domain, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                    \
   FTL_TFIELD_STRUCT(ctx, oo_p_dllink_t, reap_link, ORM_OUTPUT_EXTRA)     \
   FTL_TSTRUCT_END(ctx)
@@ -877,11 +960,22 @@ typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
 #define STRUCT_TCP_SOCKET_STATS(ctx)                                    \
   FTL_TSTRUCT_BEGIN(ctx, oo_tcp_socket_stats, )                         \
   FTL_TFIELD_INT(ctx, ci_uint64, rx_pkts, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))          \
+  ON_CI_CFG_TCP_INFO_METRICS(                                         \
+    FTL_TFIELD_INT(ctx, ci_uint64, rx_bytes, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))         \
+    FTL_TFIELD_INT(ctx, ci_uint64, tx_bytes, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))         \
+    FTL_TFIELD_INT(ctx, ci_uint64, tx_bytes_retrans, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS)) \
+    FTL_TFIELD_ARRAYOFINT(ctx, ci_uint64, chrono, CI_TCP_CHRONO_N,                            \
+                          (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                            \
+    FTL_TFIELD_INT(ctx, ci_uint32, tx_pkts, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))          \
+    FTL_TFIELD_INT(ctx, ci_uint32, tx_data_pkts, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))     \
+    FTL_TFIELD_INT(ctx, ci_uint32, rx_data_pkts, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))     \
+  )                                                                   \
   FTL_TFIELD_INT(ctx, ci_uint32, tx_stop_rwnd, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))     \
   FTL_TFIELD_INT(ctx, ci_uint32, tx_stop_cwnd, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))     \
   FTL_TFIELD_INT(ctx, ci_uint32, tx_stop_more, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))     \
   FTL_TFIELD_INT(ctx, ci_uint32, tx_stop_nagle, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))    \
   FTL_TFIELD_INT(ctx, ci_uint32, tx_stop_app, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))      \
+  FTL_TFIELD_INT(ctx, ci_uint32, tx_stop_txq, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))      \
   ON_CI_CFG_BURST_CONTROL(                                              \
      FTL_TFIELD_INT(ctx, ci_uint32, tx_stop_burst, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS)) \
                                                                         ) \
@@ -892,6 +986,9 @@ typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
   FTL_TFIELD_INT(ctx, ci_uint32, tx_tmpl_send_fast, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS)) \
   FTL_TFIELD_INT(ctx, ci_uint32, tx_tmpl_send_slow, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS)) \
   FTL_TFIELD_INT(ctx, ci_uint32, rx_isn, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))           \
+  ON_CI_CFG_TCP_INFO_METRICS(                                          \
+    FTL_TFIELD_INT(ctx, ci_uint32, rate_bpms, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))        \
+  )                                                                   \
   FTL_TFIELD_INT(ctx, ci_uint16, tx_tmpl_active, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))   \
   FTL_TFIELD_INT(ctx, ci_uint16, rtos, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))             \
   FTL_TFIELD_INT(ctx, ci_uint16, fast_recovers, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))    \
@@ -1006,6 +1103,7 @@ typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
     FTL_TFIELD_INT(ctx, ci_iptime_t, t_ka_intvl_in_secs, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS)) \
     FTL_TFIELD_INT(ctx, ci_uint16, user_mss, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))               \
     FTL_TFIELD_INT(ctx, ci_uint8, tcp_defer_accept, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))	      \
+    FTL_TFIELD_INT(ctx, ci_uint32, notsent_lowat, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))          \
     FTL_TSTRUCT_END(ctx)
 
 #define STRUCT_TCP(ctx) \
@@ -1021,6 +1119,7 @@ typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
     FTL_TFIELD_INT(ctx, ci_uint32, send_in, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))               \
     FTL_TFIELD_INT(ctx, ci_uint32, send_out, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))              \
     FTL_TFIELD_STRUCT(ctx, ci_ip_pkt_queue, send, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))               \
+    FTL_TFIELD_INT(ctx, ci_uint32, txq_bytes, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))             \
     FTL_TFIELD_STRUCT(ctx, ci_ip_pkt_queue, retrans, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))            \
     FTL_TFIELD_STRUCT(ctx, ci_ip_pkt_queue, recv1, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))              \
     FTL_TFIELD_STRUCT(ctx, ci_ip_pkt_queue, recv2, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))              \
@@ -1092,9 +1191,6 @@ typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
     FTL_TFIELD_INT(ctx, ci_iptime_t, timed_ts, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                  \
     FTL_TFIELD_INT(ctx, ci_uint32, tsrecent, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                    \
     FTL_TFIELD_INT(ctx, ci_uint32, tslastack, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                   \
-    ON_DEBUG(                                                                 \
-      FTL_TFIELD_INT(ctx, ci_uint32, tslastseq, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                 \
-    )                                                                         \
     FTL_TFIELD_INT(ctx, ci_iptime_t, tspaws, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                    \
     FTL_TFIELD_INT(ctx, ci_uint16, acks_pending, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                \
     FTL_TFIELD_INT(ctx, ci_uint16, urg_data, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                    \
@@ -1102,6 +1198,13 @@ typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
     FTL_TFIELD_INT(ctx, ci_uint16, zwin_probes, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                 \
     FTL_TFIELD_INT(ctx, ci_uint16, zwin_acks, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))             \
     FTL_TFIELD_INT(ctx, ci_uint8, incoming_tcp_hdr_len, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))         \
+    ON_CI_CFG_TCP_INFO_METRICS(                                                \
+      FTL_TFIELD_INT(ctx, ci_uint8, chrono_type, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                  \
+      FTL_TFIELD_INT(ctx, ci_uint16, min_rtt, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                     \
+      FTL_TFIELD_INT(ctx, ci_iptime_t, chrono_start, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))              \
+      FTL_TFIELD_INT(ctx, ci_iptime_t, rate_start, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                \
+      FTL_TFIELD_INT(ctx, ci_uint32, rate_una, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                    \
+    )                                                                         \
     FTL_TFIELD_STRUCT(ctx, ci_ip_timer, rto_tid, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                \
     FTL_TFIELD_STRUCT(ctx, ci_ip_timer, delack_tid, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))             \
     FTL_TFIELD_STRUCT(ctx, ci_ip_timer, zwin_tid, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))               \
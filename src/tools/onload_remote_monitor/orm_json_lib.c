@@ -566,6 +566,17 @@ static void dump_buf_quoted_uint_comma(uint64_t value)
   __dump_buf_cat0("\"", 1);
 }
 
+static void dump_buf_quoted_int_comma(int64_t value)
+{
+  __dump_buf_cat0("\"", 1);
+  if( value < 0 ) {
+    __dump_buf_cat0("-", 1);
+    value = -value;
+  }
+  dump_buf_uint_comma(value);
+  __dump_buf_cat0("\"", 1);
+}
+
 #if 0
 /* Unused for now, but looks potentially useful */
 static void dump_buf_int_comma_oo_sp(oo_sp value)
@@ -601,6 +612,7 @@ REDISPATCH_INT_DUMP(ci_iptime_callback_fn_t, uint, )
 REDISPATCH_INT_DUMP(ci_uint16, uint, )
 REDISPATCH_INT_DUMP(ci_uint8, uint, )
 
+REDISPATCH_INT_DUMP(ci_int64, quoted_int, )
 REDISPATCH_INT_DUMP(ci_int32, int, )
 REDISPATCH_INT_DUMP(int, int, )
 REDISPATCH_INT_DUMP(oo_p, int, )